@@ -56,4 +56,14 @@
 #define ADSP_AVS_CFG_PATH ";/etc/acdbdata/;"
 #endif
 
+struct stat;
+
+/**
+  * @brief Gets the stat of a file opened with apps_std
+  * @param sin: file opened with one of the apps_std_fopen functions
+  * @param st: filled in with the stat of the file
+  * @return 0 on success, EBADF for in-memory streams
+  **/
+int apps_std_fstat_internal(apps_std_FILE sin, struct stat *st);
+
 #endif /*__APPS_STD_INTERNAL_H__*/
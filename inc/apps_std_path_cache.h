@@ -0,0 +1,96 @@
+// Copyright (c) 2024, Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef __APPS_STD_PATH_CACHE_H__
+#define __APPS_STD_PATH_CACHE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Cache of files resolved on a search path, such as DSP_LIBRARY_PATH.
+ *
+ * An entry maps a search path, subsystem, file name and mode to the path the
+ * file was opened from, or records that the file is in none of the search
+ * directories. Every directory searched is watched with inotify, and any
+ * change in a watched directory drops all entries, so a repeated open only
+ * costs the open of the cached path.
+ *
+ * A missing directory is covered by a watch of its nearest existing ancestor.
+ * Relative directories, including the empty one, are resolved against the
+ * working directory. Its device and inode are then part of the key, so a
+ * lookup only stats it, and its path is only looked up when the directories
+ * of a search are watched. A search is cached only if all of its directories
+ * could be watched.
+ */
+
+/* Outcome of a lookup */
+enum apps_std_path_state {
+  APPS_STD_PATH_UNKNOWN, // not cached, search the path
+  APPS_STD_PATH_FOUND,   // found at the cached path
+  APPS_STD_PATH_MISSING, // in none of the directories of the search path
+};
+
+/* A search of one file, from lookup to apps_std_path_cache_end() */
+struct apps_std_path_query {
+  char *key;      // key of the search, NULL if it cannot be cached
+  char *cwd;      // working directory, once a relative directory is watched
+  dev_t cwd_dev;  // working directory at lookup, if the search path has
+  ino_t cwd_ino;  // relative directories
+  uint32_t gen;   // cache generation at lookup
+  bool cacheable; // false once a directory could not be watched
+};
+
+/*
+ * Looks up a file on a search path. Call before the search path is parsed.
+ * @ q: query, to pass to the other functions and to end
+ * @ dirs: search path, directories separated by delim
+ * @ delim: delimiter of dirs
+ * @ subsys: subsystem directory searched first in each directory
+ * @ name: file name
+ * @ mode: open mode
+ * @ path: on APPS_STD_PATH_FOUND, cached path to free by the caller
+ * returns the outcome of the lookup
+ */
+enum apps_std_path_state
+apps_std_path_cache_lookup(struct apps_std_path_query *q, const char *dirs,
+                           const char *delim, const char *subsys,
+                           const char *name, const char *mode, char **path);
+
+/*
+ * Watches a search directory and its subsystem directory. Call before the
+ * files of the directory are tried.
+ * @ q: query of the search
+ * @ dir: search directory
+ * @ subsys: subsystem directory in dir
+ */
+void apps_std_path_cache_watch(struct apps_std_path_query *q, const char *dir,
+                               const char *subsys);
+
+/*
+ * Adds the result of a search, unless a watched directory changed since the
+ * lookup.
+ * @ q: query of the search
+ * @ path: path the file was opened from, NULL if it was in no directory
+ */
+void apps_std_path_cache_add(struct apps_std_path_query *q, const char *path);
+
+/*
+ * Drops the entry of a search, e.g. when the cached path failed to open
+ */
+void apps_std_path_cache_remove(struct apps_std_path_query *q);
+
+/*
+ * Ends a query
+ */
+void apps_std_path_cache_end(struct apps_std_path_query *q);
+
+/*
+ * Initializes and deinitializes the cache, the watcher thread is started on
+ * the first search
+ */
+int apps_std_path_cache_init(void);
+void apps_std_path_cache_deinit(void);
+
+#endif /*__APPS_STD_PATH_CACHE_H__*/
@@ -58,11 +58,30 @@ enum dspqueue_stat {
     DSPQUEUE_STAT_WRITE_QUEUE_BYTES,      /**< Number of bytes in the write queue */
     DSPQUEUE_STAT_EARLY_WAKEUP_WAIT_TIME, /**< Total accumulated early wakeup wait time in microseconds */
     DSPQUEUE_STAT_EARLY_WAKEUP_MISSES,    /**< Number accumulated of packets missed in the early wakeup loop */
-    DSPQUEUE_STAT_SIGNALING_PERF          /**< Signaling performance; 0 or undefined indicates the first implementation,
+    DSPQUEUE_STAT_SIGNALING_PERF,         /**< Signaling performance; 0 or undefined indicates the first implementation,
                                                DSPQUEUE_SIGNALING_PERF_REDUCED_SIGNALING or higher a version if reduced
                                                signaling for polling clients. */
+    DSPQUEUE_STAT_POLL_HITS,              /**< Number of accumulated blocking reads served by polling */
+    DSPQUEUE_STAT_POLL_MISSES,            /**< Number of accumulated blocking reads that polled without a packet
+                                               and fell back to waiting for a signal */
+    DSPQUEUE_STAT_POLL_BUDGET             /**< Current polling budget in microseconds. Not reset when read. */
 };
 
+/**
+ * Queue creation flags, used as a bitfield in dspqueue_create()
+ */
+enum dspqueue_create_flags {
+    DSPQUEUE_CREATE_FLAG_POLL =          0x0001, /**< Blocking reads and peeks spin on the response queue
+                                                      before waiting for a signal. The spin budget adapts
+                                                      to the response latency, up to DSPQUEUE_POLL_MAX_US
+                                                      in the environment (default DSPQUEUE_DEFAULT_POLL_US,
+                                                      or 0 with a single online CPU). */
+    DSPQUEUE_CREATE_FLAG_RESERVED_ZERO = 0xfffffffe
+};
+
+/** Default upper bound of the polling budget in microseconds */
+#define DSPQUEUE_DEFAULT_POLL_US 100
+
 /* Request IDs to be used with "dspqueue_request" */
 typedef enum {
 	/*
@@ -117,6 +136,18 @@ struct dspqueue_buffer {
 };
 
 
+/**
+ * Packet to write with dspqueue_write_batch_noblock() or dspqueue_write_batch()
+ */
+struct dspqueue_packet {
+    uint32_t flags;                  /**< Packet flags. See enum #dspqueue_packet_flags */
+    uint32_t num_buffers;            /**< Number of buffer references; zero if none */
+    struct dspqueue_buffer *buffers; /**< Pointer to buffer references */
+    uint32_t message_length;         /**< Message length in bytes; zero if no message */
+    const uint8_t *message;          /**< Pointer to packet message */
+};
+
+
 /**
  * Callback function type for all queue callbacks
  *
@@ -215,7 +246,7 @@ extern "C" {
  * Refer 'dspqueue_request' for that.
  *
  * @param [in] domain DSP to communicate with (CDSP_DOMAIN_ID in remote.h for cDSP)
- * @param [in] flags Queue creation flags
+ * @param [in] flags Queue creation flags, see enum #dspqueue_create_flags
  * @param [in] req_queue_size Total request queue memory size in bytes; use 0 for system default
  * @param [in] resp_queue_size Total response queue memory size in bytes; use 0 for system default
  * @param [in] packet_callback Callback function called when there are new packets to read.
@@ -344,8 +375,8 @@ AEEResult dspqueue_write_noblock(dspqueue_t queue, uint32_t flags,
                                  uint32_t message_length, const uint8_t *message);
 
 /**
- * Write a packet to a queue. If the queue is full this function will
- * block until space becomes available or the request times out.
+ * Write a packet to a queue. If the queue is full, this function will block
+ * until space becomes available or the request times out.
  *
  * With this function the client can pass separate pointers to the
  * buffer references and message to include in the packet and the
@@ -384,6 +415,121 @@ AEEResult dspqueue_write(dspqueue_t queue, uint32_t flags,
                          uint32_t message_length, const uint8_t *message,
                          uint32_t timeout_us);
 
+/**
+ * Write several packets to a queue. This variant of the function will not
+ * block: it writes packets in order until the queue is full, and returns
+ * AEE_EWOULDBLOCK if some packets did not fit.
+ *
+ * The packets are written under a single lock of the queue, made visible to
+ * the DSP at once and signaled at most once, which costs less than writing
+ * them one by one with dspqueue_write_noblock().
+ *
+ * When a packet fails, for example on an unmapped buffer, the packets before
+ * it are still written, and the error is returned.
+ *
+ * On a multi-domain queue, packets are written one by one as with
+ * dspqueue_write_noblock().
+ *
+ * @param [in] queue Queue handle from dspqueue_create() or dspqueue_import()
+ * @param [in] num_packets Number of packets to write
+ * @param [in] packets Packets to write
+ * @param [out] num_written Number of packets written, from the first one;
+ *                    may be NULL
+ *
+ * @return 0 when all packets are written, error code otherwise.
+ *         - AEE_EWOULDBLOCK: The queue is full, only num_written packets were written
+ *         - AEE_EBADPARM: Bad parameters, e.g. buffers is NULL when num_buffers > 0
+ *         - AEE_ENOSUCHMAP: Attempt to refer to an unmapped buffer. Buffers must be mapped to the DSP
+ *                           with fastrpc_mmap() before they can be used in queue packets.
+ *         - AEE_EBADSTATE: Queue is in bad-state and can no longer be used
+ */
+AEEResult dspqueue_write_batch_noblock(dspqueue_t queue, uint32_t num_packets,
+                                       struct dspqueue_packet *packets,
+                                       uint32_t *num_written);
+
+/**
+ * Write several packets to a queue. If the queue fills up this function will
+ * block until there is space for the remaining packets or the request times
+ * out. Packets are written as described for dspqueue_write_batch_noblock(),
+ * with one signal per group of packets that fit at once.
+ *
+ * @param [in] queue Queue handle from dspqueue_create() or dspqueue_import()
+ * @param [in] num_packets Number of packets to write
+ * @param [in] packets Packets to write
+ * @param [out] num_written Number of packets written, from the first one;
+ *                    may be NULL
+ * @param [in] timeout_us Timeout in microseconds for the whole batch; use
+ *                   DSPQUEUE_TIMEOUT_NONE to block indefinitely until all
+ *                   packets are written.
+ *
+ * @return 0 when all packets are written, error code otherwise.
+ *         - AEE_EBADPARM: Bad parameters, e.g. buffers is NULL when num_buffers > 0
+ *         - AEE_ENOSUCHMAP: Attempt to refer to an unmapped buffer. Buffers must be mapped to the DSP
+ *                           with fastrpc_mmap() before they can be used in queue packets.
+ *         - AEE_EEXPIRED: Request timed out, only num_written packets were written
+ *         - AEE_EINTERRUPTED: The request was canceled
+ *         - AEE_EBADSTATE: Queue is in bad-state and can no longer be used
+ */
+AEEResult dspqueue_write_batch(dspqueue_t queue, uint32_t num_packets,
+                               struct dspqueue_packet *packets,
+                               uint32_t *num_written, uint32_t timeout_us);
+
+/**
+ * Reserve space for a packet in a queue, for the client to write its message
+ * in place instead of having it copied from another buffer. The packet is
+ * sent to the DSP with dspqueue_write_commit().
+ *
+ * Buffer references are handled as in dspqueue_write(), when the packet is
+ * reserved. Packets written to the queue until it is committed are queued
+ * behind it and sent to the DSP with it, in order. Only one packet can be
+ * reserved at a time: another reservation waits for the commit, or fails with
+ * AEE_EWOULDBLOCK when non-blocking. Every reserved packet must be committed,
+ * and a thread must not reserve a packet on a queue on which it holds a
+ * reservation.
+ *
+ * Not supported on multi-domain queues.
+ *
+ * @param [in] queue Queue handle from dspqueue_create() or dspqueue_import()
+ * @param [in] flags Packet flags. See enum #dspqueue_packet_flags
+ * @param [in] num_buffers Number of buffer references to insert to the packet;
+ *                    zero if there are no buffer references
+ * @param [in] buffers Pointer to buffer references
+ * @param [in] message_length Message length in bytes;
+ *                       zero if the packet contains no message
+ * @param [out] message Where to write the message_length bytes of the message
+ *                 in the queue; NULL if message_length is zero. Only valid until
+ *                 dspqueue_write_commit().
+ * @param [in] timeout_us Timeout in microseconds; use DSPQUEUE_TIMEOUT_NONE to
+ *                   block indefinitely until a space is available or
+ *                   zero for non-blocking behavior.
+ *
+ * @return 0 on success, error code on failure.
+ *         - AEE_EWOULDBLOCK: The queue is full or a packet is already reserved
+ *                            (non-blocking only)
+ *         - AEE_EBADPARM: Bad parameters, e.g. buffers is NULL when num_buffers > 0
+ *         - AEE_ENOSUCHMAP: Attempt to refer to an unmapped buffer. Buffers must be mapped to the DSP
+ *                           with fastrpc_mmap() before they can be used in queue packets.
+ *         - AEE_EEXPIRED: Request timed out
+ *         - AEE_EINTERRUPTED: The request was canceled
+ *         - AEE_EUNSUPPORTED: Multi-domain queue
+ */
+AEEResult dspqueue_write_reserve(dspqueue_t queue, uint32_t flags,
+                                 uint32_t num_buffers, struct dspqueue_buffer *buffers,
+                                 uint32_t message_length, uint8_t **message,
+                                 uint32_t timeout_us);
+
+/**
+ * Send the packet reserved with dspqueue_write_reserve() to the DSP, once its
+ * message has been written.
+ *
+ * @param [in] queue Queue handle from dspqueue_create() or dspqueue_import()
+ *
+ * @return 0 on success, error code on failure.
+ *         - AEE_EBADPARM: No packet is reserved
+ *         - AEE_EUNSUPPORTED: Multi-domain queue
+ */
+AEEResult dspqueue_write_commit(dspqueue_t queue);
+
 /**
  * Read a packet from a queue. This variant of the function will not
  * block, and will instead return AEE_EWOULDBLOCK if the queue does not have
@@ -419,9 +565,9 @@ AEEResult dspqueue_read_noblock(dspqueue_t queue, uint32_t *flags,
                                 uint32_t max_message_length, uint32_t *message_length, uint8_t *message);
 
 /**
- * Read a packet from a queue. If the queue is empty this function
- * will block until a packet is available or the request times out.
- * The queue must not have a packet callback set.
+ * Read a packet from a queue. If the queue is empty, this function will
+ * block until a packet is available or the request times out. The queue
+ * must not have a packet callback set.
  *
  * This function will read packet contents directly into
  * client-provided buffers. The buffers must be large enough to fit
@@ -453,6 +599,59 @@ AEEResult dspqueue_read(dspqueue_t queue, uint32_t *flags,
                         uint32_t max_message_length, uint32_t *message_length, uint8_t *message,
                         uint32_t timeout_us);
 
+/**
+ * Read a packet from a queue in place: the message is returned as a pointer
+ * into the queue instead of being copied to a client buffer. The packet stays
+ * in the queue until dspqueue_read_release().
+ *
+ * Buffer references are read and handled as in dspqueue_read(). Packets
+ * read from the queue until it is released are the ones behind it, and their
+ * space is freed with it. Only one packet can be acquired at a time: another
+ * acquire waits for the release, or fails with AEE_EWOULDBLOCK when
+ * non-blocking. Every acquired packet must be released, and a thread must not
+ * acquire a packet from a queue on which it holds an acquired packet.
+ *
+ * Not supported on multi-domain queues.
+ *
+ * @param [in] queue Queue handle from dspqueue_create() or dspqueue_import()
+ * @param [out] flags Packet flags. See enum #dspqueue_packet_flags
+ * @param [in] max_buffers The maximum number of buffer references that can fit in the "buffers" parameter
+ * @param [out] num_buffers The number of buffer references in the packet
+ * @param [out] buffers Buffer reference data from the packet
+ * @param [out] message_length Packet message length in bytes
+ * @param [out] message Packet message in the queue; NULL if the packet has no
+ *                 message. Only valid until dspqueue_read_release().
+ * @param [in] timeout_us Timeout in microseconds; use DSPQUEUE_TIMEOUT_NONE to
+ *                   block indefinitely until a packet is available or
+ *                   zero for non-blocking behavior.
+ *
+ * @return 0 on success, error code on failure.
+ *         - AEE_EWOULDBLOCK: The queue is empty or a packet is already acquired
+ *                            (non-blocking only)
+ *         - AEE_EBADPARM: Bad parameters. This includes the buffers parameter being too small to fit all buffer references in the packet.
+ *         - AEE_EBADITEM: The queue contains a corrupted packet. Internal error.
+ *         - AEE_EEXPIRED: Request timed out
+ *         - AEE_EINTERRUPTED: The request was canceled
+ *         - AEE_EUNSUPPORTED: Multi-domain queue
+ */
+AEEResult dspqueue_read_acquire(dspqueue_t queue, uint32_t *flags,
+                                uint32_t max_buffers, uint32_t *num_buffers,
+                                struct dspqueue_buffer *buffers,
+                                uint32_t *message_length, const uint8_t **message,
+                                uint32_t timeout_us);
+
+/**
+ * Release the packet acquired with dspqueue_read_acquire(), freeing its space
+ * in the queue.
+ *
+ * @param [in] queue Queue handle from dspqueue_create() or dspqueue_import()
+ *
+ * @return 0 on success, error code on failure.
+ *         - AEE_EBADPARM: No packet is acquired
+ *         - AEE_EUNSUPPORTED: Multi-domain queue
+ */
+AEEResult dspqueue_read_release(dspqueue_t queue);
+
 /**
  * Retrieve information for the next packet if available, without reading
  * it from the queue and advancing the read pointer. This function
@@ -556,6 +755,36 @@ AEEResult dspqueue_write_early_wakeup_noblock(dspqueue_t queue, uint32_t wakeup_
 AEEResult dspqueue_get_stat(dspqueue_t queue, enum dspqueue_stat stat, uint64_t *value);
 
 
+/**
+ * Get an eventfd that becomes readable when the queue may have new response
+ * packets or new space for requests, for use with poll(), select() or epoll.
+ * This lets a single thread service many queues without a packet callback
+ * thread or a blocked reader per queue.
+ *
+ * The eventfd is signaled by the dspqueue signaling thread of the domain.
+ * Readiness is a hint: after it fires, read the eventfd to reset it, then
+ * drain the queue with dspqueue_read_noblock() until it returns
+ * AEE_EWOULDBLOCK and retry pending writes with dspqueue_write_noblock().
+ * The eventfd also becomes readable if the DSP fails, in which case the
+ * queue calls return the error.
+ *
+ * Repeated calls return the same eventfd. It is owned by the queue and
+ * closed by dspqueue_close(); do not close it. Once requested the DSP
+ * signals every response and every freed request slot, even when no thread
+ * waits in a blocking call.
+ *
+ * This function is currently not supported on multi-domain queues, or on
+ * queues using kernel driver signaling.
+ *
+ * @param [in] queue Queue handle from dspqueue_create()
+ * @param [out] fd Eventfd of the queue
+ *
+ * @return 0 on success, error code on failure.
+ *         - AEE_EUNSUPPORTED: Not supported for this queue
+ */
+AEEResult dspqueue_get_eventfd(dspqueue_t queue, int *fd);
+
+
 /** @}
  */
 
@@ -68,8 +68,13 @@ struct dspqueue_header {
    if the feature is not supported. */
 #define DSPQUEUE_HEADER_FLAG_DRIVER_SIGNALING 2
 
+/* Dirty bitmaps in the process queue state are maintained for the queue. Set by
+   the CPU with FastRPC signaling; the CPU creates the queue again without the flag
+   if the DSP fails initialization. */
+#define DSPQUEUE_HEADER_FLAG_DIRTY_BITMAP 4
+
 /* Unexpected flags */
-#define DSPQUEUE_HEADER_UNEXPECTED_FLAGS ~(DSPQUEUE_HEADER_FLAG_WAIT_COUNTS | DSPQUEUE_HEADER_FLAG_DRIVER_SIGNALING)
+#define DSPQUEUE_HEADER_UNEXPECTED_FLAGS ~(DSPQUEUE_HEADER_FLAG_WAIT_COUNTS | DSPQUEUE_HEADER_FLAG_DRIVER_SIGNALING | DSPQUEUE_HEADER_FLAG_DIRTY_BITMAP)
 
 
 /* Maximum queue size in bytes */
@@ -100,12 +105,29 @@ struct dspqueue_header {
 
    This reduces the number of signals to two per process and lets us
    use argumentless FastRPC calls for signaling.
+
+   For queues with DSPQUEUE_HEADER_FLAG_DIRTY_BITMAP, the participant also
+   sets the bit of the queue in the dirty bitmap of the other party after
+   updating the counts and before signaling. The other party atomically
+   clears its bitmap and only goes through the queues that were set, plus
+   the queues without the flag. The bitmaps follow the count arrays, older
+   DSP images do not see them.
  */
+#define DSPQUEUE_DIRTY_WORDS ((DSPQUEUE_MAX_PROCESS_QUEUES + 63) / 64)
+#define DSPQUEUE_DIRTY_LINE 256
+
 struct dspqueue_process_queue_state {
     uint32_t req_packet_count[DSPQUEUE_MAX_PROCESS_QUEUES];
     uint32_t req_space_count[DSPQUEUE_MAX_PROCESS_QUEUES];
     uint32_t resp_packet_count[DSPQUEUE_MAX_PROCESS_QUEUES];
     uint32_t resp_space_count[DSPQUEUE_MAX_PROCESS_QUEUES];
+    /* Queues with new response packets or request space, set by the DSP.
+       Each bitmap is on its own cache line. */
+    uint64_t cpu_dirty[DSPQUEUE_DIRTY_WORDS];
+    uint8_t cpu_dirty_pad[DSPQUEUE_DIRTY_LINE - 8 * DSPQUEUE_DIRTY_WORDS];
+    /* Queues with new request packets or response space, set by the CPU */
+    uint64_t dsp_dirty[DSPQUEUE_DIRTY_WORDS];
+    uint8_t dsp_dirty_pad[DSPQUEUE_DIRTY_LINE - 8 * DSPQUEUE_DIRTY_WORDS];
 };
 
 /* Info specific to multi-domain queues */
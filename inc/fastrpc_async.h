@@ -22,8 +22,12 @@
 
 #define SECONDS_PER_HOUR             (3600)
 
+// Bit of the jobid set for jobs completed through the domain's completion ring
+#define FASTRPC_ASYNC_RING_JOB_POS   47
+#define FASTRPC_ASYNC_RING_JOB       (1ULL << FASTRPC_ASYNC_RING_JOB_POS)
+
 #define FASTRPC_ASYNC_DOMAIN_MASK     (POS_TO_MASK(FASTRPC_ASYNC_JOB_POS))
-#define FASTRPC_ASYNC_JOB_CNT_MASK    (POS_TO_MASK(FASTRPC_ASYNC_TIME_SPEC_POS) & ~FASTRPC_ASYNC_DOMAIN_MASK)
+#define FASTRPC_ASYNC_JOB_CNT_MASK    (POS_TO_MASK(FASTRPC_ASYNC_RING_JOB_POS) & ~FASTRPC_ASYNC_DOMAIN_MASK)
 #define FASTRPC_ASYNC_HASH_MASK       (POS_TO_MASK(FASTRPC_ASYNC_HASH_IDX_POS) & ~FASTRPC_ASYNC_DOMAIN_MASK)
 
 // Async job structure
@@ -33,7 +37,8 @@ struct fastrpc_async_job {
 	* Fastrpc async job ID bit-map:
 	*
 	* bits 0-3   :	domain ID
-	* bits 4-47  :	job counter
+	* bits 4-46  :	job counter
+	* bit  47    :	completion ring job
 	* bits 48-63 :	timespec
 	*/
 	fastrpc_async_jobid jobid;
@@ -19,6 +19,11 @@ int fastrpc_get_cap(uint32_t domain, uint32_t attributeID, uint32_t *capability)
   * by DSP.
   **/
 uint32_t get_dsp_dma_reverse_rpc_map_capability(int domain);
+/**
+  * @brief Checks whether the DSP passes buffers by reference in
+  * reverse RPC calls, see struct listener_buf_ref.
+  **/
+uint32_t get_dsp_reverse_rpc_buf_ref_capability(int domain);
 /**
   * @brief Checks kernel if error codes returned are latest to the user
   **/
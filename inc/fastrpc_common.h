@@ -126,7 +126,8 @@
 	 FASTRPC_ENABLE_SYSTRACE = 6, //to enable tracing using Systrace
 	 FASTRPC_DEBUG_PDDUMP = 7, // to enable pd dump debug data collection on rooted device for signed/unsigned pd
 	 FASTRPC_PROCESS_ATTRS_PERSISTENT = 8, // to set proc attr as persistent
-	 FASTRPC_BUILD_TYPE = 9 // Fetch build type of firmware image. It gives the details if its debug or prod build
+	 FASTRPC_BUILD_TYPE = 9, // Fetch build type of firmware image. It gives the details if its debug or prod build
+	 FASTRPC_SHELL_CACHE_DIR = 10 // Directory of the PD shell image cache, cache is off if unset
  }fastrpc_properties;
 
 /**
@@ -140,6 +141,7 @@ enum fastrpc_internal_attributes {
    MAP_DMA_HANDLE_REVERSERPC   = 129,       /**<  Map DMA handle in reverse RPC call */
    DSPSIGNAL_DSP_SUPPORT       = 130,       /**<  New "dspsignal" signaling supported on DSP */
    PROC_SHARED_BUFFER_SUPPORT  = 131,       /**<  sharedbuf capability support */
+   REVERSE_RPC_BUF_REF_SUPPORT = 132,       /**<  Buffers passed by reference in reverse RPC calls */
    PERF_V2_DRIVER_SUPPORT      = 256,       /**<  Perf logging V2 kernel support */
    DRIVER_ERROR_CODE_CHANGE    = 257,       /**<  Fastrpc Driver error code change */
    USERSPACE_ALLOCATION_SUPPORT = 258,      /**<  Userspace memory allocation support */
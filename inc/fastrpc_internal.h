@@ -44,7 +44,7 @@
  * the corresponding enums.
  **/
 /* Max value of fastrpc_async_notify_type, used to validate the user input */
-#define FASTRPC_ASYNC_TYPE_MAX FASTRPC_ASYNC_POLL + 1
+#define FASTRPC_ASYNC_TYPE_MAX FASTRPC_ASYNC_RING + 1
 
 /* Max value of remote_dsp_attributes, used to validate the attribute ID*/
 #define FASTRPC_MAX_DSP_ATTRIBUTES MCID_MULTICAST + 1
@@ -158,6 +158,26 @@ enum {
    FASTRPC_DOMAIN_STATE_DEINIT 	= 2,
 };
 
+/**
+  * @brief Stages of the session bring-up in domain_init, timed for the
+  * bring-up report. Stages from DOMAIN_INIT_STAGE_DEFERRED on are off the
+  * critical path and run on a worker thread after the session is usable.
+  **/
+enum domain_init_stage {
+   DOMAIN_INIT_STAGE_REMOTE_INIT = 0,   // open device, create DSP process
+   DOMAIN_INIT_STAGE_MEM,               // fastrpc_mem_open and apps_mem_init
+   DOMAIN_INIT_STAGE_KERNEL_OPT,        // kernel optimizations
+   DOMAIN_INIT_STAGE_NOTIF,             // process state notifications
+   DOMAIN_INIT_STAGE_LATENCY,           // QoS latency init
+   DOMAIN_INIT_STAGE_LISTENER,          // reverse RPC listener start
+   DOMAIN_INIT_STAGE_DEFERRED,
+   DOMAIN_INIT_STAGE_PANIC_CODES = DOMAIN_INIT_STAGE_DEFERRED,
+   DOMAIN_INIT_STAGE_FILE_WATCHER,      // FARF runtime config watcher
+   DOMAIN_INIT_STAGE_MSGD,              // PD exception logging
+   DOMAIN_INIT_STAGE_PERF,              // perf key discovery
+   DOMAIN_INIT_STAGE_MAX,
+};
+
 /**
   * @brief FastRPC ioctl structure to set session related info
   **/
@@ -328,6 +348,26 @@ struct handle_list {
 	void *proc_sharedbuf;
 	/* current process shared buffer address to pack process params */
 	uint32_t *proc_sharedbuf_cur_addr;
+	/* Time spent in each bring-up stage in us, see enum domain_init_stage */
+	uint64_t init_stage_us[DOMAIN_INIT_STAGE_MAX];
+	/* Worker thread running the deferred bring-up stages, both under mut */
+	pthread_t deferred_init_thread;
+	bool deferred_init_started;
+	/* Background bring-up requested with FASTRPC_SESSION_PREWARM */
+	pthread_mutex_t prewarm_mut;
+	pthread_cond_t prewarm_cond;
+	/* Held from the open of a module by the bring-up until its handle is
+	 * kept, and by closes deciding whether to end the session */
+	pthread_mutex_t prewarm_open_mut;
+	pthread_t prewarm_thread;
+	bool prewarm_joinable;
+	int prewarm_status;        // status reported by FASTRPC_PREWARM_WAIT/POLL
+	uint32_t session_gen;      // sessions torn down, under mut
+	uint32_t prewarm_gen;      // session_gen when the bring-up was started
+	char **prewarm_uris;       // modules to open once the session is up
+	uint32_t num_prewarm_uris;
+	remote_handle64 *prewarm_handles; // modules opened by the bring-up
+	uint32_t num_prewarm_handles;
 };
 
 /**
@@ -377,6 +417,16 @@ int check_rpc_error(int err);
   **/
 void fastrpc_qos_activity(int domain);
 
+/**
+  * @brief Get invoke path allocation statistics of the process.
+  * @invokes: number of invokes made through remote_handle_invoke_domain
+  * @heap_allocs: number of heap allocations made by those invokes, not
+  * counting the setup of the per-thread scratch arena used by the
+  * synchronous invoke path. Synchronous invokes only add to heap_allocs
+  * when the arena of their thread is unavailable.
+  **/
+void fastrpc_get_invoke_alloc_stats(uint64_t *invokes, uint64_t *heap_allocs);
+
 /**
   * @brief Make IOCTL call to exit async thread
   */
@@ -499,6 +549,8 @@ remote_handle64 get_adsp_perf1_handle(int domain);
   * @handle: handle to prepend or dequeue
   * @req: request id from enum handle_list_update_id
   * @domain: domain id
+  * @local: on prepend, the local handle of the new entry; on dequeue, if not
+  *         NULL, selects the entry by local handle instead of remote handle
   * Prepend and dequeue operations can be performed on reverse and non-domain handle list
   * @returns: 0 on success, valid non-zero error code on failure
   *
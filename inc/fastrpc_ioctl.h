@@ -57,14 +57,26 @@
 	#define DEFAULT_DEVICE ""
 #endif
 
-#define INITIALIZE_REMOTE_ARGS(total)	int *pfds = NULL; \
+/* Maximum number of buffers and handles that can be encoded in a scalar */
+#define FASTRPC_MAX_INVOKE_ARGS		(0xff + 0xff + 0x0f + 0x0f)
+
+/*
+ * Args are carved out of the caller's preallocated array when one is given
+ * (sized to FASTRPC_MAX_INVOKE_ARGS), otherwise they are allocated here.
+ */
+#define INITIALIZE_REMOTE_ARGS(total, prealloc)	int *pfds = NULL; \
 					unsigned *pattrs = NULL; \
-					args = (struct fastrpc_invoke_args*) calloc(sizeof(*args), total);	\
+					if (prealloc) {	\
+						args = (struct fastrpc_invoke_args*)(prealloc);	\
+						memset(args, 0, sizeof(*args) * (total));	\
+					} else {	\
+						args = (struct fastrpc_invoke_args*) calloc(sizeof(*args), total);	\
+					}	\
 					if(args==NULL) { 	\
 						goto bail;	\
 					}
 
-#define DESTROY_REMOTE_ARGS()		if(args) {	\
+#define DESTROY_REMOTE_ARGS(prealloc)	if(args && (void*)args != (void*)(prealloc)) {	\
 						free(args);	\
 					}
 
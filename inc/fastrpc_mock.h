@@ -0,0 +1,142 @@
+// Copyright (c) 2024, Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef FASTRPC_MOCK_H
+#define FASTRPC_MOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fastrpc_async.h"
+#include "fastrpc_ioctl.h"
+#include "remote.h"
+
+/*
+ * Userspace mock of the FastRPC kernel driver.
+ *
+ * When enabled, device nodes opened by the library are mock devices and the
+ * ioctl backend in fastrpc_ioctl.c forwards every call here instead of to the
+ * kernel. Each mock device emulates one DSP process with a loopback "DSP"
+ * that runs in the calling process:
+ *   - modules are opened through mod_table, so skels linked into the process
+ *     (registered with mod_table_register_static*) or dlopen()-able skel
+ *     libraries serve the remote calls. DSP system modules and modules that
+ *     cannot be found are served by a null skel that completes every method
+ *     with success.
+ *   - synchronous invokes run on the calling thread, async invokes run on a
+ *     per-process loopback thread and complete through
+ *     ioctl_invoke2_response().
+ *   - buffers are allocated with memfd_create() and maps return the CPU
+ *     address as the remote address.
+ *   - a signal sent with ioctl_signal_signal() is echoed back by the DSP, so
+ *     it wakes waiters on the same signal.
+ *   - dspqueue_rpc is served by a peer that echoes every request packet back
+ *     as a response.
+ *   - multi-domain contexts can be created over the sessions already opened
+ *     on their domains, e.g. several sessions of the CDSP.
+ *   - the listener is served: fastrpc_mock_reverse_invoke() lets code acting
+ *     as the DSP issue reverse RPC calls that go through the listener thread.
+ *
+ * The mock is only built into libraries configured with --enable-mock-driver,
+ * which defines ENABLE_MOCK_DRIVER. It is then selected by setting
+ * FASTRPC_MOCK_DRIVER=1 in the environment before the library is loaded, or
+ * with the FASTRPC_MOCK_DRIVER request of remote_session_control() before any
+ * session is opened.
+ */
+
+/* Environment variable selecting the mock driver */
+#define FASTRPC_MOCK_DRIVER_ENV "FASTRPC_MOCK_DRIVER"
+
+#ifdef ENABLE_MOCK_DRIVER
+
+/*
+ * Returns the result of a mock call from the calling ioctl wrapper when the
+ * mock driver is selected
+ */
+#define FASTRPC_MOCK_RETURN(call)                                              \
+  do {                                                                         \
+    if (fastrpc_mock_enabled())                                                \
+      return (call);                                                           \
+  } while (0)
+
+/*
+ * Returns 1 if the mock driver is selected
+ */
+int fastrpc_mock_enabled(void);
+
+/*
+ * Selects or deselects the mock driver
+ * Fails with AEE_EBADSTATE while a mock device is open.
+ * @ enable: 1 to select the mock driver, 0 for the kernel driver
+ * returns 0 on success
+ */
+int fastrpc_mock_set_enabled(int enable);
+
+/*
+ * Opens a mock device node for a domain
+ * returns the device fd, -1 on failure
+ */
+int fastrpc_mock_open(int domain);
+
+/*
+ * Closes a device node. Ends the mock DSP process of a mock device, any
+ * other fd is only closed.
+ */
+int fastrpc_mock_close(int dev);
+
+/*
+ * Allocates a buffer that can be mapped to the mock DSP
+ * returns the buffer fd, -1 on failure
+ */
+int fastrpc_mock_alloc_buf(size_t size);
+
+/* Mock implementations of the ioctl backend, see fastrpc_internal.h */
+int fastrpc_mock_init(int dev, uint32_t flags);
+int fastrpc_mock_invoke(int dev, remote_handle handle, uint32_t sc,
+                        struct fastrpc_invoke_args *args,
+                        struct fastrpc_async_job *job);
+int fastrpc_mock_invoke2_response(int dev, fastrpc_async_jobid *jobid,
+                                  remote_handle *handle, uint32_t *sc,
+                                  int *result);
+int fastrpc_mock_mmap(int dev, int fd, size_t len, uintptr_t vaddrin,
+                      uint64_t *vaddrout);
+int fastrpc_mock_munmap(int dev, int fd, uint64_t vaddr);
+int fastrpc_mock_getdspinfo(int dev, uint32_t attr, uint32_t *capability);
+int fastrpc_mock_control(int dev, int req, void *c);
+int fastrpc_mock_signal_create(int dev, uint32_t signal);
+int fastrpc_mock_signal_destroy(int dev, uint32_t signal);
+int fastrpc_mock_signal_signal(int dev, uint32_t signal);
+int fastrpc_mock_signal_wait(int dev, uint32_t signal, uint32_t timeout_usec);
+int fastrpc_mock_signal_cancel_wait(int dev, uint32_t signal);
+int fastrpc_mock_mdctx_manage(int dev, int req, void *user_ctx,
+                              unsigned int *domain_ids,
+                              unsigned int num_domain_ids, uint64_t *ctx);
+
+/*
+ * Issues a reverse RPC call from the mock DSP of a domain to a module on
+ * the CPU, e.g. to the const apps_remotectl handle 0 to open a module.
+ * Blocks until the listener thread of the domain has served the call.
+ * The in and out handles of sc are buffers passed by reference, given as
+ * buffers within a buffer mapped with fastrpc_mmap, which the CPU module
+ * reads and writes in place, see struct listener_buf_ref. The mock DSP
+ * advertises REVERSE_RPC_BUF_REF_SUPPORT for them.
+ * @ domain: domain of the mock DSP process
+ * @ handle: CPU module handle
+ * @ sc: scalars of the call
+ * @ pra: arguments of the call, output buffers are filled in
+ * returns the result of the call
+ */
+int fastrpc_mock_reverse_invoke(int domain, remote_handle handle, uint32_t sc,
+                                remote_arg *pra);
+
+#else
+
+/* Without the mock driver every call goes to the kernel driver */
+#define fastrpc_mock_enabled() 0
+#define FASTRPC_MOCK_RETURN(call)                                              \
+  do {                                                                         \
+  } while (0)
+
+#endif // ENABLE_MOCK_DRIVER
+
+#endif // FASTRPC_MOCK_H
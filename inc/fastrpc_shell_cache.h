@@ -0,0 +1,89 @@
+// Copyright (c) 2024, Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef __FASTRPC_SHELL_CACHE_H__
+#define __FASTRPC_SHELL_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "apps_std.h"
+
+/*
+ * Cache of PD shell images shared by the processes of a user.
+ *
+ * Each entry is a file in the cache directory holding a shell image, with
+ * the testsig appended when one was loaded. Entries are keyed by the device,
+ * inode, size and modification time of the shell and testsig files, so an
+ * updated file is a miss and gets a new entry; entries of replaced files
+ * stay until the directory is cleared. A hit maps the entry and
+ * hands the mapping to the kernel as the shell, without reading or copying
+ * the file into a new buffer.
+ *
+ * The cache is off unless a directory is configured with the
+ * FASTRPC_SHELL_CACHE_DIR property, ideally on a tmpfs private to the user
+ * such as a directory under $XDG_RUNTIME_DIR. The directory is created with
+ * mode 0700. The cache stays off if it is a symbolic link, is not owned by
+ * the effective user or is writable by group or others, and entries not
+ * owned by the user or writable by others are misses. Hit, miss, store and
+ * error counts of all processes using the directory are kept in its "stats"
+ * file.
+ */
+
+/* Shell image mapped from the cache */
+struct fastrpc_shell_image {
+  void *base;         // mapping of the cache entry
+  size_t map_len;     // length of the mapping
+  void *data;         // shell image, followed by the testsig
+  uint32_t shell_len; // length of the shell image
+  uint32_t sig_len;   // length of the testsig, 0 if none
+};
+
+/* Cache counters */
+struct fastrpc_shell_cache_stats {
+  uint64_t hits;   // shells served from the cache
+  uint64_t misses; // shells read from file
+  uint64_t stores; // entries added
+  uint64_t errors; // lookups or stores that failed on I/O
+};
+
+/*
+ * Looks up the image of an open shell file, and of the testsig appended to
+ * it if any.
+ * @ shell: open shell file
+ * @ sig: open testsig file, -1 if none
+ * @ img: filled in on a hit, release with fastrpc_shell_cache_release()
+ * returns 0 on a hit, AEE_EUNSUPPORTED if the cache is off, other errors on
+ * a miss
+ */
+int fastrpc_shell_cache_lookup(apps_std_FILE shell, apps_std_FILE sig,
+                               struct fastrpc_shell_image *img);
+
+/*
+ * Adds the image read from a shell file, and testsig if any, to the cache.
+ * Errors are only counted, the cache is best effort.
+ * @ shell: open shell file the image was read from
+ * @ sig: open testsig file, -1 if none
+ * @ data: shell image followed by the testsig
+ * @ shell_len: length of the shell image
+ * @ sig_len: length of the testsig
+ */
+void fastrpc_shell_cache_store(apps_std_FILE shell, apps_std_FILE sig,
+                               const void *data, uint32_t shell_len,
+                               uint32_t sig_len);
+
+/*
+ * Unmaps an image returned by fastrpc_shell_cache_lookup()
+ */
+void fastrpc_shell_cache_release(struct fastrpc_shell_image *img);
+
+/*
+ * Gets the cache counters
+ * @ process: counters of this process, may be NULL
+ * @ all: counters of all processes using the cache directory, may be NULL
+ * returns 0 on success, AEE_EUNSUPPORTED if the cache is off
+ */
+int fastrpc_shell_cache_get_stats(struct fastrpc_shell_cache_stats *process,
+                                  struct fastrpc_shell_cache_stats *all);
+
+#endif /*__FASTRPC_SHELL_CACHE_H__*/
@@ -6,6 +6,7 @@
 
 #include <semaphore.h>
 #include <dlfcn.h>
+#include <stdint.h>
 
 #define   MSG(a, b, c)              printf(__FILE_LINE__ ":" c )
 #define   MSG_1(a, b, c, d)         printf(__FILE_LINE__ ":" c , d)
@@ -36,4 +37,43 @@ int listener_android_domain_init(int domain, int update_requested, sem_t *r_sem)
  */
 void listener_android_domain_deinit(int domain);
 
+/*
+ * Reverse invoke latency buckets: bucket i counts calls that took less than
+ * 2^i us, the last bucket counts all slower calls
+ */
+#define LISTENER_LATENCY_BUCKETS 24
+
+/* Reverse invokes of a handle */
+struct listener_handle_stats {
+  uint32_t handle;
+  uint64_t calls;
+  uint64_t total_us;
+  uint64_t max_us;
+  uint64_t latency[LISTENER_LATENCY_BUCKETS];
+};
+
+/* Reverse invokes and buffer management of the listener of a domain */
+struct listener_stats {
+  uint64_t invokes;      // reverse invokes served
+  uint64_t grows;        // buffers replaced by larger ones
+  uint64_t shrinks;      // buffers replaced by smaller ones
+  uint64_t bytes_copied; // request bytes moved to a new buffer
+  uint64_t bytes_in;     // request bytes received
+  uint64_t bytes_out;    // response bytes sent
+  uint64_t bytes_by_ref; // bytes passed by reference, not copied
+};
+
+/*
+ * API to get the listener statistics of a domain
+ * @ domain: domain of the listener
+ * @ stats: listener counters
+ * @ handles: filled with the stats of up to *num_handles open handles,
+ *   may be NULL
+ * @ num_handles: in, entries of handles; out, number of handles with stats
+ * returns 0 on success, AEE_ERESOURCENOTFOUND if the domain has no listener
+ */
+int listener_android_get_stats(int domain, struct listener_stats *stats,
+                               struct listener_handle_stats *handles,
+                               int *num_handles);
+
 #endif
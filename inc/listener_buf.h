@@ -8,6 +8,22 @@
 #include "remote.h"
 #include "verify.h"
 
+/*
+ * Buffer passed by reference in a reverse invoke, instead of being copied
+ * into the request or response. It is a range of a buffer the process
+ * mapped to the DSP with fastrpc_mmap, which the skel reads or writes in
+ * place. When the DSP advertises REVERSE_RPC_BUF_REF_SUPPORT, the in and
+ * out handles of the scalars of a reverse invoke are buffer references,
+ * packed after the output lengths. The skel sees them as buffers following
+ * the copied buffers of the same direction. Without the capability, reverse
+ * invokes carrying handles are rejected.
+ */
+struct listener_buf_ref {
+   int32_t fd;      // fd of the buffer mapped with fastrpc_mmap
+   uint32_t offset; // offset of the range in the buffer
+   uint32_t len;    // length of the range
+};
+
 static __inline void pack_in_bufs(struct sbuf* buf, remote_arg* pra, int nBufs) {
    int ii;
    uint32_t len;
@@ -59,6 +75,22 @@ static __inline void unpack_out_lens(struct sbuf* buf, remote_arg* pra, int nBuf
    }
 }
 
+static __inline void pack_buf_refs(struct sbuf* buf, struct listener_buf_ref* refs, int nRefs) {
+   int ii;
+   C_ASSERT(sizeof(*refs) == 12);
+   for(ii = 0; ii < nRefs; ++ii) {
+      sbuf_write(buf, (uint8_t*)&refs[ii], sizeof(refs[ii]));
+   }
+}
+
+static __inline void unpack_buf_refs(struct sbuf* buf, struct listener_buf_ref* refs, int nRefs) {
+   int ii;
+   C_ASSERT(sizeof(*refs) == 12);
+   for(ii = 0; ii < nRefs; ++ii) {
+      sbuf_read(buf, (uint8_t*)&refs[ii], sizeof(refs[ii]));
+   }
+}
+
 //map out buffers on the hlos side to the remote_arg array
 //dst is the space required for buffers we coun't map from the adsp
 static __inline void pack_out_bufs(struct sbuf* buf, remote_arg* pra, int nBufs) {
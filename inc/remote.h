@@ -203,6 +203,7 @@ enum fastrpc_async_notify_type {
     FASTRPC_ASYNC_NO_SYNC,   /** No notification required */
     FASTRPC_ASYNC_CALLBACK,  /** Callback notification using fastrpc_async_callback */
     FASTRPC_ASYNC_POLL,      /** User will poll for the notification */
+    FASTRPC_ASYNC_RING,      /** Completion is pushed to the domain's completion ring */
 /** Update FASTRPC_ASYNC_TYPE_MAX when adding new value to this enum */
 };
 
@@ -224,6 +225,44 @@ typedef struct fastrpc_async_descriptor {
     fastrpc_async_callback_t cb;          /** Async call back response type */
 }fastrpc_async_descriptor_t;
 
+/** Completion of a FASTRPC_ASYNC_RING job */
+typedef struct fastrpc_async_completion {
+    fastrpc_async_jobid jobid;  /** Job id returned in the async descriptor */
+    int result;                 /** Result of the job */
+}fastrpc_async_completion_t;
+
+/** Set in fastrpc_async_ring.flags when pending ring jobs were lost to a session reset */
+#define FASTRPC_ASYNC_RING_RESET 0x1
+
+/**
+ * Single-producer, single-consumer completion ring of a domain.
+ * FastRPC produces completions at head, the application consumes them at
+ * tail. Both indices increase monotonically and wrap at 2^32; the slot of an
+ * index is (index & (size - 1)). The application must read head with acquire
+ * semantics and publish tail with release semantics, or use
+ * fastrpc_async_ring_drain().
+ */
+typedef struct fastrpc_async_ring {
+    fastrpc_async_completion_t *entries; /** Completion slots, owned by the application */
+    uint32_t size;   /** Number of slots, a power of 2 */
+    uint32_t head;   /** Next slot written by FastRPC */
+    uint32_t tail;   /** Next slot read by the application */
+    uint32_t flags;  /** FASTRPC_ASYNC_RING_* flags set by FastRPC */
+}fastrpc_async_ring_t;
+
+/** One call of a batch submitted with remote_handle64_invoke_batch */
+typedef struct remote_invoke_batch_call {
+    remote_handle64 h;   /** Multi-domain handle to invoke */
+    uint32_t dwScalars;  /** Method and argument counts, see REMOTE_SCALARS_* */
+    remote_arg *pra;     /** Arguments of the call */
+} remote_invoke_batch_call;
+
+/** Flags for remote_handle64_invoke_batch */
+enum remote_invoke_batch_flags {
+    /** Keep submitting the remaining calls after a call fails */
+    REMOTE_INVOKE_BATCH_CONTINUE_ON_ERROR = 0x1,
+};
+
 
 /**
  * Flags used in struct remote_rpc_control_latency
@@ -593,6 +632,58 @@ typedef struct fastrpc_context_destroy {
 	uint64_t flags;
 } fastrpc_context_destroy;
 
+/*
+ * struct to be used with FASTRPC_MOCK_DRIVER request ID
+ * Selects the userspace mock FastRPC driver, which emulates the DSP in the
+ * calling process (see fastrpc_mock.h). Must be set before any session is
+ * opened; the mock can also be selected with FASTRPC_MOCK_DRIVER=1 in the
+ * environment. Only libraries configured with --enable-mock-driver contain
+ * the mock, others fail the request with AEE_EUNSUPPORTED.
+ */
+struct remote_rpc_mock_driver {
+	int enable;		/** @param[in]: 1 to select the mock driver, 0 for the kernel driver */
+};
+
+/**
+ * Operations of the FASTRPC_SESSION_PREWARM request
+ **/
+enum remote_rpc_prewarm_op {
+    FASTRPC_PREWARM_START,                 /** Start the session bring-up in the background */
+    FASTRPC_PREWARM_WAIT,                  /** Wait up to timeout_us for the bring-up to finish */
+    FASTRPC_PREWARM_POLL,                  /** Query the bring-up status without waiting */
+};
+
+/** Timeout of FASTRPC_PREWARM_WAIT to wait until the bring-up is done */
+#define FASTRPC_PREWARM_WAIT_FOREVER       0xffffffff
+
+/**
+ * Structure used for request ID `FASTRPC_SESSION_PREWARM`
+ * in remote session control interface, to create the session of a domain
+ * and spawn its user PD ahead of the first remote_handle64_open().
+ * A remote_handle64_open() issued while the bring-up is in progress waits
+ * for it instead of starting another one. A FASTRPC_PREWARM_START while a
+ * bring-up is in progress or done for the current session does nothing.
+ **/
+struct remote_rpc_session_prewarm {
+    int domain;                            /** @param[in]: Effective domain ID of the session */
+    uint32_t op;                           /** @param[in]: Operation, one of enum remote_rpc_prewarm_op */
+    const char **skel_uris;                /** @param[in]: FASTRPC_PREWARM_START only, optional URIs of modules to
+                                             * open once the session is up, as passed to remote_handle64_open().
+                                             * The modules stay loaded until the session is closed, they do not
+                                             * keep it open: closing the last handle of the application or
+                                             * FASTRPC_SESSION_CLOSE releases them.
+                                             */
+    uint32_t num_skel_uris;                /** @param[in]: Number of URIs in skel_uris */
+    uint32_t timeout_us;                   /** @param[in]: FASTRPC_PREWARM_WAIT only, maximum wait in microseconds
+                                             * or FASTRPC_PREWARM_WAIT_FOREVER
+                                             */
+    int status;                            /** @param[out]: AEE_SUCCESS once the session is up, AEE_EITEMBUSY while
+                                             * the bring-up is in progress, AEE_ENOTINITIALIZED if no session
+                                             * was started, or the error of the bring-up. Modules that fail to
+                                             * open are only logged.
+                                             */
+};
+
 /**
  * Request IDs for remote session control interface
  **/
@@ -616,6 +707,8 @@ enum session_control_req_id {
     FASTRPC_MAX_THREAD_PARAM,                  /** Set max thread value for unsigned PD */
     FASTRPC_CONTEXT_CREATE,                    /** Create or attaches to remote session(s) on one or more domains */
     FASTRPC_CONTEXT_DESTROY,                   /** Destroy or detach from remote sessions */
+    FASTRPC_MOCK_DRIVER,                       /** Select the userspace mock driver instead of the kernel driver */
+    FASTRPC_SESSION_PREWARM,                   /** Bring up a session in the background and query its readiness */
 };
 
 
@@ -843,6 +936,34 @@ __QAIC_REMOTE_EXPORT __QAIC_RETURN int __QAIC_REMOTE(remote_handle64_open)( __QA
 __QAIC_REMOTE_EXPORT __QAIC_RETURN int __QAIC_REMOTE(remote_handle_invoke)(__QAIC_IN remote_handle h, __QAIC_IN uint32_t dwScalars, __QAIC_IN remote_arg *pra) __QAIC_REMOTE_ATTRIBUTE;
 __QAIC_REMOTE_EXPORT __QAIC_RETURN int __QAIC_REMOTE(remote_handle64_invoke)(__QAIC_IN remote_handle64 h, __QAIC_IN uint32_t dwScalars, __QAIC_IN remote_arg *pra) __QAIC_REMOTE_ATTRIBUTE;
 
+/**
+ * Invokes a batch of remote functions through multi-domain handles
+ *
+ * The calls are submitted in order, with the same semantics as calling
+ * remote_handle64_invoke() on each of them. Each distinct handle is validated
+ * once per batch. The session reference, wake-lock, QoS vote and RPC timeout
+ * timer are set up once per batch instead of once per call.
+ *
+ * @param calls [in] Array of calls to submit
+ * @param num_calls [in] Number of entries in calls and results
+ * @param flags [in] Bitmask of remote_invoke_batch_flags
+ * @param results [out] Result of each call. Calls that were not submitted
+ *                      because an earlier call failed are set to
+ *                      AEE_EINTERRUPTED.
+ *
+ * @return 0 if every call succeeded, otherwise the error of the first call
+ *         that failed:
+ *         - AEE_EBADPARM: Invalid parameters (NULL pointers, unknown flags)
+ *         - AEE_EINVHANDLE: Invalid remote handle
+ *         - Other error codes returned by remote_handle64_invoke()
+ *
+ * @note By default the batch stops at the first failed call. Set
+ *       REMOTE_INVOKE_BATCH_CONTINUE_ON_ERROR to submit every call.
+ *
+ * @note Handles must stay open until the batch returns.
+ */
+__QAIC_REMOTE_EXPORT __QAIC_RETURN int __QAIC_REMOTE(remote_handle64_invoke_batch)(__QAIC_IN const remote_invoke_batch_call *calls, __QAIC_IN uint32_t num_calls, __QAIC_IN uint32_t flags, __QAIC_OUT int *results) __QAIC_REMOTE_ATTRIBUTE;
+
 
 /**
  * Closes a remote handle previously opened with remote_handle_open()
@@ -1025,6 +1146,63 @@ __QAIC_REMOTE_EXPORT __QAIC_RETURN int __QAIC_REMOTE(fastrpc_async_get_status)(_
  */
 __QAIC_REMOTE_EXPORT __QAIC_RETURN int __QAIC_REMOTE(fastrpc_release_async_job)(__QAIC_IN fastrpc_async_jobid jobid);
 
+/**
+ * Registers the completion ring of a domain
+ *
+ * Jobs submitted with the FASTRPC_ASYNC_RING descriptor type on the domain
+ * complete by pushing a fastrpc_async_completion_t to the ring, and the
+ * returned eventfd is signaled. The application can wait on the eventfd with
+ * poll or epoll, read it to clear it, and then drain all available
+ * completions at once. Ring jobs are not tracked individually, so they must
+ * not be passed to fastrpc_async_get_status() or fastrpc_release_async_job().
+ * Submitting a ring job on a domain without a registered ring fails with
+ * AEE_EBADPARM.
+ *
+ * @param domain [in] Effective domain id of the session
+ * @param ring [in] Ring to register. size must be a power of 2, head and tail
+ *                  must be equal. The ring must stay valid until it is
+ *                  unregistered.
+ * @param efd [out] Non-blocking eventfd signaled when completions are pushed.
+ *                  Owned by FastRPC and closed on unregister.
+ *
+ * @return 0 on success, otherwise error code:
+ *         - AEE_EBADPARM: Invalid parameters
+ *         - AEE_EALREADY: A ring is already registered for the domain
+ *         - AEE_EFAILED: Failed to create the eventfd
+ *
+ * @note The ring must have room for every ring job in flight on the domain.
+ *       When it is full, the completion of further jobs waits for the
+ *       application to consume entries.
+ * @note Each time the eventfd is signaled, drain until the ring is empty:
+ *       the eventfd is only signaled again when a completion lands in an
+ *       empty ring. Completions of all async jobs of the domain, ring or
+ *       not, are delivered by a single worker thread, which stalls while the
+ *       ring is full.
+ */
+__QAIC_REMOTE_EXPORT __QAIC_RETURN int __QAIC_REMOTE(fastrpc_async_ring_register)(__QAIC_IN int domain, __QAIC_IN fastrpc_async_ring_t *ring, __QAIC_OUT int *efd);
+
+/**
+ * Unregisters the completion ring of a domain and closes its eventfd
+ *
+ * @param domain [in] Effective domain id the ring was registered on
+ *
+ * @return 0 on success, otherwise error code:
+ *         - AEE_EBADPARM: No ring is registered for the domain
+ *         - AEE_EBUSY: Ring jobs are still in flight
+ */
+__QAIC_REMOTE_EXPORT __QAIC_RETURN int __QAIC_REMOTE(fastrpc_async_ring_unregister)(__QAIC_IN int domain);
+
+/**
+ * Consumes completions from a completion ring
+ *
+ * @param ring [in] Registered completion ring
+ * @param completions [out] Array receiving the completions
+ * @param max [in] Number of entries in completions
+ *
+ * @return Number of completions copied to completions, 0 if the ring is empty
+ */
+__QAIC_REMOTE_EXPORT __QAIC_RETURN uint32_t __QAIC_REMOTE(fastrpc_async_ring_drain)(__QAIC_IN fastrpc_async_ring_t *ring, __QAIC_OUT fastrpc_async_completion_t *completions, __QAIC_IN uint32_t max);
+
 
 /**
  * DEPRECATED: Use fastrpc_mmap() instead.
@@ -34,6 +34,18 @@
  */
 #define RPCMEM_TRY_MAP_STATIC   0x04000000
 
+/**
+ * Buffers allocated with this flag are returned to a per-heap buffer pool on
+ * rpcmem_free instead of being released. The pool keeps them mapped and
+ * registered with the FastRPC library and hands them back to the next
+ * allocation of the same heap and size class, which saves the allocation,
+ * mapping and registration cost for workloads that allocate buffers of the
+ * same size repeatedly. Pooling can also be enabled for all allocations by
+ * setting the FASTRPC_RPCMEM_POOL environment variable to 1.
+ * See rpcmem_pool_set_limit, rpcmem_pool_trim and rpcmem_pool_get_stats.
+ */
+#define RPCMEM_POOLED   0x00800000
+
 /**
  *  Supported RPCMEM heap IDs.
  *
@@ -195,6 +207,42 @@ void rpcmem_free(void* po);
  */
 int rpcmem_to_fd(void* po);
 
+/**
+ * Buffer pool statistics of a heap, see RPCMEM_POOLED.
+ */
+struct rpcmem_pool_stats {
+   uint64_t hits;          /**< Allocations served from the pool */
+   uint64_t misses;        /**< Pooled allocations that had to allocate a new buffer */
+   uint64_t releases;      /**< Freed buffers released instead of pooled (limit or trim) */
+   uint32_t cached_bufs;   /**< Buffers currently held in the pool */
+   uint64_t cached_bytes;  /**< Bytes currently held in the pool */
+};
+
+/**
+ * Set the high-water mark of the buffer pool.
+ * Freed pooled buffers are released once the pool holds more than this many
+ * bytes across all heaps. The default can be set with the
+ * FASTRPC_RPCMEM_POOL_LIMIT environment variable.
+ * @param[in] bytes  Maximum number of bytes held by the pool.
+ * @return           0 on success.
+ */
+int rpcmem_pool_set_limit(size_t bytes);
+
+/**
+ * Release buffers held by the pool until it holds at most the given number
+ * of bytes. Passing 0 empties the pool.
+ * @param[in] bytes  Number of bytes the pool may keep.
+ */
+void rpcmem_pool_trim(size_t bytes);
+
+/**
+ * Get buffer pool statistics of a heap.
+ * @param[in]  heapid  Heap ID the buffers were allocated from.
+ * @param[out] stats   Statistics of the heap.
+ * @return             0 on success, non-zero if the heap was never pooled.
+ */
+int rpcmem_pool_get_stats(int heapid, struct rpcmem_pool_stats *stats);
+
 /**
  * @}
  */
@@ -1,6 +1,10 @@
 // Copyright (c) 2024, Qualcomm Innovation Center, Inc. All rights reserved.
 // SPDX-License-Identifier: BSD-3-Clause
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #ifdef _WIN32
 #ifndef _CRT_SECURE_NO_WARNINGS
 #define _CRT_SECURE_NO_WARNINGS
@@ -32,7 +36,9 @@
 #include "HAP_farf.h"
 #include "apps_std.h"
 #include "apps_std_internal.h"
+#include "apps_std_path_cache.h"
 #include "fastrpc_internal.h"
+#include "fastrpc_mock.h"
 #include "fastrpc_trace.h"
 #include "platform_libs.h"
 #include "remote.h"
@@ -42,11 +48,18 @@
 #include <limits.h>
 #include <dlfcn.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <linux/udmabuf.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -63,6 +76,9 @@
 #endif // C_ASSERT
 
 #define APPS_FD_BASE 100
+/* FILE entries are allocated in chunks that stay until deinit */
+#define APPS_STD_FILE_CHUNK 64
+#define APPS_STD_FILE_MAX_CHUNKS 1024
 #define ERRNO (errno ? errno : nErr ? nErr : -1)
 #define APPS_STD_STREAM_FILE 1
 #define APPS_STD_STREAM_BUF 2
@@ -73,6 +89,10 @@
 #define TESTSIG_FILE_NAME "testsig"
 #define RPC_VERSION_FILE_NAME "librpcversion_skel.so"
 
+#define UDMABUF_DEV "/dev/udmabuf"
+/* Files are copied in windows of this size to bound memory in flight */
+#define FOPEN_FD_WINDOW (4 * 1024 * 1024)
+
 #define FREEIF(pv)                                                             \
   do {                                                                         \
     if (pv) {                                                                  \
@@ -90,13 +110,27 @@ struct apps_std_buf_info {
 };
 
 struct apps_std_info {
-  QNode qn;
+  pthread_mutex_t mut; // guards in_use, type and u
+  bool in_use;
   int type;
   union {
     FILE *stream;
     struct apps_std_buf_info binfo;
   } u;
   apps_std_FILE fd;
+  int next_free; // index of the next free entry, -1 if last
+};
+
+/*
+ * Table of FILE handles, indexed by handle - APPS_FD_BASE. Entries never
+ * move, so a handle is looked up without a table-wide lock, and the lock of
+ * the table only guards the free list.
+ */
+struct apps_std_file_table {
+  pthread_mutex_t mut;
+  struct apps_std_info *_Atomic chunks[APPS_STD_FILE_MAX_CHUNKS];
+  int num_chunks;
+  int free_head; // index of the first free entry, -1 if none
 };
 
 /*
@@ -107,7 +141,7 @@ struct apps_std_dir_info {
   uint64_t handle;
 };
 
-static QList apps_std_qlst;
+static struct apps_std_file_table ftable = {.free_head = -1};
 
 /* Linked list that tracks list of all valid dir handles */
 static QList apps_std_dirlist;
@@ -119,7 +153,8 @@ struct mem_io_to_fd {
   int fd;
   int fdfile;
   FILE *stream;
-  void *buf;
+  void *buf;   // rpcmem copy of the file, NULL if backed by memfd
+  int memfd;   // memfd backing fd, -1 if none
 };
 
 struct mem_io_fd_list {
@@ -128,6 +163,8 @@ struct mem_io_fd_list {
 };
 
 static struct mem_io_fd_list fdlist;
+/* Set once udmabuf is found to be unavailable */
+static _Atomic bool udmabuf_unavailable;
 
 int setenv(const char *name, const char *value, int overwrite);
 int unsetenv(const char *name);
@@ -163,15 +200,30 @@ bail:
 }
 
 int apps_std_init(void) {
-  QList_Ctor(&apps_std_qlst);
+  pthread_mutex_init(&ftable.mut, 0);
   QList_Ctor(&apps_std_dirlist);
   pthread_mutex_init(&apps_std_mt, 0);
   pthread_mutex_init(&fdlist.mut, 0);
   QList_Ctor(&fdlist.ql);
-  return AEE_SUCCESS;
+  return apps_std_path_cache_init();
 }
 
 void apps_std_deinit(void) {
+  int ii, jj;
+
+  apps_std_path_cache_deinit();
+  for (ii = 0; ii < ftable.num_chunks; ii++) {
+    struct apps_std_info *chunk = atomic_load(&ftable.chunks[ii]);
+
+    for (jj = 0; jj < APPS_STD_FILE_CHUNK; jj++) {
+      pthread_mutex_destroy(&chunk[jj].mut);
+    }
+    atomic_store(&ftable.chunks[ii], NULL);
+    free(chunk);
+  }
+  ftable.num_chunks = 0;
+  ftable.free_head = -1;
+  pthread_mutex_destroy(&ftable.mut);
   pthread_mutex_destroy(&apps_std_mt);
   pthread_mutex_destroy(&fdlist.mut);
 }
@@ -179,54 +231,71 @@ void apps_std_deinit(void) {
 PL_DEFINE(apps_std, apps_std_init, apps_std_deinit);
 
 static void apps_std_FILE_free(struct apps_std_info *sfree) {
+  bool in_use;
 
   FARF(RUNTIME_RPC_LOW, "Entering %s", __func__);
-  pthread_mutex_lock(&apps_std_mt);
-  QNode_Dequeue(&sfree->qn);
-  pthread_mutex_unlock(&apps_std_mt);
-
-  FREEIF(sfree);
+  pthread_mutex_lock(&sfree->mut);
+  in_use = sfree->in_use;
+  sfree->in_use = false;
+  pthread_mutex_unlock(&sfree->mut);
+
+  // Only the first of concurrent frees returns the entry
+  if (in_use) {
+    pthread_mutex_lock(&ftable.mut);
+    sfree->next_free = ftable.free_head;
+    ftable.free_head = sfree->fd - APPS_FD_BASE;
+    pthread_mutex_unlock(&ftable.mut);
+  }
   FARF(RUNTIME_RPC_LOW, "Exiting %s", __func__);
   return;
 }
 
+// Adds a chunk of free entries, called with ftable.mut held
+static int apps_std_FILE_grow_locked(void) {
+  struct apps_std_info *chunk = NULL;
+  int nErr = AEE_SUCCESS, base = 0, ii;
+
+  VERIFYC(ftable.num_chunks < APPS_STD_FILE_MAX_CHUNKS, EMFILE);
+  VERIFYC(0 != (chunk = calloc(APPS_STD_FILE_CHUNK, sizeof(*chunk))), ENOMEM);
+  base = ftable.num_chunks * APPS_STD_FILE_CHUNK;
+  for (ii = 0; ii < APPS_STD_FILE_CHUNK; ii++) {
+    pthread_mutex_init(&chunk[ii].mut, 0);
+    chunk[ii].fd = APPS_FD_BASE + base + ii;
+    chunk[ii].next_free = ii + 1 < APPS_STD_FILE_CHUNK ? base + ii + 1 : -1;
+  }
+  atomic_store(&ftable.chunks[ftable.num_chunks++], chunk);
+  ftable.free_head = base;
+bail:
+  return nErr;
+}
+
 static int apps_std_FILE_alloc(FILE *stream, apps_std_FILE *fd) {
-  struct apps_std_info *sinfo = 0, *info;
-  QNode *pn = 0;
-  apps_std_FILE prevfd = APPS_FD_BASE - 1;
-  int nErr = AEE_SUCCESS;
+  struct apps_std_info *sinfo = 0;
+  int nErr = AEE_SUCCESS, idx = -1;
 
   FARF(RUNTIME_RPC_LOW, "Entering %s", __func__);
-  VERIFYC(0 != (sinfo = calloc(1, sizeof(*sinfo))), ENOMEM);
-  QNode_CtorZ(&sinfo->qn);
-  sinfo->type = APPS_STD_STREAM_FILE;
-  pthread_mutex_lock(&apps_std_mt);
-  pn = QList_GetFirst(&apps_std_qlst);
-  if (pn) {
-    info = STD_RECOVER_REC(struct apps_std_info, qn, pn);
-    prevfd = info->fd;
-    QLIST_FOR_REST(&apps_std_qlst, pn) {
-      info = STD_RECOVER_REC(struct apps_std_info, qn, pn);
-      if (info->fd != prevfd + 1) {
-        sinfo->fd = prevfd + 1;
-        QNode_InsPrev(pn, &sinfo->qn);
-        break;
-      }
-      prevfd = info->fd;
-    }
+  pthread_mutex_lock(&ftable.mut);
+  if (ftable.free_head == -1) {
+    nErr = apps_std_FILE_grow_locked();
   }
-  if (!QNode_IsQueuedZ(&sinfo->qn)) {
-    sinfo->fd = prevfd + 1;
-    QList_AppendNode(&apps_std_qlst, &sinfo->qn);
+  if (nErr == AEE_SUCCESS) {
+    idx = ftable.free_head;
+    sinfo = &atomic_load(
+        &ftable.chunks[idx / APPS_STD_FILE_CHUNK])[idx % APPS_STD_FILE_CHUNK];
+    ftable.free_head = sinfo->next_free;
   }
-  pthread_mutex_unlock(&apps_std_mt);
+  pthread_mutex_unlock(&ftable.mut);
+  VERIFY(nErr == AEE_SUCCESS);
 
+  pthread_mutex_lock(&sinfo->mut);
+  sinfo->type = APPS_STD_STREAM_FILE;
   sinfo->u.stream = stream;
+  sinfo->in_use = true;
+  pthread_mutex_unlock(&sinfo->mut);
   *fd = sinfo->fd;
 
 bail:
   if (nErr) {
-    FREEIF(sinfo);
     VERIFY_EPRINTF("Error 0x%x: apps_std_FILE_alloc failed, errno %s \n", nErr,
                    strerror(nErr));
   }
@@ -235,21 +304,21 @@ bail:
 }
 
 static int apps_std_FILE_get(apps_std_FILE fd, struct apps_std_info **info) {
-  struct apps_std_info *sinfo = 0;
-  QNode *pn, *pnn;
-  int nErr = EBADF;
+  struct apps_std_info *chunk = NULL, *sinfo = NULL;
+  int nErr = EBADF, idx = fd - APPS_FD_BASE;
 
   FARF(RUNTIME_RPC_LOW, "Entering %s", __func__);
-  pthread_mutex_lock(&apps_std_mt);
-  QLIST_NEXTSAFE_FOR_ALL(&apps_std_qlst, pn, pnn) {
-    sinfo = STD_RECOVER_REC(struct apps_std_info, qn, pn);
-    if (sinfo->fd == fd) {
+  if (idx >= 0 && idx < APPS_STD_FILE_CHUNK * APPS_STD_FILE_MAX_CHUNKS &&
+      NULL !=
+          (chunk = atomic_load(&ftable.chunks[idx / APPS_STD_FILE_CHUNK]))) {
+    sinfo = &chunk[idx % APPS_STD_FILE_CHUNK];
+    pthread_mutex_lock(&sinfo->mut);
+    if (sinfo->in_use) {
       *info = sinfo;
       nErr = AEE_SUCCESS;
-      break;
     }
+    pthread_mutex_unlock(&sinfo->mut);
   }
-  pthread_mutex_unlock(&apps_std_mt);
   if (nErr) {
     VERIFY_EPRINTF(
         "Error 0x%x: apps_std_FILE_get failed for fd 0x%x, errno %s \n", nErr,
@@ -261,13 +330,13 @@ static int apps_std_FILE_get(apps_std_FILE fd, struct apps_std_info **info) {
 
 static void apps_std_FILE_set_buffer_stream(struct apps_std_info *sinfo,
                                             char *fbuf, int flen, int pos) {
-  pthread_mutex_lock(&apps_std_mt);
+  pthread_mutex_lock(&sinfo->mut);
   fclose(sinfo->u.stream);
   sinfo->type = APPS_STD_STREAM_BUF;
   sinfo->u.binfo.fbuf = fbuf;
   sinfo->u.binfo.flen = flen;
   sinfo->u.binfo.pos = pos;
-  pthread_mutex_unlock(&apps_std_mt);
+  pthread_mutex_unlock(&sinfo->mut);
 }
 
 __QAIC_IMPL_EXPORT int
@@ -304,13 +373,123 @@ bail:
   return nErr;
 }
 
+/*
+ * Copies a file into a sealed memfd and exports it as a dma-buf with
+ * udmabuf, so the DSP maps the file without an rpcmem buffer of its size.
+ * The kernel copies the file from the page cache in windows of
+ * FOPEN_FD_WINDOW, without a userspace buffer. The mock driver maps the
+ * memfd itself.
+ * returns AEE_EUNSUPPORTED if udmabuf is not available
+ */
+static int apps_std_fopen_fd_memfd(int fdfile, size_t size, int *memfd,
+                                   int *dmafd, uint64_t *alloc_time,
+                                   uint64_t *read_time) {
+  int nErr = AEE_SUCCESS, dev = -1, mfd = -1, dfd = -1;
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  // udmabuf exports whole pages
+  size_t len = size ? (size + page - 1) & ~(page - 1) : page;
+  struct udmabuf_create create = {0};
+  bool mock = fastrpc_mock_enabled();
+  off_t off = 0;
+  ssize_t sz = 0;
+  uint64_t tdiff = 0;
+
+  if (!mock) {
+    VERIFYC(!atomic_load(&udmabuf_unavailable), AEE_EUNSUPPORTED);
+    if (-1 == (dev = open(UDMABUF_DEV, O_RDWR | O_CLOEXEC))) {
+      atomic_store(&udmabuf_unavailable, true);
+      FARF(RUNTIME_RPC_HIGH, "%s: %s not available (%s), using rpcmem",
+           __func__, UDMABUF_DEV, strerror(errno));
+      nErr = AEE_EUNSUPPORTED;
+      goto bail;
+    }
+  }
+  PROFILE_ALWAYS(alloc_time,
+    mfd = memfd_create("apps_std_fopen_fd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  );
+  VERIFYC(-1 != mfd, AEE_ENORPCMEMORY);
+  VERIFYC(0 == ftruncate(mfd, len), AEE_ENORPCMEMORY);
+  PROFILE_ALWAYS(read_time,
+    while ((size_t)off < size) {
+      sz = sendfile(mfd, fdfile, &off, STD_MIN(size - off, FOPEN_FD_WINDOW));
+      if (sz <= 0) {
+        break;
+      }
+    }
+  );
+  VERIFYC((size_t)off == size, AEE_EFILE);
+  // udmabuf requires the memfd to be sealed against shrinking
+  VERIFYC(0 == fcntl(mfd, F_ADD_SEALS,
+                     F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL),
+          AEE_EFILE);
+  if (mock) {
+    dfd = mfd;
+  } else {
+    create.memfd = mfd;
+    create.flags = UDMABUF_FLAGS_CLOEXEC;
+    create.offset = 0;
+    create.size = len;
+    PROFILE_ALWAYS(&tdiff, dfd = ioctl(dev, UDMABUF_CREATE, &create););
+    *alloc_time += tdiff;
+    VERIFYC(-1 != dfd, AEE_ENORPCMEMORY);
+  }
+  *memfd = mfd;
+  *dmafd = dfd;
+  mfd = -1;
+bail:
+  if (dev != -1) {
+    close(dev);
+  }
+  if (mfd != -1) {
+    close(mfd);
+  }
+  if (nErr != AEE_SUCCESS && nErr != AEE_EUNSUPPORTED) {
+    FARF(ERROR, "Error 0x%x: %s failed for size %zu, using rpcmem (%s)", nErr,
+         __func__, size, strerror(ERRNO));
+  }
+  return nErr;
+}
+
+/*
+ * Reads a file into an rpcmem buffer in windows of FOPEN_FD_WINDOW
+ */
+static int apps_std_fopen_fd_read(int fdfile, size_t size, void **buf,
+                                  uint64_t *alloc_time, uint64_t *read_time) {
+  int nErr = AEE_SUCCESS;
+  void *source = NULL;
+  size_t off = 0;
+  ssize_t sz = 0;
+
+  PROFILE_ALWAYS(alloc_time,
+      source = rpcmem_alloc_internal(0, RPCMEM_HEAP_DEFAULT, size););
+  VERIFYC(0 != source, AEE_ENORPCMEMORY);
+  PROFILE_ALWAYS(read_time,
+    while (off < size) {
+      sz = pread(fdfile, (char *)source + off,
+                 STD_MIN(size - off, FOPEN_FD_WINDOW), off);
+      if (sz <= 0) {
+        break;
+      }
+      off += sz;
+    }
+  );
+  VERIFYC(off == size, AEE_EFILE);
+  *buf = source;
+  source = NULL;
+bail:
+  if (source) {
+    rpcmem_free_internal(source);
+  }
+  return nErr;
+}
+
 __QAIC_IMPL_EXPORT int
 __QAIC_IMPL(apps_std_fopen_fd)(const char *name, const char *mode, int *fd,
                                int *len) __QAIC_IMPL_ATTRIBUTE {
   int nErr = AEE_SUCCESS;
   struct stat statbuf;
   void *source = NULL;
-  int sz = 0, fdfile = 0;
+  int fdfile = 0, memfd = -1, dmafd = -1;
   struct mem_io_to_fd *tofd = 0;
   int domain = get_current_domain();
   FILE *stream = NULL;
@@ -329,20 +508,22 @@ __QAIC_IMPL(apps_std_fopen_fd)(const char *name, const char *mode, int *fd,
   }
   VERIFYC(-1 != (fdfile = fileno(stream)), ERRNO);
   VERIFYC(0 == fstat(fdfile, &statbuf), ERRNO);
-  PROFILE_ALWAYS(
-      &rpc_alloc_time,
-      source = rpcmem_alloc_internal(0, RPCMEM_HEAP_DEFAULT, statbuf.st_size););
-  VERIFYC(0 != source, AEE_ENORPCMEMORY);
-  PROFILE_ALWAYS(&read_time, sz = read(fdfile, source, statbuf.st_size););
-  if (sz < 0) {
-    nErr = AEE_EFILE;
-    goto bail;
+  VERIFYC(statbuf.st_size <= INT_MAX, AEE_EBADSIZE);
+  if (AEE_SUCCESS == apps_std_fopen_fd_memfd(fdfile, statbuf.st_size, &memfd,
+                                             &dmafd, &rpc_alloc_time,
+                                             &read_time)) {
+    *fd = dmafd;
+  } else {
+    VERIFY(AEE_SUCCESS ==
+           (nErr = apps_std_fopen_fd_read(fdfile, statbuf.st_size, &source,
+                                          &rpc_alloc_time, &read_time)));
+    *fd = rpcmem_to_fd(source);
   }
-  *fd = rpcmem_to_fd(source);
   *len = statbuf.st_size;
   PROFILE_ALWAYS(&mmap_time, nErr = fastrpc_mmap(domain, *fd, source, 0, *len,
                                                  FASTRPC_MAP_FD));
   VERIFY(AEE_SUCCESS == nErr);
+  mmap_pass = true;
   VERIFYC(NULL != (tofd = calloc(1, sizeof(*tofd))), AEE_ENOMEMORY);
   QNode_CtorZ(&tofd->qn);
   tofd->size = *len;
@@ -350,6 +531,7 @@ __QAIC_IMPL(apps_std_fopen_fd)(const char *name, const char *mode, int *fd,
   tofd->fdfile = fdfile;
   tofd->stream = stream;
   tofd->buf = source;
+  tofd->memfd = memfd;
   pthread_mutex_lock(&fdlist.mut);
   QList_AppendNode(&fdlist.ql, &tofd->qn);
   pthread_mutex_unlock(&fdlist.mut);
@@ -371,6 +553,12 @@ bail:
       rpcmem_free_internal(source);
       source = NULL;
     }
+    if (dmafd != -1 && dmafd != memfd) {
+      close(dmafd);
+    }
+    if (memfd != -1) {
+      close(memfd);
+    }
   }
   FARF(RUNTIME_RPC_LOW, "Exiting %s name %s mode %s err %d", __func__, name,
        mode, nErr);
@@ -380,8 +568,10 @@ bail:
                        mmap_time);
   FARF(CRITICAL,
        "%s: done for %s with fopen:%" PRIu64 "us, read:%" PRIu64
-       "us, rpc_alloc:%" PRIu64 "us, mmap:%" PRIu64 "us, fd 0x%x error_code 0x%x",
-       __func__, name, fopen_time, read_time, rpc_alloc_time, mmap_time, *fd, nErr);
+       "us, rpc_alloc:%" PRIu64 "us, mmap:%" PRIu64
+       "us, fd 0x%x (%s) error_code 0x%x",
+       __func__, name, fopen_time, read_time, rpc_alloc_time, mmap_time, *fd,
+       memfd != -1 ? "memfd" : "rpcmem", nErr);
   return nErr;
 }
 __QAIC_IMPL_EXPORT int
@@ -503,6 +693,12 @@ __QAIC_IMPL(apps_std_fclose_fd)(int fd) __QAIC_IMPL_ATTRIBUTE {
       rpcmem_free_internal(freefd->buf);
       freefd->buf = NULL;
     }
+    if (freefd->memfd != -1) {
+      if (freefd->fd != freefd->memfd) {
+        close(freefd->fd);
+      }
+      close(freefd->memfd);
+    }
     PROFILE_ALWAYS(&tdiff,
     nErr = fclose(freefd->stream);
     );
@@ -1031,6 +1227,8 @@ __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fopen_with_env)(
   const char *envVar = NULL;
   uint16_t absNameLen = 0;
   int domain = GET_DOMAIN_FROM_EFFEC_DOMAIN_ID(get_current_domain());
+  struct apps_std_path_query query = {0};
+  bool missing = true;
 
   FARF(LOW, "Entering %s", __func__);
   VERIFYC(NULL != mode, AEE_EBADPARM);
@@ -1055,6 +1253,26 @@ __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fopen_with_env)(
   VERIFYC(NULL != (dirList = dirListBuf), AEE_EBADPARM);
   FARF(RUNTIME_RPC_HIGH, "%s dirList %s", __func__, dirList);
 
+  switch (apps_std_path_cache_lookup(&query, dirList, delim,
+                                     SUBSYSTEM_NAME[domain], name, mode,
+                                     &absName)) {
+  case APPS_STD_PATH_MISSING:
+    errno = nErr = ENOENT;
+    goto bail;
+  case APPS_STD_PATH_FOUND:
+    nErr = apps_std_fopen(absName, mode, psout);
+    if (AEE_SUCCESS == nErr) {
+      FARF(RUNTIME_RPC_HIGH, "Opened cached path %s", absName);
+      goto bail;
+    }
+    // Stale entry, search again
+    apps_std_path_cache_remove(&query);
+    FREEIF(absName);
+    break;
+  default:
+    break;
+  }
+
   while (dirList) {
     pos = strstr(dirList, delim);
     dirName = dirList;
@@ -1065,6 +1283,7 @@ __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fopen_with_env)(
       dirList = 0;
     }
 
+    apps_std_path_cache_watch(&query, dirName, SUBSYSTEM_NAME[domain]);
     // Append domain to path
     absNameLen =
         strlen(dirName) + strlen(name) + 2 + strlen("adsp") + 1;
@@ -1083,9 +1302,11 @@ __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fopen_with_env)(
     nErr = apps_std_fopen(absName, mode, psout);
     if (AEE_SUCCESS == nErr) {
       // Success
+      apps_std_path_cache_add(&query, absName);
       FARF(ALWAYS, "Successfully opened file %s", absName);
       goto bail;
     }
+    missing = missing && nErr == ENOENT;
     FREEIF(absName);
 
     // fallback: If not found in domain path /vendor/dsp/adsp try in /vendor/dsp
@@ -1103,6 +1324,7 @@ __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fopen_with_env)(
     nErr = apps_std_fopen(absName, mode, psout);
     if (AEE_SUCCESS == nErr) {
       // Success
+      apps_std_path_cache_add(&query, absName);
       if (name != NULL &&
           (strncmp(name, OEM_CONFIG_FILE_NAME,
                        strlen(OEM_CONFIG_FILE_NAME)) != 0) &&
@@ -1111,9 +1333,14 @@ __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fopen_with_env)(
         FARF(ALWAYS, "Successfully opened file %s", name);
       goto bail;
     }
+    missing = missing && nErr == ENOENT;
     FREEIF(absName);
   }
+  if (missing) {
+    apps_std_path_cache_add(&query, NULL);
+  }
 bail:
+  apps_std_path_cache_end(&query);
   FREEIF(absName);
   FREEIF(dirListBuf);
   if (nErr != AEE_SUCCESS) {
@@ -1151,6 +1378,7 @@ __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fopen_with_env_fd)(
   const char *envVar = NULL;
   uint16_t absNameLen = 0;
   int domain = GET_DOMAIN_FROM_EFFEC_DOMAIN_ID(get_current_domain());
+  struct apps_std_path_query query = {0};
 
   FARF(RUNTIME_RPC_LOW, "Entering %s", __func__);
   VERIFYC(NULL != mode, AEE_EBADPARM);
@@ -1182,6 +1410,27 @@ __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fopen_with_env_fd)(
   VERIFY(0 == (nErr = get_dirlist_from_env(envVar, &dirListBuf)));
   VERIFYC(NULL != (dirList = dirListBuf), AEE_EBADPARM);
 
+  switch (apps_std_path_cache_lookup(&query, dirList, delim,
+                                     SUBSYSTEM_NAME[domain], name, mode,
+                                     &absName)) {
+  case APPS_STD_PATH_MISSING:
+    errno = nErr = ENOENT;
+    goto bail;
+  case APPS_STD_PATH_FOUND:
+    nErr = apps_std_fopen_fd(absName, mode, fd, len);
+    if (AEE_SUCCESS == nErr) {
+      FARF(RUNTIME_RPC_HIGH, "Opened cached path %s", absName);
+      goto bail;
+    }
+    // Stale entry, search again
+    apps_std_path_cache_remove(&query);
+    FREEIF(absName);
+    nErr = ENOENT;
+    break;
+  default:
+    break;
+  }
+
   while (dirList) {
     pos = strstr(dirList, delim);
     dirName = dirList;
@@ -1192,6 +1441,7 @@ __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fopen_with_env_fd)(
       dirList = 0;
     }
 
+    apps_std_path_cache_watch(&query, dirName, SUBSYSTEM_NAME[domain]);
     // Append domain to path
     absNameLen =
         strlen(dirName) + strlen(name) + 2 + strlen("adsp") + 1;
@@ -1210,6 +1460,7 @@ __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fopen_with_env_fd)(
     err = apps_std_fopen_fd(absName, mode, fd, len);
     if (AEE_SUCCESS == err) {
       // Success
+      apps_std_path_cache_add(&query, absName);
       FARF(ALWAYS, "Successfully opened file %s", absName);
       goto bail;
     }
@@ -1238,6 +1489,7 @@ __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fopen_with_env_fd)(
     err = apps_std_fopen_fd(absName, mode, fd, len);
     if (AEE_SUCCESS == err) {
       // Success
+      apps_std_path_cache_add(&query, absName);
       FARF(ALWAYS, "Successfully opened file %s", absName);
       nErr = err;
       goto bail;
@@ -1257,7 +1509,11 @@ __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fopen_with_env_fd)(
    */
   if (err == ENOENT && (nErr == ENOENT || nErr == AEE_SUCCESS))
     nErr = err;
+  if (nErr == ENOENT) {
+    apps_std_path_cache_add(&query, NULL);
+  }
 bail:
+  apps_std_path_cache_end(&query);
   if (nErr != AEE_SUCCESS) {
     if (ERRNO != ENOENT ||
         (name != NULL &&
@@ -1498,6 +1754,18 @@ bail:
   return nErr;
 }
 
+int apps_std_fstat_internal(apps_std_FILE sin, struct stat *st) {
+  int fd, nErr = AEE_SUCCESS;
+  struct apps_std_info *sinfo = 0;
+
+  VERIFY(0 == (nErr = apps_std_FILE_get(sin, &sinfo)));
+  VERIFYC(sinfo->type == APPS_STD_STREAM_FILE, EBADF);
+  VERIFYC(-1 != (fd = fileno(sinfo->u.stream)), ERRNO);
+  VERIFYC(0 == fstat(fd, st), ERRNO);
+bail:
+  return nErr;
+}
+
 __QAIC_IMPL_EXPORT int __QAIC_IMPL(apps_std_fdopen_decrypt)(
     apps_std_FILE sin, apps_std_FILE *psout) __QAIC_IMPL_ATTRIBUTE {
   int fd, nErr = AEE_SUCCESS;
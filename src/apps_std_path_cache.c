@@ -0,0 +1,374 @@
+// Copyright (c) 2024, Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef VERIFY_PRINT_ERROR
+#define VERIFY_PRINT_ERROR
+#endif // VERIFY_PRINT_ERROR
+#define FARF_ERROR 1
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "AEEStdErr.h"
+#include "HAP_farf.h"
+#include "apps_std_path_cache.h"
+#include "uthash.h"
+#include "verify.h"
+
+/* Changes of a search directory that can change where a file resolves */
+#define PATH_CACHE_WATCH_MASK                                                  \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |           \
+   IN_DELETE_SELF | IN_MOVE_SELF)
+/* All entries are dropped when the cache grows beyond this */
+#define PATH_CACHE_MAX_ENTRIES 512
+#define PATH_CACHE_EVENT_BUF_LEN                                               \
+  (64 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+/* Separates the fields of a key, not expected in paths or names */
+#define PATH_CACHE_KEY_SEP "\x1f"
+
+struct path_cache_entry {
+  char *key;
+  char *path; // NULL if the file is in no directory
+  UT_hash_handle hh;
+};
+
+static struct {
+  pthread_mutex_t mut;
+  struct path_cache_entry *tbl;
+  unsigned int count;
+  _Atomic uint32_t gen; // bumped whenever entries are dropped
+  int inotify_fd;
+  int event_fd;
+  pthread_t thread;
+  bool started;
+  bool failed; // watching is not possible, nothing is cached
+} pcache = {
+    .inotify_fd = -1,
+    .event_fd = -1,
+};
+
+// Called with pcache.mut held
+static void path_cache_flush_locked(void) {
+  struct path_cache_entry *e = NULL, *tmp = NULL;
+
+  HASH_ITER(hh, pcache.tbl, e, tmp) {
+    HASH_DEL(pcache.tbl, e);
+    free(e->key);
+    free(e->path);
+    free(e);
+  }
+  pcache.count = 0;
+  atomic_fetch_add(&pcache.gen, 1);
+}
+
+static void *path_cache_watcher_thread(void *arg) {
+  char buf[PATH_CACHE_EVENT_BUF_LEN]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct pollfd pfd[] = {
+      {.fd = pcache.inotify_fd, .events = POLLIN},
+      {.fd = pcache.event_fd, .events = POLLIN},
+  };
+  ssize_t len = 0;
+
+  (void)arg;
+  while (1) {
+    if (poll(pfd, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      FARF(ERROR, "Error: %s: poll failed (errno %s), dropping path cache",
+           __func__, strerror(errno));
+      break;
+    }
+    if (pfd[1].revents & POLLIN) {
+      return NULL;
+    }
+    // Any change drops all entries, drain the events first
+    do {
+      len = read(pcache.inotify_fd, buf, sizeof(buf));
+    } while (len > 0);
+    pthread_mutex_lock(&pcache.mut);
+    FARF(RUNTIME_RPC_HIGH, "%s: search directory changed, dropping %u entries",
+         __func__, pcache.count);
+    path_cache_flush_locked();
+    pthread_mutex_unlock(&pcache.mut);
+  }
+  // Entries can no longer be trusted
+  pthread_mutex_lock(&pcache.mut);
+  pcache.failed = true;
+  path_cache_flush_locked();
+  pthread_mutex_unlock(&pcache.mut);
+  return NULL;
+}
+
+// Called with pcache.mut held
+static int path_cache_start_locked(void) {
+  int nErr = AEE_SUCCESS;
+
+  if (pcache.started || pcache.failed) {
+    return pcache.failed ? AEE_EUNSUPPORTED : AEE_SUCCESS;
+  }
+  VERIFYC(-1 != (pcache.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+          AEE_EFAILED);
+  VERIFYC(-1 != (pcache.event_fd = eventfd(0, EFD_CLOEXEC)), AEE_EFAILED);
+  VERIFYC(0 == pthread_create(&pcache.thread, NULL, path_cache_watcher_thread,
+                              NULL),
+          AEE_EFAILED);
+  pcache.started = true;
+bail:
+  if (nErr != AEE_SUCCESS) {
+    FARF(ERROR, "Error 0x%x: %s failed (errno %s), search paths not cached",
+         nErr, __func__, strerror(errno));
+    if (pcache.inotify_fd != -1) {
+      close(pcache.inotify_fd);
+      pcache.inotify_fd = -1;
+    }
+    if (pcache.event_fd != -1) {
+      close(pcache.event_fd);
+      pcache.event_fd = -1;
+    }
+    pcache.failed = true;
+  }
+  return nErr;
+}
+
+// Returns true if a directory of a search path is relative or empty
+static bool path_cache_has_relative(const char *dirs, const char *delim) {
+  const char *p = dirs;
+
+  while (p) {
+    if (*p != '/') {
+      return true;
+    }
+    if ((p = strstr(p, delim))) {
+      p += strlen(delim);
+    }
+  }
+  return false;
+}
+
+enum apps_std_path_state
+apps_std_path_cache_lookup(struct apps_std_path_query *q, const char *dirs,
+                           const char *delim, const char *subsys,
+                           const char *name, const char *mode, char **path) {
+  struct path_cache_entry *e = NULL;
+  enum apps_std_path_state state = APPS_STD_PATH_UNKNOWN;
+  char cwd_id[2 * sizeof(unsigned long long) * 2 + 2] = "";
+  struct stat st;
+  int len = 0;
+
+  memset(q, 0, sizeof(*q));
+  *path = NULL;
+  // Files in subdirectories of the search directories are not watched
+  if (pcache.failed || strchr(name, '/')) {
+    return state;
+  }
+  // Working directories are told apart without resolving their path
+  if (path_cache_has_relative(dirs, delim)) {
+    if (stat(".", &st)) {
+      return state;
+    }
+    q->cwd_dev = st.st_dev;
+    q->cwd_ino = st.st_ino;
+    snprintf(cwd_id, sizeof(cwd_id), "%llx:%llx",
+             (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+  }
+  len = snprintf(NULL, 0, "%s" PATH_CACHE_KEY_SEP "%s" PATH_CACHE_KEY_SEP
+                 "%s" PATH_CACHE_KEY_SEP "%s" PATH_CACHE_KEY_SEP "%s"
+                 PATH_CACHE_KEY_SEP "%s",
+                 mode, subsys, name, delim, dirs, cwd_id);
+  if (NULL == (q->key = malloc(len + 1))) {
+    return state;
+  }
+  snprintf(q->key, len + 1, "%s" PATH_CACHE_KEY_SEP "%s" PATH_CACHE_KEY_SEP
+           "%s" PATH_CACHE_KEY_SEP "%s" PATH_CACHE_KEY_SEP "%s"
+           PATH_CACHE_KEY_SEP "%s",
+           mode, subsys, name, delim, dirs, cwd_id);
+  q->cacheable = true;
+  pthread_mutex_lock(&pcache.mut);
+  q->gen = atomic_load(&pcache.gen);
+  HASH_FIND_STR(pcache.tbl, q->key, e);
+  if (e && !e->path) {
+    state = APPS_STD_PATH_MISSING;
+  } else if (e && NULL != (*path = strdup(e->path))) {
+    state = APPS_STD_PATH_FOUND;
+  }
+  pthread_mutex_unlock(&pcache.mut);
+  return state;
+}
+
+/*
+ * Watches a directory, or its nearest existing ancestor if it is missing,
+ * which sees the directory being created
+ */
+static int path_cache_add_watch(int fd, const char *dir) {
+  char path[PATH_MAX];
+  char *slash = NULL;
+
+  if (snprintf(path, sizeof(path), "%s", dir) >= (int)sizeof(path)) {
+    return -1;
+  }
+  while (inotify_add_watch(fd, path, PATH_CACHE_WATCH_MASK) < 0) {
+    if ((errno != ENOENT && errno != ENOTDIR) ||
+        NULL == (slash = strrchr(path, '/'))) {
+      return -1;
+    }
+    if (slash == path) {
+      // Parent is the root directory
+      slash++;
+      if (!*slash) {
+        return -1;
+      }
+    }
+    *slash = '\0';
+  }
+  return 0;
+}
+
+/*
+ * Gets the path of the working directory of a query, which must still be
+ * the one it was looked up in
+ */
+static int path_cache_resolve_cwd(struct apps_std_path_query *q) {
+  struct stat st;
+
+  if (q->cwd) {
+    return 0;
+  }
+  if (NULL == (q->cwd = getcwd(NULL, 0))) {
+    return -1;
+  }
+  if (stat(q->cwd, &st) || st.st_dev != q->cwd_dev ||
+      st.st_ino != q->cwd_ino) {
+    return -1;
+  }
+  return 0;
+}
+
+void apps_std_path_cache_watch(struct apps_std_path_query *q, const char *dir,
+                               const char *subsys) {
+  char absdir[PATH_MAX], subdir[PATH_MAX];
+  int fd = -1;
+
+  if (!q->cacheable) {
+    return;
+  }
+  if (dir[0] != '/') {
+    if (path_cache_resolve_cwd(q) ||
+        snprintf(absdir, sizeof(absdir), "%s%s%s", q->cwd, dir[0] ? "/" : "",
+                 dir) >= (int)sizeof(absdir)) {
+      q->cacheable = false;
+      return;
+    }
+    dir = absdir;
+  }
+  pthread_mutex_lock(&pcache.mut);
+  if (AEE_SUCCESS == path_cache_start_locked()) {
+    fd = pcache.inotify_fd;
+  }
+  pthread_mutex_unlock(&pcache.mut);
+  if (fd == -1 ||
+      snprintf(subdir, sizeof(subdir), "%s/%s", dir, subsys) >=
+          (int)sizeof(subdir) ||
+      path_cache_add_watch(fd, dir) || path_cache_add_watch(fd, subdir)) {
+    q->cacheable = false;
+  }
+}
+
+void apps_std_path_cache_add(struct apps_std_path_query *q, const char *path) {
+  struct path_cache_entry *e = NULL;
+
+  if (!q->cacheable || !q->key) {
+    return;
+  }
+  pthread_mutex_lock(&pcache.mut);
+  // A directory changed during the search
+  if (!pcache.started || q->gen != atomic_load(&pcache.gen)) {
+    goto bail;
+  }
+  HASH_FIND_STR(pcache.tbl, q->key, e);
+  if (e) {
+    e = NULL;
+    goto bail;
+  }
+  if (pcache.count >= PATH_CACHE_MAX_ENTRIES) {
+    path_cache_flush_locked();
+    goto bail;
+  }
+  if (NULL == (e = calloc(1, sizeof(*e))) ||
+      (path && NULL == (e->path = strdup(path)))) {
+    goto bail;
+  }
+  e->key = q->key;
+  q->key = NULL;
+  HASH_ADD_KEYPTR(hh, pcache.tbl, e->key, strlen(e->key), e);
+  pcache.count++;
+  e = NULL;
+bail:
+  pthread_mutex_unlock(&pcache.mut);
+  if (e) {
+    free(e->path);
+    free(e);
+  }
+}
+
+void apps_std_path_cache_remove(struct apps_std_path_query *q) {
+  struct path_cache_entry *e = NULL;
+
+  if (!q->key) {
+    return;
+  }
+  pthread_mutex_lock(&pcache.mut);
+  HASH_FIND_STR(pcache.tbl, q->key, e);
+  if (e) {
+    HASH_DEL(pcache.tbl, e);
+    pcache.count--;
+  }
+  pthread_mutex_unlock(&pcache.mut);
+  if (e) {
+    free(e->key);
+    free(e->path);
+    free(e);
+  }
+}
+
+void apps_std_path_cache_end(struct apps_std_path_query *q) {
+  free(q->key);
+  free(q->cwd);
+  q->key = q->cwd = NULL;
+}
+
+int apps_std_path_cache_init(void) {
+  pthread_mutex_init(&pcache.mut, 0);
+  return AEE_SUCCESS;
+}
+
+void apps_std_path_cache_deinit(void) {
+  uint64_t exit = 1;
+
+  if (pcache.started) {
+    if (write(pcache.event_fd, &exit, sizeof(exit)) == sizeof(exit)) {
+      pthread_join(pcache.thread, NULL);
+    } else {
+      pthread_detach(pcache.thread);
+    }
+    close(pcache.inotify_fd);
+    close(pcache.event_fd);
+    pcache.inotify_fd = pcache.event_fd = -1;
+    pcache.started = false;
+  }
+  pthread_mutex_lock(&pcache.mut);
+  path_cache_flush_locked();
+  pthread_mutex_unlock(&pcache.mut);
+  pthread_mutex_destroy(&pcache.mut);
+}
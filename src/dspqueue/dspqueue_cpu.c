@@ -37,6 +37,7 @@
 #include <rpcmem_internal.h>
 #include <stdatomic.h>
 #include <stdlib.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
 struct dspqueue {
@@ -73,7 +74,31 @@ struct dspqueue {
   uint32_t queue_count;
   int have_wait_counts;
   int have_driver_signaling;
+  int have_dirty_bitmap; // DSPQUEUE_HEADER_FLAG_DIRTY_BITMAP
   pthread_t error_callback_thread;
+  int poll;             // DSPQUEUE_CREATE_FLAG_POLL
+  uint32_t poll_budget; // Current spin budget in microseconds
+  uint32_t poll_hits;
+  uint32_t poll_misses;
+  // Packet written in place with dspqueue_write_reserve(), protected by mutex.
+  // Packets written after it stay unpublished until it is committed.
+  int write_reserved;
+  int write_reserved_waiters; // Blocking reservations waiting on space_cond
+  uint32_t write_tail;        // Write position after the last packet written
+  uint32_t write_unpublished; // Packets written after the reserved one
+  void *reserve_message;
+  uint32_t reserve_message_length;
+  struct dspqueue_buffer *reserve_buffers; // Unreferenced if dropped
+  uint32_t reserve_num_buffers;
+  // Packet read in place with dspqueue_read_acquire(), protected by mutex.
+  // Packets read after it are only consumed once it is released.
+  int read_acquired;
+  int read_acquired_waiters; // Blocking acquires waiting on packet_cond
+  uint32_t read_tail;        // Read position after the last packet read
+  uint32_t read_unconsumed;  // Packets read after the acquired one
+  // Eventfd from dspqueue_get_eventfd(), -1 until requested. Created under
+  // mutex, written by the receive signal thread
+  _Atomic int event_fd;
 };
 
 struct dspqueue_domain_queues {
@@ -83,6 +108,9 @@ struct dspqueue_domain_queues {
       queue_list_mutex; // Hold this to manipulate queues[] or max_queue
   unsigned max_queue;
   struct dspqueue *queues[DSPQUEUE_MAX_PROCESS_QUEUES];
+  // Queues without a dirty bitmap, always checked on a signal. Protected by
+  // queue_list_mutex
+  uint64_t legacy_queues[DSPQUEUE_DIRTY_WORDS];
   struct dspqueue_process_queue_state *state;
   int state_fd;
   remote_handle64 dsp_handle;
@@ -118,6 +146,7 @@ struct dspqueue_process_queues {
   struct dspqueue_domain_queues *domain_queues[NUM_DOMAINS_EXTEND];
   uint32_t count;
   int notif_registered[NUM_DOMAINS_EXTEND];
+  uint32_t poll_max_us; // Upper bound of the polling budget
 };
 
 static struct dspqueue_process_queues proc_queues;
@@ -127,6 +156,16 @@ static pthread_once_t queues_once = PTHREAD_ONCE_INIT;
 static void *dspqueue_send_signal_thread(void *arg);
 static void *dspqueue_receive_signal_thread(void *arg);
 static void *dspqueue_packet_callback_thread(void *arg);
+static uint64_t get_time_usec(uint64_t *t);
+static int dspqueue_multidomain_write(struct dspqueue *q, uint32_t flags,
+	uint32_t num_buffers, struct dspqueue_buffer *buffers,
+	uint32_t message_length, const uint8_t *message,
+	uint32_t timeout_us, bool block);
+static int dspqueue_multidomain_write_until(struct dspqueue *q, uint32_t flags,
+	uint32_t num_buffers, struct dspqueue_buffer *buffers,
+	uint32_t message_length, const uint8_t *message,
+	uint32_t timeout_us, struct timespec *timeout_ts, bool block);
+static void timespec_add_us(struct timespec *ts, uint32_t us);
 
 #define QUEUE_CACHE_ALIGN 256
 #define CACHE_ALIGN_SIZE(x)                                                    \
@@ -149,10 +188,44 @@ static void *dspqueue_packet_callback_thread(void *arg);
 #define cache_invalidate(a, l)
 #define cache_flush_invalidate(a, l)
 
+// Sets the bit of a queue in a dirty bitmap of the process queue state
+static inline void set_dirty(uint64_t *bitmap, unsigned id) {
+  _Atomic uint64_t *word = (_Atomic uint64_t *)&bitmap[id / 64];
+
+  atomic_fetch_or(word, 1ULL << (id % 64));
+  cache_flush_word(word);
+}
+
 #define DEFAULT_EARLY_WAKEUP_WAIT 1000
 #define MAX_EARLY_WAKEUP_WAIT 2500
 #define EARLY_WAKEUP_SLEEP 100
 
+// Polling: the budget never drops below 1/POLL_MIN_DIV of the maximum so
+// that a queue whose responses got faster can grow it back
+#define POLL_MIN_DIV 16
+// Spins between clock reads
+#define POLL_CLOCK_INTERVAL 64
+#if defined(__aarch64__) || defined(__ARM_ARCH)
+#define cpu_relax() __asm__ __volatile__("yield" : : : "memory")
+#elif defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax()
+#endif
+
+// Makes the queue eventfd readable, if one was requested
+static inline void signal_eventfd(struct dspqueue *q) {
+  int fd = atomic_load(&q->event_fd);
+  uint64_t one = 1;
+
+  // A full counter (EAGAIN) is still readable
+  if ((fd != -1) && (write(fd, &one, sizeof(one)) != sizeof(one)) &&
+      (errno != EAGAIN)) {
+    FARF(ERROR, "Error: %s: eventfd write for queue %u failed (errno %s)",
+         __func__, q->id, strerror(errno));
+  }
+}
+
 // Signal ID to match a specific queue signal
 #define QUEUE_SIGNAL(queue_id, signal_no)                                      \
   ((DSPQUEUE_NUM_SIGNALS * queue_id) + signal_no + DSPSIGNAL_DSPQUEUE_MIN)
@@ -172,6 +245,11 @@ static void init_process_queues_once(void) {
     return;
   }
   queues->count = 1; // Start non-zero to help spot certain errors
+  // Spinning only delays the thread that delivers the packet on a single CPU
+  queues->poll_max_us =
+      (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? DSPQUEUE_DEFAULT_POLL_US : 0;
+  if (getenv("DSPQUEUE_POLL_MAX_US"))
+    queues->poll_max_us = (uint32_t)atoi(getenv("DSPQUEUE_POLL_MAX_US"));
 }
 
 // Dynamically initialize process queue structure. This allocates memory and
@@ -515,7 +593,7 @@ AEEResult dspqueue_create(int domain, uint32_t flags, uint32_t req_queue_size,
   dq->queues[id] = INVALID_QUEUE;
   pthread_mutex_unlock(&dq->queue_list_mutex);
 
-  VERIFYC(flags == 0, AEE_EBADPARM);
+  VERIFYC((flags & DSPQUEUE_CREATE_FLAG_RESERVED_ZERO) == 0, AEE_EBADPARM);
 
   // Check queue size limits
   VERIFYC(req_queue_size <= DSPQUEUE_MAX_QUEUE_SIZE, AEE_EBADPARM);
@@ -523,11 +601,16 @@ AEEResult dspqueue_create(int domain, uint32_t flags, uint32_t req_queue_size,
 
   // Allocate internal queue structure
   VERIFYC((q = calloc(1, sizeof(*q))) != NULL, AEE_ENOMEMORY);
+  q->event_fd = -1;
   VERIFY((nErr = pthread_mutex_init(&q->mutex, NULL)) == 0);
   mutex_init = 1;
   q->packet_callback = packet_callback;
   q->error_callback = error_callback;
   q->callback_context = callback_context;
+  if ((flags & DSPQUEUE_CREATE_FLAG_POLL) && queues->poll_max_us) {
+    q->poll = 1;
+    q->poll_budget = queues->poll_max_us;
+  }
   q->id = id;
   q->domain = domain;
 
@@ -620,10 +703,25 @@ AEEResult dspqueue_create(int domain, uint32_t flags, uint32_t req_queue_size,
     q->header->flags = DSPQUEUE_HEADER_FLAG_WAIT_COUNTS;
     if (q->have_driver_signaling) {
       q->header->flags |= DSPQUEUE_HEADER_FLAG_DRIVER_SIGNALING;
+    } else {
+      // Dirty bitmaps only matter to FastRPC signaling. DSP images that
+      // predate them fail the create on the unexpected flag, retry without.
+      q->header->flags |= DSPQUEUE_HEADER_FLAG_DIRTY_BITMAP;
+      nErr = dspqueue_rpc_create_queue(dq->dsp_handle, q->id, q->user_queue_fd,
+                                       queue_count, &q->dsp_id);
+      if (nErr == AEE_SUCCESS) {
+        q->have_dirty_bitmap = 1;
+      } else {
+        FARF(HIGH, "Queue create with dirty bitmap failed with 0x%x, retry "
+                   "without", nErr);
+        q->header->flags &= ~DSPQUEUE_HEADER_FLAG_DIRTY_BITMAP;
+      }
+    }
+    if (!q->have_dirty_bitmap) {
+      VERIFY((nErr = dspqueue_rpc_create_queue(dq->dsp_handle, q->id,
+                                               q->user_queue_fd, queue_count,
+                                               &q->dsp_id)) == 0);
     }
-    VERIFY((nErr = dspqueue_rpc_create_queue(dq->dsp_handle, q->id,
-                                             q->user_queue_fd, queue_count,
-                                             &q->dsp_id)) == 0);
     q->have_wait_counts = 1;
     // Note that we expect the DSP will support both wait counts and driver
     // signaling or neither. However we can operate with wait counts only in
@@ -671,6 +769,9 @@ AEEResult dspqueue_create(int domain, uint32_t flags, uint32_t req_queue_size,
   *queue = q;
   pthread_mutex_lock(&dq->queue_list_mutex);
   dq->queues[id] = q;
+  if (!q->have_dirty_bitmap) {
+    dq->legacy_queues[id / 64] |= 1ULL << (id % 64);
+  }
   pthread_mutex_unlock(&dq->queue_list_mutex);
   FARF(ALWAYS, "%s: created Queue %u, %p, DSP 0x%08x for domain %d", __func__,
        q->id, q, (unsigned)q->dsp_id, q->domain);
@@ -843,6 +944,7 @@ AEEResult dspqueue_close(dspqueue_t queue) {
 
   pthread_mutex_lock(&dq->queue_list_mutex);
   dq->queues[q->id] = INVALID_QUEUE;
+  dq->legacy_queues[q->id / 64] &= ~(1ULL << (q->id % 64));
   pthread_mutex_unlock(&dq->queue_list_mutex);
 
   if (q->error_callback_thread) {
@@ -874,16 +976,16 @@ AEEResult dspqueue_close(dspqueue_t queue) {
         }
       }
     }
-  } else {
-    pthread_mutex_lock(&q->packet_mutex);
-    q->packet_mask |= SIGNAL_BIT_CANCEL;
-    pthread_cond_broadcast(&q->packet_cond);
-    pthread_mutex_unlock(&q->packet_mutex);
-    pthread_mutex_lock(&q->space_mutex);
-    q->space_mask |= SIGNAL_BIT_CANCEL;
-    pthread_cond_broadcast(&q->space_cond);
-    pthread_mutex_unlock(&q->space_mutex);
   }
+  // Also wakes up the calls waiting for an in-place packet, with either
+  pthread_mutex_lock(&q->packet_mutex);
+  q->packet_mask |= SIGNAL_BIT_CANCEL;
+  pthread_cond_broadcast(&q->packet_cond);
+  pthread_mutex_unlock(&q->packet_mutex);
+  pthread_mutex_lock(&q->space_mutex);
+  q->space_mask |= SIGNAL_BIT_CANCEL;
+  pthread_cond_broadcast(&q->space_cond);
+  pthread_mutex_unlock(&q->space_mutex);
 
   if (q->packet_callback) {
     void *ret;
@@ -936,6 +1038,9 @@ AEEResult dspqueue_close(dspqueue_t queue) {
   pthread_mutex_destroy(&q->packet_mutex);
   pthread_mutex_destroy(&q->space_mutex);
   pthread_mutex_destroy(&q->mutex);
+  if (q->event_fd != -1) {
+    close(q->event_fd);
+  }
 
   pthread_mutex_lock(&dq->queue_list_mutex);
   dq->queues[q->id] = UNUSED_QUEUE;
@@ -1122,6 +1227,26 @@ static void get_queue_state_write(void *memory,
   }
 }
 
+/*
+ * Gets the space left in the request queue and the position to write the
+ * next packet at. Packets written behind a reserved packet are not published
+ * yet, so they are written after the last of them. Must hold q->mutex.
+ */
+static void get_write_pos_locked(struct dspqueue *q, uint32_t *space_left,
+                                 uint32_t *write_pos) {
+
+  uint32_t qsize = q->header->req_queue.queue_length;
+  uint32_t w, qleft;
+
+  get_queue_state_write(q->header, &q->header->req_queue, &qleft, NULL, &w);
+  if (q->write_reserved) {
+    qleft -= (q->write_tail + qsize - w) % qsize;
+    w = q->write_tail;
+  }
+  *space_left = qleft;
+  *write_pos = w;
+}
+
 static void get_queue_state_read(void *memory,
                                  struct dspqueue_packet_queue_header *pq,
                                  uint32_t *data_left, uint32_t *read_pos,
@@ -1160,6 +1285,26 @@ static void get_queue_state_read(void *memory,
   }
 }
 
+/*
+ * Gets the data left in the response queue and the position to read the
+ * next packet from. Packets read behind an acquired packet are not consumed
+ * yet, so the next one is after the last of them. Must hold q->mutex.
+ */
+static void get_read_pos_locked(struct dspqueue *q, uint32_t *data_left,
+                                uint32_t *read_pos) {
+
+  uint32_t qsize = q->header->resp_queue.queue_length;
+  uint32_t r, qleft;
+
+  get_queue_state_read(q->header, &q->header->resp_queue, &qleft, &r, NULL);
+  if (q->read_acquired) {
+    qleft -= (q->read_tail + qsize - r) % qsize;
+    r = q->read_tail;
+  }
+  *data_left = qleft;
+  *read_pos = r;
+}
+
 static inline uint32_t write_64(volatile uint8_t *packet_queue,
                                 uint32_t write_pos, uint32_t queue_len,
                                 uint64_t data) {
@@ -1321,96 +1466,98 @@ bail:
   return nErr;
 }
 
-/* Write packet to multi-domain queue */
-static int dspqueue_multidomain_write(struct dspqueue *q, uint32_t flags,
-	uint32_t num_buffers, struct dspqueue_buffer *buffers,
-	uint32_t message_length, const uint8_t *message,
-	uint32_t timeout_us, bool block) {
-	int nErr = AEE_SUCCESS;
-	struct dspqueue_multidomain *mdq = NULL;
-	bool locked = false;
+/*
+ * Waits until the packet another thread reserved or acquired in place on the
+ * queue is committed or released, for blocking reservations and acquires that
+ * got AEE_EITEMBUSY. busy and waiters are q->write_reserved and
+ * q->write_reserved_waiters with space_mutex/space_cond held, or
+ * q->read_acquired and q->read_acquired_waiters with packet_mutex/packet_cond.
+ * The appropriate mutex must be locked.
+ */
+static AEEResult wait_in_place_locked(struct dspqueue *q, const int *busy,
+                                      int *waiters, pthread_mutex_t *mutex,
+                                      pthread_cond_t *cond,
+                                      const uint32_t *mask,
+                                      struct timespec *timeout) {
 
-	VERIFYC(q, AEE_EBADPARM);
+  int rc = 0;
 
-	mdq = &q->mdq;
-	VERIFYC(mdq->is_mdq, AEE_EINVALIDITEM);
+  pthread_mutex_lock(&q->mutex);
+  while (*busy && rc == 0) {
+    if (*mask & SIGNAL_BIT_CANCEL) {
+      pthread_mutex_unlock(&q->mutex);
+      return AEE_EINTERRUPTED;
+    }
+    // Checked under q->mutex, the commit or release then signals cond
+    (*waiters)++;
+    pthread_mutex_unlock(&q->mutex);
+    if (timeout) {
+      rc = pthread_cond_timedwait(cond, mutex, timeout);
+    } else {
+      pthread_cond_wait(cond, mutex);
+    }
+    pthread_mutex_lock(&q->mutex);
+    (*waiters)--;
+  }
+  pthread_mutex_unlock(&q->mutex);
+  return rc == ETIMEDOUT ? AEE_EEXPIRED : (rc ? AEE_EFAILED : AEE_SUCCESS);
+}
 
-	// Only one multi-domain write request at a time.
-	pthread_mutex_lock(&q->mutex);
-	locked = true;
+/* Wakes up the calls waiting in wait_in_place_locked(), if any */
+static void wake_in_place_waiters(int waiters, pthread_mutex_t *mutex,
+                                  pthread_cond_t *cond) {
+  if (waiters) {
+    pthread_mutex_lock(mutex);
+    pthread_cond_broadcast(cond);
+    pthread_mutex_unlock(mutex);
+  }
+}
 
-	// Write packet to individual queues
-	for (unsigned int ii = 0; ii < mdq->num_domain_ids; ii++) {
-		if (block) {
-			/*
-			 * Multi-domain blocking write operation will serially block
-			 * on each individual queue.
-			 */
-			VERIFY(AEE_SUCCESS == (nErr = dspqueue_write(mdq->queues[ii],
-				flags, num_buffers, buffers, message_length, message,
-				timeout_us)));
-		} else {
-			VERIFY(AEE_SUCCESS == (nErr = dspqueue_write_noblock(
-				mdq->queues[ii], flags, num_buffers, buffers,
-				message_length, message)));
-		}
-	}
-bail:
-	if (locked)
-		pthread_mutex_unlock(&q->mutex);
+/* Undoes the reference changes write_packet_locked() made to buffers */
+static void unref_buffers(struct dspqueue *q, struct dspqueue_buffer *buffers,
+                          uint32_t num_buffers) {
+  uint32_t i;
 
-	if (nErr) {
-		/*
-		 * If multi-domain write operation failed on some but not all
-		 * queues, then the MDQ is now in an irrecoverable bad-state as
-		 * the packet was partially written to some domains but not all
-		 * and it cannot be "erased". Client is expected to close queue.
-		 */
-		nErr = AEE_EBADSTATE;
-		FARF(ERROR, "Error 0x%x: %s (block %d): failed for queue %p, flags 0x%x, num bufs %u, msg len %u, timeout %u",
-			nErr, __func__, block, q, flags, num_buffers,
-			message_length, timeout_us);
-	}
-	return nErr;
+  for (i = 0; i < num_buffers; i++) {
+    struct dspqueue_buffer *b = &buffers[i];
+    if (b->flags & DSPQUEUE_BUFFER_FLAG_REF) {
+      fastrpc_buffer_ref(q->domain, b->fd, -1, NULL, NULL);
+    } else if (b->flags & DSPQUEUE_BUFFER_FLAG_DEREF) {
+      fastrpc_buffer_ref(q->domain, b->fd, 1, NULL, NULL);
+    }
+  }
 }
 
-AEEResult dspqueue_write_noblock(dspqueue_t queue, uint32_t flags,
-                                 uint32_t num_buffers,
-                                 struct dspqueue_buffer *buffers,
-                                 uint32_t message_length,
-                                 const uint8_t *message) {
+/*
+ * Writes a packet to the request queue at *write_pos without publishing it,
+ * taking the references of its buffers. *space_left is the space of the
+ * queue from *write_pos, both are advanced past the packet.
+ * If reserved is not NULL, the message is left for the caller to write at
+ * *reserved instead of being copied from message.
+ * Must hold q->mutex.
+ *
+ * Returns AEE_EWOULDBLOCK if the packet does not fit in the queue.
+ */
+static AEEResult write_packet_locked(struct dspqueue *q, uint32_t flags,
+                                     uint32_t num_buffers,
+                                     struct dspqueue_buffer *buffers,
+                                     uint32_t message_length,
+                                     const uint8_t *message,
+                                     uint8_t **reserved,
+                                     uint32_t *write_pos,
+                                     uint32_t *space_left) {
 
   AEEResult nErr = AEE_SUCCESS;
-  struct dspqueue *q = queue;
-  struct dspqueue_packet_queue_header *pq = NULL;
-  volatile uint8_t *qp = NULL;
-  struct dspqueue_packet_queue_state *read_state = NULL;
-  struct dspqueue_packet_queue_state *write_state = NULL;
-  struct dspqueue_domain_queues *dq = NULL;
+  struct dspqueue_packet_queue_header *pq = &q->header->req_queue;
+  volatile uint8_t *qp =
+      (volatile uint8_t *)(((uintptr_t)q->header) + pq->queue_offset);
   unsigned len, alen;
-  uint32_t r, w;
-  uint32_t qleft = 0, qsize = 0;
-  int locked = 0;
+  uint32_t w = *write_pos, qleft = *space_left, qsize = pq->queue_length;
   uint64_t phdr;
   int wrap = 0;
   uint32_t i;
   uint32_t buf_refs = 0;
 
-  if (q->mdq.is_mdq) {
-    // Recursively call 'dspqueue_write_noblock' on individual queues
-    return dspqueue_multidomain_write(q, flags, num_buffers, buffers,
-              message_length, message, 0, false);
-  }
-
-  pq = &q->header->req_queue;
-  qp = (volatile uint8_t*) (((uintptr_t)q->header) + pq->queue_offset);
-  read_state = (struct dspqueue_packet_queue_state*) (((uintptr_t)q->header)
-                        + pq->read_state_offset);
-  write_state = (struct dspqueue_packet_queue_state*) (((uintptr_t)q->header)
-                        + pq->write_state_offset);
-  dq = queues->domain_queues[q->domain];
-  qsize = pq->queue_length;
-
   // Check properties
   VERIFYC(num_buffers <= DSPQUEUE_MAX_BUFFERS, AEE_EBADPARM);
   VERIFYC(message_length <= DSPQUEUE_MAX_MESSAGE_SIZE, AEE_EBADPARM);
@@ -1424,7 +1571,7 @@ AEEResult dspqueue_write_noblock(dspqueue_t queue, uint32_t flags,
   }
   if (message_length > 0) {
     flags |= DSPQUEUE_PACKET_FLAG_MESSAGE;
-    VERIFYC(message != NULL, AEE_EBADPARM);
+    VERIFYC(message != NULL || reserved != NULL, AEE_EBADPARM);
   } else {
     flags &= ~DSPQUEUE_PACKET_FLAG_MESSAGE;
   }
@@ -1441,15 +1588,8 @@ AEEResult dspqueue_write_noblock(dspqueue_t queue, uint32_t flags,
     goto bail;
   }
 
-  pthread_mutex_lock(&q->mutex);
-  locked = 1;
-
-  VERIFYC(q->header->queue_count == q->queue_count, AEE_ERPC);
-
   // Check that we have space for the packet in the queue
-  get_queue_state_write(q->header, pq, &qleft, &r, &w);
   if (qleft < alen) {
-    pthread_mutex_unlock(&q->mutex);
     return AEE_EWOULDBLOCK;
   }
   if ((qsize - w) < alen) {
@@ -1457,10 +1597,11 @@ AEEResult dspqueue_write_noblock(dspqueue_t queue, uint32_t flags,
     // beginning, replicating the header
     wrap = 1;
     if ((qleft - (qsize - w)) < alen) {
-      pthread_mutex_unlock(&q->mutex);
       return AEE_EWOULDBLOCK;
     }
+    qleft -= qsize - w;
   }
+  qleft -= alen;
 
   // Go through buffers
   for (i = 0; i < num_buffers; i++) {
@@ -1518,23 +1659,59 @@ AEEResult dspqueue_write_noblock(dspqueue_t queue, uint32_t flags,
   }
 
   // Write message
-  if (message_length > 0) {
+  if (message_length > 0 && reserved != NULL) {
+    *reserved = (uint8_t *)((uintptr_t)qp + w);
+    w += (message_length + 7) & (~7);
+    if (w >= qsize) {
+      w = 0;
+    }
+  } else if (message_length > 0) {
     w = write_data(qp, w, qsize, message, message_length);
   }
 
-  // Update write pointer. This marks the message available in the user queue
-  q->write_packet_count++;
+  q->seq_no++;
+  *write_pos = w;
+  *space_left = qleft;
+  return 0;
+
+bail:
+  unref_buffers(q, buffers, buf_refs);
+  return nErr;
+}
+
+/*
+ * Makes the packets written up to write_pos available to the DSP and
+ * signals it if needed. Must hold q->mutex.
+ */
+static AEEResult publish_packets_locked(struct dspqueue *q, uint32_t write_pos,
+                                        uint32_t num_packets) {
+
+  AEEResult nErr = AEE_SUCCESS;
+  struct dspqueue_packet_queue_header *pq = &q->header->req_queue;
+  struct dspqueue_packet_queue_state *read_state =
+      (struct dspqueue_packet_queue_state *)(((uintptr_t)q->header) +
+                                             pq->read_state_offset);
+  struct dspqueue_packet_queue_state *write_state =
+      (struct dspqueue_packet_queue_state *)(((uintptr_t)q->header) +
+                                             pq->write_state_offset);
+  struct dspqueue_domain_queues *dq = queues->domain_queues[q->domain];
+
+  // Update write pointer. This marks the messages available in the user queue
+  q->write_packet_count += num_packets;
   barrier_store();
-  write_state->position = w;
+  write_state->position = write_pos;
   write_state->packet_count = q->write_packet_count;
   cache_flush_line(write_state);
 
-  // Signal that we've written a packet
-  q->req_packet_count++;
+  // Signal that we've written packets
+  q->req_packet_count += num_packets;
   dq->state->req_packet_count[q->id] = q->req_packet_count;
   FARF(LOW, "Queue %u req_packet_count %u", (unsigned)q->id,
        (unsigned)q->req_packet_count);
   cache_flush_word(&dq->state->req_packet_count[q->id]);
+  if (q->have_dirty_bitmap) {
+    set_dirty(dq->state->dsp_dirty, q->id);
+  }
   if (q->have_wait_counts) {
     // Only send a signal if the other end is potentially waiting
     barrier_full();
@@ -1549,23 +1726,64 @@ AEEResult dspqueue_write_noblock(dspqueue_t queue, uint32_t flags,
     FARF(MEDIUM, "%s: No wait counts - send signal", __func__);
     VERIFY((nErr = send_signal(q, DSPQUEUE_SIGNAL_REQ_PACKET)) == 0);
   }
+bail:
+  return nErr;
+}
 
-  q->seq_no++;
+/*
+ * Writes a packet to a queue, or with reserved not NULL reserves it for
+ * dspqueue_write_commit() and returns where to write the message.
+ * A packet written while another one is reserved is queued behind it and
+ * published with it, so the DSP still sees the packets in order.
+ *
+ * Returns AEE_EITEMBUSY if reserved is not NULL and a packet is already
+ * reserved.
+ */
+static AEEResult write_noblock(struct dspqueue *q, uint32_t flags,
+                               uint32_t num_buffers,
+                               struct dspqueue_buffer *buffers,
+                               uint32_t message_length, const uint8_t *message,
+                               uint8_t **reserved) {
 
-  pthread_mutex_unlock(&q->mutex);
-  locked = 0;
-  return 0;
+  AEEResult nErr = AEE_SUCCESS;
+  uint32_t w;
+  uint32_t qleft = 0;
+  int locked = 0;
 
-bail:
-  for (i = 0; i < buf_refs; i++) {
-    // Undo buffer reference changes
-    struct dspqueue_buffer *b = &buffers[i];
-    if (b->flags & DSPQUEUE_BUFFER_FLAG_REF) {
-      fastrpc_buffer_ref(q->domain, b->fd, -1, NULL, NULL);
-    } else if (b->flags & DSPQUEUE_BUFFER_FLAG_DEREF) {
-      fastrpc_buffer_ref(q->domain, b->fd, 1, NULL, NULL);
-    }
+  pthread_mutex_lock(&q->mutex);
+  locked = 1;
+
+  VERIFYC(q->header->queue_count == q->queue_count, AEE_ERPC);
+  if (reserved != NULL && q->write_reserved) {
+    pthread_mutex_unlock(&q->mutex);
+    return AEE_EITEMBUSY;
+  }
+
+  get_write_pos_locked(q, &qleft, &w);
+  nErr = write_packet_locked(q, flags, num_buffers, buffers, message_length,
+                             message, reserved, &w, &qleft);
+  if (nErr == AEE_EWOULDBLOCK) {
+    pthread_mutex_unlock(&q->mutex);
+    return nErr;
+  }
+  VERIFY(nErr == AEE_SUCCESS);
+  if (reserved != NULL) {
+    // Published by dspqueue_write_commit()
+    q->write_reserved = 1;
+    q->write_tail = w;
+    q->write_unpublished = 0;
+    q->reserve_message = message_length > 0 ? *reserved : NULL;
+    q->reserve_message_length = message_length;
+    q->reserve_buffers = buffers;
+    q->reserve_num_buffers = num_buffers;
+  } else if (q->write_reserved) {
+    q->write_tail = w;
+    q->write_unpublished++;
+  } else {
+    VERIFY(AEE_SUCCESS == (nErr = publish_packets_locked(q, w, 1)));
   }
+
+bail:
   if (locked) {
     pthread_mutex_unlock(&q->mutex);
   }
@@ -1573,106 +1791,543 @@ bail:
     FARF(ERROR,
          "Error 0x%x: %s failed for queue %p (flags 0x%x, num_buffers %u, "
          "message_length %u)",
-         nErr, __func__, queue, (unsigned)flags, (unsigned)num_buffers,
+         nErr, __func__, q, (unsigned)flags, (unsigned)num_buffers,
          (unsigned)message_length);
   }
   return nErr;
 }
 
-static void timespec_add_us(struct timespec *ts, uint32_t us) {
-  uint64_t ns = (uint64_t)ts->tv_nsec + (uint64_t)(1000 * (us % 1000000));
-  if (ns > 1000000000ULL) {
-    ts->tv_nsec = (long)(ns - 1000000000ULL);
-    ts->tv_sec += (us / 1000000) + 1;
-  } else {
-    ts->tv_nsec = ns;
-    ts->tv_sec += us / 1000000;
-  }
-}
-
-AEEResult dspqueue_write(dspqueue_t queue, uint32_t flags, uint32_t num_buffers,
-                         struct dspqueue_buffer *buffers,
-                         uint32_t message_length, const uint8_t *message,
-                         uint32_t timeout_us) {
+AEEResult dspqueue_write_noblock(dspqueue_t queue, uint32_t flags,
+                                 uint32_t num_buffers,
+                                 struct dspqueue_buffer *buffers,
+                                 uint32_t message_length,
+                                 const uint8_t *message) {
 
-  AEEResult nErr = AEE_SUCCESS;
   struct dspqueue *q = queue;
-  struct dspqueue_packet_queue_header *pq = NULL;
-  struct dspqueue_packet_queue_state *write_state = NULL;
-  _Atomic uint32_t *wait_count = NULL;
-  int waiting = 0;
-  struct timespec *timeout_ts = NULL; // no timeout by default
-  struct timespec ts;
 
-  errno = 0;
   if (q->mdq.is_mdq) {
-    // Recursively call 'dspqueue_write' on individual queues.
+    // Recursively call 'dspqueue_write_noblock' on individual queues
     return dspqueue_multidomain_write(q, flags, num_buffers, buffers,
-                    message_length, message, timeout_us, true);
+              message_length, message, 0, false);
   }
+  return write_noblock(q, flags, num_buffers, buffers, message_length, message,
+                       NULL);
+}
 
-  pq = &q->header->req_queue;
-  write_state = (struct dspqueue_packet_queue_state*)(((uintptr_t)q->header)
-                        + pq->write_state_offset);
-  wait_count = (_Atomic uint32_t*) &write_state->wait_count;
-
-  pthread_mutex_lock(&q->space_mutex);
-
-  // Try a write first before dealing with timeouts
-  nErr = dspqueue_write_noblock(queue, flags, num_buffers, buffers,
-                                message_length, message);
-  if (nErr != AEE_EWOULDBLOCK) {
-    // Write got through or failed permanently
-    goto bail;
-  }
+/*
+ * Writes a batch to a multi-domain queue packet by packet, blocking writes
+ * wait against one deadline for the whole batch
+ */
+static AEEResult dspqueue_multidomain_write_batch(
+    struct dspqueue *q, uint32_t num_packets, struct dspqueue_packet *packets,
+    uint32_t *num_written, uint32_t timeout_us, bool block) {
 
-  if (q->have_wait_counts) {
-    // Flag that we're potentially waiting and try again
-    atomic_fetch_add(wait_count, 1);
-    cache_flush_word(wait_count);
-    waiting = 1;
-    nErr = dspqueue_write_noblock(queue, flags, num_buffers, buffers,
-                                  message_length, message);
-    if (nErr != AEE_EWOULDBLOCK) {
-      goto bail;
-    }
-  }
+  AEEResult nErr = AEE_SUCCESS;
+  struct timespec *timeout_ts = NULL, ts;
+  uint32_t i = 0;
 
-  if (timeout_us != DSPQUEUE_TIMEOUT_NONE) {
-    // Calculate timeout expiry and use timeout
+  if (block && timeout_us != DSPQUEUE_TIMEOUT_NONE) {
     VERIFYC(clock_gettime(CLOCK_REALTIME, &ts) == 0, AEE_EFAILED);
     timespec_add_us(&ts, timeout_us);
     timeout_ts = &ts;
   }
+  for (i = 0; i < num_packets; i++) {
+    struct dspqueue_packet *p = &packets[i];
 
-  while (1) {
-    FARF(LOW, "Queue %u wait space", (unsigned)q->id);
-    VERIFY((nErr = wait_signal_locked(q, DSPQUEUE_SIGNAL_REQ_SPACE,
-                                      timeout_ts)) == 0);
-    FARF(LOW, "Queue %u got space", (unsigned)q->id);
-    nErr = dspqueue_write_noblock(queue, flags, num_buffers, buffers,
-                                  message_length, message);
-    if (nErr != AEE_EWOULDBLOCK) {
-      goto bail;
+    nErr = dspqueue_multidomain_write_until(q, p->flags, p->num_buffers,
+                                            p->buffers, p->message_length,
+                                            p->message, timeout_us, timeout_ts,
+                                            block);
+    if (nErr) {
+      break;
     }
   }
-
 bail:
-  if (waiting) {
-    atomic_fetch_sub(wait_count, 1);
-    cache_flush_word(wait_count);
+  if (num_written) {
+    *num_written = i;
+  }
+  return nErr;
+}
+
+AEEResult dspqueue_write_batch_noblock(dspqueue_t queue, uint32_t num_packets,
+                                       struct dspqueue_packet *packets,
+                                       uint32_t *num_written) {
+
+  AEEResult nErr = AEE_SUCCESS;
+  struct dspqueue *q = queue;
+  uint32_t w;
+  uint32_t qleft = 0;
+  uint32_t i = 0;
+  int locked = 0;
+
+  if (num_written) {
+    *num_written = 0;
+  }
+  VERIFYC(q, AEE_EBADPARM);
+  VERIFYC(num_packets == 0 || packets != NULL, AEE_EBADPARM);
+  if (q->mdq.is_mdq) {
+    return dspqueue_multidomain_write_batch(q, num_packets, packets,
+                                            num_written, 0, false);
+  }
+  if (num_packets == 0) {
+    return AEE_SUCCESS;
+  }
+
+  pthread_mutex_lock(&q->mutex);
+  locked = 1;
+
+  VERIFYC(q->header->queue_count == q->queue_count, AEE_ERPC);
+
+  get_write_pos_locked(q, &qleft, &w);
+  for (i = 0; i < num_packets; i++) {
+    struct dspqueue_packet *p = &packets[i];
+
+    nErr = write_packet_locked(q, p->flags, p->num_buffers, p->buffers,
+                               p->message_length, p->message, NULL, &w,
+                               &qleft);
+    if (nErr) {
+      break;
+    }
+  }
+  // Packets written before the queue filled up or a packet failed still go,
+  // after the reserved packet if there is one
+  if (i > 0 && q->write_reserved) {
+    q->write_tail = w;
+    q->write_unpublished += i;
+  } else if (i > 0) {
+    AEEResult pErr = publish_packets_locked(q, w, i);
+
+    if (pErr) {
+      nErr = pErr;
+    }
+  }
+  if (num_written) {
+    *num_written = i;
+  }
+  if (nErr == AEE_EWOULDBLOCK) {
+    pthread_mutex_unlock(&q->mutex);
+    return nErr;
+  }
+
+bail:
+  if (locked) {
+    pthread_mutex_unlock(&q->mutex);
   }
-  pthread_mutex_unlock(&q->space_mutex);
+  if (nErr != AEE_SUCCESS) {
+    FARF(ERROR,
+         "Error 0x%x: %s failed for queue %p at packet %u of %u",
+         nErr, __func__, queue, (unsigned)i, (unsigned)num_packets);
+  }
+  return nErr;
+}
+
+static void timespec_add_us(struct timespec *ts, uint32_t us) {
+  uint64_t ns = (uint64_t)ts->tv_nsec + (uint64_t)(1000 * (us % 1000000));
+  if (ns > 1000000000ULL) {
+    ts->tv_nsec = (long)(ns - 1000000000ULL);
+    ts->tv_sec += (us / 1000000) + 1;
+  } else {
+    ts->tv_nsec = ns;
+    ts->tv_sec += us / 1000000;
+  }
+}
+
+/*
+ * Blocking write_noblock(), waiting for space until timeout_ts or without a
+ * timeout if it is NULL
+ */
+static AEEResult write_block_until(struct dspqueue *q, uint32_t flags,
+                                   uint32_t num_buffers,
+                                   struct dspqueue_buffer *buffers,
+                                   uint32_t message_length,
+                                   const uint8_t *message, uint8_t **reserved,
+                                   struct timespec *timeout_ts) {
+
+  AEEResult nErr = AEE_SUCCESS;
+  struct dspqueue_packet_queue_header *pq = NULL;
+  struct dspqueue_packet_queue_state *write_state = NULL;
+  _Atomic uint32_t *wait_count = NULL;
+  int waiting = 0;
+
+  errno = 0;
+  pq = &q->header->req_queue;
+  write_state = (struct dspqueue_packet_queue_state*)(((uintptr_t)q->header)
+                        + pq->write_state_offset);
+  wait_count = (_Atomic uint32_t*) &write_state->wait_count;
+
+  pthread_mutex_lock(&q->space_mutex);
+
+  // Try a write first before dealing with timeouts. A reservation waits for
+  // the packet reserved by another thread like for space.
+  nErr = write_noblock(q, flags, num_buffers, buffers, message_length,
+                       message, reserved);
+  if (nErr != AEE_EWOULDBLOCK && nErr != AEE_EITEMBUSY) {
+    // Write got through or failed permanently
+    goto bail;
+  }
+
+  if (q->have_wait_counts && nErr == AEE_EWOULDBLOCK) {
+    // Flag that we're potentially waiting and try again
+    atomic_fetch_add(wait_count, 1);
+    cache_flush_word(wait_count);
+    waiting = 1;
+    nErr = write_noblock(q, flags, num_buffers, buffers, message_length,
+                         message, reserved);
+    if (nErr != AEE_EWOULDBLOCK && nErr != AEE_EITEMBUSY) {
+      goto bail;
+    }
+  }
+
+  while (1) {
+    if (nErr == AEE_EITEMBUSY) {
+      FARF(LOW, "Queue %u wait reserved packet", (unsigned)q->id);
+      VERIFY((nErr = wait_in_place_locked(q, &q->write_reserved,
+                                          &q->write_reserved_waiters,
+                                          &q->space_mutex, &q->space_cond,
+                                          &q->space_mask, timeout_ts)) == 0);
+    } else {
+      FARF(LOW, "Queue %u wait space", (unsigned)q->id);
+      VERIFY((nErr = wait_signal_locked(q, DSPQUEUE_SIGNAL_REQ_SPACE,
+                                        timeout_ts)) == 0);
+      FARF(LOW, "Queue %u got space", (unsigned)q->id);
+    }
+    nErr = write_noblock(q, flags, num_buffers, buffers, message_length,
+                         message, reserved);
+    if (nErr != AEE_EWOULDBLOCK && nErr != AEE_EITEMBUSY) {
+      goto bail;
+    }
+  }
+
+bail:
+  if (waiting) {
+    atomic_fetch_sub(wait_count, 1);
+    cache_flush_word(wait_count);
+  }
+  pthread_mutex_unlock(&q->space_mutex);
   if (nErr != AEE_SUCCESS) {
     FARF(ERROR,
          "Error 0x%x: %s failed for queue %p (flags 0x%x, num_buffers %u, "
          "message_length %u errno %s)",
-         nErr, __func__, queue, (unsigned)flags, (unsigned)num_buffers,
+         nErr, __func__, q, (unsigned)flags, (unsigned)num_buffers,
          (unsigned)message_length, strerror(errno));
   }
   return nErr;
 }
 
+/* Blocking write_noblock() */
+static AEEResult write_block(struct dspqueue *q, uint32_t flags,
+                             uint32_t num_buffers,
+                             struct dspqueue_buffer *buffers,
+                             uint32_t message_length, const uint8_t *message,
+                             uint8_t **reserved, uint32_t timeout_us) {
+
+  struct timespec *timeout_ts = NULL; // no timeout by default
+  struct timespec ts;
+
+  if (timeout_us != DSPQUEUE_TIMEOUT_NONE) {
+    // Calculate timeout expiry and use timeout
+    if (clock_gettime(CLOCK_REALTIME, &ts) != 0) {
+      return AEE_EFAILED;
+    }
+    timespec_add_us(&ts, timeout_us);
+    timeout_ts = &ts;
+  }
+  return write_block_until(q, flags, num_buffers, buffers, message_length,
+                           message, reserved, timeout_ts);
+}
+
+AEEResult dspqueue_write(dspqueue_t queue, uint32_t flags, uint32_t num_buffers,
+                         struct dspqueue_buffer *buffers,
+                         uint32_t message_length, const uint8_t *message,
+                         uint32_t timeout_us) {
+
+  struct dspqueue *q = queue;
+
+  if (q->mdq.is_mdq) {
+    // Recursively call 'dspqueue_write' on individual queues.
+    return dspqueue_multidomain_write(q, flags, num_buffers, buffers,
+                    message_length, message, timeout_us, true);
+  }
+  return write_block(q, flags, num_buffers, buffers, message_length, message,
+                     NULL, timeout_us);
+}
+
+AEEResult dspqueue_write_reserve(dspqueue_t queue, uint32_t flags,
+                                 uint32_t num_buffers,
+                                 struct dspqueue_buffer *buffers,
+                                 uint32_t message_length, uint8_t **message,
+                                 uint32_t timeout_us) {
+
+  AEEResult nErr = AEE_SUCCESS;
+  struct dspqueue *q = queue;
+
+  if (q->mdq.is_mdq || message == NULL) {
+    // Each domain has its own queue memory
+    return q->mdq.is_mdq ? AEE_EUNSUPPORTED : AEE_EBADPARM;
+  }
+  *message = NULL;
+  if (timeout_us == 0) {
+    // A packet reserved by another thread is reported like a full queue
+    nErr = write_noblock(q, flags, num_buffers, buffers, message_length, NULL,
+                         message);
+    return nErr == AEE_EITEMBUSY ? AEE_EWOULDBLOCK : nErr;
+  }
+  return write_block(q, flags, num_buffers, buffers, message_length, NULL,
+                     message, timeout_us);
+}
+
+/* Publishes the packet reserved with write_noblock() */
+static AEEResult write_commit(struct dspqueue *q) {
+
+  AEEResult nErr = AEE_SUCCESS;
+  int waiters;
+
+  pthread_mutex_lock(&q->mutex);
+  if (!q->write_reserved) {
+    pthread_mutex_unlock(&q->mutex);
+    return AEE_EBADPARM;
+  }
+  if (q->reserve_message_length > 0) {
+    cache_flush(q->reserve_message, q->reserve_message_length);
+  }
+  q->write_reserved = 0;
+  // Along with the packets written after it
+  nErr = publish_packets_locked(q, q->write_tail, 1 + q->write_unpublished);
+  q->write_unpublished = 0;
+  waiters = q->write_reserved_waiters;
+  pthread_mutex_unlock(&q->mutex);
+  wake_in_place_waiters(waiters, &q->space_mutex, &q->space_cond);
+  return nErr;
+}
+
+/*
+ * Drops the packet reserved with write_noblock() without publishing it.
+ * The DSP never saw the packet, so its space and sequence number are reused.
+ * Only used on the queues of a multi-domain queue, whose writes are
+ * serialized, so no packet is ever written behind the dropped one.
+ */
+static void write_cancel(struct dspqueue *q) {
+
+  int waiters = 0;
+
+  pthread_mutex_lock(&q->mutex);
+  if (q->write_reserved) {
+    assert(q->write_unpublished == 0);
+    unref_buffers(q, q->reserve_buffers, q->reserve_num_buffers);
+    q->seq_no--;
+    q->write_reserved = 0;
+    waiters = q->write_reserved_waiters;
+  }
+  pthread_mutex_unlock(&q->mutex);
+  wake_in_place_waiters(waiters, &q->space_mutex, &q->space_cond);
+}
+
+AEEResult dspqueue_write_commit(dspqueue_t queue) {
+
+  AEEResult nErr = AEE_SUCCESS;
+  struct dspqueue *q = queue;
+
+  VERIFYC(!q->mdq.is_mdq, AEE_EUNSUPPORTED);
+  nErr = write_commit(q);
+
+bail:
+  if (nErr != AEE_SUCCESS) {
+    FARF(ERROR, "Error 0x%x: %s failed for queue %p", nErr, __func__, queue);
+  }
+  return nErr;
+}
+
+/*
+ * Writes a packet to every queue of a multi-domain queue, or to none of them.
+ * The packet is first reserved on each queue and only committed once all
+ * reservations succeeded, so a full queue or a failed write drops the
+ * reservations and leaves the multi-domain queue usable.
+ * Blocking writes wait for the queues that are full against one deadline
+ * while holding the reservations made on the others. The domains drain in
+ * parallel during the wait, so a write takes as long as the slowest domain
+ * rather than the sum of the waits on each.
+ */
+static int dspqueue_multidomain_write(struct dspqueue *q, uint32_t flags,
+	uint32_t num_buffers, struct dspqueue_buffer *buffers,
+	uint32_t message_length, const uint8_t *message,
+	uint32_t timeout_us, bool block) {
+	struct timespec *timeout_ts = NULL, ts;
+
+	if (block && timeout_us != DSPQUEUE_TIMEOUT_NONE) {
+		if (clock_gettime(CLOCK_REALTIME, &ts) != 0)
+			return AEE_EFAILED;
+		timespec_add_us(&ts, timeout_us);
+		timeout_ts = &ts;
+	}
+	return dspqueue_multidomain_write_until(q, flags, num_buffers, buffers,
+				message_length, message, timeout_us, timeout_ts, block);
+}
+
+/*
+ * dspqueue_multidomain_write() against a deadline, timeout_ts, or without
+ * a timeout if it is NULL. timeout_us is the timeout the deadline was set
+ * from, for the logs.
+ */
+static int dspqueue_multidomain_write_until(struct dspqueue *q, uint32_t flags,
+	uint32_t num_buffers, struct dspqueue_buffer *buffers,
+	uint32_t message_length, const uint8_t *message,
+	uint32_t timeout_us, struct timespec *timeout_ts, bool block) {
+	int nErr = AEE_SUCCESS;
+	struct dspqueue_multidomain *mdq = NULL;
+	unsigned int ii = 0, num_reserved = 0;
+	bool locked = false, committing = false;
+	uint8_t *msg = NULL;
+
+	VERIFYC(q, AEE_EBADPARM);
+
+	mdq = &q->mdq;
+	VERIFYC(mdq->is_mdq, AEE_EINVALIDITEM);
+
+	// Only one multi-domain write request at a time.
+	pthread_mutex_lock(&q->mutex);
+	locked = true;
+
+	// Reserve the packet on all individual queues
+	for (ii = 0; ii < mdq->num_domain_ids; ii++) {
+		if (block) {
+			nErr = write_block_until(mdq->queues[ii], flags,
+				num_buffers, buffers, message_length, NULL, &msg,
+				timeout_ts);
+		} else {
+			nErr = write_noblock(mdq->queues[ii], flags, num_buffers,
+				buffers, message_length, NULL, &msg);
+		}
+		if (nErr)
+			goto bail;
+		num_reserved++;
+		if (message_length > 0)
+			memcpy(msg, message, message_length);
+	}
+
+	// Then make it visible to all domains
+	committing = true;
+	for (ii = 0; ii < mdq->num_domain_ids; ii++) {
+		VERIFY(AEE_SUCCESS == (nErr = write_commit(mdq->queues[ii])));
+	}
+bail:
+	// Drop the reservations not committed, if any
+	for (ii = 0; ii < num_reserved; ii++)
+		write_cancel(mdq->queues[ii]);
+	if (locked)
+		pthread_mutex_unlock(&q->mutex);
+
+	if (nErr && committing) {
+		/*
+		 * Signaling a domain failed after the packet was published to
+		 * some of them, and it cannot be "erased". The MDQ is now in an
+		 * irrecoverable bad-state and the client is expected to close it.
+		 */
+		nErr = AEE_EBADSTATE;
+	}
+	if (nErr && nErr != AEE_EWOULDBLOCK) {
+		FARF(ERROR, "Error 0x%x: %s (block %d): failed for queue %p, flags 0x%x, num bufs %u, msg len %u, timeout %u us",
+			nErr, __func__, block, q, flags, num_buffers,
+			message_length, timeout_us);
+	}
+	return nErr;
+}
+
+AEEResult dspqueue_write_batch(dspqueue_t queue, uint32_t num_packets,
+                               struct dspqueue_packet *packets,
+                               uint32_t *num_written, uint32_t timeout_us) {
+
+  AEEResult nErr = AEE_SUCCESS;
+  struct dspqueue *q = queue;
+  struct dspqueue_packet_queue_header *pq = NULL;
+  struct dspqueue_packet_queue_state *write_state = NULL;
+  _Atomic uint32_t *wait_count = NULL;
+  int waiting = 0;
+  struct timespec *timeout_ts = NULL; // no timeout by default
+  struct timespec ts;
+  uint32_t done = 0, n = 0;
+  int locked = 0;
+
+  errno = 0;
+  if (num_written) {
+    *num_written = 0;
+  }
+  VERIFYC(q, AEE_EBADPARM);
+  VERIFYC(num_packets == 0 || packets != NULL, AEE_EBADPARM);
+  if (q->mdq.is_mdq) {
+    // Each packet goes to all individual queues or none
+    return dspqueue_multidomain_write_batch(q, num_packets, packets,
+                                            num_written, timeout_us, true);
+  }
+
+  pq = &q->header->req_queue;
+  write_state = (struct dspqueue_packet_queue_state*)(((uintptr_t)q->header)
+                        + pq->write_state_offset);
+  wait_count = (_Atomic uint32_t*) &write_state->wait_count;
+
+  pthread_mutex_lock(&q->space_mutex);
+  locked = 1;
+
+  // Try a write first before dealing with timeouts
+  nErr = dspqueue_write_batch_noblock(queue, num_packets, packets, &done);
+  if (nErr != AEE_EWOULDBLOCK) {
+    // Batch got through or failed permanently
+    goto bail;
+  }
+
+  if (q->have_wait_counts && nErr == AEE_EWOULDBLOCK) {
+    // Flag that we're potentially waiting and try again
+    atomic_fetch_add(wait_count, 1);
+    cache_flush_word(wait_count);
+    waiting = 1;
+    nErr = dspqueue_write_batch_noblock(queue, num_packets - done,
+                                        packets + done, &n);
+    done += n;
+    if (nErr != AEE_EWOULDBLOCK) {
+      goto bail;
+    }
+  }
+
+  if (timeout_us != DSPQUEUE_TIMEOUT_NONE) {
+    // Calculate timeout expiry and use timeout
+    VERIFYC(clock_gettime(CLOCK_REALTIME, &ts) == 0, AEE_EFAILED);
+    timespec_add_us(&ts, timeout_us);
+    timeout_ts = &ts;
+  }
+
+  while (1) {
+    FARF(LOW, "Queue %u wait space for %u packets", (unsigned)q->id,
+         (unsigned)(num_packets - done));
+    VERIFY((nErr = wait_signal_locked(q, DSPQUEUE_SIGNAL_REQ_SPACE,
+                                      timeout_ts)) == 0);
+    nErr = dspqueue_write_batch_noblock(queue, num_packets - done,
+                                        packets + done, &n);
+    done += n;
+    if (nErr != AEE_EWOULDBLOCK) {
+      goto bail;
+    }
+  }
+
+bail:
+  if (waiting) {
+    atomic_fetch_sub(wait_count, 1);
+    cache_flush_word(wait_count);
+  }
+  if (locked) {
+    pthread_mutex_unlock(&q->space_mutex);
+  }
+  if (num_written) {
+    *num_written = done;
+  }
+  if (nErr != AEE_SUCCESS) {
+    FARF(ERROR,
+         "Error 0x%x: %s failed for queue %p, %u of %u packets written "
+         "(errno %s)",
+         nErr, __func__, queue, (unsigned)done, (unsigned)num_packets,
+         strerror(errno));
+  }
+  return nErr;
+}
+
 AEEResult dspqueue_write_early_wakeup_noblock(dspqueue_t queue,
                                               uint32_t wakeup_delay,
                                               uint32_t packet_flags) {
@@ -1821,11 +2476,80 @@ bail:
 	if (locked)
 		pthread_mutex_unlock(&q->mutex);
 
-	if (nErr && nErr != AEE_EWOULDBLOCK) {
-		FARF(ALWAYS, "Error 0x%x: %s (read %d, block %d): failed for queue %p, max bufs %u, max msg len %u",
-			nErr, __func__, read, block, q, max_buffers, max_message_length);
-	}
-	return nErr;
+	if (nErr && nErr != AEE_EWOULDBLOCK) {
+		FARF(ALWAYS, "Error 0x%x: %s (read %d, block %d): failed for queue %p, max bufs %u, max msg len %u",
+			nErr, __func__, read, block, q, max_buffers, max_message_length);
+	}
+	return nErr;
+}
+
+// Spin on the response queue until a packet arrives, for up to the polling
+// budget or timeout_us, whichever is shorter. Returns 1 if a packet arrived.
+// Sets *start to the time the spin started. Must hold q->packet_mutex, which
+// is released while spinning so that the signal thread can still deliver
+// signals to the other queues of the domain.
+static int poll_packet_locked(struct dspqueue *q, uint32_t timeout_us,
+                              uint64_t *start) {
+  struct dspqueue_packet_queue_header *pq = &q->header->resp_queue;
+  struct dspqueue_packet_queue_state *write_state =
+      (struct dspqueue_packet_queue_state *)(((uintptr_t)q->header) +
+                                             pq->write_state_offset);
+  _Atomic uint32_t *packet_count =
+      (_Atomic uint32_t *)&write_state->packet_count;
+  uint32_t budget = STD_MIN(q->poll_budget, timeout_us);
+  uint32_t min_budget = STD_MAX(queues->poll_max_us / POLL_MIN_DIV, 1);
+  // Packets read behind an acquired one are not counted as consumed yet
+  uint32_t read_count = q->read_packet_count + q->read_unconsumed;
+  uint64_t t = 0;
+  unsigned i = 0;
+  int hit = 0;
+
+  if (get_time_usec(start) != 0) {
+    return 0;
+  }
+  t = *start;
+  pthread_mutex_unlock(&q->packet_mutex);
+  while (1) {
+    cache_invalidate_word(packet_count);
+    if (atomic_load(packet_count) != read_count) {
+      hit = 1;
+      break;
+    }
+    if ((++i % POLL_CLOCK_INTERVAL) == 0 &&
+        (get_time_usec(&t) != 0 || (t - *start) >= budget)) {
+      break;
+    }
+    cpu_relax();
+  }
+  pthread_mutex_lock(&q->packet_mutex);
+  if (hit) {
+    q->poll_hits++;
+    // Keep the budget well above the latency seen
+    if (2 * (t - *start) > q->poll_budget) {
+      q->poll_budget = STD_MIN(2 * q->poll_budget, queues->poll_max_us);
+    }
+    return 1;
+  }
+  // Responses currently take longer than the budget, spin less
+  q->poll_misses++;
+  q->poll_budget = STD_MAX(q->poll_budget / 2, min_budget);
+  return 0;
+}
+
+// Adapt the polling budget to a packet that arrived after polling gave up
+// and the reader blocked. Must hold q->packet_mutex.
+static void poll_blocked_locked(struct dspqueue *q, uint64_t start) {
+  uint64_t t = 0;
+
+  if (get_time_usec(&t) != 0) {
+    return;
+  }
+  // Spin long enough next time if the packet came within the maximum budget
+  if ((t - start) < queues->poll_max_us) {
+    q->poll_budget = STD_MIN(
+        STD_MAX(q->poll_budget, (uint32_t)(2 * (t - start))),
+        queues->poll_max_us);
+  }
 }
 
 AEEResult dspqueue_peek_noblock(dspqueue_t queue, uint32_t *flags,
@@ -1853,7 +2577,7 @@ AEEResult dspqueue_peek_noblock(dspqueue_t queue, uint32_t *flags,
   locked = 1;
 
   // Check if we have a packet available
-  get_queue_state_read(q->header, pq, &qleft, &r, NULL);
+  get_read_pos_locked(q, &qleft, &r);
   if (qleft < 8) {
     pthread_mutex_unlock(&q->mutex);
     return AEE_EWOULDBLOCK;
@@ -1885,6 +2609,8 @@ AEEResult dspqueue_peek(dspqueue_t queue, uint32_t *flags,
   int waiting = 0;
   struct timespec *timeout_ts = NULL; // no timeout by default
   struct timespec ts;
+  int polled = 0;
+  uint64_t poll_start = 0;
 
   if (q->mdq.is_mdq) {
     // Recursively call 'dspqueue_read_noblock' on individual queues
@@ -1906,6 +2632,24 @@ AEEResult dspqueue_peek(dspqueue_t queue, uint32_t *flags,
     goto bail;
   }
 
+  if (timeout_us != DSPQUEUE_TIMEOUT_NONE) {
+    // Calculate timeout expiry and use timeout
+    VERIFYC(clock_gettime(CLOCK_REALTIME, &ts) == 0, AEE_EFAILED);
+    timespec_add_us(&ts, timeout_us);
+    timeout_ts = &ts;
+  }
+
+  if (q->poll && timeout_us != 0) {
+    // Spin for the packet before asking the DSP for a signal
+    polled = 1;
+    if (poll_packet_locked(q, timeout_us, &poll_start)) {
+      nErr = dspqueue_peek_noblock(queue, flags, num_buffers, message_length);
+      if (nErr != AEE_EWOULDBLOCK) {
+        goto bail;
+      }
+    }
+  }
+
   if (q->have_wait_counts) {
     // Mark that we're potentially waiting and try again
     atomic_fetch_add(wait_count, 1);
@@ -1917,13 +2661,6 @@ AEEResult dspqueue_peek(dspqueue_t queue, uint32_t *flags,
     }
   }
 
-  if (timeout_us != DSPQUEUE_TIMEOUT_NONE) {
-    // Calculate timeout expiry and use timeout
-    VERIFYC(clock_gettime(CLOCK_REALTIME, &ts) == 0, AEE_EFAILED);
-    timespec_add_us(&ts, timeout_us);
-    timeout_ts = &ts;
-  }
-
   while (1) {
     FARF(LOW, "Queue %u wait packet", (unsigned)q->id);
     VERIFY((nErr = wait_signal_locked(q, DSPQUEUE_SIGNAL_RESP_PACKET,
@@ -1932,6 +2669,9 @@ AEEResult dspqueue_peek(dspqueue_t queue, uint32_t *flags,
     nErr = dspqueue_peek_noblock(queue, flags, num_buffers, message_length);
     if (nErr != AEE_EWOULDBLOCK) {
       // Have a packet or got an error
+      if (polled && nErr == AEE_SUCCESS) {
+        poll_blocked_locked(q, poll_start);
+      }
       goto bail;
     }
   }
@@ -1975,18 +2715,86 @@ static inline uint32_t read_data(volatile const uint8_t *packet_queue,
   return read_pos;
 }
 
-AEEResult dspqueue_read_noblock(dspqueue_t queue, uint32_t *flags,
-                                uint32_t max_buffers, uint32_t *num_buffers,
-                                struct dspqueue_buffer *buffers,
-                                uint32_t max_message_length,
-                                uint32_t *message_length, uint8_t *message) {
+/*
+ * Marks the response queue read up to read_pos, num_packets more packets,
+ * and signals the DSP if it waits for space. Must hold q->mutex.
+ */
+static AEEResult consume_packet_locked(struct dspqueue *q, uint32_t read_pos,
+                                       uint32_t num_packets) {
+
+  AEEResult nErr = AEE_SUCCESS;
+  struct dspqueue_domain_queues *dq = queues->domain_queues[q->domain];
+  struct dspqueue_packet_queue_header *pq = &q->header->resp_queue;
+  struct dspqueue_packet_queue_state *read_state =
+      (struct dspqueue_packet_queue_state *)(((uintptr_t)q->header) +
+                                             pq->read_state_offset);
+  struct dspqueue_packet_queue_state *write_state =
+      (struct dspqueue_packet_queue_state *)(((uintptr_t)q->header) +
+                                             pq->write_state_offset);
+
+  // Update read pointer
+  q->read_packet_count += num_packets;
+  barrier_full();
+  read_state->position = read_pos;
+  read_state->packet_count = q->read_packet_count;
+  cache_flush_line(read_state);
+
+  // Signal that we've consumed packets
+  q->resp_space_count += num_packets;
+  dq->state->resp_space_count[q->id] = q->resp_space_count;
+  FARF(LOW, "Queue %u resp_space_count %u", (unsigned)q->id,
+       (unsigned)q->resp_space_count);
+  cache_flush_word(&dq->state->resp_space_count[q->id]);
+  if (q->have_dirty_bitmap) {
+    set_dirty(dq->state->dsp_dirty, q->id);
+  }
+  if (q->have_wait_counts) {
+    // Only signal if the other end is potentially waiting
+    cache_invalidate_word(&write_state->wait_count);
+    if (write_state->wait_count) {
+      VERIFY((nErr = send_signal(q, DSPQUEUE_SIGNAL_RESP_SPACE)) ==
+             AEE_SUCCESS);
+    }
+  } else {
+    VERIFY((nErr = send_signal(q, DSPQUEUE_SIGNAL_RESP_SPACE)) == AEE_SUCCESS);
+  }
+bail:
+  return nErr;
+}
+
+/*
+ * Consumes the packet read up to read_pos. While a packet is acquired, it is
+ * left for dspqueue_read_release() to consume after the acquired one, whose
+ * space the DSP must not reuse yet. Must hold q->mutex.
+ */
+static AEEResult read_done_locked(struct dspqueue *q, uint32_t read_pos) {
+  if (q->read_acquired) {
+    q->read_tail = read_pos;
+    q->read_unconsumed++;
+    return AEE_SUCCESS;
+  }
+  return consume_packet_locked(q, read_pos, 1);
+}
+
+/*
+ * Reads a packet from a queue, or with acquired not NULL leaves it in the
+ * queue for dspqueue_read_release() and returns where its message is.
+ * A packet read while another one is acquired is consumed with it.
+ *
+ * Returns AEE_EITEMBUSY if acquired is not NULL and a packet is already
+ * acquired.
+ */
+static AEEResult read_noblock(struct dspqueue *q, uint32_t *flags,
+                              uint32_t max_buffers, uint32_t *num_buffers,
+                              struct dspqueue_buffer *buffers,
+                              uint32_t max_message_length,
+                              uint32_t *message_length, uint8_t *message,
+                              const uint8_t **acquired) {
 
   AEEResult nErr = AEE_SUCCESS;
-  struct dspqueue *q = queue;
-  struct dspqueue_domain_queues *dq = NULL;
   struct dspqueue_packet_queue_header *pq = NULL;
+  int acquiring = 0;
   volatile const uint8_t *qp = NULL;
-  struct dspqueue_packet_queue_state *read_state = NULL;
   struct dspqueue_packet_queue_state *write_state = NULL;
   uint32_t r, qleft;
   uint32_t f, num_b, msg_l, qsize = 0;
@@ -1998,18 +2806,8 @@ AEEResult dspqueue_read_noblock(dspqueue_t queue, uint32_t *flags,
 
   errno = 0;
 
-if (q->mdq.is_mdq) {
-        // Recursively call 'dspqueue_read_noblock' on individual queues
-        return dspqueue_multidomain_read(q, flags, max_buffers,
-                num_buffers, buffers, max_message_length,
-                message_length, message, 0, true, false);
-    }
-
-  dq = queues->domain_queues[q->domain];
   pq = &q->header->resp_queue;
   qp = (volatile const uint8_t *) (((uintptr_t)q->header) + pq->queue_offset);
-  read_state = (struct dspqueue_packet_queue_state *) (((uintptr_t)q->header)
-                        + pq->read_state_offset);
   write_state = (struct dspqueue_packet_queue_state *) (((uintptr_t)q->header)
                         + pq->write_state_offset);
   qsize = pq->queue_length;
@@ -2018,10 +2816,14 @@ if (q->mdq.is_mdq) {
   locked = 1;
 
   VERIFYC(q->header->queue_count == q->queue_count, AEE_ERPC);
+  if (acquired != NULL && q->read_acquired) {
+    pthread_mutex_unlock(&q->mutex);
+    return AEE_EITEMBUSY;
+  }
 
   // Check if we have a packet available
   FARF(LOW, "Queue %u wp %u", (unsigned)q->id, (unsigned)write_state->position);
-  get_queue_state_read(q->header, pq, &qleft, &r, NULL);
+  get_read_pos_locked(q, &qleft, &r);
   if (qleft < 8) {
     pthread_mutex_unlock(&q->mutex);
     return AEE_EWOULDBLOCK;
@@ -2057,34 +2859,12 @@ if (q->mdq.is_mdq) {
       }
     }
 
-    // Update read pointer
-    q->read_packet_count++;
-    barrier_full();
-    read_state->position = r;
-    read_state->packet_count = q->read_packet_count;
-    cache_flush_line(read_state);
-
-    // Signal that we've consumed a packet
-    q->resp_space_count++;
-    dq->state->resp_space_count[q->id] = q->resp_space_count;
-    FARF(LOW, "Queue %u resp_space_count %u", (unsigned)q->id,
-         (unsigned)q->resp_space_count);
-    cache_flush_word(&dq->state->resp_space_count[q->id]);
-    if (q->have_wait_counts) {
-      // Only signal if the other end is potentially waiting
-      cache_invalidate_word(&write_state->wait_count);
-      if (write_state->wait_count) {
-        VERIFY((nErr = send_signal(q, DSPQUEUE_SIGNAL_RESP_SPACE)) ==
-               AEE_SUCCESS);
-      }
-    } else {
-      VERIFY((nErr = send_signal(q, DSPQUEUE_SIGNAL_RESP_SPACE)) ==
-             AEE_SUCCESS);
-    }
+    // Consume the wakeup packet
+    VERIFY(AEE_SUCCESS == (nErr = read_done_locked(q, r)));
 
     // Wait for a packet to become available
     FARF(LOW, "Early wakeup, %u usec", (unsigned)waittime);
-    get_queue_state_read(q->header, pq, &qleft, &r, NULL);
+    get_read_pos_locked(q, &qleft, &r);
     if (qleft < 8) {
       VERIFY((nErr = get_time_usec(&t1)) == 0);
       uint64_t t2 = 0;
@@ -2094,7 +2874,7 @@ if (q->mdq.is_mdq) {
             (((t1 + waittime) - t2) > EARLY_WAKEUP_SLEEP)) {
           FARF(LOW, "No sleep %u", (unsigned)EARLY_WAKEUP_SLEEP);
         }
-        get_queue_state_read(q->header, pq, &qleft, &r, NULL);
+        get_read_pos_locked(q, &qleft, &r);
         if (qleft >= 8) {
           if (t2 != 0) {
             q->early_wakeup_wait += t2 - t1;
@@ -2164,7 +2944,11 @@ if (q->mdq.is_mdq) {
     }
   }
   if (msg_l > 0) {
-    if (message != NULL) {
+    if (acquired != NULL) {
+      cache_invalidate((void *)((uintptr_t)qp + r), msg_l);
+      *acquired = (const uint8_t *)((uintptr_t)qp + r);
+      r += (msg_l + 7) & (~7);
+    } else if (message != NULL) {
       r = read_data(qp, r, qsize, message, msg_l);
     } else {
       r += (msg_l + 7) & (~7);
@@ -2179,27 +2963,14 @@ if (q->mdq.is_mdq) {
   if (r >= qsize) {
     r = 0;
   }
-  q->read_packet_count++;
-  barrier_full();
-  read_state->position = r;
-  read_state->packet_count = q->read_packet_count;
-  cache_flush_line(read_state);
-
-  // Signal that we've consumed a packet
-  q->resp_space_count++;
-  dq->state->resp_space_count[q->id] = q->resp_space_count;
-  FARF(LOW, "Queue %u resp_space_count %u", (unsigned)q->id,
-       (unsigned)q->resp_space_count);
-  cache_flush_word(&dq->state->resp_space_count[q->id]);
-  if (q->have_wait_counts) {
-    // Only signal if the other end is potentially waiting
-    cache_invalidate_word(&write_state->wait_count);
-    if (write_state->wait_count) {
-      VERIFY((nErr = send_signal(q, DSPQUEUE_SIGNAL_RESP_SPACE)) ==
-             AEE_SUCCESS);
-    }
+  if (acquired != NULL) {
+    // Consumed by dspqueue_read_release()
+    q->read_acquired = 1;
+    q->read_tail = r;
+    q->read_unconsumed = 0;
+    acquiring = 1;
   } else {
-    VERIFY((nErr = send_signal(q, DSPQUEUE_SIGNAL_RESP_SPACE)) == AEE_SUCCESS);
+    VERIFY(AEE_SUCCESS == (nErr = read_done_locked(q, r)));
   }
 
   // Go through buffers
@@ -2259,36 +3030,57 @@ bail:
       nErr = fastrpc_buffer_ref(q->domain, b->fd, 1, NULL, NULL);
     }
   }
+  if (acquiring) {
+    // Consume the packet, as a read does on errors in its buffers
+    q->read_acquired = 0;
+    (void)consume_packet_locked(q, q->read_tail, 1);
+    *acquired = NULL;
+  }
   if (locked) {
     pthread_mutex_unlock(&q->mutex);
   }
   if (nErr != AEE_SUCCESS) {
     FARF(ERROR, "Error 0x%x: %s failed for queue %p errno %s", nErr, __func__,
-         queue, strerror(errno));
+         q, strerror(errno));
   }
   return nErr;
 }
 
-AEEResult dspqueue_read(dspqueue_t queue, uint32_t *flags, uint32_t max_buffers,
-                        uint32_t *num_buffers, struct dspqueue_buffer *buffers,
-                        uint32_t max_message_length, uint32_t *message_length,
-                        uint8_t *message, uint32_t timeout_us) {
+AEEResult dspqueue_read_noblock(dspqueue_t queue, uint32_t *flags,
+                                uint32_t max_buffers, uint32_t *num_buffers,
+                                struct dspqueue_buffer *buffers,
+                                uint32_t max_message_length,
+                                uint32_t *message_length, uint8_t *message) {
 
-  AEEResult nErr = AEE_SUCCESS;
   struct dspqueue *q = queue;
+
+  if (q->mdq.is_mdq) {
+    // Recursively call 'dspqueue_read_noblock' on individual queues
+    return dspqueue_multidomain_read(q, flags, max_buffers, num_buffers,
+                                     buffers, max_message_length,
+                                     message_length, message, 0, true, false);
+  }
+  return read_noblock(q, flags, max_buffers, num_buffers, buffers,
+                      max_message_length, message_length, message, NULL);
+}
+
+/* Blocking read_noblock() */
+static AEEResult read_block(struct dspqueue *q, uint32_t *flags,
+                            uint32_t max_buffers, uint32_t *num_buffers,
+                            struct dspqueue_buffer *buffers,
+                            uint32_t max_message_length,
+                            uint32_t *message_length, uint8_t *message,
+                            const uint8_t **acquired, uint32_t timeout_us) {
+
+  AEEResult nErr = AEE_SUCCESS;
   struct dspqueue_packet_queue_header *pq = NULL;
   struct dspqueue_packet_queue_state *read_state = NULL;
   _Atomic uint32_t *wait_count = NULL;
   int waiting = 0;
   struct timespec *timeout_ts = NULL; // no timeout by default
   struct timespec ts;
-
-  if (q->mdq.is_mdq) {
-    // Recursively call 'dspqueue_read_noblock' on individual queues
-    return dspqueue_multidomain_read(q, flags, max_buffers,
-                  num_buffers, buffers, max_message_length,
-                  message_length, message, timeout_us, true, true);
-  }
+  int polled = 0;
+  uint64_t poll_start = 0;
 
   pq = &q->header->resp_queue;
   read_state = (struct dspqueue_packet_queue_state *) (((uintptr_t)q->header)
@@ -2297,44 +3089,72 @@ AEEResult dspqueue_read(dspqueue_t queue, uint32_t *flags, uint32_t max_buffers,
 
   pthread_mutex_lock(&q->packet_mutex);
 
-  // Try a read first before dealing with timeouts
-  nErr = dspqueue_read_noblock(queue, flags, max_buffers, num_buffers, buffers,
-                               max_message_length, message_length, message);
-  if (nErr != AEE_EWOULDBLOCK) {
+  // Try a read first before dealing with timeouts. An acquire waits for the
+  // packet acquired by another thread like for a new packet.
+  nErr = read_noblock(q, flags, max_buffers, num_buffers, buffers,
+                        max_message_length, message_length, message,
+                        acquired);
+  if (nErr != AEE_EWOULDBLOCK && nErr != AEE_EITEMBUSY) {
     // Have a packet or got an error
     goto bail;
   }
 
-  if (q->have_wait_counts) {
+  if (timeout_us != DSPQUEUE_TIMEOUT_NONE) {
+    // Calculate timeout expiry and use timeout
+    VERIFYC(clock_gettime(CLOCK_REALTIME, &ts) == 0, AEE_EFAILED);
+    timespec_add_us(&ts, timeout_us);
+    timeout_ts = &ts;
+  }
+
+  if (q->poll && timeout_us != 0 && nErr == AEE_EWOULDBLOCK) {
+    // Spin for the packet before asking the DSP for a signal
+    polled = 1;
+    if (poll_packet_locked(q, timeout_us, &poll_start)) {
+      nErr = read_noblock(q, flags, max_buffers, num_buffers, buffers,
+                        max_message_length, message_length, message,
+                        acquired);
+      if (nErr != AEE_EWOULDBLOCK) {
+        goto bail;
+      }
+    }
+  }
+
+  if (q->have_wait_counts && nErr == AEE_EWOULDBLOCK) {
     // Mark that we're potentially waiting and try again
     atomic_fetch_add(wait_count, 1);
     cache_flush_word(wait_count);
     waiting = 1;
     nErr =
-        dspqueue_read_noblock(queue, flags, max_buffers, num_buffers, buffers,
-                              max_message_length, message_length, message);
-    if (nErr != AEE_EWOULDBLOCK) {
+        read_noblock(q, flags, max_buffers, num_buffers, buffers,
+                        max_message_length, message_length, message,
+                        acquired);
+    if (nErr != AEE_EWOULDBLOCK && nErr != AEE_EITEMBUSY) {
       goto bail;
     }
   }
 
-  if (timeout_us != DSPQUEUE_TIMEOUT_NONE) {
-    // Calculate timeout expiry and use timeout
-    VERIFYC(clock_gettime(CLOCK_REALTIME, &ts) == 0, AEE_EFAILED);
-    timespec_add_us(&ts, timeout_us);
-    timeout_ts = &ts;
-  }
-
   while (1) {
-    FARF(LOW, "Queue %u wait packet", (unsigned)q->id);
-    VERIFY((nErr = wait_signal_locked(q, DSPQUEUE_SIGNAL_RESP_PACKET,
-                                      timeout_ts)) == 0);
-    FARF(LOW, "Queue %u got packet", (unsigned)q->id);
+    if (nErr == AEE_EITEMBUSY) {
+      FARF(LOW, "Queue %u wait acquired packet", (unsigned)q->id);
+      VERIFY((nErr = wait_in_place_locked(q, &q->read_acquired,
+                                          &q->read_acquired_waiters,
+                                          &q->packet_mutex, &q->packet_cond,
+                                          &q->packet_mask, timeout_ts)) == 0);
+    } else {
+      FARF(LOW, "Queue %u wait packet", (unsigned)q->id);
+      VERIFY((nErr = wait_signal_locked(q, DSPQUEUE_SIGNAL_RESP_PACKET,
+                                        timeout_ts)) == 0);
+      FARF(LOW, "Queue %u got packet", (unsigned)q->id);
+    }
     nErr =
-        dspqueue_read_noblock(queue, flags, max_buffers, num_buffers, buffers,
-                              max_message_length, message_length, message);
-    if (nErr != AEE_EWOULDBLOCK) {
+        read_noblock(q, flags, max_buffers, num_buffers, buffers,
+                        max_message_length, message_length, message,
+                        acquired);
+    if (nErr != AEE_EWOULDBLOCK && nErr != AEE_EITEMBUSY) {
       // Have a packet or got an error
+      if (polled && nErr == AEE_SUCCESS) {
+        poll_blocked_locked(q, poll_start);
+      }
       goto bail;
     }
   }
@@ -2348,6 +3168,76 @@ bail:
   return nErr;
 }
 
+AEEResult dspqueue_read(dspqueue_t queue, uint32_t *flags, uint32_t max_buffers,
+                        uint32_t *num_buffers, struct dspqueue_buffer *buffers,
+                        uint32_t max_message_length, uint32_t *message_length,
+                        uint8_t *message, uint32_t timeout_us) {
+
+  struct dspqueue *q = queue;
+
+  if (q->mdq.is_mdq) {
+    // Recursively call 'dspqueue_read_noblock' on individual queues
+    return dspqueue_multidomain_read(q, flags, max_buffers,
+                  num_buffers, buffers, max_message_length,
+                  message_length, message, timeout_us, true, true);
+  }
+  return read_block(q, flags, max_buffers, num_buffers, buffers,
+                    max_message_length, message_length, message, NULL,
+                    timeout_us);
+}
+
+AEEResult dspqueue_read_acquire(dspqueue_t queue, uint32_t *flags,
+                                uint32_t max_buffers, uint32_t *num_buffers,
+                                struct dspqueue_buffer *buffers,
+                                uint32_t *message_length,
+                                const uint8_t **message, uint32_t timeout_us) {
+
+  AEEResult nErr = AEE_SUCCESS;
+  struct dspqueue *q = queue;
+
+  if (q->mdq.is_mdq || message == NULL) {
+    // Each domain has its own queue memory
+    return q->mdq.is_mdq ? AEE_EUNSUPPORTED : AEE_EBADPARM;
+  }
+  *message = NULL;
+  if (timeout_us == 0) {
+    // A packet acquired by another thread is reported like an empty queue
+    nErr = read_noblock(q, flags, max_buffers, num_buffers, buffers, 0,
+                        message_length, NULL, message);
+    return nErr == AEE_EITEMBUSY ? AEE_EWOULDBLOCK : nErr;
+  }
+  return read_block(q, flags, max_buffers, num_buffers, buffers, 0,
+                    message_length, NULL, message, timeout_us);
+}
+
+AEEResult dspqueue_read_release(dspqueue_t queue) {
+
+  AEEResult nErr = AEE_SUCCESS;
+  struct dspqueue *q = queue;
+  int waiters;
+
+  VERIFYC(!q->mdq.is_mdq, AEE_EUNSUPPORTED);
+  pthread_mutex_lock(&q->mutex);
+  if (!q->read_acquired) {
+    pthread_mutex_unlock(&q->mutex);
+    nErr = AEE_EBADPARM;
+    goto bail;
+  }
+  q->read_acquired = 0;
+  // Along with the packets read after it
+  nErr = consume_packet_locked(q, q->read_tail, 1 + q->read_unconsumed);
+  q->read_unconsumed = 0;
+  waiters = q->read_acquired_waiters;
+  pthread_mutex_unlock(&q->mutex);
+  wake_in_place_waiters(waiters, &q->packet_mutex, &q->packet_cond);
+
+bail:
+  if (nErr != AEE_SUCCESS) {
+    FARF(ERROR, "Error 0x%x: %s failed for queue %p", nErr, __func__, queue);
+  }
+  return nErr;
+}
+
 /* Get stats of multi-domain queue */
 static int dspqueue_multidomain_get_stat(struct dspqueue *q,
 	enum dspqueue_stat stat, uint64_t *value) {
@@ -2387,6 +3277,61 @@ bail:
 	return nErr;
 }
 
+AEEResult dspqueue_get_eventfd(dspqueue_t queue, int *fd) {
+
+  AEEResult nErr = AEE_SUCCESS;
+  struct dspqueue *q = queue;
+  struct dspqueue_packet_queue_state *state = NULL;
+  _Atomic uint32_t *wait_count = NULL;
+  int efd = -1, locked = 0;
+
+  errno = 0;
+  VERIFYC(q && fd, AEE_EBADPARM);
+  VERIFYC(!q->mdq.is_mdq, AEE_EUNSUPPORTED);
+  // Driver signals are waited on one at a time, there is no shared thread
+  // to drive the eventfd
+  VERIFYC(!q->have_driver_signaling, AEE_EUNSUPPORTED);
+
+  pthread_mutex_lock(&q->mutex);
+  locked = 1;
+  if (q->event_fd != -1) {
+    *fd = q->event_fd;
+    goto bail;
+  }
+  VERIFYC((efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) != -1, AEE_EFAILED);
+
+  // The poller is always waiting: keep the DSP signaling new responses and
+  // request space from now on
+  if (q->have_wait_counts) {
+    state = (struct dspqueue_packet_queue_state
+                 *)(((uintptr_t)q->header) +
+                    q->header->resp_queue.read_state_offset);
+    wait_count = (_Atomic uint32_t *)&state->wait_count;
+    atomic_fetch_add(wait_count, 1);
+    cache_flush_word(wait_count);
+    state = (struct dspqueue_packet_queue_state
+                 *)(((uintptr_t)q->header) +
+                    q->header->req_queue.write_state_offset);
+    wait_count = (_Atomic uint32_t *)&state->wait_count;
+    atomic_fetch_add(wait_count, 1);
+    cache_flush_word(wait_count);
+  }
+  atomic_store(&q->event_fd, efd);
+  // Packets or space that arrived before the eventfd existed
+  signal_eventfd(q);
+  *fd = efd;
+
+bail:
+  if (locked) {
+    pthread_mutex_unlock(&q->mutex);
+  }
+  if (nErr != AEE_SUCCESS) {
+    FARF(ERROR, "Error 0x%x: %s failed for queue %p (errno %s)", nErr,
+         __func__, queue, strerror(errno));
+  }
+  return nErr;
+}
+
 AEEResult dspqueue_get_stat(dspqueue_t queue, enum dspqueue_stat stat,
                             uint64_t *value) {
 
@@ -2409,6 +3354,20 @@ AEEResult dspqueue_get_stat(dspqueue_t queue, enum dspqueue_stat stat,
     q->early_wakeup_misses = 0;
     break;
 
+  case DSPQUEUE_STAT_POLL_HITS:
+    *value = q->poll_hits;
+    q->poll_hits = 0;
+    break;
+
+  case DSPQUEUE_STAT_POLL_MISSES:
+    *value = q->poll_misses;
+    q->poll_misses = 0;
+    break;
+
+  case DSPQUEUE_STAT_POLL_BUDGET:
+    *value = q->poll_budget;
+    break;
+
   case DSPQUEUE_STAT_READ_QUEUE_PACKETS: {
     struct dspqueue_packet_queue_header *pq = &q->header->resp_queue;
     struct dspqueue_packet_queue_state *write_state =
@@ -2529,6 +3488,8 @@ static void error_callback(struct dspqueue_domain_queues *dq, AEEResult error) {
         pthread_cond_broadcast(&q->space_cond);
         pthread_mutex_unlock(&q->space_mutex);
       }
+      // Pollers see the error on their next read or write
+      signal_eventfd(q);
       if (q->error_callback != NULL) {
         struct error_callback_args *a;
         pthread_attr_t tattr;
@@ -2588,7 +3549,7 @@ static void *dspqueue_receive_signal_thread(void *arg) {
 
   struct dspqueue_domain_queues *dq = (struct dspqueue_domain_queues *)arg;
   AEEResult nErr = 0;
-  unsigned i;
+  unsigned i, w;
 
   errno = 0;
   while (1) {
@@ -2606,23 +3567,37 @@ static void *dspqueue_receive_signal_thread(void *arg) {
     FARF(LOW, "Got signal");
 
     // Ensure we have visibility into updates from the DSP
-    cache_invalidate(dq->state->req_space_count,
-                     sizeof(dq->state->req_space_count));
-    cache_invalidate(dq->state->resp_packet_count,
-                     sizeof(dq->state->resp_packet_count));
+    cache_invalidate(dq->state->cpu_dirty, sizeof(dq->state->cpu_dirty));
 
     pthread_mutex_lock(&dq->queue_list_mutex);
     FARF(LOW, "Go through queues");
-    for (i = 0; i <= dq->max_queue; i++) {
-      if ((dq->queues[i] != UNUSED_QUEUE) && (dq->queues[i] != INVALID_QUEUE)) {
+    for (w = 0; w < DSPQUEUE_DIRTY_WORDS; w++) {
+      // Queues the DSP flagged, cleared before their counts are read so a
+      // later update flags them again, and the queues without a bitmap
+      uint64_t dirty = atomic_exchange(
+          (_Atomic uint64_t *)&dq->state->cpu_dirty[w], 0);
+
+      cache_flush_word(&dq->state->cpu_dirty[w]);
+      dirty |= dq->legacy_queues[w];
+      while (dirty) {
+        i = w * 64 + __builtin_ctzll(dirty);
+        dirty &= dirty - 1;
+        if ((i > dq->max_queue) || (dq->queues[i] == UNUSED_QUEUE) ||
+            (dq->queues[i] == INVALID_QUEUE)) {
+          continue;
+        }
         struct dspqueue *q = dq->queues[i];
+        int changed = 0;
         assert(!q->have_driver_signaling);
+        cache_invalidate_word(&dq->state->resp_packet_count[i]);
+        cache_invalidate_word(&dq->state->req_space_count[i]);
         pthread_mutex_lock(&q->packet_mutex);
         if (q->resp_packet_count != dq->state->resp_packet_count[i]) {
           q->resp_packet_count = dq->state->resp_packet_count[i];
           FARF(LOW, "Queue %u new resp_packet_count %u", i,
                (unsigned)q->resp_packet_count);
           pthread_cond_broadcast(&q->packet_cond);
+          changed = 1;
         }
         pthread_mutex_unlock(&q->packet_mutex);
         pthread_mutex_lock(&q->space_mutex);
@@ -2631,8 +3606,12 @@ static void *dspqueue_receive_signal_thread(void *arg) {
           FARF(LOW, "Queue %u new req_space_count %u", i,
                (unsigned)q->req_space_count);
           pthread_cond_broadcast(&q->space_cond);
+          changed = 1;
         }
         pthread_mutex_unlock(&q->space_mutex);
+        if (changed) {
+          signal_eventfd(q);
+        }
       }
     }
     FARF(LOW, "Done");
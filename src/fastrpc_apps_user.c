@@ -60,10 +60,12 @@
 #include "fastrpc_latency.h"
 #include "fastrpc_log.h"
 #include "fastrpc_mem.h"
+#include "fastrpc_mock.h"
 #include "fastrpc_notif.h"
 #include "fastrpc_perf.h"
 #include "fastrpc_pm.h"
 #include "fastrpc_procbuf.h"
+#include "fastrpc_shell_cache.h"
 #include "listener_android.h"
 #include "log_config.h"
 #include "platform_libs.h"
@@ -237,7 +239,8 @@ const char *ENV_DEBUG_VAR_NAME[] = {"FASTRPC_PROCESS_ATTRS",
                                     "FASTRPC_DEBUG_SYSTRACE",
                                     "FASTRPC_DEBUG_PDDUMP",
                                     "FASTRPC_PROCESS_ATTRS_PERSISTENT",
-                                    "ro.debuggable"};
+                                    "ro.debuggable",
+                                    "FASTRPC_SHELL_CACHE_DIR"};
 const char *ANDROIDP_DEBUG_VAR_NAME[] = {"vendor.fastrpc.process.attrs",
                                          "vendor.fastrpc.debug.trace",
                                          "vendor.fastrpc.debug.testsig",
@@ -247,7 +250,8 @@ const char *ANDROIDP_DEBUG_VAR_NAME[] = {"vendor.fastrpc.process.attrs",
                                          "vendor.fastrpc.debug.systrace",
                                          "vendor.fastrpc.debug.pddump",
                                          "persist.vendor.fastrpc.process.attrs",
-                                         "ro.build.type"};
+                                         "ro.build.type",
+                                         "vendor.fastrpc.shell.cache.dir"};
 const char *ANDROID_DEBUG_VAR_NAME[] = {"fastrpc.process.attrs",
                                         "fastrpc.debug.trace",
                                         "fastrpc.debug.testsig",
@@ -257,7 +261,8 @@ const char *ANDROID_DEBUG_VAR_NAME[] = {"fastrpc.process.attrs",
                                         "fastrpc.debug.systrace",
                                         "fastrpc.debug.pddump",
                                         "persist.fastrpc.process.attrs",
-                                        "ro.build.type"};
+                                        "ro.build.type",
+                                        "fastrpc.shell.cache.dir"};
 
 const char *SUBSYSTEM_NAME[] = {"adsp", "mdsp", "sdsp", "cdsp", "cdsp1", "reserved", "reserved", "reserved"};
 
@@ -288,6 +293,43 @@ struct handle_info {
   char *name;
 };
 
+/*
+ * Table of open multi-domain handles. A local handle encodes the index of
+ * its slot and the slot generation at the time it was opened, so it can be
+ * validated and resolved to its domain and remote handle with a few atomic
+ * loads instead of walking every domain's handle list under lmut.
+ *
+ * The generation of a slot is odd while it holds an open handle and is
+ * bumped on close, which invalidates every handle issued for it. Readers
+ * check the generation before and after reading the slot. Chunks of slots
+ * are allocated on demand and freed only on library deinit, so a reader
+ * racing with close never touches freed memory.
+ */
+#define HANDLE_CHUNK_SLOTS 256
+#define HANDLE_TABLE_CHUNKS 256
+#define HANDLE_TABLE_MAX_SLOTS (HANDLE_CHUNK_SLOTS * HANDLE_TABLE_CHUNKS)
+
+#define HANDLE_ENCODE(idx, gen) (((remote_handle64)(gen) << 32) | ((idx) + 1))
+#define HANDLE_INDEX(h) ((uint32_t)(h) - 1)
+#define HANDLE_GEN(h) ((uint32_t)((h) >> 32))
+// Size of the copy of a handle's library name made for logging
+#define HANDLE_NAME_LOG_LEN 128
+
+struct handle_slot {
+  atomic_uint gen;
+  atomic_int domain;
+  atomic_uint_fast64_t remote;
+  struct handle_info *hinfo; // Protected by htbl.mut
+  uint32_t next_free;        // Protected by htbl.mut
+};
+
+static struct {
+  struct handle_slot *_Atomic chunks[HANDLE_TABLE_CHUNKS];
+  pthread_mutex_t mut;
+  uint32_t nslots;    // Number of slots handed out so far
+  uint32_t free_head; // Index + 1 of the first free slot, 0 if none
+} htbl = {.mut = PTHREAD_MUTEX_INITIALIZER};
+
 // Fastrpc client notification request node to be queued to <notif_list>
 struct fastrpc_notif {
   QNode qn;
@@ -325,13 +367,56 @@ static uint32_t fastrpc_wake_lock_enable[NUM_DOMAINS_EXTEND] = {0};
 
 static int domain_init(int domain, int *dev);
 static void domain_deinit(int domain);
+static void domain_deferred_init_join(int domain);
+static int session_prewarm_start(int domain, const char **uris,
+                                 uint32_t num_uris);
+static int session_prewarm_wait(int domain, uint32_t timeout_us, int *status);
+static void session_prewarm_close_handles(int domain);
+static void session_prewarm_drop_handles(int domain);
 static int close_device_node(int domain_id, int dev);
+int remote_handle_close_domain(int domain, remote_handle h);
 extern int apps_mem_table_init(void);
 extern void apps_mem_table_deinit(void);
 
 static uint32_t crc_table[256];
 static atomic_bool timer_expired = false;
 
+/*
+ * Per-thread scratch arena used by the synchronous invoke path, sized to
+ * the maximums a scalar can encode, so that an invoke does not have to
+ * allocate its args, CRC and perf buffers on every call.
+ */
+struct invoke_scratch {
+  struct fastrpc_invoke_args args[FASTRPC_MAX_INVOKE_ARGS];
+  uint32_t crc_local[M_CRCLIST];
+  uint32_t crc_remote[M_CRCLIST];
+  uint64_t perf_kernel[PERF_KERNEL_KEY_MAX];
+  uint64_t perf_dsp[PERF_DSP_KEY_MAX];
+  bool busy; // Set while owned by an in-flight invoke on this thread
+};
+
+/*
+ * Per-domain state of a batch submitted by remote_handle64_invoke_batch.
+ * The session reference, wake-lock and RPC timer are set up once for all
+ * invokes of the batch on a domain. The kernel PM vote only lasts
+ * PM_TIMEOUT_MS, so it is still renewed before each invoke.
+ */
+struct invoke_batch {
+  bool active;
+  int domain;
+  int dev;
+  bool wake_lock;     // wake-lock held until invoke_batch_end
+  int rpc_timeout;    // RPC timeout in ms, 0 if disabled
+  bool timer_created; // frpc_timer.timer is created and must be deleted
+  fastrpc_timer frpc_timer;
+};
+
+static pthread_key_t invoke_scratch_key = INVALID_KEY;
+// Number of invokes and heap allocations made on the invoke path, the
+// allocation of the scratch arena of each thread excluded
+static atomic_uint_fast64_t invoke_count = 0;
+static atomic_uint_fast64_t invoke_heap_allocs = 0;
+
 void set_thread_context(int domain) {
   if (tlsKey != INVALID_KEY) {
     pthread_setspecific(tlsKey, (void *)&hlist[domain]);
@@ -362,15 +447,21 @@ int fastrpc_session_open(int domain, int *dev) {
   return AEE_ECONNREFUSED;
 }
 
+/* Closes a device node, on the mock driver if it is selected */
+static int close_device(int dev) {
+  FASTRPC_MOCK_RETURN(fastrpc_mock_close(dev));
+  return close(dev);
+}
+
 void fastrpc_session_close(int domain, int dev) {
   if (!hlist)
     return;
   if ((hlist[domain].dev == INVALID_DEVICE) &&
       (dev != INVALID_DEVICE)) {
-    close(dev);
+    close_device(dev);
   } else if ((hlist[domain].dev != INVALID_DEVICE) &&
             (dev == INVALID_DEVICE)) {
-    close(hlist[domain].dev);
+    close_device(hlist[domain].dev);
     hlist[domain].dev = INVALID_DEVICE;
   }
   return;
@@ -670,59 +761,159 @@ bail:
   return nErr;
 }
 
-static inline bool is_valid_local_handle(int domain, struct handle_info *hinfo) {
-  QNode *pn;
-  int ii = 0;
-  if(domain == -1) {
-    FOR_EACH_EFFECTIVE_DOMAIN_ID(ii) {
-      pthread_mutex_lock(&hlist[ii].lmut);
-      QLIST_FOR_ALL(&hlist[ii].ql, pn) {
-        struct handle_info *hi = STD_RECOVER_REC(struct handle_info, qn, pn);
-        if (hi == hinfo) {
-          pthread_mutex_unlock(&hlist[ii].lmut);
-          return true;
-        }
-      }
-      pthread_mutex_unlock(&hlist[ii].lmut);
-    }
-  } else {
-      pthread_mutex_lock(&hlist[domain].lmut);
-      QLIST_FOR_ALL(&hlist[domain].ql, pn) {
-        struct handle_info *hi = STD_RECOVER_REC(struct handle_info, qn, pn);
-        if (hi == hinfo) {
-          pthread_mutex_unlock(&hlist[domain].lmut);
-          return true;
-        }
-      }
-      pthread_mutex_unlock(&hlist[domain].lmut);
-  }
-  return false;
+static inline struct handle_slot *handle_table_slot(uint32_t idx) {
+  struct handle_slot *chunk = atomic_load_explicit(
+      &htbl.chunks[idx / HANDLE_CHUNK_SLOTS], memory_order_acquire);
+
+  return chunk ? &chunk[idx % HANDLE_CHUNK_SLOTS] : NULL;
 }
 
-static int verify_local_handle(int domain, remote_handle64 local) {
-  struct handle_info *hinfo = (struct handle_info *)(uintptr_t)local;
+/**
+ * handle_table_alloc() - Publish an open handle in the handle table.
+ * @hinfo: handle info of the open handle.
+ * @domain: domain the handle was opened on.
+ * @remote: remote handle on the DSP.
+ * @local: on success, the local handle to hand out to the client.
+ * Return: 0 on success, AEE_ENOMEMORY if the table is full.
+ */
+static int handle_table_alloc(struct handle_info *hinfo, int domain,
+                              remote_handle64 remote, remote_handle64 *local) {
+  struct handle_slot *slot = NULL, *chunk = NULL;
+  uint32_t idx, gen;
   int nErr = AEE_SUCCESS;
 
-  VERIFYC((local != (remote_handle64)-1) && hinfo, AEE_EINVHANDLE);
-  VERIFYC(is_valid_local_handle(domain, hinfo), AEE_EINVHANDLE);
-  VERIFYC((hinfo->hlist >= &hlist[0]) &&
-              (hinfo->hlist < &hlist[NUM_DOMAINS_EXTEND]),
-          AEE_ERPC);
-  VERIFYC(QNode_IsQueuedZ(&hinfo->qn), AEE_EINVHANDLE);
+  pthread_mutex_lock(&htbl.mut);
+  if (htbl.free_head) {
+    idx = htbl.free_head - 1;
+    slot = handle_table_slot(idx);
+    htbl.free_head = slot->next_free;
+  } else {
+    VERIFYC(htbl.nslots < HANDLE_TABLE_MAX_SLOTS, AEE_ENOMEMORY);
+    idx = htbl.nslots;
+    if (!(idx % HANDLE_CHUNK_SLOTS)) {
+      VERIFYC(NULL != (chunk = calloc(HANDLE_CHUNK_SLOTS, sizeof(*chunk))),
+              AEE_ENOMEMORY);
+      atomic_store_explicit(&htbl.chunks[idx / HANDLE_CHUNK_SLOTS], chunk,
+                            memory_order_release);
+    }
+    htbl.nslots++;
+    slot = handle_table_slot(idx);
+  }
+  slot->hinfo = hinfo;
+  slot->next_free = 0;
+  /*
+   * Order the slot updates after the generation bump of the previous close,
+   * so that a reader that sees the new values also sees the stale generation
+   * change on its re-check.
+   */
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&slot->domain, domain, memory_order_relaxed);
+  atomic_store_explicit(&slot->remote, remote, memory_order_relaxed);
+  gen = atomic_load_explicit(&slot->gen, memory_order_relaxed) + 1;
+  atomic_store_explicit(&slot->gen, gen, memory_order_release);
+  *local = HANDLE_ENCODE(idx, gen);
 bail:
+  pthread_mutex_unlock(&htbl.mut);
   if (nErr != AEE_SUCCESS) {
-    FARF(RUNTIME_RPC_HIGH, "Error 0x%x: %s failed. handle 0x%" PRIx64 "\n",
-         nErr, __func__, local);
+    FARF(ERROR, "Error 0x%x: %s failed for domain %d\n", nErr, __func__,
+         domain);
   }
   return nErr;
 }
 
+/**
+ * handle_table_free() - Invalidate a local handle and recycle its slot.
+ * @local: local handle returned by handle_table_alloc.
+ * Return: void.
+ */
+static void handle_table_free(remote_handle64 local) {
+  uint32_t idx = HANDLE_INDEX(local), gen = HANDLE_GEN(local);
+  struct handle_slot *slot = NULL;
+
+  pthread_mutex_lock(&htbl.mut);
+  if (idx < htbl.nslots && (slot = handle_table_slot(idx)) &&
+      atomic_load_explicit(&slot->gen, memory_order_relaxed) == gen) {
+    atomic_store_explicit(&slot->gen, gen + 1, memory_order_release);
+    slot->hinfo = NULL;
+    slot->next_free = htbl.free_head;
+    htbl.free_head = idx + 1;
+  }
+  pthread_mutex_unlock(&htbl.mut);
+}
+
+/* Frees all chunks of the handle table. Called on library deinit. */
+static void handle_table_deinit(void) {
+  int ii;
+
+  pthread_mutex_lock(&htbl.mut);
+  for (ii = 0; ii < HANDLE_TABLE_CHUNKS; ii++) {
+    free(atomic_load_explicit(&htbl.chunks[ii], memory_order_relaxed));
+    atomic_store_explicit(&htbl.chunks[ii], NULL, memory_order_relaxed);
+  }
+  htbl.nslots = 0;
+  htbl.free_head = 0;
+  pthread_mutex_unlock(&htbl.mut);
+}
+
+/**
+ * handle_table_lookup() - Validate a local handle and resolve it.
+ * @local: local handle.
+ * @domain: on success, domain the handle was opened on.
+ * @remote: on success, remote handle on the DSP.
+ *
+ * Lock-free; safe against a concurrent open or close of any handle.
+ * Return: 0 on success, AEE_EINVHANDLE if the handle is not open.
+ */
+static int handle_table_lookup(remote_handle64 local, int *domain,
+                               remote_handle64 *remote) {
+  uint32_t idx = HANDLE_INDEX(local), gen = HANDLE_GEN(local);
+  struct handle_slot *slot = NULL;
+  remote_handle64 rem;
+  int dom;
+
+  if (!(gen & 1) || idx >= HANDLE_TABLE_MAX_SLOTS ||
+      !(slot = handle_table_slot(idx)))
+    return AEE_EINVHANDLE;
+  if (atomic_load_explicit(&slot->gen, memory_order_acquire) != gen)
+    return AEE_EINVHANDLE;
+  dom = atomic_load_explicit(&slot->domain, memory_order_relaxed);
+  rem = atomic_load_explicit(&slot->remote, memory_order_relaxed);
+  atomic_thread_fence(memory_order_acquire);
+  if (atomic_load_explicit(&slot->gen, memory_order_relaxed) != gen)
+    return AEE_EINVHANDLE;
+  if (domain)
+    *domain = dom;
+  if (remote)
+    *remote = rem;
+  return AEE_SUCCESS;
+}
+
+/*
+ * Copies the library name of an open handle to buf, for logging only. The
+ * copy is made under htbl.mut, as a concurrent close frees the name.
+ * Returns buf, "unknown" if the handle is not open.
+ */
+static const char *handle_table_name(remote_handle64 local, char *buf,
+                                     size_t len) {
+  uint32_t idx = HANDLE_INDEX(local);
+  struct handle_slot *slot = NULL;
+
+  snprintf(buf, len, "unknown");
+  pthread_mutex_lock(&htbl.mut);
+  if (idx < htbl.nslots && (slot = handle_table_slot(idx)) &&
+      atomic_load_explicit(&slot->gen, memory_order_relaxed) ==
+          HANDLE_GEN(local) &&
+      slot->hinfo && slot->hinfo->name)
+    snprintf(buf, len, "%s", slot->hinfo->name);
+  pthread_mutex_unlock(&htbl.mut);
+  return buf;
+}
+
 int get_domain_from_handle(remote_handle64 local, int *domain) {
-  struct handle_info *hinfo = (struct handle_info *)(uintptr_t)local;
   int dom, nErr = AEE_SUCCESS;
 
-  VERIFY(AEE_SUCCESS == (nErr = verify_local_handle(-1, local)));
-  dom = (int)(hinfo->hlist - &hlist[0]);
+  VERIFYC(local != (remote_handle64)-1, AEE_EINVHANDLE);
+  VERIFY(AEE_SUCCESS == (nErr = handle_table_lookup(local, &dom, NULL)));
   VERIFYM(IS_VALID_EFFECTIVE_DOMAIN_ID(dom), AEE_EINVHANDLE,
           "Error 0x%x: domain mapped to handle is out of range domain %d "
           "handle 0x%" PRIx64 "\n",
@@ -804,11 +995,9 @@ static const char *get_domain_from_id(int domain_id) {
 #define IS_CONST_HANDLE(h) (((h) < 0xff) ? 1 : 0)
 
 static int get_handle_remote(remote_handle64 local, remote_handle64 *remote) {
-  struct handle_info *hinfo = (struct handle_info *)(uintptr_t)local;
   int nErr = AEE_SUCCESS;
 
-  VERIFY(AEE_SUCCESS == (nErr = verify_local_handle(-1, local)));
-  *remote = hinfo->remote;
+  VERIFY(AEE_SUCCESS == (nErr = handle_table_lookup(local, NULL, remote)));
 bail:
   if (nErr != AEE_SUCCESS) {
     FARF(ERROR, "Error %x: get handle remote failed %p\n", nErr, &local);
@@ -880,12 +1069,19 @@ static int fastrpc_alloc_handle(int domain, QList *me, remote_handle64 remote,
   char *libname = NULL;
 
   VERIFYC(NULL != (hinfo = calloc(1, sizeof(*hinfo))), AEE_ENOMEMORY);
-  hinfo->local = (remote_handle64)(uintptr_t)hinfo;
   hinfo->remote = remote;
   libname = get_lib_name(name);
   hinfo->name = libname;
   hinfo->hlist = &hlist[domain];
-  *local = hinfo->local;
+  // Only multi-domain handles are handed out to clients as local handles
+  if (me == &hlist[domain].ql) {
+    VERIFY(AEE_SUCCESS ==
+           (nErr = handle_table_alloc(hinfo, domain, remote, &hinfo->local)));
+  } else {
+    hinfo->local = (remote_handle64)(uintptr_t)hinfo;
+  }
+  if (local)
+    *local = hinfo->local;
 
   QNode_CtorZ(&hinfo->qn);
   pthread_mutex_lock(&hlist[domain].lmut);
@@ -893,6 +1089,10 @@ static int fastrpc_alloc_handle(int domain, QList *me, remote_handle64 remote,
   pthread_mutex_unlock(&hlist[domain].lmut);
 bail:
   if (nErr != AEE_SUCCESS) {
+    if (hinfo) {
+      free(hinfo->name);
+      free(hinfo);
+    }
     FARF(ERROR,
          "Error 0x%x: %s failed for local handle 0x%x, remote handle 0x%x, "
          "domain %d\n",
@@ -901,14 +1101,22 @@ bail:
   return nErr;
 }
 
-static int fastrpc_free_handle(int domain, QList *me, remote_handle64 remote) {
+/*
+ * Frees the entry of a handle. Several entries can share a remote handle,
+ * e.g. const handles opened more than once, so clients closing a local
+ * handle select the entry by its local handle.
+ */
+static int fastrpc_free_handle(int domain, QList *me, remote_handle64 remote,
+                               const remote_handle64 *local) {
   pthread_mutex_lock(&hlist[domain].lmut);
   if (!QList_IsEmpty(me)) {
     QNode *pn = NULL, *pnn = NULL;
     QLIST_NEXTSAFE_FOR_ALL(me, pn, pnn) {
       struct handle_info *hi = STD_RECOVER_REC(struct handle_info, qn, pn);
-      if (hi->remote == remote) {
+      if (local ? hi->local == *local : hi->remote == remote) {
         QNode_DequeueZ(&hi->qn);
+        if (me == &hlist[domain].ql)
+          handle_table_free(hi->local);
         if(hi->name)
           free(hi->name);
         free(hi);
@@ -942,7 +1150,7 @@ int fastrpc_update_module_list(uint32_t req, int domain, remote_handle64 h,
   }
   case DOMAIN_LIST_DEQUEUE: {
     VERIFY(AEE_SUCCESS ==
-           (nErr = fastrpc_free_handle(domain, &hlist[domain].ql, h)));
+           (nErr = fastrpc_free_handle(domain, &hlist[domain].ql, h, local)));
     if(IS_CONST_HANDLE(h)) {
       pthread_mutex_lock(&hlist[domain].lmut);
       hlist[domain].constCount--;
@@ -964,7 +1172,7 @@ int fastrpc_update_module_list(uint32_t req, int domain, remote_handle64 h,
   }
   case NON_DOMAIN_LIST_DEQUEUE: {
     VERIFY(AEE_SUCCESS ==
-           (nErr = fastrpc_free_handle(domain, &hlist[domain].nql, h)));
+           (nErr = fastrpc_free_handle(domain, &hlist[domain].nql, h, local)));
     pthread_mutex_lock(&hlist[domain].lmut);
     hlist[domain].nondomainsCount--;
     pthread_mutex_unlock(&hlist[domain].lmut);
@@ -980,7 +1188,7 @@ int fastrpc_update_module_list(uint32_t req, int domain, remote_handle64 h,
   }
   case REVERSE_HANDLE_LIST_DEQUEUE: {
     VERIFY(AEE_SUCCESS ==
-           (nErr = fastrpc_free_handle(domain, &hlist[domain].rql, h)));
+           (nErr = fastrpc_free_handle(domain, &hlist[domain].rql, h, local)));
     pthread_mutex_lock(&hlist[domain].lmut);
     hlist[domain].reverseCount--;
     pthread_mutex_unlock(&hlist[domain].lmut);
@@ -1014,6 +1222,7 @@ static void fastrpc_clear_handle_list(uint32_t req, int domain) {
     if (!QList_IsNull(&hlist[domain].ql)) {
       while ((pn = QList_Pop(&hlist[domain].ql))) {
         struct handle_info *hi = STD_RECOVER_REC(struct handle_info, qn, pn);
+        handle_table_free(hi->local);
         free(hi);
         hi = NULL;
       }
@@ -1107,10 +1316,11 @@ static void fastrpc_timer_callback(void *ptr) {
   }
 }
 
+static void fastrpc_arm_timer(fastrpc_timer *frpc_timer);
+
 // Function to add timer before remote RPC call
 static void fastrpc_add_timer(fastrpc_timer *frpc_timer) {
   struct sigevent sigevent;
-  struct itimerspec time_spec;
   int err = 0;
 
   memset(&sigevent, 0, sizeof(sigevent));
@@ -1123,6 +1333,15 @@ static void fastrpc_add_timer(fastrpc_timer *frpc_timer) {
     FARF(ERROR, "%s: failed to create timer with error 0x%x\n", __func__, err);
     goto bail;
   }
+  fastrpc_arm_timer(frpc_timer);
+bail:
+  return;
+}
+
+// Function to (re)start the timeout of an existing timer
+static void fastrpc_arm_timer(fastrpc_timer *frpc_timer) {
+  struct itimerspec time_spec = {0};
+  int err = 0;
 
   time_spec.it_value.tv_sec = frpc_timer->timeout_millis / 1000;
   time_spec.it_value.tv_nsec =
@@ -1145,9 +1364,113 @@ static void fastrpc_delete_timer(timer_t *timer) {
   }
 }
 
-int remote_handle_invoke_domain(int domain, remote_handle handle,
-                                fastrpc_async_descriptor_t *desc, uint32_t sc,
-                                remote_arg *pra) {
+static void invoke_scratch_free(void *value) { free(value); }
+
+/*
+ * Returns the calling thread's invoke scratch arena and marks it busy.
+ * The arena is allocated on the first invoke of each thread only. NULL is
+ * returned if it is unavailable, in which case the caller falls back to
+ * allocating its buffers on the heap.
+ */
+static struct invoke_scratch *invoke_scratch_get(void) {
+  struct invoke_scratch *scratch = NULL;
+
+  if (invoke_scratch_key == INVALID_KEY)
+    return NULL;
+  scratch = (struct invoke_scratch *)pthread_getspecific(invoke_scratch_key);
+  if (!scratch) {
+    scratch = (struct invoke_scratch *)calloc(1, sizeof(*scratch));
+    if (!scratch)
+      return NULL;
+    if (pthread_setspecific(invoke_scratch_key, scratch)) {
+      free(scratch);
+      return NULL;
+    }
+  }
+  if (scratch->busy)
+    return NULL;
+  scratch->busy = true;
+  return scratch;
+}
+
+static inline void invoke_scratch_put(struct invoke_scratch *scratch) {
+  if (scratch)
+    scratch->busy = false;
+}
+
+void fastrpc_get_invoke_alloc_stats(uint64_t *invokes, uint64_t *heap_allocs) {
+  if (invokes)
+    *invokes = atomic_load(&invoke_count);
+  if (heap_allocs)
+    *heap_allocs = atomic_load(&invoke_heap_allocs);
+}
+
+/**
+ * invoke_batch_begin() - Set up the per-domain state of an invoke batch.
+ * @batch: batch state, must not be active.
+ * @domain: domain of the invokes that follow.
+ * Return: 0 on success, error from fastrpc_session_get otherwise.
+ */
+static int invoke_batch_begin(struct invoke_batch *batch, int domain) {
+  int nErr = AEE_SUCCESS;
+
+  memset(batch, 0, sizeof(*batch));
+  VERIFY(AEE_SUCCESS == (nErr = fastrpc_session_get(domain)));
+  if (AEE_SUCCESS != (nErr = fastrpc_session_dev(domain, &batch->dev))) {
+    fastrpc_session_put(domain);
+    goto bail;
+  }
+  batch->active = true;
+  batch->domain = domain;
+  // Held across the batch in place of the wake-lock taken around each invoke
+  if (fastrpc_wake_lock_enable[domain] && !fastrpc_wake_lock())
+    batch->wake_lock = true;
+  if ((batch->rpc_timeout = fastrpc_config_get_rpctimeout()) > 0) {
+    batch->frpc_timer.domain = domain;
+    batch->frpc_timer.timeout_millis = batch->rpc_timeout;
+    batch->frpc_timer.tid = gettid();
+  }
+bail:
+  return nErr;
+}
+
+/* Releases the state set up by invoke_batch_begin, if any */
+static void invoke_batch_end(struct invoke_batch *batch) {
+  if (!batch->active)
+    return;
+  if (batch->timer_created)
+    fastrpc_delete_timer(&batch->frpc_timer.timer);
+  if (batch->wake_lock)
+    fastrpc_wake_unlock();
+  fastrpc_session_put(batch->domain);
+  batch->active = false;
+}
+
+/*
+ * Starts the RPC timeout of the next invoke of a batch. The timer is
+ * created by the first invoke and only re-armed by the following ones.
+ */
+static void invoke_batch_arm_timer(struct invoke_batch *batch,
+                                   remote_handle handle, uint32_t sc) {
+  if (batch->rpc_timeout <= 0)
+    return;
+  batch->frpc_timer.sc = sc;
+  batch->frpc_timer.handle = handle;
+  if (batch->timer_created) {
+    fastrpc_arm_timer(&batch->frpc_timer);
+  } else {
+    fastrpc_add_timer(&batch->frpc_timer);
+    batch->timer_created = true;
+  }
+}
+
+/*
+ * Invokes a remote method. @batch is NULL for a standalone invoke, or the
+ * state of the batch the invoke is part of, set up for @domain.
+ */
+static int invoke_domain(int domain, remote_handle handle,
+                         fastrpc_async_descriptor_t *desc, uint32_t sc,
+                         remote_arg *pra, struct invoke_batch *batch) {
   int dev, total, bufs, handles, i, nErr = 0, wake_lock = 0, rpc_timeout = 0;
   unsigned req;
   uint32_t len;
@@ -1161,6 +1484,7 @@ int remote_handle_invoke_domain(int domain, remote_handle handle,
   int trace_marker_fd = hlist[domain].trace_marker_fd;
   bool trace_enabled = false;
   struct fastrpc_invoke_args* args = NULL; 
+  struct invoke_scratch *scratch = NULL;
 
   if (IS_QTF_TRACING_ENABLED(hlist[domain].procattrs) &&
       !IS_STATIC_HANDLE(handle) && trace_marker_fd > 0) {
@@ -1168,10 +1492,14 @@ int remote_handle_invoke_domain(int domain, remote_handle handle,
     trace_enabled = true;
   }
 
-  VERIFY(AEE_SUCCESS == (nErr = fastrpc_session_dev(domain, &dev)));
+  if (batch) {
+    dev = batch->dev;
+  } else {
+    VERIFY(AEE_SUCCESS == (nErr = fastrpc_session_dev(domain, &dev)));
+  }
 
   errno = 0;
-  if (fastrpc_wake_lock_enable[domain]) {
+  if (!batch && fastrpc_wake_lock_enable[domain]) {
     if (!IS_REVERSE_RPC_CALL(handle, sc) ||
         is_first_reverse_rpc_call(domain, handle, sc)) {
       if (!fastrpc_wake_lock())
@@ -1198,7 +1526,11 @@ int remote_handle_invoke_domain(int domain, remote_handle handle,
   handles = REMOTE_SCALARS_INHANDLES(sc) + REMOTE_SCALARS_OUTHANDLES(sc);
   total = bufs + handles;
 
-  INITIALIZE_REMOTE_ARGS(total);
+  atomic_fetch_add(&invoke_count, 1);
+  scratch = invoke_scratch_get();
+  if (!scratch && total)
+    atomic_fetch_add(&invoke_heap_allocs, 1);
+  INITIALIZE_REMOTE_ARGS(total, scratch ? scratch->args : NULL);
 
   if (desc) {
     struct timespec time_spec;
@@ -1219,9 +1551,13 @@ int remote_handle_invoke_domain(int domain, remote_handle handle,
     asyncjob.jobid = ((((time_spec.tv_sec) / SECONDS_PER_HOUR)
                        << (FASTRPC_ASYNC_TIME_SPEC_POS / 2))
                           << ((FASTRPC_ASYNC_TIME_SPEC_POS + 1) / 2) |
-                      (asyncjob.jobid << FASTRPC_ASYNC_JOB_POS) | domain);
+                      ((asyncjob.jobid << FASTRPC_ASYNC_JOB_POS) &
+                       FASTRPC_ASYNC_JOB_CNT_MASK) |
+                      domain);
+    // Nothing is saved on failure, e.g. a ring job without a ring
+    VERIFY(AEE_SUCCESS ==
+           (nErr = fastrpc_save_async_job(domain, &asyncjob, desc)));
     asyncjob.isasyncjob = 1;
-    fastrpc_save_async_job(domain, &asyncjob, desc);
     job = &asyncjob;
   }
 
@@ -1303,8 +1639,16 @@ int remote_handle_invoke_domain(int domain, remote_handle handle,
   if (IS_CRC_CHECK_ENABLED(hlist[domain].procattrs) &&
       (!IS_STATIC_HANDLE(handle)) && !asyncjob.isasyncjob) {
     int nInBufs = REMOTE_SCALARS_INBUFS(sc);
-    crc_local = (uint32_t *)calloc(M_CRCLIST, sizeof(uint32_t));
-    crc_remote = (uint32_t *)calloc(M_CRCLIST, sizeof(uint32_t));
+    if (scratch) {
+      crc_local = scratch->crc_local;
+      crc_remote = scratch->crc_remote;
+      memset(crc_local, 0, sizeof(scratch->crc_local));
+      memset(crc_remote, 0, sizeof(scratch->crc_remote));
+    } else {
+      atomic_fetch_add(&invoke_heap_allocs, 2);
+      crc_local = (uint32_t *)calloc(M_CRCLIST, sizeof(uint32_t));
+      crc_remote = (uint32_t *)calloc(M_CRCLIST, sizeof(uint32_t));
+    }
     VERIFYC(crc_local != NULL && crc_remote != NULL, AEE_ENOMEMORY);
     VERIFYC(!(NULL == pra && nInBufs > 0), AEE_EBADPARM);
     for (i = 0; (i < nInBufs) && (i < M_CRCLIST); i++)
@@ -1313,21 +1657,41 @@ int remote_handle_invoke_domain(int domain, remote_handle handle,
     req = INVOKE_CRC;
   }
 
+  /*
+   * Perf buffers of async jobs are filled in when the job completes, so
+   * they cannot live in the per-thread scratch.
+   */
   if (IS_KERNEL_PERF_ENABLED(hlist[domain].procattrs) &&
       (!IS_STATIC_HANDLE(handle))) {
-    perf_kernel = (uint64_t *)calloc(PERF_KERNEL_KEY_MAX, sizeof(uint64_t));
+    if (scratch && !asyncjob.isasyncjob) {
+      perf_kernel = scratch->perf_kernel;
+      memset(perf_kernel, 0, sizeof(scratch->perf_kernel));
+    } else {
+      atomic_fetch_add(&invoke_heap_allocs, 1);
+      perf_kernel = (uint64_t *)calloc(PERF_KERNEL_KEY_MAX, sizeof(uint64_t));
+    }
     VERIFYC(perf_kernel != NULL, AEE_ENOMEMORY);
     req = INVOKE_PERF;
   }
   if (IS_DSP_PERF_ENABLED(hlist[domain].procattrs) &&
       (!IS_STATIC_HANDLE(handle))) {
-    perf_dsp = (uint64_t *)calloc(PERF_DSP_KEY_MAX, sizeof(uint64_t));
+    if (scratch && !asyncjob.isasyncjob) {
+      perf_dsp = scratch->perf_dsp;
+      memset(perf_dsp, 0, sizeof(scratch->perf_dsp));
+    } else {
+      atomic_fetch_add(&invoke_heap_allocs, 1);
+      perf_dsp = (uint64_t *)calloc(PERF_DSP_KEY_MAX, sizeof(uint64_t));
+    }
     VERIFYC(perf_dsp != NULL, AEE_ENOMEMORY);
     req = INVOKE_PERF;
   }
 
-  if (!IS_STATIC_HANDLE(handle)) {
+  if (!IS_STATIC_HANDLE(handle))
     fastrpc_latency_invoke_incr(&hlist[domain].qos);
+  if (batch) {
+    if (!IS_STATIC_HANDLE(handle))
+      invoke_batch_arm_timer(batch, handle, sc);
+  } else if (!IS_STATIC_HANDLE(handle)) {
     if ((rpc_timeout = fastrpc_config_get_rpctimeout()) > 0) {
       frpc_timer.domain = domain;
       frpc_timer.sc = sc;
@@ -1343,6 +1707,8 @@ int remote_handle_invoke_domain(int domain, remote_handle handle,
     wakelock_control_kernel_pm(domain, dev, PM_TIMEOUT_MS);
     fastrpc_wake_unlock();
     wake_lock = 0;
+  } else if (batch && batch->wake_lock) {
+    wakelock_control_kernel_pm(domain, dev, PM_TIMEOUT_MS);
   }
   // Macros are initializing and destroying pfds and pattrs.
   nErr = ioctl_invoke(dev, req, handle, sc, get_args(), pfds, pattrs, job,
@@ -1351,7 +1717,7 @@ int remote_handle_invoke_domain(int domain, remote_handle handle,
     nErr = convert_kernel_to_user_error(nErr, errno);
   }
 
-  if (fastrpc_wake_lock_enable[domain]) {
+  if (!batch && fastrpc_wake_lock_enable[domain]) {
     if (!fastrpc_wake_lock())
       wake_lock = 1;
   }
@@ -1415,23 +1781,24 @@ bail:
       desc->jobid = -1;
     }
   }
-  DESTROY_REMOTE_ARGS();
-  if (crc_local) {
+  DESTROY_REMOTE_ARGS(scratch ? scratch->args : NULL);
+  if (crc_local && !scratch) {
     free(crc_local);
     crc_local = NULL;
   }
-  if (crc_remote) {
+  if (crc_remote && !scratch) {
     free(crc_remote);
     crc_remote = NULL;
   }
-  if (perf_kernel && !asyncjob.isasyncjob) {
+  if (perf_kernel && !asyncjob.isasyncjob && !scratch) {
     free(perf_kernel);
     perf_kernel = NULL;
   }
-  if (perf_dsp && !asyncjob.isasyncjob) {
+  if (perf_dsp && !asyncjob.isasyncjob && !scratch) {
     free(perf_dsp);
     perf_dsp = NULL;
   }
+  invoke_scratch_put(scratch);
   if (wake_lock) {
     // Keep holding wake-lock for reverse RPC calls to keep CPU awake for any
     // further processing
@@ -1453,6 +1820,12 @@ bail:
   return nErr;
 }
 
+int remote_handle_invoke_domain(int domain, remote_handle handle,
+                                fastrpc_async_descriptor_t *desc, uint32_t sc,
+                                remote_arg *pra) {
+  return invoke_domain(domain, handle, desc, sc, pra, NULL);
+}
+
 int remote_handle_invoke(remote_handle handle, uint32_t sc, remote_arg *pra) {
   int domain = -1, nErr = AEE_SUCCESS, ref = 0;
 
@@ -1497,7 +1870,6 @@ int remote_handle64_invoke(remote_handle64 local, uint32_t sc,
                            remote_arg *pra) {
   remote_handle64 remote = 0;
   int nErr = AEE_SUCCESS, domain = -1, ref = 0;
-  struct handle_info *h = (struct handle_info*)local;
 
   if (IS_STATICPD_HANDLE(local)) {
      nErr = AEE_EINVHANDLE;
@@ -1512,9 +1884,8 @@ int remote_handle64_invoke(remote_handle64 local, uint32_t sc,
                          (int)local, sc);
   VERIFYC(local != (remote_handle64)-1, AEE_EINVHANDLE);
 
-  VERIFY(AEE_SUCCESS == (nErr = get_domain_from_handle(local, &domain)));
+  VERIFY(AEE_SUCCESS == (nErr = handle_table_lookup(local, &domain, &remote)));
   FASTRPC_GET_REF(domain);
-  VERIFY(AEE_SUCCESS == (nErr = get_handle_remote(local, &remote)));
   VERIFY(AEE_SUCCESS ==
          (nErr = remote_handle_invoke_domain(domain, remote, NULL, sc, pra)));
 bail:
@@ -1525,10 +1896,14 @@ bail:
     }
     if (0 == check_rpc_error(nErr)) {
       if (get_logger_state(domain)) {
+        char name[HANDLE_NAME_LOG_LEN];
+
         FARF(ERROR,
              "Error 0x%x: %s failed for module %s, handle 0x%" PRIx64
              ", method %d on domain %d (sc 0x%x) (errno %s)\n",
-             nErr, __func__, h->name, local, REMOTE_SCALARS_METHOD(sc), domain, sc,
+             nErr, __func__, handle_table_name(local, name, sizeof(name)),
+             local,
+             REMOTE_SCALARS_METHOD(sc), domain, sc,
              strerror(errno));
       }
     }
@@ -1537,6 +1912,78 @@ bail:
   return nErr;
 }
 
+int remote_handle64_invoke_batch(const remote_invoke_batch_call *calls,
+                                 uint32_t num_calls, uint32_t flags,
+                                 int *results) {
+  struct invoke_batch batch = {0};
+  remote_handle64 local = INVALID_HANDLE, remote = 0;
+  int nErr = AEE_SUCCESS, err = AEE_SUCCESS, domain = -1;
+  bool submitted = false;
+  uint32_t ii = 0;
+
+  VERIFY(AEE_SUCCESS == (nErr = fastrpc_init_once()));
+
+  FARF(RUNTIME_RPC_HIGH, "Entering %s, calls %p num_calls %u flags 0x%x\n",
+       __func__, calls, num_calls, flags);
+  FASTRPC_ATRACE_BEGIN_L("%s called with %u calls", __func__, num_calls);
+  VERIFYC(calls && results, AEE_EBADPARM);
+  VERIFYC(!(flags & ~REMOTE_INVOKE_BATCH_CONTINUE_ON_ERROR), AEE_EBADPARM);
+  for (ii = 0; ii < num_calls; ii++)
+    results[ii] = AEE_EINTERRUPTED;
+  submitted = true;
+
+  for (ii = 0; ii < num_calls; ii++) {
+    const remote_invoke_batch_call *call = &calls[ii];
+
+    // Back-to-back calls on the same handle are validated once
+    err = AEE_SUCCESS;
+    if (call->h != local) {
+      local = INVALID_HANDLE;
+      if (IS_STATICPD_HANDLE(call->h))
+        err = AEE_EINVHANDLE;
+      else
+        err = handle_table_lookup(call->h, &domain, &remote);
+      if (!err && (!batch.active || batch.domain != domain)) {
+        invoke_batch_end(&batch);
+        err = invoke_batch_begin(&batch, domain);
+      }
+      if (!err)
+        local = call->h;
+    }
+    if (!err)
+      err = invoke_domain(domain, remote, NULL, call->dwScalars, call->pra,
+                          &batch);
+    results[ii] = err;
+    if (err) {
+      if (0 == check_rpc_error(err) && !is_process_exiting(domain) &&
+          get_logger_state(domain)) {
+        char name[HANDLE_NAME_LOG_LEN];
+
+        FARF(ERROR,
+             "Error 0x%x: %s failed for call %u, module %s, handle 0x%" PRIx64
+             ", method %d on domain %d (sc 0x%x) (errno %s)\n",
+             err, __func__, ii, handle_table_name(call->h, name, sizeof(name)),
+             call->h,
+             REMOTE_SCALARS_METHOD(call->dwScalars), domain, call->dwScalars,
+             strerror(errno));
+      }
+      if (nErr == AEE_SUCCESS)
+        nErr = err;
+      if (!(flags & REMOTE_INVOKE_BATCH_CONTINUE_ON_ERROR))
+        break;
+    }
+  }
+bail:
+  invoke_batch_end(&batch);
+  // Failures of individual calls are logged as they happen
+  if (nErr != AEE_SUCCESS && !submitted) {
+    FARF(ERROR, "Error 0x%x: %s failed for %u calls (errno %s)\n", nErr,
+         __func__, num_calls, strerror(errno));
+  }
+  FASTRPC_ATRACE_END();
+  return nErr;
+}
+
 int remote_handle_invoke_async(remote_handle handle,
                                fastrpc_async_descriptor_t *desc, uint32_t sc,
                                remote_arg *pra) {
@@ -1584,9 +2031,8 @@ int remote_handle64_invoke_async(remote_handle64 local,
                          (int)local, sc);
   VERIFYC(local != (remote_handle64)-1, AEE_EINVHANDLE);
 
-  VERIFY(AEE_SUCCESS == (nErr = get_domain_from_handle(local, &domain)));
+  VERIFY(AEE_SUCCESS == (nErr = handle_table_lookup(local, &domain, &remote)));
   FASTRPC_GET_REF(domain);
-  VERIFY(AEE_SUCCESS == (nErr = get_handle_remote(local, &remote)));
   VERIFY(AEE_SUCCESS ==
          (nErr = remote_handle_invoke_domain(domain, remote, desc, sc, pra)));
 bail:
@@ -1811,16 +2257,17 @@ int remote_handle64_open(const char *name, remote_handle64 *ph) {
                    IS_STATICPD_HANDLE(h)) {
     *ph = h;
   } else {
-    fastrpc_update_module_list(DOMAIN_LIST_PREPEND, domain, h, &local, name);
+    VERIFY(AEE_SUCCESS == (nErr = fastrpc_update_module_list(
+                               DOMAIN_LIST_PREPEND, domain, h, &local, name)));
     get_handle_remote(local, &remote);
     *ph = local;
   }
 bail:
   if (nErr) {
+    // The module is not in the handle list, close it on the DSP only
     if (h)
-      remote_handle_close(h);
-    else
-      FASTRPC_PUT_REF(domain);
+      remote_handle_close_domain(domain, h);
+    FASTRPC_PUT_REF(domain);
     if (0 == check_rpc_error(nErr)) {
       FARF(ERROR, "Error 0x%x: %s failed for %s (errno %s)\n", nErr, __func__,
            name, strerror(errno));
@@ -1920,7 +2367,7 @@ int remote_handle64_close(remote_handle64 handle) {
   remote_handle64 remote = 0;
   int domain = -1, nErr = AEE_SUCCESS, ref = 1;
   bool start_deinit = false;
-  struct handle_info *hi = (struct handle_info*)handle;
+  char name[HANDLE_NAME_LOG_LEN] = "unknown";
 
   if (IS_STATICPD_HANDLE(handle))
      return AEE_SUCCESS;
@@ -1930,6 +2377,7 @@ int remote_handle64_close(remote_handle64 handle) {
   VERIFYC(handle != (remote_handle64)-1, AEE_EINVHANDLE);
   VERIFY(AEE_SUCCESS == (nErr = get_domain_from_handle(handle, &domain)));
   VERIFY(AEE_SUCCESS == (nErr = get_handle_remote(handle, &remote)));
+  handle_table_name(handle, name, sizeof(name));
   set_thread_context(domain);
   /*
    * Terminate remote session if
@@ -1937,9 +2385,17 @@ int remote_handle64_close(remote_handle64 handle) {
    *     2. there are no open multi-domain handles, OR
    *        only 1 multi-domain handle is open (for perf reason,
    *        skip closing of it)
+   * Modules opened by FASTRPC_SESSION_PREWARM do not keep the session alive,
+   * domain_deinit releases them. A module being opened by the bring-up is
+   * counted once its handle is kept.
    */
-  if (hlist[domain].domainsCount <= 1 && !hlist[domain].nondomainsCount)
+  pthread_mutex_lock(&hlist[domain].prewarm_open_mut);
+  pthread_mutex_lock(&hlist[domain].prewarm_mut);
+  if (hlist[domain].domainsCount - hlist[domain].num_prewarm_handles <= 1 &&
+      !hlist[domain].nondomainsCount)
     start_deinit = true;
+  pthread_mutex_unlock(&hlist[domain].prewarm_mut);
+  pthread_mutex_unlock(&hlist[domain].prewarm_open_mut);
   /*
    * If session termination is not initiated and the remote handle is valid,
    * then close the remote handle on DSP.
@@ -1950,8 +2406,9 @@ int remote_handle64_close(remote_handle64 handle) {
   }
   FARF(ALWAYS, "%s: closed module %s with handle 0x%" PRIx64 " remote handle 0x%" PRIx64
 		", num of open handles: %u",
-         __func__, hi->name, handle, remote, hlist[domain].domainsCount - 1);
-  fastrpc_update_module_list(DOMAIN_LIST_DEQUEUE, domain, handle, NULL, NULL);
+         __func__, name, handle, remote, hlist[domain].domainsCount - 1);
+  fastrpc_update_module_list(DOMAIN_LIST_DEQUEUE, domain, remote, &handle,
+                             NULL);
   FASTRPC_PUT_REF(domain);
 bail:
   if (nErr != AEE_EINVHANDLE && IS_VALID_EFFECTIVE_DOMAIN_ID(domain)) {
@@ -1966,7 +2423,7 @@ bail:
         FARF(ERROR,
            "Error 0x%x: %s close module %s failed for handle 0x%" PRIx64
            " remote handle 0x%" PRIx64 " (errno %s), num of open handles: %u\n",
-           nErr, __func__, hi->name, handle, remote, strerror(errno),
+           nErr, __func__, name, handle, remote, strerror(errno),
            hlist[domain].domainsCount);
     }
   }
@@ -2465,6 +2922,7 @@ static int close_domain_session(int domain) {
   } else {
     adsp_current_process_exit();
   }
+  session_prewarm_close_handles(domain);
   pthread_mutex_lock(&hlist[domain].lmut);
   if (!QList_IsEmpty(&hlist[domain].nql)) {
     QLIST_NEXTSAFE_FOR_ALL(&hlist[domain].nql, pn, pnn) {
@@ -2998,6 +3456,55 @@ int remote_session_control(uint32_t req, void *data, uint32_t datalen) {
     VERIFY(AEE_SUCCESS == (nErr = fastrpc_destroy_context(dest->ctx)));
     break;
   }
+  case FASTRPC_MOCK_DRIVER: {
+    struct remote_rpc_mock_driver *mock =
+        (struct remote_rpc_mock_driver *)data;
+
+    VERIFYC(datalen == sizeof(struct remote_rpc_mock_driver) && mock,
+            AEE_EBADPARM);
+#ifdef ENABLE_MOCK_DRIVER
+    // The driver can only be switched while no session is open
+    for (ii = 0; ii < NUM_DOMAINS_EXTEND; ii++)
+      VERIFYC(hlist[ii].dev == INVALID_DEVICE, AEE_EBADSTATE);
+    VERIFY(AEE_SUCCESS == (nErr = fastrpc_mock_set_enabled(mock->enable)));
+#else
+    // Library configured without --enable-mock-driver
+    nErr = AEE_EUNSUPPORTED;
+    goto bail;
+#endif
+    break;
+  }
+  case FASTRPC_SESSION_PREWARM: {
+    struct remote_rpc_session_prewarm *pw =
+        (struct remote_rpc_session_prewarm *)data;
+
+    VERIFYC(datalen == sizeof(struct remote_rpc_session_prewarm) && pw,
+            AEE_EBADPARM);
+    VERIFYC(IS_VALID_EFFECTIVE_DOMAIN_ID(pw->domain), AEE_EBADPARM);
+    switch (pw->op) {
+    case FASTRPC_PREWARM_START:
+      VERIFYC(pw->num_skel_uris == 0 || pw->skel_uris, AEE_EBADPARM);
+      for (ii = 0; ii < (int)pw->num_skel_uris; ii++)
+        VERIFYC(pw->skel_uris[ii], AEE_EBADPARM);
+      VERIFY(AEE_SUCCESS == (nErr = session_prewarm_start(pw->domain,
+                                                          pw->skel_uris,
+                                                          pw->num_skel_uris)));
+      pw->status = AEE_EITEMBUSY;
+      break;
+    case FASTRPC_PREWARM_WAIT:
+      VERIFY(AEE_SUCCESS == (nErr = session_prewarm_wait(
+                                 pw->domain, pw->timeout_us, &pw->status)));
+      break;
+    case FASTRPC_PREWARM_POLL:
+      VERIFY(AEE_SUCCESS ==
+             (nErr = session_prewarm_wait(pw->domain, 0, &pw->status)));
+      break;
+    default:
+      nErr = AEE_EBADPARM;
+      goto bail;
+    }
+    break;
+  }
   default:
     nErr = AEE_EUNSUPPORTED;
     FARF(ERROR, "ERROR 0x%x: %s Unsupported request ID %d", nErr, __func__,
@@ -3165,6 +3672,8 @@ static void domain_deinit(int domain) {
   if (!hlist) {
     return;
   }
+  // The deferred bring-up stages call into the DSP process, finish them first
+  domain_deferred_init_join(domain);
   olddev = hlist[domain].dev;
   FARF(ALWAYS, "%s for domain %d: dev %d", __func__, domain, olddev);
   if (olddev != -1) {
@@ -3190,6 +3699,7 @@ static void domain_deinit(int domain) {
     fastrpc_async_domain_deinit(domain);
     pthread_mutex_unlock(&hlist[domain].async_init_deinit_mut);
     fastrpc_notif_domain_deinit(domain);
+    session_prewarm_drop_handles(domain);
     fastrpc_clear_handle_list(MULTI_DOMAIN_HANDLE_LIST_ID, domain);
     fastrpc_clear_handle_list(REVERSE_HANDLE_LIST_ID, domain);
     if (domain == DEFAULT_DOMAIN_ID) {
@@ -3230,7 +3740,15 @@ static void domain_deinit(int domain) {
   pthread_mutex_unlock(&hlist[domain].init);
   pthread_mutex_lock(&hlist[domain].mut);
   hlist[domain].state = FASTRPC_DOMAIN_STATE_CLEAN;
+  // A bring-up still in flight must not report this session as up
+  hlist[domain].session_gen++;
   pthread_mutex_unlock(&hlist[domain].mut);
+  // A prewarmed session is gone
+  pthread_mutex_lock(&hlist[domain].prewarm_mut);
+  if (hlist[domain].prewarm_status != AEE_EITEMBUSY) {
+    hlist[domain].prewarm_status = AEE_ENOTINITIALIZED;
+  }
+  pthread_mutex_unlock(&hlist[domain].prewarm_mut);
 }
 
 static const char *get_domain_name(int domain_id) {
@@ -3265,6 +3783,7 @@ int open_device_node(int domain_id) {
   int domain = GET_DOMAIN_FROM_EFFEC_DOMAIN_ID(domain_id);
   int sess_id = GET_SESSION_ID_FROM_DOMAIN_ID(domain_id);
 
+  FASTRPC_MOCK_RETURN(fastrpc_mock_open(domain_id));
   switch (domain) {
   case ADSP_DOMAIN_ID:
   case SDSP_DOMAIN_ID:
@@ -3332,7 +3851,7 @@ int open_device_node(int domain_id) {
 
 static int close_device_node(int domain_id, int dev) {
   int nErr = 0;
-  nErr = close(dev);
+  nErr = close_device(dev);
   FARF(ALWAYS, "%s: closed dev %d on domain %d", __func__, dev, domain_id);
   return nErr;
 }
@@ -3607,6 +4126,7 @@ static int remote_init(int domain) {
   int shared_buf_support = 0;
   char *file = NULL;
   int flags = 0, filelen = 0, memlen = 0, filefd = -1;
+  struct fastrpc_shell_image shell_img = {0};
 
   FARF(RUNTIME_RPC_HIGH, "starting %s for domain %d", __func__, domain);
   /*
@@ -3746,14 +4266,21 @@ static int remote_init(int domain) {
         VERIFY(AEE_SUCCESS == (nErr = apps_std_flen(fh, &len)));
         filelen = len + siglen;
         VERIFYC(filelen && filelen < INT_MAX, AEE_EFILE);
-        file = rpcmem_alloc_internal(0, RPCMEM_HEAP_DEFAULT, (size_t)filelen);
-        VERIFYC(file, AEE_ENORPCMEMORY);
-        VERIFY(AEE_SUCCESS ==
-               (nErr = apps_std_fread(fh, (unsigned char *)file, len, &readlen, &eof)));
-        VERIFYC((int)len == readlen, AEE_EFILE);
-        filefd = rpcmem_to_fd_internal((void *)file);
-        filelen = (int)len;
-        VERIFYC(filefd != -1, AEE_ERPC);
+        if (AEE_SUCCESS == fastrpc_shell_cache_lookup(fh, fsig, &shell_img)) {
+          // Shell and testsig are mapped from the cache, the kernel copies
+          // them from there
+          file = shell_img.data;
+          filelen = (int)len;
+        } else {
+          file = rpcmem_alloc_internal(0, RPCMEM_HEAP_DEFAULT, (size_t)filelen);
+          VERIFYC(file, AEE_ENORPCMEMORY);
+          VERIFY(AEE_SUCCESS ==
+                 (nErr = apps_std_fread(fh, (unsigned char *)file, len, &readlen, &eof)));
+          VERIFYC((int)len == readlen, AEE_EFILE);
+          filefd = rpcmem_to_fd_internal((void *)file);
+          filelen = (int)len;
+          VERIFYC(filefd != -1, AEE_ERPC);
+        }
       } else {
         siglen = 0;
         fsig = -1;
@@ -3773,13 +4300,19 @@ static int remote_init(int domain) {
       }
       if (hlist[domain].procattrs) {
         if (siglen && fsig != -1) {
-          VERIFY(AEE_SUCCESS ==
-                 (nErr = apps_std_fread(fsig, (unsigned char *)(file + len), siglen,
-                                        &readlen, &eof)));
-          VERIFYC(siglen == (uint64_t)readlen, AEE_EFILE);
+          if (!shell_img.base) {
+            VERIFY(AEE_SUCCESS ==
+                   (nErr = apps_std_fread(fsig, (unsigned char *)(file + len),
+                                          siglen, &readlen, &eof)));
+            VERIFYC(siglen == (uint64_t)readlen, AEE_EFILE);
+          }
           filelen = len + siglen;
         }
       }
+      if (fh != -1 && !shell_img.base) {
+        fastrpc_shell_cache_store(fh, fsig, file, (uint32_t)len,
+                                  (uint32_t)(filelen - len));
+      }
       ioErr = ioctl_init(dev, flags, hlist[domain].procattrs, (unsigned char *)file,
                          filelen, filefd, NULL, memlen, -1, siglen);
       if (ioErr) {
@@ -3806,6 +4339,10 @@ bail:
   // errno is being set to 0 in apps_std_fclose and we need original errno to
   // return proper error to user call
   errno_save = errno;
+  if (shell_img.base) {
+    fastrpc_shell_cache_release(&shell_img);
+    file = NULL;
+  }
   if (file) {
     rpcmem_free_internal(file);
     file = NULL;
@@ -3947,11 +4484,141 @@ bail:
   return INVALID_HANDLE;
 }
 
-static int domain_init(int domain, int *dev) {
-  int nErr = AEE_SUCCESS, dom = GET_DOMAIN_FROM_EFFEC_DOMAIN_ID(domain);
+static const char *domain_init_stage_names[DOMAIN_INIT_STAGE_MAX] = {
+    [DOMAIN_INIT_STAGE_REMOTE_INIT] = "remote_init",
+    [DOMAIN_INIT_STAGE_MEM] = "mem",
+    [DOMAIN_INIT_STAGE_KERNEL_OPT] = "kernel_opt",
+    [DOMAIN_INIT_STAGE_NOTIF] = "notif",
+    [DOMAIN_INIT_STAGE_LATENCY] = "latency",
+    [DOMAIN_INIT_STAGE_LISTENER] = "listener",
+    [DOMAIN_INIT_STAGE_PANIC_CODES] = "panic_codes",
+    [DOMAIN_INIT_STAGE_FILE_WATCHER] = "file_watcher",
+    [DOMAIN_INIT_STAGE_MSGD] = "msgd",
+    [DOMAIN_INIT_STAGE_PERF] = "perf",
+};
+
+// Logs the time spent in the bring-up stages [first, last) of a domain
+static void domain_init_report(int domain, int first, int last) {
+  char buf[512];
+  int ii, len = 0;
+  uint64_t total = 0;
+
+  buf[0] = '\0';
+  for (ii = first; ii < last && len < (int)sizeof(buf); ii++) {
+    len += snprintf(buf + len, sizeof(buf) - len, " %s %" PRIu64,
+                    domain_init_stage_names[ii], hlist[domain].init_stage_us[ii]);
+    total += hlist[domain].init_stage_us[ii];
+  }
+  FARF(ALWAYS, "%s: domain %d %s bring-up took %" PRIu64 " us:%s", __func__,
+       domain, first < DOMAIN_INIT_STAGE_DEFERRED ? "session" : "deferred",
+       total, buf);
+}
+
+// Sends the panic error codes of the debug config to the DSP process, to
+// crash it when one of them is hit
+static void domain_send_panic_err_codes(int domain) {
+  int dom = GET_DOMAIN_FROM_EFFEC_DOMAIN_ID(domain);
   remote_handle64 panic_handle = 0;
   struct err_codes *err_codes_to_send = NULL;
 
+  if (dom != CDSP_DOMAIN_ID && dom != CDSP1_DOMAIN_ID) {
+    return;
+  }
+  panic_handle = get_adsp_current_process1_handle(domain);
+  if (panic_handle != INVALID_HANDLE) {
+    int ret = -1;
+    /* If error codes are available in debug config, send panic error codes to
+     * dsp to crash. */
+    err_codes_to_send = fastrpc_config_get_errcodes();
+    if (err_codes_to_send) {
+      ret = adsp_current_process1_panic_err_codes(
+          panic_handle, err_codes_to_send->err_code,
+          err_codes_to_send->num_err_codes);
+      if (AEE_SUCCESS == ret) {
+        FARF(ALWAYS, "%s : panic error codes sent successfully\n", __func__);
+      } else {
+        FARF(ERROR, "Error 0x%x: %s : panic error codes send failed\n", ret,
+             __func__);
+      }
+    }
+  } else {
+    FARF(ALWAYS, "%s : current process handle is not valid\n", __func__);
+  }
+}
+
+// Runs the bring-up stages that the session does not need to serve its
+// first call. Errors are only logged, as they were never fatal to the session.
+static void *domain_deferred_init_thread(void *arg) {
+  int domain = (int)(uintptr_t)arg;
+  uint64_t *stage_us = hlist[domain].init_stage_us;
+
+  PROFILE_ALWAYS(&stage_us[DOMAIN_INIT_STAGE_PANIC_CODES],
+                 domain_send_panic_err_codes(domain););
+  PROFILE_ALWAYS(&stage_us[DOMAIN_INIT_STAGE_FILE_WATCHER],
+                 initFileWatcher(domain);); // Ignore errors
+#ifdef PD_EXCEPTION_LOGGING
+  PROFILE_ALWAYS(&stage_us[DOMAIN_INIT_STAGE_MSGD], {
+    int dom = GET_DOMAIN_FROM_EFFEC_DOMAIN_ID(domain);
+    if ((dom != SDSP_DOMAIN_ID) && hlist[domain].dsppd == ROOT_PD) {
+      remote_handle64 handle = 0;
+      handle = get_adspmsgd_adsp1_handle(domain);
+      if (handle != INVALID_HANDLE) {
+        adspmsgd_init(handle, 0x10); // enable PD exception logging
+      }
+    }
+  });
+#endif
+  PROFILE_ALWAYS(&stage_us[DOMAIN_INIT_STAGE_PERF],
+                 fastrpc_perf_init(hlist[domain].dev, domain););
+  domain_init_report(domain, DOMAIN_INIT_STAGE_DEFERRED,
+                     DOMAIN_INIT_STAGE_MAX);
+  return NULL;
+}
+
+/*
+ * Starts the deferred bring-up stages of a domain on a worker thread. Must
+ * hold hlist[domain].mut, so that the thread is known to domain_deinit
+ * before the domain is published as initialized. Returns non-zero if no
+ * thread could be created, the caller then runs the stages inline once the
+ * mutex is released.
+ */
+static int domain_deferred_init_start_locked(int domain) {
+  int nErr = pthread_create(&hlist[domain].deferred_init_thread, NULL,
+                            domain_deferred_init_thread,
+                            (void *)(uintptr_t)domain);
+
+  if (nErr) {
+    FARF(ERROR, "Error 0x%x: %s: thread create failed for domain %d", nErr,
+         __func__, domain);
+    return nErr;
+  }
+  hlist[domain].deferred_init_started = true;
+  return 0;
+}
+
+// Waits for the deferred bring-up stages of a domain to finish
+static void domain_deferred_init_join(int domain) {
+  bool started;
+
+  pthread_mutex_lock(&hlist[domain].mut);
+  started = hlist[domain].deferred_init_started;
+  hlist[domain].deferred_init_started = false;
+  pthread_mutex_unlock(&hlist[domain].mut);
+  if (!started) {
+    return;
+  }
+  if (pthread_equal(pthread_self(), hlist[domain].deferred_init_thread)) {
+    // Session torn down by a failure in one of the deferred stages
+    pthread_detach(hlist[domain].deferred_init_thread);
+  } else {
+    pthread_join(hlist[domain].deferred_init_thread, NULL);
+  }
+}
+
+static int domain_init(int domain, int *dev) {
+  int nErr = AEE_SUCCESS, deferred_inline = 0;
+  uint64_t *stage_us = hlist[domain].init_stage_us;
+
   pthread_mutex_lock(&hlist[domain].mut);
   if (hlist[domain].state != FASTRPC_DOMAIN_STATE_CLEAN) {
     *dev = hlist[domain].dev;
@@ -3963,46 +4630,29 @@ static int domain_init(int domain, int *dev) {
   QList_Ctor(&hlist[domain].nql);
   QList_Ctor(&hlist[domain].rql);
   hlist[domain].is_session_reserved = true;
-  VERIFY(AEE_SUCCESS == (nErr = remote_init(domain)));
+  memset(stage_us, 0, sizeof(hlist[domain].init_stage_us));
+  PROFILE_ALWAYS(&stage_us[DOMAIN_INIT_STAGE_REMOTE_INIT],
+                 VERIFY(AEE_SUCCESS == (nErr = remote_init(domain))););
   if (fastrpc_wake_lock_enable[domain]) {
     VERIFY(AEE_SUCCESS ==
            (nErr = update_kernel_wakelock_status(
                 domain, hlist[domain].dev, fastrpc_wake_lock_enable[domain])));
   }
-  VERIFY(AEE_SUCCESS == (nErr = fastrpc_mem_open(domain)));
-  VERIFY(AEE_SUCCESS == (nErr = apps_mem_init(domain)));
-
-  if (dom == CDSP_DOMAIN_ID || dom == CDSP1_DOMAIN_ID) {
-    panic_handle = get_adsp_current_process1_handle(domain);
-    if (panic_handle != INVALID_HANDLE) {
-      int ret = -1;
-      /* If error codes are available in debug config, send panic error codes to
-       * dsp to crash. */
-      err_codes_to_send = fastrpc_config_get_errcodes();
-      if (err_codes_to_send) {
-        ret = adsp_current_process1_panic_err_codes(
-            panic_handle, err_codes_to_send->err_code,
-            err_codes_to_send->num_err_codes);
-        if (AEE_SUCCESS == ret) {
-          FARF(ALWAYS, "%s : panic error codes sent successfully\n", __func__);
-        } else {
-          FARF(ERROR, "Error 0x%x: %s : panic error codes send failed\n", ret,
-               __func__);
-        }
-      }
-    } else {
-      FARF(ALWAYS, "%s : current process handle is not valid\n", __func__);
-    }
-  }
-  VERIFY(AEE_SUCCESS == (nErr = fastrpc_enable_kernel_optimizations(domain)));
-  initFileWatcher(domain); // Ignore errors
+  PROFILE_ALWAYS(&stage_us[DOMAIN_INIT_STAGE_MEM], {
+    VERIFY(AEE_SUCCESS == (nErr = fastrpc_mem_open(domain)));
+    VERIFY(AEE_SUCCESS == (nErr = apps_mem_init(domain)));
+  });
+  PROFILE_ALWAYS(&stage_us[DOMAIN_INIT_STAGE_KERNEL_OPT],
+                 VERIFY(AEE_SUCCESS ==
+                        (nErr = fastrpc_enable_kernel_optimizations(domain))););
   trace_marker_init(domain);
 
   // If client notifications are registered, initialize notification thread and
   // enable notifications on domains
   if (fastrpc_notif_flag) {
     int ret = 0;
-    ret = enable_process_state_notif_on_dsp(domain);
+    PROFILE_ALWAYS(&stage_us[DOMAIN_INIT_STAGE_NOTIF],
+                   ret = enable_process_state_notif_on_dsp(domain););
     if (ret == (int)(DSP_AEE_EOFFSET + AEE_EUNSUPPORTED)) {
       VERIFY_WPRINTF("Warning: %s: DSP does not support notifications",
                      __func__);
@@ -4011,25 +4661,28 @@ static int domain_init(int domain, int *dev) {
                 ret == (int)(DSP_AEE_EOFFSET + AEE_EUNSUPPORTED),
             ret);
   }
-#ifdef PD_EXCEPTION_LOGGING
-  if ((dom != SDSP_DOMAIN_ID) && hlist[domain].dsppd == ROOT_PD) {
-    remote_handle64 handle = 0;
-    handle = get_adspmsgd_adsp1_handle(domain);
-    if (handle != INVALID_HANDLE) {
-      adspmsgd_init(handle, 0x10); // enable PD exception logging
-    }
-  }
-#endif
-  fastrpc_perf_init(hlist[domain].dev, domain);
-  VERIFY(AEE_SUCCESS ==
-         (nErr = fastrpc_latency_init(hlist[domain].dev, &hlist[domain].qos)));
+  PROFILE_ALWAYS(&stage_us[DOMAIN_INIT_STAGE_LATENCY],
+                 VERIFY(AEE_SUCCESS ==
+                        (nErr = fastrpc_latency_init(hlist[domain].dev,
+                                                     &hlist[domain].qos))););
   get_dsp_dma_reverse_rpc_map_capability(domain);
+  /*
+   * Panic codes, the file watcher, PD exception logging and perf key
+   * discovery are not needed to serve the first call: run them on a worker
+   * thread, concurrently with the listener start and the first calls.
+   */
+  deferred_inline = domain_deferred_init_start_locked(domain);
   hlist[domain].state = FASTRPC_DOMAIN_STATE_INIT;
   hlist[domain].ref = 0;
   pthread_mutex_unlock(&hlist[domain].mut);
-  VERIFY(AEE_SUCCESS == (nErr = listener_android_domain_init(
+  if (deferred_inline)
+    domain_deferred_init_thread((void *)(uintptr_t)domain);
+  PROFILE_ALWAYS(&stage_us[DOMAIN_INIT_STAGE_LISTENER],
+                 VERIFY(AEE_SUCCESS ==
+                        (nErr = listener_android_domain_init(
                              domain, hlist[domain].th_params.update_requested,
-                             &hlist[domain].th_params.r_sem)));
+                             &hlist[domain].th_params.r_sem))););
+  domain_init_report(domain, 0, DOMAIN_INIT_STAGE_DEFERRED);
 bail:
   if (nErr != AEE_SUCCESS) {
     domain_deinit(domain);
@@ -4054,6 +4707,245 @@ bail:
   }
 }
 
+static void session_prewarm_free_uris(int domain) {
+  uint32_t ii;
+
+  for (ii = 0; ii < hlist[domain].num_prewarm_uris; ii++) {
+    free(hlist[domain].prewarm_uris[ii]);
+  }
+  free(hlist[domain].prewarm_uris);
+  hlist[domain].prewarm_uris = NULL;
+  hlist[domain].num_prewarm_uris = 0;
+}
+
+/*
+ * Keeps a module opened by the bring-up, so that it stays loaded until the
+ * session is closed.
+ * returns 0 on success, the caller closes the handle otherwise
+ */
+static int session_prewarm_keep_handle(int domain, remote_handle64 h) {
+  remote_handle64 *handles;
+
+  pthread_mutex_lock(&hlist[domain].prewarm_mut);
+  handles = realloc(hlist[domain].prewarm_handles,
+                    (hlist[domain].num_prewarm_handles + 1) * sizeof(*handles));
+  if (handles) {
+    hlist[domain].prewarm_handles = handles;
+    handles[hlist[domain].num_prewarm_handles++] = h;
+  }
+  pthread_mutex_unlock(&hlist[domain].prewarm_mut);
+  if (!handles) {
+    FARF(ERROR, "Error 0x%x: %s: no memory to keep handle 0x%" PRIx64,
+         AEE_ENOMEMORY, __func__, h);
+    return AEE_ENOMEMORY;
+  }
+  return AEE_SUCCESS;
+}
+
+/*
+ * Closes the modules opened by the bring-up, one at a time so that
+ * remote_handle64_close sees the ones still held.
+ */
+static void session_prewarm_close_handles(int domain) {
+  remote_handle64 h;
+
+  for (;;) {
+    pthread_mutex_lock(&hlist[domain].prewarm_mut);
+    if (!hlist[domain].num_prewarm_handles) {
+      pthread_mutex_unlock(&hlist[domain].prewarm_mut);
+      break;
+    }
+    h = hlist[domain].prewarm_handles[--hlist[domain].num_prewarm_handles];
+    pthread_mutex_unlock(&hlist[domain].prewarm_mut);
+    remote_handle64_close(h);
+  }
+}
+
+/*
+ * Releases the local state of the modules opened by the bring-up, on
+ * session teardown when the DSP process is already gone.
+ */
+static void session_prewarm_drop_handles(int domain) {
+  remote_handle64 remote = 0;
+  uint32_t ii;
+
+  pthread_mutex_lock(&hlist[domain].prewarm_mut);
+  for (ii = 0; ii < hlist[domain].num_prewarm_handles; ii++) {
+    get_handle_remote(hlist[domain].prewarm_handles[ii], &remote);
+    fastrpc_update_module_list(DOMAIN_LIST_DEQUEUE, domain, remote,
+                               &hlist[domain].prewarm_handles[ii], NULL);
+  }
+  free(hlist[domain].prewarm_handles);
+  hlist[domain].prewarm_handles = NULL;
+  hlist[domain].num_prewarm_handles = 0;
+  pthread_mutex_unlock(&hlist[domain].prewarm_mut);
+}
+
+static void *session_prewarm_thread(void *arg) {
+  int domain = (int)(uintptr_t)arg;
+  int nErr = AEE_SUCCESS, dev = -1;
+  uint32_t ii, gen = 0;
+  uint64_t t_init = 0, t_open = 0;
+
+  /*
+   * An open issued meanwhile blocks in domain_init until this one is done.
+   * If it already brought up a session and closed it, there is nothing
+   * left to warm.
+   */
+  pthread_mutex_lock(&hlist[domain].mut);
+  if (hlist[domain].session_gen != hlist[domain].prewarm_gen)
+    nErr = AEE_ENOTINITIALIZED;
+  pthread_mutex_unlock(&hlist[domain].mut);
+  if (nErr == AEE_SUCCESS)
+    PROFILE_ALWAYS(&t_init, nErr = domain_init(domain, &dev););
+  if (nErr == AEE_SUCCESS) {
+    // Generation of the session that is up, it may already be closed
+    pthread_mutex_lock(&hlist[domain].mut);
+    if (hlist[domain].state == FASTRPC_DOMAIN_STATE_INIT)
+      gen = hlist[domain].session_gen;
+    else
+      nErr = AEE_ENOTINITIALIZED;
+    pthread_mutex_unlock(&hlist[domain].mut);
+  }
+  if (nErr == AEE_SUCCESS) {
+    PROFILE_ALWAYS(&t_open, {
+      for (ii = 0; ii < hlist[domain].num_prewarm_uris; ii++) {
+        remote_handle64 h = INVALID_HANDLE;
+        int ret;
+        int kept = AEE_EFAILED;
+
+        // A close must not count the module before its handle is kept
+        pthread_mutex_lock(&hlist[domain].prewarm_open_mut);
+        ret = remote_handle64_open(hlist[domain].prewarm_uris[ii], &h);
+        if (ret == AEE_SUCCESS)
+          kept = session_prewarm_keep_handle(domain, h);
+        pthread_mutex_unlock(&hlist[domain].prewarm_open_mut);
+        if (ret != AEE_SUCCESS) {
+          FARF(ERROR, "Error 0x%x: %s: failed to open %s on domain %d", ret,
+               __func__, hlist[domain].prewarm_uris[ii], domain);
+        } else if (kept != AEE_SUCCESS) {
+          remote_handle64_close(h);
+        }
+      }
+    });
+  }
+  FARF(ALWAYS,
+       "%s: domain %d done, err 0x%x (init %" PRIu64 " us, %u modules %" PRIu64
+       " us)",
+       __func__, domain, nErr, t_init, hlist[domain].num_prewarm_uris, t_open);
+  pthread_mutex_lock(&hlist[domain].prewarm_mut);
+  session_prewarm_free_uris(domain);
+  /*
+   * The session came up but was closed before the bring-up reported it.
+   * A later close resets the status itself, as it is no longer busy.
+   */
+  pthread_mutex_lock(&hlist[domain].mut);
+  if (nErr == AEE_SUCCESS && hlist[domain].session_gen != gen)
+    nErr = AEE_ENOTINITIALIZED;
+  pthread_mutex_unlock(&hlist[domain].mut);
+  hlist[domain].prewarm_status = nErr;
+  pthread_cond_broadcast(&hlist[domain].prewarm_cond);
+  pthread_mutex_unlock(&hlist[domain].prewarm_mut);
+  return NULL;
+}
+
+/*
+ * Starts the bring-up of the session of a domain on a background thread,
+ * unless one is already in progress or done for the current session.
+ * @ domain: effective domain ID
+ * @ uris: modules to open once the session is up, may be NULL
+ * @ num_uris: number of modules in uris
+ * returns 0 on success
+ */
+static int session_prewarm_start(int domain, const char **uris,
+                                 uint32_t num_uris) {
+  int nErr = AEE_SUCCESS;
+  uint32_t ii;
+
+  pthread_mutex_lock(&hlist[domain].prewarm_mut);
+  if (hlist[domain].prewarm_status == AEE_EITEMBUSY ||
+      hlist[domain].prewarm_status == AEE_SUCCESS) {
+    // Bring-up in flight or session already warm, its modules are open
+    goto bail;
+  }
+  if (hlist[domain].prewarm_joinable) {
+    pthread_join(hlist[domain].prewarm_thread, NULL);
+    hlist[domain].prewarm_joinable = false;
+  }
+  if (num_uris) {
+    VERIFYC(NULL != (hlist[domain].prewarm_uris =
+                         calloc(num_uris, sizeof(*hlist[domain].prewarm_uris))),
+            AEE_ENOMEMORY);
+    for (ii = 0; ii < num_uris; ii++) {
+      VERIFYC(NULL != (hlist[domain].prewarm_uris[ii] = strdup(uris[ii])),
+              AEE_ENOMEMORY);
+      hlist[domain].num_prewarm_uris++;
+    }
+  }
+  pthread_mutex_lock(&hlist[domain].mut);
+  hlist[domain].prewarm_gen = hlist[domain].session_gen;
+  pthread_mutex_unlock(&hlist[domain].mut);
+  VERIFY(AEE_SUCCESS ==
+         (nErr = pthread_create(&hlist[domain].prewarm_thread, NULL,
+                                session_prewarm_thread,
+                                (void *)(uintptr_t)domain)));
+  hlist[domain].prewarm_joinable = true;
+  hlist[domain].prewarm_status = AEE_EITEMBUSY;
+bail:
+  if (nErr != AEE_SUCCESS) {
+    session_prewarm_free_uris(domain);
+    FARF(ERROR, "Error 0x%x: %s failed for domain %d", nErr, __func__, domain);
+  }
+  pthread_mutex_unlock(&hlist[domain].prewarm_mut);
+  return nErr;
+}
+
+/*
+ * Waits for the background bring-up of a domain session.
+ * @ domain: effective domain ID
+ * @ timeout_us: maximum wait, 0 to poll, FASTRPC_PREWARM_WAIT_FOREVER
+ * @ status: AEE_SUCCESS if the session is up, AEE_EITEMBUSY if the
+ *   bring-up is in progress, AEE_ENOTINITIALIZED if no session was started
+ *   or the error of the bring-up
+ * returns 0 on success
+ */
+static int session_prewarm_wait(int domain, uint32_t timeout_us, int *status) {
+  int nErr = AEE_SUCCESS;
+  struct timespec ts;
+
+  pthread_mutex_lock(&hlist[domain].prewarm_mut);
+  if (timeout_us != 0 && timeout_us != FASTRPC_PREWARM_WAIT_FOREVER) {
+    VERIFYC(clock_gettime(CLOCK_REALTIME, &ts) == 0, AEE_EFAILED);
+    ts.tv_sec += timeout_us / 1000000;
+    ts.tv_nsec += (timeout_us % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+  }
+  while (timeout_us != 0 && hlist[domain].prewarm_status == AEE_EITEMBUSY) {
+    if (timeout_us == FASTRPC_PREWARM_WAIT_FOREVER) {
+      pthread_cond_wait(&hlist[domain].prewarm_cond,
+                        &hlist[domain].prewarm_mut);
+    } else if (pthread_cond_timedwait(&hlist[domain].prewarm_cond,
+                                      &hlist[domain].prewarm_mut,
+                                      &ts) == ETIMEDOUT) {
+      break;
+    }
+  }
+  *status = hlist[domain].prewarm_status;
+bail:
+  pthread_mutex_unlock(&hlist[domain].prewarm_mut);
+  // Also ready if the session was brought up by a plain open
+  if (nErr == AEE_SUCCESS && *status == AEE_ENOTINITIALIZED) {
+    pthread_mutex_lock(&hlist[domain].mut);
+    if (hlist[domain].state == FASTRPC_DOMAIN_STATE_INIT)
+      *status = AEE_SUCCESS;
+    pthread_mutex_unlock(&hlist[domain].mut);
+  }
+  return nErr;
+}
+
 static void fastrpc_apps_user_deinit(void) {
   int i;
 
@@ -4062,12 +4954,26 @@ static void fastrpc_apps_user_deinit(void) {
     pthread_key_delete(tlsKey);
     tlsKey = INVALID_KEY;
   }
+  if (invoke_scratch_key != INVALID_KEY) {
+    pthread_key_delete(invoke_scratch_key);
+    invoke_scratch_key = INVALID_KEY;
+  }
+  FARF(RUNTIME_RPC_HIGH, "%s: %" PRIu64 " invokes, %" PRIu64 " heap allocations",
+       __func__, (uint64_t)atomic_load(&invoke_count),
+       (uint64_t)atomic_load(&invoke_heap_allocs));
   fastrpc_clear_handle_list(NON_DOMAIN_HANDLE_LIST_ID, DEFAULT_DOMAIN_ID);
   if (hlist) {
     FOR_EACH_EFFECTIVE_DOMAIN_ID(i) {
       fastrpc_clear_handle_list(MULTI_DOMAIN_HANDLE_LIST_ID, i);
       fastrpc_clear_handle_list(REVERSE_HANDLE_LIST_ID, i);
       sem_destroy(&hlist[i].th_params.r_sem);
+      if (hlist[i].prewarm_joinable) {
+        pthread_join(hlist[i].prewarm_thread, NULL);
+      }
+      free(hlist[i].prewarm_handles);
+      pthread_cond_destroy(&hlist[i].prewarm_cond);
+      pthread_mutex_destroy(&hlist[i].prewarm_mut);
+      pthread_mutex_destroy(&hlist[i].prewarm_open_mut);
       pthread_mutex_destroy(&hlist[i].mut);
       pthread_mutex_destroy(&hlist[i].lmut);
       pthread_mutex_destroy(&hlist[i].init);
@@ -4077,6 +4983,7 @@ static void fastrpc_apps_user_deinit(void) {
     free(hlist);
     hlist = NULL;
   }
+  handle_table_deinit();
   fastrpc_context_table_deinit();
   deinit_process_signals();
   fastrpc_notif_deinit();
@@ -4170,9 +5077,15 @@ static int fastrpc_apps_user_init(void) {
     pthread_mutex_init(&hlist[i].lmut, 0);
     pthread_mutex_init(&hlist[i].init, 0);
     pthread_mutex_init(&hlist[i].async_init_deinit_mut, 0);
+    pthread_mutex_init(&hlist[i].prewarm_mut, 0);
+    pthread_cond_init(&hlist[i].prewarm_cond, 0);
+    pthread_mutex_init(&hlist[i].prewarm_open_mut, 0);
+    hlist[i].prewarm_status = AEE_ENOTINITIALIZED;
   }
   listener_android_init();
   VERIFY(AEE_SUCCESS == (nErr = pthread_key_create(&tlsKey, exit_thread)));
+  VERIFY(AEE_SUCCESS ==
+         (nErr = pthread_key_create(&invoke_scratch_key, invoke_scratch_free)));
   VERIFY(AEE_SUCCESS == (nErr = PL_INIT(apps_std)));
   GenCrc32Tab(POLY32, crc_table);
   fastrpc_notif_init();
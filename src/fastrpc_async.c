@@ -14,10 +14,12 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/eventfd.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "AEEQList.h"
@@ -34,6 +36,12 @@
 #define GET_HASH_FROM_JOBID(jobid)                                             \
   ((jobid & FASTRPC_ASYNC_HASH_MASK) >> FASTRPC_ASYNC_JOB_POS)
 #define EVENT_COMPLETE 0xff
+#define IS_RING_JOB(jobid) ((jobid) & FASTRPC_ASYNC_RING_JOB)
+/*
+ * Longest wait of the worker on a full ring. fastrpc_async_ring_drain wakes
+ * it at once, applications advancing tail themselves are seen on timeout.
+ */
+#define RING_FULL_WAIT_MS 10
 
 struct fastrpc_async {
   QList ql[FASTRPC_ASYNC_QUEUE_LIST_LEN];
@@ -41,6 +49,14 @@ struct fastrpc_async {
   pthread_t thread;
   int init_done;
   int deinit_started;
+  /*
+   * Completion ring registered by the application. Ring jobs are not
+   * queued in ql; the worker pushes their completion straight to the ring.
+   * Registration is protected by async_mut and outlives async deinit.
+   */
+  fastrpc_async_ring_t *_Atomic ring;
+  int ring_efd;
+  atomic_uint ring_pending; // Ring jobs submitted and not yet completed
 };
 
 struct fastrpc_async_job_node {
@@ -53,6 +69,10 @@ struct fastrpc_async_job_node {
 
 pthread_mutex_t async_mut = PTHREAD_MUTEX_INITIALIZER;
 static struct fastrpc_async lasyncinfo[NUM_DOMAINS_EXTEND];
+// Workers waiting for room in a full completion ring, on ring_space_cond
+static pthread_mutex_t ring_space_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_space_cond = PTHREAD_COND_INITIALIZER;
+static atomic_int ring_space_waiters;
 
 extern void set_thread_context(int domain);
 static int get_remote_async_response(int domain, fastrpc_async_jobid *jobid,
@@ -139,6 +159,19 @@ bail:
   return nErr;
 }
 
+/*
+ * Drops a ring job from the pending count. The count is reset when the
+ * session is, so a job completing or failing after that must not wrap it.
+ */
+static void ring_pending_put(struct fastrpc_async *me) {
+  unsigned int pending = atomic_load(&me->ring_pending);
+
+  while (pending &&
+         !atomic_compare_exchange_weak(&me->ring_pending, &pending,
+                                       pending - 1))
+    ;
+}
+
 int fastrpc_remove_async_job(fastrpc_async_jobid jobid,
                              bool dsp_invoke_done) {
   int nErr = AEE_SUCCESS;
@@ -146,6 +179,14 @@ int fastrpc_remove_async_job(fastrpc_async_jobid jobid,
   struct fastrpc_async_job_node *lasync_node = NULL;
   int domain = -1;
 
+  if (IS_RING_JOB(jobid)) {
+    // Ring jobs are released on completion, only a failed submit gets here
+    domain = GET_DOMAIN_FROM_JOBID(jobid);
+    VERIFYC(!dsp_invoke_done && IS_VALID_EFFECTIVE_DOMAIN_ID(domain),
+            AEE_EBADPARM);
+    ring_pending_put(&lasyncinfo[domain]);
+    goto bail;
+  }
   VERIFY(AEE_SUCCESS == (nErr = fastrpc_search_async_job(jobid, &lasync_node)));
   domain = GET_DOMAIN_FROM_JOBID(jobid);
   me = &lasyncinfo[domain];
@@ -185,6 +226,22 @@ int fastrpc_save_async_job(int domain, struct fastrpc_async_job *async_job,
   int hash = -1;
 
   VERIFYC(me->init_done == 1, AEE_EINVALIDJOB);
+  if (desc->type == FASTRPC_ASYNC_RING) {
+    /*
+     * Count the job before checking for the ring, so that a concurrent
+     * unregister either fails with the job counted or is seen here.
+     */
+    atomic_fetch_add(&me->ring_pending, 1);
+    if (!atomic_load(&me->ring)) {
+      ring_pending_put(me);
+      nErr = AEE_EBADPARM;
+      FARF(ERROR, "Error 0x%x: %s: no completion ring registered for domain %d",
+           nErr, __func__, domain);
+      goto bail;
+    }
+    async_job->jobid |= FASTRPC_ASYNC_RING_JOB;
+    goto bail;
+  }
   VERIFYC(NULL != (lasync_job = calloc(1, sizeof(*lasync_job))), AEE_ENOMEMORY);
   QNode_CtorZ(&lasync_job->qn);
   lasync_job->async_desc.jobid = async_job->jobid;
@@ -208,12 +265,168 @@ bail:
   return nErr;
 }
 
+/* Returns true if the ring has no free slot */
+static inline bool ring_full(fastrpc_async_ring_t *ring, uint32_t head) {
+  return head - __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) >= ring->size;
+}
+
+/*
+ * Waits for the application to consume from a full ring, or for the
+ * deinit of the domain.
+ */
+static void ring_wait_space(struct fastrpc_async *me,
+                            fastrpc_async_ring_t *ring, uint32_t head) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += RING_FULL_WAIT_MS / 1000;
+  ts.tv_nsec += (RING_FULL_WAIT_MS % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  pthread_mutex_lock(&ring_space_mut);
+  // Announced before the recheck, pairs with fastrpc_async_ring_drain
+  atomic_fetch_add(&ring_space_waiters, 1);
+  if (ring_full(ring, head) && !me->deinit_started)
+    pthread_cond_timedwait(&ring_space_cond, &ring_space_mut, &ts);
+  atomic_fetch_sub(&ring_space_waiters, 1);
+  pthread_mutex_unlock(&ring_space_mut);
+}
+
+/*
+ * Pushes the completion of a ring job to the domain's completion ring.
+ * Called only from the domain's worker thread, the single producer.
+ */
+static void fastrpc_async_ring_push(struct fastrpc_async *me,
+                                    fastrpc_async_jobid jobid, int result) {
+  fastrpc_async_ring_t *ring = atomic_load(&me->ring);
+  uint32_t head;
+
+  if (!ring) {
+    FARF(ERROR, "%s: no completion ring for jobid 0x%" PRIx64 ", result 0x%x",
+         __func__, jobid, result);
+    return;
+  }
+  head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  while (ring_full(ring, head)) {
+    if (me->deinit_started)
+      return;
+    ring_wait_space(me, ring, head);
+  }
+  ring->entries[head & (ring->size - 1)].jobid = jobid;
+  ring->entries[head & (ring->size - 1)].result = result;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+  ring_pending_put(me);
+  /*
+   * Only wake the application if it had consumed everything, otherwise it
+   * is still draining and will see this entry before it waits again.
+   */
+  if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == head)
+    eventfd_write(me->ring_efd, 1);
+}
+
+uint32_t fastrpc_async_ring_drain(fastrpc_async_ring_t *ring,
+                                  fastrpc_async_completion_t *completions,
+                                  uint32_t max) {
+  uint32_t tail, head, count, i;
+
+  if (!ring || !completions)
+    return 0;
+  tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  // Pairs with the tail check of fastrpc_async_ring_push
+  head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+  count = head - tail < max ? head - tail : max;
+  for (i = 0; i < count; i++)
+    completions[i] = ring->entries[(tail + i) & (ring->size - 1)];
+  __atomic_store_n(&ring->tail, tail + count, __ATOMIC_SEQ_CST);
+  // Wakes a worker that found the ring full, see ring_wait_space
+  if (count && atomic_load(&ring_space_waiters)) {
+    pthread_mutex_lock(&ring_space_mut);
+    pthread_cond_broadcast(&ring_space_cond);
+    pthread_mutex_unlock(&ring_space_mut);
+  }
+  return count;
+}
+
+int fastrpc_async_ring_register(int domain, fastrpc_async_ring_t *ring,
+                                int *efd) {
+  struct fastrpc_async *me = NULL;
+  int nErr = AEE_SUCCESS;
+
+  VERIFYC(IS_VALID_EFFECTIVE_DOMAIN_ID(domain), AEE_EBADPARM);
+  VERIFYC(ring && ring->entries && efd, AEE_EBADPARM);
+  VERIFYC(ring->size && !(ring->size & (ring->size - 1)), AEE_EBADPARM);
+  VERIFYC(ring->head == ring->tail, AEE_EBADPARM);
+  me = &lasyncinfo[domain];
+  pthread_mutex_lock(&async_mut);
+  if (atomic_load(&me->ring)) {
+    nErr = AEE_EALREADY;
+    goto unlock_bail;
+  }
+  if (-1 == (me->ring_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {
+    nErr = AEE_EFAILED;
+    goto unlock_bail;
+  }
+  ring->flags = 0;
+  atomic_store(&me->ring, ring);
+  *efd = me->ring_efd;
+unlock_bail:
+  pthread_mutex_unlock(&async_mut);
+bail:
+  if (nErr) {
+    FARF(ERROR, "Error 0x%x: %s failed for domain %d (%s)\n", nErr, __func__,
+         domain, strerror(errno));
+  }
+  return nErr;
+}
+
+int fastrpc_async_ring_unregister(int domain) {
+  struct fastrpc_async *me = NULL;
+  fastrpc_async_ring_t *ring = NULL;
+  int nErr = AEE_SUCCESS;
+
+  VERIFYC(IS_VALID_EFFECTIVE_DOMAIN_ID(domain), AEE_EBADPARM);
+  me = &lasyncinfo[domain];
+  pthread_mutex_lock(&async_mut);
+  if (!(ring = atomic_exchange(&me->ring, NULL))) {
+    nErr = AEE_EBADPARM;
+    goto unlock_bail;
+  }
+  // Pairs with the pending count taken by fastrpc_save_async_job
+  if (atomic_load(&me->ring_pending)) {
+    atomic_store(&me->ring, ring);
+    nErr = AEE_EBUSY;
+    goto unlock_bail;
+  }
+  close(me->ring_efd);
+  me->ring_efd = -1;
+unlock_bail:
+  pthread_mutex_unlock(&async_mut);
+bail:
+  if (nErr) {
+    FARF(ERROR, "Error 0x%x: %s failed for domain %d\n", nErr, __func__,
+         domain);
+  }
+  return nErr;
+}
+
 void fastrpc_async_respond_all_pending_jobs(int domain) {
   int i = 0;
   struct fastrpc_async *me = &lasyncinfo[domain];
   struct fastrpc_async_job_node *lasync_node = NULL;
+  fastrpc_async_ring_t *ring = atomic_load(&me->ring);
   QNode *pn;
 
+  /*
+   * Ring jobs are not tracked individually, flag the ring instead. The
+   * jobs dropped here no longer count, see ring_pending_put.
+   */
+  if (ring && atomic_exchange(&me->ring_pending, 0)) {
+    __atomic_or_fetch(&ring->flags, FASTRPC_ASYNC_RING_RESET, __ATOMIC_SEQ_CST);
+    eventfd_write(me->ring_efd, 1);
+  }
+
   for (i = 0; i < FASTRPC_ASYNC_QUEUE_LIST_LEN; i++) {
     pthread_mutex_lock(&me->mut);
     while (!QList_IsEmpty(&me->ql[i])) {
@@ -269,6 +482,10 @@ static void *async_fastrpc_thread(void *arg) {
          "adsprpc: %s received async response for jobid 0x%" PRIx64
          " and result 0x%x",
          __func__, jobid, result);
+    if (IS_RING_JOB(jobid)) {
+      fastrpc_async_ring_push(me, jobid, result);
+      continue;
+    }
     isjobfound = false;
     hash = GET_HASH_FROM_JOBID(jobid);
     pthread_mutex_lock(&me->mut);
@@ -346,6 +563,10 @@ void fastrpc_async_domain_deinit(int domain) {
        __func__, domain);
   if (me->thread) {
     me->deinit_started = 1;
+    // The worker may be waiting for room in the completion ring
+    pthread_mutex_lock(&ring_space_mut);
+    pthread_cond_broadcast(&ring_space_cond);
+    pthread_mutex_unlock(&ring_space_mut);
     err = fastrpc_exit_async_thread(domain);
     if (err) {
       pthread_kill(me->thread, SIGUSR1);
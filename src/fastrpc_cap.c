@@ -17,6 +17,7 @@
 #include "fastrpc_cap.h"
 #include "fastrpc_common.h"
 #include "fastrpc_internal.h"
+#include "fastrpc_mock.h"
 
 
 #define BUF_SIZE 50
@@ -99,6 +100,11 @@ int fastrpc_get_cap(uint32_t domain, uint32_t attributeID, uint32_t *capability)
    *capability = 0;
 
    if (attributeID == DOMAIN_SUPPORT) {
+      // Every domain is present on the mock driver
+      if (fastrpc_mock_enabled()) {
+        *capability = 1;
+        goto bail;
+      }
       *capability = fastrpc_check_if_dsp_present_pil(dom);
       if (*capability == 0) {
         *capability = fastrpc_check_if_dsp_present_rproc(dom);
@@ -145,6 +151,17 @@ uint32_t get_dsp_dma_reverse_rpc_map_capability(int domain) {
     return 0;
 }
 
+uint32_t get_dsp_reverse_rpc_buf_ref_capability(int domain) {
+	int nErr = 0;
+	uint32_t capability = 0;
+
+	nErr = fastrpc_get_cap(domain, REVERSE_RPC_BUF_REF_SUPPORT, &capability);
+	if (nErr == 0) {
+		return capability;
+	}
+	return 0;
+}
+
 static int check_status_notif_version2_capability(int domain)
 {
 	int nErr = 0;
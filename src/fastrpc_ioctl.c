@@ -7,14 +7,15 @@
 #include "HAP_farf.h"
 #include "fastrpc_async.h"
 #include "fastrpc_internal.h"
+#include "fastrpc_mock.h"
 #include "fastrpc_notif.h"
 #include "remote.h"
 #include <sys/ioctl.h>
 
 /* check async support */
 int is_async_fastrpc_supported(void) {
-  /* async not supported by upstream driver */
-  return 0;
+  /* async not supported by upstream driver, only by the mock driver */
+  return fastrpc_mock_enabled();
 }
 
 /* Returns the name of the domain based on the following
@@ -53,6 +54,7 @@ int ioctl_init(int dev, uint32_t flags, int attr, unsigned char *shell, int shel
   struct fastrpc_ioctl_init_create init = {0};
   struct fastrpc_ioctl_init_create_static init_static = {0};
 
+  FASTRPC_MOCK_RETURN(fastrpc_mock_init(dev, flags));
   switch (flags) {
   case FASTRPC_INIT_ATTACH:
     ioErr = ioctl(dev, FASTRPC_IOCTL_INIT_ATTACH, NULL);
@@ -93,6 +95,7 @@ int ioctl_invoke(int dev, int req, remote_handle handle, uint32_t sc, void *pra,
   invoke.handle = handle;
   invoke.sc = sc;
   invoke.args = (uint64_t)pra;
+  FASTRPC_MOCK_RETURN(fastrpc_mock_invoke(dev, handle, sc, pra, job));
   if (req >= INVOKE && req <= INVOKE_FD)
     ioErr = ioctl(dev, FASTRPC_IOCTL_INVOKE, (unsigned long)&invoke);
   else
@@ -104,6 +107,8 @@ int ioctl_invoke(int dev, int req, remote_handle handle, uint32_t sc, void *pra,
 int ioctl_invoke2_response(int dev, fastrpc_async_jobid *jobid,
                            remote_handle *handle, uint32_t *sc, int *result,
                            uint64_t *perf_kernel, uint64_t *perf_dsp) {
+  FASTRPC_MOCK_RETURN(
+      fastrpc_mock_invoke2_response(dev, jobid, handle, sc, result));
   return AEE_EUNSUPPORTED;
 }
 
@@ -115,6 +120,7 @@ int ioctl_mmap(int dev, int req, uint32_t flags, int attr, int fd, int offset,
                size_t len, uintptr_t vaddrin, uint64_t *vaddrout) {
   int ioErr = AEE_SUCCESS;
 
+  FASTRPC_MOCK_RETURN(fastrpc_mock_mmap(dev, fd, len, vaddrin, vaddrout));
   switch (req) {
   case MEM_MAP: {
     struct fastrpc_ioctl_mem_map map = {0};
@@ -150,6 +156,7 @@ int ioctl_munmap(int dev, int req, int attr, void *buf, int fd, int len,
                  uint64_t vaddr) {
   int ioErr = AEE_SUCCESS;
 
+  FASTRPC_MOCK_RETURN(fastrpc_mock_munmap(dev, fd, vaddr));
   switch (req) {
   case MEM_UNMAP:
   case MUNMAP_FD: {
@@ -184,6 +191,7 @@ int ioctl_getdspinfo(int dev, int domain, uint32_t attr, uint32_t *capability) {
   int ioErr = AEE_SUCCESS;
   static struct fastrpc_ioctl_capability cap = {0};
 
+  FASTRPC_MOCK_RETURN(fastrpc_mock_getdspinfo(dev, attr, capability));
   if (attr >= PERF_V2_DRIVER_SUPPORT && attr < FASTRPC_MAX_ATTRIBUTES) {
     *capability = 0;
     return 0;
@@ -205,6 +213,7 @@ int ioctl_setmode(int dev, int mode) {
 }
 
 int ioctl_control(int dev, int req, void *c) {
+  FASTRPC_MOCK_RETURN(fastrpc_mock_control(dev, req, c));
   return AEE_EUNSUPPORTED;
 }
 
@@ -213,22 +222,27 @@ int ioctl_getperf(int dev, int key, void *data, int *datalen) {
 }
 
 int ioctl_signal_create(int dev, uint32_t signal, uint32_t flags) {
+  FASTRPC_MOCK_RETURN(fastrpc_mock_signal_create(dev, signal));
   return AEE_EUNSUPPORTED;
 }
 
 int ioctl_signal_destroy(int dev, uint32_t signal) {
+  FASTRPC_MOCK_RETURN(fastrpc_mock_signal_destroy(dev, signal));
   return AEE_EUNSUPPORTED;
 }
 
 int ioctl_signal_signal(int dev, uint32_t signal) {
+  FASTRPC_MOCK_RETURN(fastrpc_mock_signal_signal(dev, signal));
   return AEE_EUNSUPPORTED;
 }
 
 int ioctl_signal_wait(int dev, uint32_t signal, uint32_t timeout_usec) {
+  FASTRPC_MOCK_RETURN(fastrpc_mock_signal_wait(dev, signal, timeout_usec));
   return AEE_EUNSUPPORTED;
 }
 
 int ioctl_signal_cancel_wait(int dev, uint32_t signal) {
+  FASTRPC_MOCK_RETURN(fastrpc_mock_signal_cancel_wait(dev, signal));
   return AEE_EUNSUPPORTED;
 }
 
@@ -248,6 +262,8 @@ int ioctl_optimization(int dev, uint32_t max_concurrency) {
 int ioctl_mdctx_manage(int dev, int req, void *user_ctx,
 	unsigned int *domain_ids, unsigned int num_domain_ids, uint64_t *ctx)
 {
+	FASTRPC_MOCK_RETURN(fastrpc_mock_mdctx_manage(dev, req, user_ctx,
+			domain_ids, num_domain_ids, ctx));
 	// TODO: Implement this for opensource
 	return AEE_EUNSUPPORTED;
 }
\ No newline at end of file
@@ -37,6 +37,7 @@
 #include "fastrpc_common.h"
 #include "fastrpc_internal.h"
 #include "fastrpc_mem.h"
+#include "pthread_rw_mutex.h"
 #include "rpcmem.h"
 #include "shared.h"
 #include "verify.h"
@@ -73,7 +74,10 @@
 #define FASTRPC_MAP_FLAGS_MASK (0xFFFF)
 
 struct mem_to_fd {
-  QNode qn;
+  struct mem_to_fd *left, *right; //! Interval tree links
+  uintptr_t max_end; //! Highest end address in this subtree
+  int height;        //! Height of this subtree
+  uint64_t seq;      //! Registration order, orders buffers at same address
   void *buf;
   size_t size;
   int fd;
@@ -83,9 +87,18 @@ struct mem_to_fd {
   bool mapped[NUM_DOMAINS_EXTEND]; //! Buffer persistent mapping status
 };
 
+/**
+ * Registered buffers are kept in an AVL tree ordered by start address
+ * (and registration order for buffers starting at the same address),
+ * augmented with the highest end address of each subtree, so that the
+ * buffer containing an address is found in O(log n).
+ * The invoke path only reads the tree, so it is protected with a
+ * reader/writer lock.
+ */
 struct mem_to_fd_list {
-  QList ql;
-  pthread_mutex_t mut;
+  struct mem_to_fd *root;
+  uint64_t seq;
+  RW_MUTEX_T mut;
 };
 
 struct dma_handle_info {
@@ -114,16 +127,186 @@ static struct static_map_list smaplst[NUM_DOMAINS_EXTEND];
 static struct mem_to_fd_list fdlist;
 static struct dma_handle_info dhandles[MAX_DMA_HANDLES];
 static int dma_handle_count = 0;
+static pthread_mutex_t dhandles_mut;
 
 static int fastrpc_unmap_fd(void *buf, size_t size, int fd, int attr);
 static __inline void try_map_buffer(struct mem_to_fd *tofd);
 static __inline int try_unmap_buffer(struct mem_to_fd *tofd);
 
+#define FDTREE_END(n) ((uintptr_t)(n)->buf + (n)->size)
+
+static __inline int fdtree_height(struct mem_to_fd *n) {
+  return n ? n->height : 0;
+}
+
+/* Compare by start address, then by registration order */
+static __inline int fdtree_cmp(struct mem_to_fd *a, struct mem_to_fd *b) {
+  if ((uintptr_t)a->buf != (uintptr_t)b->buf)
+    return (uintptr_t)a->buf < (uintptr_t)b->buf ? -1 : 1;
+  if (a->seq != b->seq)
+    return a->seq < b->seq ? -1 : 1;
+  return 0;
+}
+
+static void fdtree_update(struct mem_to_fd *n) {
+  int hl = fdtree_height(n->left), hr = fdtree_height(n->right);
+
+  n->height = 1 + STD_MAX(hl, hr);
+  n->max_end = FDTREE_END(n);
+  if (n->left && n->left->max_end > n->max_end)
+    n->max_end = n->left->max_end;
+  if (n->right && n->right->max_end > n->max_end)
+    n->max_end = n->right->max_end;
+}
+
+static struct mem_to_fd *fdtree_rotate_right(struct mem_to_fd *n) {
+  struct mem_to_fd *l = n->left;
+
+  n->left = l->right;
+  l->right = n;
+  fdtree_update(n);
+  fdtree_update(l);
+  return l;
+}
+
+static struct mem_to_fd *fdtree_rotate_left(struct mem_to_fd *n) {
+  struct mem_to_fd *r = n->right;
+
+  n->right = r->left;
+  r->left = n;
+  fdtree_update(n);
+  fdtree_update(r);
+  return r;
+}
+
+static struct mem_to_fd *fdtree_balance(struct mem_to_fd *n) {
+  int bf;
+
+  fdtree_update(n);
+  bf = fdtree_height(n->left) - fdtree_height(n->right);
+  if (bf > 1) {
+    if (fdtree_height(n->left->left) < fdtree_height(n->left->right))
+      n->left = fdtree_rotate_left(n->left);
+    return fdtree_rotate_right(n);
+  }
+  if (bf < -1) {
+    if (fdtree_height(n->right->right) < fdtree_height(n->right->left))
+      n->right = fdtree_rotate_right(n->right);
+    return fdtree_rotate_left(n);
+  }
+  return n;
+}
+
+static struct mem_to_fd *fdtree_insert(struct mem_to_fd *root,
+                                       struct mem_to_fd *n) {
+  if (!root) {
+    n->left = n->right = NULL;
+    fdtree_update(n);
+    return n;
+  }
+  if (fdtree_cmp(n, root) < 0)
+    root->left = fdtree_insert(root->left, n);
+  else
+    root->right = fdtree_insert(root->right, n);
+  return fdtree_balance(root);
+}
+
+static struct mem_to_fd *fdtree_remove_min(struct mem_to_fd *root,
+                                           struct mem_to_fd **min) {
+  if (!root->left) {
+    *min = root;
+    return root->right;
+  }
+  root->left = fdtree_remove_min(root->left, min);
+  return fdtree_balance(root);
+}
+
+static struct mem_to_fd *fdtree_remove(struct mem_to_fd *root,
+                                       struct mem_to_fd *n) {
+  struct mem_to_fd *min = NULL;
+  int cmp;
+
+  if (!root)
+    return NULL;
+  cmp = fdtree_cmp(n, root);
+  if (cmp < 0) {
+    root->left = fdtree_remove(root->left, n);
+  } else if (cmp > 0) {
+    root->right = fdtree_remove(root->right, n);
+  } else {
+    if (!root->left || !root->right)
+      return root->left ? root->left : root->right;
+    root->right = fdtree_remove_min(root->right, &min);
+    min->left = root->left;
+    min->right = root->right;
+    root = min;
+  }
+  return fdtree_balance(root);
+}
+
+/*
+ * Returns the earliest registered buffer containing addr, or NULL.
+ * Subtrees whose buffers all end at or before addr are skipped.
+ */
+static struct mem_to_fd *fdtree_find_containing(struct mem_to_fd *n,
+                                                uintptr_t addr,
+                                                struct mem_to_fd *best) {
+  if (!n || n->max_end <= addr)
+    return best;
+  best = fdtree_find_containing(n->left, addr, best);
+  if ((uintptr_t)n->buf <= addr) {
+    if (addr < FDTREE_END(n) && (!best || n->seq < best->seq))
+      best = n;
+    best = fdtree_find_containing(n->right, addr, best);
+  }
+  return best;
+}
+
+/*
+ * Visits, in registration order, the buffers starting at addr until the
+ * callback returns non-zero. Returns the last callback result.
+ */
+static int fdtree_for_each_at(struct mem_to_fd *n, uintptr_t addr,
+                              int (*cb)(struct mem_to_fd *, void *),
+                              void *ctx) {
+  int ret;
+
+  if (!n)
+    return 0;
+  if (addr < (uintptr_t)n->buf)
+    return fdtree_for_each_at(n->left, addr, cb, ctx);
+  if (addr > (uintptr_t)n->buf)
+    return fdtree_for_each_at(n->right, addr, cb, ctx);
+  if ((ret = fdtree_for_each_at(n->left, addr, cb, ctx)))
+    return ret;
+  if ((ret = cb(n, ctx)))
+    return ret;
+  return fdtree_for_each_at(n->right, addr, cb, ctx);
+}
+
+/* Visits all registered buffers */
+static void fdtree_for_all(struct mem_to_fd *n,
+                           void (*cb)(struct mem_to_fd *, void *), void *ctx) {
+  if (!n)
+    return;
+  fdtree_for_all(n->left, cb, ctx);
+  cb(n, ctx);
+  fdtree_for_all(n->right, cb, ctx);
+}
+
+/* Adds a buffer to the index, must be called with fdlist.mut held for write */
+static __inline void fdlist_add(struct mem_to_fd *tofd) {
+  tofd->seq = fdlist.seq++;
+  fdlist.root = fdtree_insert(fdlist.root, tofd);
+}
+
 int fastrpc_mem_init(void) {
   int ii;
 
-  pthread_mutex_init(&fdlist.mut, 0);
-  QList_Ctor(&fdlist.ql);
+  RW_MUTEX_CTOR(fdlist.mut);
+  fdlist.root = NULL;
+  fdlist.seq = 0;
+  pthread_mutex_init(&dhandles_mut, 0);
   memset(dhandles, 0, sizeof(dhandles));
   FOR_EACH_EFFECTIVE_DOMAIN_ID(ii) {
     QList_Ctor(&smaplst[ii].ql);
@@ -135,7 +318,8 @@ int fastrpc_mem_init(void) {
 int fastrpc_mem_deinit(void) {
   int ii;
 
-  pthread_mutex_destroy(&fdlist.mut);
+  RW_MUTEX_DTOR(fdlist.mut);
+  pthread_mutex_destroy(&dhandles_mut);
   FOR_EACH_EFFECTIVE_DOMAIN_ID(ii) {
     pthread_mutex_destroy(&smaplst[ii].mut);
   }
@@ -152,7 +336,6 @@ static void *remote_register_fd_attr(int fd, size_t size, int attr) {
   VERIFYC(fd >= 0, AEE_EBADPARM);
 
   VERIFYC(NULL != (tofd = calloc(1, sizeof(*tofd))), AEE_ENOMEMORY);
-  QNode_CtorZ(&tofd->qn);
   VERIFYM((void *)-1 != (buf = mmap(0, size, PROT_NONE,
                                     MAP_ANONYMOUS | MAP_PRIVATE, -1, 0)),
           AEE_ERPC, "Error %x: mmap failed for fd %x, size %x\n", nErr, fd,
@@ -163,9 +346,9 @@ static void *remote_register_fd_attr(int fd, size_t size, int attr) {
   tofd->nova = 1;
   tofd->attr = attr;
 
-  pthread_mutex_lock(&fdlist.mut);
-  QList_AppendNode(&fdlist.ql, &tofd->qn);
-  pthread_mutex_unlock(&fdlist.mut);
+  RW_MUTEX_LOCK_WRITE(fdlist.mut);
+  fdlist_add(tofd);
+  RW_MUTEX_UNLOCK_WRITE(fdlist.mut);
 
   tofd = 0;
   po = buf;
@@ -198,6 +381,41 @@ void *remote_register_fd2(int fd, size_t size) {
   return remote_register_fd_attr(fd, size, 0);
 }
 
+struct register_buf_ctx {
+  size_t size;
+  int fd;
+  int attr;
+  struct mem_to_fd *freefd;
+  struct mem_to_fd *addr_match_fd;
+};
+
+/* Takes a reference on an already registered buffer with same size and fd */
+static int register_buf_ref(struct mem_to_fd *tofd, void *ctx) {
+  struct register_buf_ctx *c = (struct register_buf_ctx *)ctx;
+
+  if (tofd->size == c->size && tofd->fd == c->fd) {
+    if (c->attr)
+      tofd->attr = c->attr;
+    tofd->refcount++;
+    return 1;
+  }
+  return 0;
+}
+
+/* Drops a reference on the registered buffer with same size */
+static int deregister_buf_unref(struct mem_to_fd *tofd, void *ctx) {
+  struct register_buf_ctx *c = (struct register_buf_ctx *)ctx;
+
+  if (tofd->size == c->size) {
+    tofd->refcount--;
+    if (tofd->refcount <= 0)
+      c->freefd = tofd;
+    return 1;
+  }
+  c->addr_match_fd = tofd;
+  return 0;
+}
+
 static int remote_register_buf_common(void *buf, size_t size, int fd,
                                       int attr) {
   int nErr = 0;
@@ -209,24 +427,15 @@ static int remote_register_buf_common(void *buf, size_t size, int fd,
 
   if (fd != -1) {
     struct mem_to_fd *tofd;
+    struct register_buf_ctx ctx = {size, fd, attr, NULL, NULL};
     int fdfound = 0;
-    QNode *pn, *pnn;
-
-    pthread_mutex_lock(&fdlist.mut);
-    QLIST_NEXTSAFE_FOR_ALL(&fdlist.ql, pn, pnn) {
-      tofd = STD_RECOVER_REC(struct mem_to_fd, qn, pn);
-      if (tofd->buf == buf && tofd->size == size && tofd->fd == fd) {
-        fdfound = 1;
-        if (attr)
-          tofd->attr = attr;
-        tofd->refcount++;
-        break;
-      }
-    }
-    pthread_mutex_unlock(&fdlist.mut);
+
+    RW_MUTEX_LOCK_WRITE(fdlist.mut);
+    fdfound =
+        fdtree_for_each_at(fdlist.root, (uintptr_t)buf, register_buf_ref, &ctx);
+    RW_MUTEX_UNLOCK_WRITE(fdlist.mut);
     if (!fdfound) {
       VERIFYC(NULL != (tofd = calloc(1, sizeof(*tofd))), AEE_ENOMEMORY);
-      QNode_CtorZ(&tofd->qn);
       tofd->buf = buf;
       tofd->size = size;
       tofd->fd = fd;
@@ -236,32 +445,22 @@ static int remote_register_buf_common(void *buf, size_t size, int fd,
       if (tofd->attr & FASTRPC_ATTR_TRY_MAP_STATIC) {
         try_map_buffer(tofd);
       }
-      pthread_mutex_lock(&fdlist.mut);
-      QList_AppendNode(&fdlist.ql, &tofd->qn);
-      pthread_mutex_unlock(&fdlist.mut);
+      RW_MUTEX_LOCK_WRITE(fdlist.mut);
+      fdlist_add(tofd);
+      RW_MUTEX_UNLOCK_WRITE(fdlist.mut);
     }
   } else {
-    QNode *pn, *pnn;
-    struct mem_to_fd *freefd = NULL;
-    pthread_mutex_lock(&fdlist.mut);
-    struct mem_to_fd *addr_match_fd = NULL;
-    QLIST_NEXTSAFE_FOR_ALL(&fdlist.ql, pn, pnn) {
-      struct mem_to_fd *tofd = STD_RECOVER_REC(struct mem_to_fd, qn, pn);
-      if (tofd->buf == buf) {
-        if (tofd->size == size) {
-          tofd->refcount--;
-          if (tofd->refcount <= 0) {
-            QNode_DequeueZ(&tofd->qn);
-            freefd = tofd;
-            tofd = NULL;
-          }
-          break;
-        } else {
-          addr_match_fd = tofd;
-        }
-      }
-    }
-    pthread_mutex_unlock(&fdlist.mut);
+    struct register_buf_ctx ctx = {size, fd, attr, NULL, NULL};
+    struct mem_to_fd *freefd = NULL, *addr_match_fd = NULL;
+
+    RW_MUTEX_LOCK_WRITE(fdlist.mut);
+    fdtree_for_each_at(fdlist.root, (uintptr_t)buf, deregister_buf_unref,
+                       &ctx);
+    freefd = ctx.freefd;
+    addr_match_fd = ctx.addr_match_fd;
+    if (freefd)
+      fdlist.root = fdtree_remove(fdlist.root, freefd);
+    RW_MUTEX_UNLOCK_WRITE(fdlist.mut);
     if (freefd) {
       if (freefd->attr & FASTRPC_ATTR_KEEP_MAP) {
         fastrpc_unmap_fd(freefd->buf, freefd->size, freefd->fd, freefd->attr);
@@ -324,7 +523,7 @@ int remote_register_dma_handle_attr(int fd, uint32_t len, uint32_t attr) {
   VERIFYC(fd >= 0, AEE_EBADPARM);
   VERIFYC(len >= 0, AEE_EBADPARM);
 
-  pthread_mutex_lock(&fdlist.mut);
+  pthread_mutex_lock(&dhandles_mut);
   for (i = 0; i < dma_handle_count; i++) {
     if (dhandles[i].used && dhandles[i].fd == fd) {
       /* If fd already present in handle list, then just update attribute only
@@ -337,13 +536,13 @@ int remote_register_dma_handle_attr(int fd, uint32_t len, uint32_t attr) {
       break;
     }
   }
-  pthread_mutex_unlock(&fdlist.mut);
+  pthread_mutex_unlock(&dhandles_mut);
 
   if (fd_found) {
     return AEE_SUCCESS;
   }
 
-  pthread_mutex_lock(&fdlist.mut);
+  pthread_mutex_lock(&dhandles_mut);
   for (i = 0; i < dma_handle_count; i++) {
     if (!dhandles[i].used) {
       dhandles[i].fd = fd;
@@ -366,7 +565,7 @@ int remote_register_dma_handle_attr(int fd, uint32_t len, uint32_t attr) {
       dma_handle_count++;
     }
   }
-  pthread_mutex_unlock(&fdlist.mut);
+  pthread_mutex_unlock(&dhandles_mut);
 
 bail:
   if (nErr) {
@@ -388,7 +587,7 @@ void unregister_dma_handle(int fd, uint32_t *len, uint32_t *attr) {
   *len = 0;
   *attr = 0;
 
-  pthread_mutex_lock(&fdlist.mut);
+  pthread_mutex_lock(&dhandles_mut);
   for (i = 0; i < dma_handle_count; i++) {
     if (dhandles[i].used) {
       if (dhandles[i].fd == fd) {
@@ -404,39 +603,38 @@ void unregister_dma_handle(int fd, uint32_t *len, uint32_t *attr) {
       }
     }
   }
-  pthread_mutex_unlock(&fdlist.mut);
+  pthread_mutex_unlock(&dhandles_mut);
 }
 
 int fdlist_fd_from_buf(void *buf, int bufLen, int *nova, void **base, int *attr,
                        int *ofd) {
-  QNode *pn;
+  struct mem_to_fd *tofd = NULL;
   int fd = -1;
-  pthread_mutex_lock(&fdlist.mut);
-  QLIST_FOR_ALL(&fdlist.ql, pn) {
-    if (fd != -1) {
-      break;
+
+  RW_MUTEX_LOCK_READ(fdlist.mut);
+  /*
+   * The earliest registered buffer containing the start address is used,
+   * and the whole range has to fit in it.
+   */
+  tofd = fdtree_find_containing(fdlist.root, (uintptr_t)buf, NULL);
+  if (tofd) {
+    if (STD_BETWEEN((unsigned long)buf + bufLen - 1, tofd->buf,
+                    (unsigned long)tofd->buf + tofd->size)) {
+      fd = tofd->fd;
+      *nova = tofd->nova;
+      *base = tofd->buf;
+      *attr = tofd->attr;
     } else {
-      struct mem_to_fd *tofd = STD_RECOVER_REC(struct mem_to_fd, qn, pn);
-      if (STD_BETWEEN(buf, tofd->buf, (unsigned long)tofd->buf + tofd->size)) {
-        if (STD_BETWEEN((unsigned long)buf + bufLen - 1, tofd->buf,
-                        (unsigned long)tofd->buf + tofd->size)) {
-          fd = tofd->fd;
-          *nova = tofd->nova;
-          *base = tofd->buf;
-          *attr = tofd->attr;
-        } else {
-          pthread_mutex_unlock(&fdlist.mut);
-          FARF(ERROR,
-               "Error 0x%x: Mismatch in buffer address(%p) or size(%x) to the "
-               "registered FD(0x%x), address(%p) and size(%zu)\n",
-               AEE_EBADPARM, buf, bufLen, tofd->fd, tofd->buf, tofd->size);
-          return AEE_EBADPARM;
-        }
-      }
+      RW_MUTEX_UNLOCK_READ(fdlist.mut);
+      FARF(ERROR,
+           "Error 0x%x: Mismatch in buffer address(%p) or size(%x) to the "
+           "registered FD(0x%x), address(%p) and size(%zu)\n",
+           AEE_EBADPARM, buf, bufLen, tofd->fd, tofd->buf, tofd->size);
+      return AEE_EBADPARM;
     }
   }
   *ofd = fd;
-  pthread_mutex_unlock(&fdlist.mut);
+  RW_MUTEX_UNLOCK_READ(fdlist.mut);
   return 0;
 }
 
@@ -878,10 +1076,33 @@ static __inline int try_unmap_buffer(struct mem_to_fd *tofd) {
   return errcnt;
 }
 
+/* Maps a TRY_MAP_STATIC buffer on the domain being opened */
+static void mem_open_map_buffer(struct mem_to_fd *tofd, void *ctx) {
+  int domain = *(int *)ctx;
+
+  if (tofd->attr & FASTRPC_ATTR_TRY_MAP_STATIC &&
+      tofd->mapped[domain] == false) {
+    if (!fastrpc_mmap(domain, tofd->fd, tofd->buf, 0, tofd->size,
+                      FASTRPC_MAP_STATIC)) {
+      tofd->mapped[domain] = true;
+    }
+  }
+}
+
+/* Clears mapping status of a buffer on the domain being closed */
+static void mem_close_clear_mapping(struct mem_to_fd *tofd, void *ctx) {
+  int domain = *(int *)ctx;
+
+  /* This function is called only when remote session is being closed.
+   * So no need to do "fastrpc_munmap" here.
+   */
+  if (tofd->mapped[domain]) {
+    tofd->mapped[domain] = false;
+  }
+}
+
 int fastrpc_mem_open(int domain) {
   int nErr = 0;
-  QNode *pn, *pnn;
-  struct mem_to_fd *tofd = NULL;
 
   /**
    * Initialize fastrpc session specific informaiton of the fastrpc_mem module
@@ -892,20 +1113,10 @@ int fastrpc_mem_open(int domain) {
   /* Map buffers with TRY_MAP_STATIC attribute that were allocated
    * and registered before a session was opened on a given domain.
    */
-  pthread_mutex_lock(&fdlist.mut);
-  QLIST_NEXTSAFE_FOR_ALL(&fdlist.ql, pn, pnn) {
-    tofd = STD_RECOVER_REC(struct mem_to_fd, qn, pn);
-    if (tofd->attr & FASTRPC_ATTR_TRY_MAP_STATIC &&
-        tofd->mapped[domain] == false) {
-      nErr = fastrpc_mmap(domain, tofd->fd, tofd->buf, 0, tofd->size,
-                          FASTRPC_MAP_STATIC);
-      if (!nErr) {
-        tofd->mapped[domain] = true;
-      }
-    }
-  }
-  nErr = 0; // Try mapping is optional. Ignore error
-  pthread_mutex_unlock(&fdlist.mut);
+  RW_MUTEX_LOCK_WRITE(fdlist.mut);
+  // Try mapping is optional. Errors are ignored
+  fdtree_for_all(fdlist.root, mem_open_map_buffer, &domain);
+  RW_MUTEX_UNLOCK_WRITE(fdlist.mut);
 bail:
   if (nErr) {
     FARF(ERROR, "Error 0x%x: %s failed for domain %d", nErr, __func__, domain);
@@ -916,7 +1127,6 @@ bail:
 int fastrpc_mem_close(int domain) {
   int nErr = 0;
   struct static_map *mNode;
-  struct mem_to_fd *tofd = NULL;
   QNode *pn, *pnn;
 
   FARF(RUNTIME_RPC_HIGH, "%s for domain %d", __func__, domain);
@@ -939,17 +1149,9 @@ int fastrpc_mem_close(int domain) {
   pthread_mutex_unlock(&smaplst[domain].mut);
 
   // Remove mapping status of static buffers
-  pthread_mutex_lock(&fdlist.mut);
-  QLIST_NEXTSAFE_FOR_ALL(&fdlist.ql, pn, pnn) {
-    tofd = STD_RECOVER_REC(struct mem_to_fd, qn, pn);
-    /* This function is called only when remote session is being closed.
-     * So no need to do "fastrpc_munmap" here.
-     */
-    if (tofd->mapped[domain]) {
-      tofd->mapped[domain] = false;
-    }
-  }
-  pthread_mutex_unlock(&fdlist.mut);
+  RW_MUTEX_LOCK_WRITE(fdlist.mut);
+  fdtree_for_all(fdlist.root, mem_close_clear_mapping, &domain);
+  RW_MUTEX_UNLOCK_WRITE(fdlist.mut);
 bail:
   return nErr;
 }
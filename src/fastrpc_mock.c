@@ -0,0 +1,1208 @@
+// Copyright (c) 2024, Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#ifndef VERIFY_PRINT_ERROR
+#define VERIFY_PRINT_ERROR
+#endif /* VERIFY_PRINT_ERROR */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "AEEQList.h"
+#include "AEEStdErr.h"
+#include "AEEstd.h"
+#include "HAP_farf.h"
+#include "dspqueue_rpc.h"
+#include "dspqueue_shared.h"
+#include "dspsignal.h"
+#include "fastrpc_common.h"
+#include "fastrpc_internal.h"
+#include "fastrpc_mem.h"
+#include "fastrpc_mock.h"
+#include "listener_buf.h"
+#include "mod_table.h"
+#include "mutex.h"
+#include "uthash.h"
+#include "verify.h"
+
+#define MOCK_MAX_SESSIONS 16
+#define MOCK_FIRST_HANDLE 0x1000
+#define MOCK_STACK_ARGS 64
+
+/* Remote handles and method ids the mock DSP serves itself */
+#define MOCK_REMOTECTL_HANDLE 0
+#define MOCK_ADSP_LISTENER_HANDLE 3
+#define MOCK_ADSP_CURRENT_PROCESS1_HANDLE 4
+#define MOCK_ADSP_LISTENER1_HANDLE 7
+#define MOCK_REMOTECTL1_HANDLE 8
+
+#define MOCK_REMOTECTL_OPEN_MID 0
+#define MOCK_REMOTECTL_CLOSE_MID 1
+#define MOCK_REMOTECTL1_OPEN1_MID 2
+#define MOCK_REMOTECTL1_CLOSE1_MID 3
+#define MOCK_ADSP_LISTENER_NEXT2_MID 4
+#define MOCK_ADSP_LISTENER_GET_IN_BUFS2_MID 5
+#define MOCK_ADSP_LISTENER1_NEXT2_MID 6
+#define MOCK_ADSP_LISTENER1_GET_IN_BUFS2_MID 7
+#define MOCK_ADSP_CURRENT_PROCESS1_EXIT_MID 2
+
+#define MOCK_DSPQUEUE_INIT_PROCESS_STATE_MID 2
+#define MOCK_DSPQUEUE_CREATE_QUEUE_MID 3
+#define MOCK_DSPQUEUE_DESTROY_QUEUE_MID 4
+#define MOCK_DSPQUEUE_IS_IMPORTED_MID 5
+#define MOCK_DSPQUEUE_WAIT_SIGNAL_MID 6
+#define MOCK_DSPQUEUE_CANCEL_WAIT_SIGNAL_MID 7
+#define MOCK_DSPQUEUE_SIGNAL_MID 8
+
+/* Signal states */
+#define MOCK_SIGNAL_CREATED 0x1
+#define MOCK_SIGNAL_PENDING 0x2
+#define MOCK_SIGNAL_CANCELED 0x4
+
+#define ARG_PTR(args, ii) ((void *)(uintptr_t)(args)[ii].ptr)
+
+/* DSP system modules, always served by the null skel */
+static const char *mock_system_modules[] = {
+    "adsp_current_process", "adsp_default_listener", "adsp_listener",
+    "adsp_perf",            "adspmsgd_adsp",
+};
+
+enum mock_module_type {
+  MOCK_MODULE_NULL,     // completes every method with success
+  MOCK_MODULE_SKEL,     // skel opened through mod_table
+  MOCK_MODULE_DSPQUEUE, // dspqueue_rpc echo peer
+};
+
+struct mock_module {
+  remote_handle handle;
+  enum mock_module_type type;
+  UT_hash_handle hh;
+};
+
+/* Buffer mapped to the mock DSP */
+struct mock_map {
+  QNode qn;
+  int fd;
+  uint64_t vaddr;
+  uint64_t len;
+  void *local; // mapping made by the mock for maps without a CPU address
+};
+
+/* Async invoke queued to the loopback thread */
+struct mock_job {
+  QNode qn;
+  fastrpc_async_jobid jobid;
+  remote_handle handle;
+  uint32_t sc;
+  int result;
+  struct fastrpc_invoke_args args[];
+};
+
+/* Reverse invoke waiting for the listener */
+struct mock_rev {
+  QNode qn;
+  uint32_t ctx;
+  remote_handle handle;
+  uint32_t sc;
+  remote_arg *pra;
+  uint8_t *in; // packed input buffers and output lengths
+  int inlen;
+  int result;
+  bool done;
+};
+
+/* Mock DSP process, one per mock device */
+struct mock_session {
+  int dev;
+  int domain;
+  atomic_int refs;
+  pthread_mutex_t mut;
+  pthread_cond_t cond;
+  bool alive;  // process created and not exited
+  bool closed; // device closed
+  pthread_t thread;
+  bool thread_started;
+  QList jobs;       // async invokes not yet run
+  QList done;       // async invokes not yet reported
+  bool async_wake;  // DSPRPC_ASYNC_WAKE pending
+  QList maps;
+  QList rev_pending; // reverse invokes not yet picked up by the listener
+  QList rev_active;  // reverse invokes served by the listener
+  uint32_t next_ctx;
+  uint8_t signals[DSPSIGNAL_NUM_SIGNALS];
+  RW_MUTEX_T modlock;
+  struct mock_module *modules;
+  /* DSP side of dspqueue, protected by mut */
+  struct {
+    struct dspqueue_process_queue_state *state;
+    struct dspqueue_header *queues[DSPQUEUE_MAX_PROCESS_QUEUES];
+    uint64_t legacy[DSPQUEUE_DIRTY_WORDS]; // queues without a dirty bitmap
+    bool signal_pending;
+    bool cancel;
+  } dq;
+};
+
+static struct {
+  pthread_once_t once;
+  atomic_int enabled;
+  pthread_rwlock_t lock; // protects sessions
+  struct mock_session *sessions[MOCK_MAX_SESSIONS];
+  atomic_uint next_handle;
+  _Atomic uint64_t next_ctx; // multi-domain context ids
+} mock = {
+    .once = PTHREAD_ONCE_INIT,
+    .lock = PTHREAD_RWLOCK_INITIALIZER,
+    .next_handle = MOCK_FIRST_HANDLE,
+    .next_ctx = 1,
+};
+
+static void mock_read_env(void) {
+  const char *env = getenv(FASTRPC_MOCK_DRIVER_ENV);
+
+  if (env && atoi(env))
+    atomic_store(&mock.enabled, 1);
+}
+
+int fastrpc_mock_enabled(void) {
+  pthread_once(&mock.once, mock_read_env);
+  return atomic_load_explicit(&mock.enabled, memory_order_relaxed);
+}
+
+int fastrpc_mock_set_enabled(int enable) {
+  int nErr = AEE_SUCCESS, ii;
+
+  pthread_once(&mock.once, mock_read_env);
+  pthread_rwlock_wrlock(&mock.lock);
+  for (ii = 0; ii < MOCK_MAX_SESSIONS; ii++) {
+    if (mock.sessions[ii]) {
+      nErr = AEE_EBADSTATE;
+      break;
+    }
+  }
+  if (!nErr)
+    atomic_store(&mock.enabled, enable ? 1 : 0);
+  pthread_rwlock_unlock(&mock.lock);
+  if (nErr)
+    FARF(ERROR, "Error 0x%x: %s: mock devices are still open", nErr,
+         __func__);
+  else
+    FARF(ALWAYS, "%s: %s driver selected", __func__,
+         enable ? "mock" : "kernel");
+  return nErr;
+}
+
+static struct mock_session *session_get(int dev) {
+  struct mock_session *s = NULL;
+  int ii;
+
+  pthread_rwlock_rdlock(&mock.lock);
+  for (ii = 0; ii < MOCK_MAX_SESSIONS; ii++) {
+    if (mock.sessions[ii] && mock.sessions[ii]->dev == dev) {
+      s = mock.sessions[ii];
+      atomic_fetch_add(&s->refs, 1);
+      break;
+    }
+  }
+  pthread_rwlock_unlock(&mock.lock);
+  return s;
+}
+
+/* Returns the live process of a domain */
+static struct mock_session *session_get_domain(int domain) {
+  struct mock_session *s = NULL;
+  int ii;
+
+  pthread_rwlock_rdlock(&mock.lock);
+  for (ii = 0; ii < MOCK_MAX_SESSIONS; ii++) {
+    if (mock.sessions[ii] && mock.sessions[ii]->domain == domain &&
+        mock.sessions[ii]->alive) {
+      s = mock.sessions[ii];
+      atomic_fetch_add(&s->refs, 1);
+      break;
+    }
+  }
+  pthread_rwlock_unlock(&mock.lock);
+  return s;
+}
+
+static void session_free(struct mock_session *s) {
+  struct mock_module *m, *tmp;
+  QNode *pn;
+
+  HASH_ITER(hh, s->modules, m, tmp) {
+    HASH_DEL(s->modules, m);
+    if (m->type == MOCK_MODULE_SKEL)
+      mod_table_close(m->handle, NULL, 0, NULL);
+    free(m);
+  }
+  while ((pn = QList_Pop(&s->jobs)))
+    free(STD_RECOVER_REC(struct mock_job, qn, pn));
+  while ((pn = QList_Pop(&s->done)))
+    free(STD_RECOVER_REC(struct mock_job, qn, pn));
+  while ((pn = QList_Pop(&s->maps))) {
+    struct mock_map *map = STD_RECOVER_REC(struct mock_map, qn, pn);
+
+    if (map->local)
+      munmap(map->local, map->len);
+    free(map);
+  }
+  RW_MUTEX_DTOR(s->modlock);
+  pthread_cond_destroy(&s->cond);
+  pthread_mutex_destroy(&s->mut);
+  free(s);
+}
+
+static void session_put(struct mock_session *s) {
+  if (atomic_fetch_sub(&s->refs, 1) == 1)
+    session_free(s);
+}
+
+/* Ends the DSP process, which releases the listener and any waiter */
+static void session_exit(struct mock_session *s) {
+  pthread_mutex_lock(&s->mut);
+  s->alive = false;
+  s->dq.cancel = true;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->mut);
+}
+
+int fastrpc_mock_open(int domain) {
+  struct mock_session *s = NULL;
+  int nErr = AEE_SUCCESS, dev = -1, ii;
+
+  VERIFYC(NULL != (s = calloc(1, sizeof(*s))), AEE_ENOMEMORY);
+  VERIFYC(-1 != (dev = eventfd(0, EFD_CLOEXEC)), AEE_EFAILED);
+  s->dev = dev;
+  s->domain = domain;
+  atomic_init(&s->refs, 1);
+  pthread_mutex_init(&s->mut, 0);
+  pthread_cond_init(&s->cond, 0);
+  RW_MUTEX_CTOR(s->modlock);
+  QList_Ctor(&s->jobs);
+  QList_Ctor(&s->done);
+  QList_Ctor(&s->maps);
+  QList_Ctor(&s->rev_pending);
+  QList_Ctor(&s->rev_active);
+  pthread_rwlock_wrlock(&mock.lock);
+  for (ii = 0; ii < MOCK_MAX_SESSIONS; ii++) {
+    if (!mock.sessions[ii]) {
+      mock.sessions[ii] = s;
+      break;
+    }
+  }
+  pthread_rwlock_unlock(&mock.lock);
+  if (ii == MOCK_MAX_SESSIONS) {
+    session_put(s);
+    s = NULL;
+    nErr = AEE_ENOMEMORY;
+    goto bail;
+  }
+  FARF(RUNTIME_RPC_HIGH, "%s: opened mock device %d for domain %d", __func__,
+       dev, domain);
+bail:
+  if (nErr) {
+    FARF(ERROR, "Error 0x%x: %s failed for domain %d (errno %s)", nErr,
+         __func__, domain, strerror(errno));
+    if (dev != -1)
+      close(dev);
+    if (s)
+      free(s);
+    errno = EMFILE;
+    return -1;
+  }
+  return dev;
+}
+
+int fastrpc_mock_close(int dev) {
+  struct mock_session *s = NULL;
+  int ii;
+
+  pthread_rwlock_wrlock(&mock.lock);
+  for (ii = 0; ii < MOCK_MAX_SESSIONS; ii++) {
+    if (mock.sessions[ii] && mock.sessions[ii]->dev == dev) {
+      s = mock.sessions[ii];
+      mock.sessions[ii] = NULL;
+      break;
+    }
+  }
+  pthread_rwlock_unlock(&mock.lock);
+  if (s) {
+    pthread_mutex_lock(&s->mut);
+    s->closed = true;
+    pthread_mutex_unlock(&s->mut);
+    session_exit(s);
+    if (s->thread_started)
+      pthread_join(s->thread, NULL);
+    session_put(s);
+  }
+  return close(dev);
+}
+
+int fastrpc_mock_alloc_buf(size_t size) {
+  int fd;
+
+  if (-1 == (fd = memfd_create("fastrpc-mock-buf", MFD_CLOEXEC)))
+    return -1;
+  if (ftruncate(fd, size)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Must hold s->mut
+static void *map_find_fd_locked(struct mock_session *s, int fd) {
+  QNode *pn;
+
+  QLIST_FOR_ALL(&s->maps, pn) {
+    struct mock_map *map = STD_RECOVER_REC(struct mock_map, qn, pn);
+
+    if (map->fd == fd)
+      return (void *)(uintptr_t)map->vaddr;
+  }
+  return NULL;
+}
+
+/*
+ * Moves one request packet of queue id to its response queue. Returns
+ * false when the request queue is empty or the response queue is full.
+ * Must hold s->mut.
+ */
+static bool dspqueue_echo_locked(struct mock_session *s, unsigned id) {
+  struct dspqueue_header *h = s->dq.queues[id];
+  uint8_t *base = (uint8_t *)h;
+  struct dspqueue_packet_queue_header *req = &h->req_queue;
+  struct dspqueue_packet_queue_header *resp = &h->resp_queue;
+  struct dspqueue_packet_queue_state *req_read =
+      (void *)(base + req->read_state_offset);
+  struct dspqueue_packet_queue_state *req_write =
+      (void *)(base + req->write_state_offset);
+  struct dspqueue_packet_queue_state *resp_read =
+      (void *)(base + resp->read_state_offset);
+  struct dspqueue_packet_queue_state *resp_write =
+      (void *)(base + resp->write_state_offset);
+  uint8_t *rq = base + req->queue_offset, *wq = base + resp->queue_offset;
+  uint32_t rsize = req->queue_length, wsize = resp->queue_length;
+  uint32_t r, rw, w, wr, space, alen;
+  uint8_t *packet;
+
+  r = req_read->position;
+  rw = req_write->position;
+  atomic_thread_fence(memory_order_acquire);
+  if (r == rw)
+    return false;
+  alen = (((uint32_t) * (uint64_t *)(rq + r)) + 7) & ~7;
+  if (rsize - r < alen) {
+    // The writer moved the packet to the start of the queue
+    packet = rq;
+    r = alen;
+  } else {
+    packet = rq + r;
+    r += alen;
+  }
+  if (r >= rsize)
+    r = 0;
+
+  wr = resp_read->position;
+  w = resp_write->position;
+  atomic_thread_fence(memory_order_acquire);
+  if (wr == w)
+    space = wsize - 8;
+  else if (w > wr)
+    space = wsize - w + wr - 8;
+  else
+    space = wr - w - 8;
+  if (space < alen || (wsize - w < alen && space - (wsize - w) < alen)) {
+    // Wait for the CPU to signal that it consumed a response
+    resp_write->wait_count = 1;
+    return false;
+  }
+  if (wsize - w < alen) {
+    memcpy(wq + w, packet, 8);
+    w = 0;
+  }
+  memcpy(wq + w, packet, alen);
+  w += alen;
+  if (w >= wsize)
+    w = 0;
+
+  atomic_thread_fence(memory_order_release);
+  resp_write->wait_count = 0;
+  resp_write->position = w;
+  resp_write->packet_count++;
+  req_read->position = r;
+  req_read->packet_count++;
+  s->dq.state->resp_packet_count[id]++;
+  s->dq.state->req_space_count[id]++;
+  if (h->flags & DSPQUEUE_HEADER_FLAG_DIRTY_BITMAP)
+    atomic_fetch_or((_Atomic uint64_t *)&s->dq.state->cpu_dirty[id / 64],
+                    1ULL << (id % 64));
+  return true;
+}
+
+static int dspqueue_invoke(struct mock_session *s, uint32_t mid,
+                           struct fastrpc_invoke_args *args) {
+  int nErr = AEE_SUCCESS;
+  unsigned ii;
+
+  pthread_mutex_lock(&s->mut);
+  switch (mid) {
+  case MOCK_DSPQUEUE_INIT_PROCESS_STATE_MID:
+    s->dq.state = map_find_fd_locked(s, *(int32_t *)ARG_PTR(args, 0));
+    s->dq.cancel = false;
+    if (!s->dq.state)
+      nErr = AEE_EBADPARM;
+    break;
+  case MOCK_DSPQUEUE_CREATE_QUEUE_MID: {
+    uint32_t *in = ARG_PTR(args, 0);
+    struct dspqueue_header *h = map_find_fd_locked(s, (int32_t)in[1]);
+
+    if (!h || !s->dq.state || in[0] >= DSPQUEUE_MAX_PROCESS_QUEUES) {
+      nErr = AEE_EBADPARM;
+      break;
+    }
+    // Reject the version probe so the CPU side enables wait counts, and
+    // flags it does not know like a DSP image would
+    if (h->version != DSPQUEUE_HEADER_CURRENT_VERSION ||
+        (h->flags & DSPQUEUE_HEADER_UNEXPECTED_FLAGS)) {
+      nErr = AEE_EUNSUPPORTED;
+      break;
+    }
+    if (h->flags & DSPQUEUE_HEADER_FLAG_DIRTY_BITMAP)
+      s->dq.legacy[in[0] / 64] &= ~(1ULL << (in[0] % 64));
+    else
+      s->dq.legacy[in[0] / 64] |= 1ULL << (in[0] % 64);
+    // Always ask to be signaled for new requests
+    ((struct dspqueue_packet_queue_state *)((uint8_t *)h +
+                                            h->req_queue.read_state_offset))
+        ->wait_count = 1;
+    s->dq.queues[in[0]] = h;
+    *(uint64_t *)ARG_PTR(args, 1) = in[0] + 1;
+    break;
+  }
+  case MOCK_DSPQUEUE_DESTROY_QUEUE_MID: {
+    uint64_t id = *(uint64_t *)ARG_PTR(args, 0);
+
+    if (id >= 1 && id <= DSPQUEUE_MAX_PROCESS_QUEUES)
+      s->dq.queues[id - 1] = NULL;
+    break;
+  }
+  case MOCK_DSPQUEUE_IS_IMPORTED_MID:
+    *(int32_t *)ARG_PTR(args, 1) = 0;
+    break;
+  case MOCK_DSPQUEUE_WAIT_SIGNAL_MID:
+    while (!s->dq.signal_pending && !s->dq.cancel)
+      pthread_cond_wait(&s->cond, &s->mut);
+    if (s->dq.cancel) {
+      *(int32_t *)ARG_PTR(args, 0) = -1;
+      s->dq.cancel = false;
+    } else {
+      *(int32_t *)ARG_PTR(args, 0) = 0;
+      s->dq.signal_pending = false;
+    }
+    break;
+  case MOCK_DSPQUEUE_CANCEL_WAIT_SIGNAL_MID:
+    s->dq.cancel = true;
+    pthread_cond_broadcast(&s->cond);
+    break;
+  case MOCK_DSPQUEUE_SIGNAL_MID:
+    // Only the queues the CPU flagged, and those without a bitmap
+    for (ii = 0; ii < DSPQUEUE_DIRTY_WORDS; ii++) {
+      uint64_t dirty = atomic_exchange(
+          (_Atomic uint64_t *)&s->dq.state->dsp_dirty[ii], 0);
+
+      dirty |= s->dq.legacy[ii];
+      while (dirty) {
+        unsigned id = ii * 64 + __builtin_ctzll(dirty);
+
+        dirty &= dirty - 1;
+        while (s->dq.queues[id] && dspqueue_echo_locked(s, id))
+          s->dq.signal_pending = true;
+      }
+    }
+    if (s->dq.signal_pending)
+      pthread_cond_broadcast(&s->cond);
+    break;
+  default:
+    break;
+  }
+  pthread_mutex_unlock(&s->mut);
+  return nErr;
+}
+
+static bool is_system_module(const char *name) {
+  unsigned ii;
+
+  if (!strncmp(name, "file:///lib", strlen("file:///lib")))
+    name += strlen("file:///lib");
+  for (ii = 0; ii < STD_ARRAY_SIZE(mock_system_modules); ii++) {
+    if (!strncmp(name, mock_system_modules[ii],
+                 strlen(mock_system_modules[ii])))
+      return true;
+  }
+  return false;
+}
+
+/* Loads a module: args are primIn {nameLen, dlerrLen}, name, primROut
+ * {handle, dlErr} and dlerror */
+static int remotectl_open(struct mock_session *s,
+                          struct fastrpc_invoke_args *args) {
+  uint32_t *in = ARG_PTR(args, 0);
+  const char *name = ARG_PTR(args, 1);
+  uint32_t *out = ARG_PTR(args, 2);
+  char *dlerr = ARG_PTR(args, 3);
+  struct mock_module *m = NULL, *old = NULL;
+  char *modname = NULL;
+  int nErr = AEE_SUCCESS, dlErr = 0;
+
+  VERIFYC(name && in[0] && name[in[0] - 1] == '\0', AEE_EBADPARM);
+  VERIFYC(NULL != (m = calloc(1, sizeof(*m))), AEE_ENOMEMORY);
+  if (!strncmp(name, dspqueue_rpc_URI, strlen(dspqueue_rpc_URI))) {
+    m->type = MOCK_MODULE_DSPQUEUE;
+  } else if (is_system_module(name)) {
+    m->type = MOCK_MODULE_NULL;
+  } else {
+    // Module names carry the session parameters of the library, URIs keep
+    // their query for mod_table
+    const char *amp = strchr(name, '&');
+
+    if (amp && !strchr(name, '?'))
+      VERIFYC(NULL != (modname = strndup(name, amp - name)), AEE_ENOMEMORY);
+    nErr = mod_table_open(modname ? modname : name, &m->handle, dlerr, in[1],
+                          &dlErr);
+    if (nErr || dlErr) {
+      FARF(ALWAYS, "%s: no skel found for %s (0x%x), serving it with a null "
+           "skel", __func__, name, nErr ? nErr : dlErr);
+      nErr = AEE_SUCCESS;
+      m->type = MOCK_MODULE_NULL;
+    } else {
+      m->type = MOCK_MODULE_SKEL;
+    }
+  }
+  if (dlerr && in[1])
+    dlerr[0] = '\0';
+  RW_MUTEX_LOCK_WRITE(s->modlock);
+  do {
+    if (m->type != MOCK_MODULE_SKEL)
+      m->handle = atomic_fetch_add(&mock.next_handle, 1);
+    HASH_FIND(hh, s->modules, &m->handle, sizeof(m->handle), old);
+  } while (old && m->type != MOCK_MODULE_SKEL);
+  if (!old)
+    HASH_ADD(hh, s->modules, handle, sizeof(m->handle), m);
+  RW_MUTEX_UNLOCK_WRITE(s->modlock);
+  if (old) {
+    // A skel opened twice shares its mod_table handle
+    mod_table_close(m->handle, NULL, 0, NULL);
+    free(m);
+    m = old;
+  }
+  out[0] = m->handle;
+  out[1] = 0;
+  FARF(RUNTIME_RPC_HIGH, "%s: opened %s with handle 0x%x type %d", __func__,
+       name, m->handle, m->type);
+bail:
+  free(modname);
+  if (nErr) {
+    FARF(ERROR, "Error 0x%x: %s failed", nErr, __func__);
+    free(m);
+  }
+  return nErr;
+}
+
+/* Unloads a module: args are primIn {handle, errLen}, primROut {dlErr} and
+ * the error string */
+static int remotectl_close(struct mock_session *s,
+                           struct fastrpc_invoke_args *args) {
+  uint32_t *in = ARG_PTR(args, 0);
+  uint32_t *out = ARG_PTR(args, 1);
+  char *errStr = ARG_PTR(args, 2);
+  struct mock_module *m = NULL;
+  int nErr = AEE_SUCCESS, dlErr = 0;
+
+  RW_MUTEX_LOCK_WRITE(s->modlock);
+  HASH_FIND(hh, s->modules, &in[0], sizeof(in[0]), m);
+  if (m)
+    HASH_DEL(s->modules, m);
+  RW_MUTEX_UNLOCK_WRITE(s->modlock);
+  VERIFYC(m, AEE_EINVHANDLE);
+  if (m->type == MOCK_MODULE_SKEL)
+    nErr = mod_table_close(m->handle, errStr, in[1], &dlErr);
+  free(m);
+  out[0] = dlErr;
+bail:
+  return nErr;
+}
+
+static int skel_invoke(remote_handle handle, uint32_t sc,
+                       struct fastrpc_invoke_args *args) {
+  remote_arg stack[MOCK_STACK_ARGS], *pra = stack;
+  int nErr = AEE_SUCCESS, ii;
+  int bufs = REMOTE_SCALARS_INBUFS(sc) + REMOTE_SCALARS_OUTBUFS(sc);
+  int total = REMOTE_SCALARS_LENGTH(sc);
+
+  if (total > MOCK_STACK_ARGS)
+    VERIFYC(NULL != (pra = calloc(total, sizeof(*pra))), AEE_ENOMEMORY);
+  for (ii = 0; ii < bufs; ii++) {
+    pra[ii].buf.pv = ARG_PTR(args, ii);
+    pra[ii].buf.nLen = args[ii].length;
+  }
+  for (; ii < total; ii++) {
+    pra[ii].dma.fd = args[ii].fd;
+    pra[ii].dma.offset = (uint32_t)args[ii].ptr;
+  }
+  nErr = mod_table_invoke(handle, sc, pra);
+bail:
+  if (pra != stack)
+    free(pra);
+  return nErr;
+}
+
+/* Returns the response of a finished reverse invoke. Must hold s->mut. */
+static void rev_complete_locked(struct mock_session *s, uint32_t ctx,
+                                int result, uint8_t *bufs, int bufsLen) {
+  QNode *pn;
+
+  QLIST_FOR_ALL(&s->rev_active, pn) {
+    struct mock_rev *rev = STD_RECOVER_REC(struct mock_rev, qn, pn);
+
+    if (rev->ctx != ctx)
+      continue;
+    if (result == AEE_SUCCESS) {
+      struct sbuf buf;
+
+      sbuf_init(&buf, 0, bufs, bufsLen);
+      result = unpack_out_bufs(&buf, rev->pra + REMOTE_SCALARS_INBUFS(rev->sc),
+                               REMOTE_SCALARS_OUTBUFS(rev->sc));
+    }
+    rev->result = result;
+    rev->done = true;
+    QNode_DequeueZ(&rev->qn);
+    pthread_cond_broadcast(&s->cond);
+    return;
+  }
+}
+
+/*
+ * Returns the previous reverse invoke response and waits for the next
+ * request: args are primIn {prevCtx, prevResult, prevbufsLen, bufsLen},
+ * prevbufs, primROut {ctx, handle, sc, bufsLenReq} and bufs
+ */
+static int listener_next2(struct mock_session *s,
+                          struct fastrpc_invoke_args *args) {
+  uint32_t *in = ARG_PTR(args, 0);
+  uint32_t *out = ARG_PTR(args, 2);
+  uint8_t *bufs = ARG_PTR(args, 3);
+  struct mock_rev *rev;
+  QNode *pn;
+
+  pthread_mutex_lock(&s->mut);
+  if (in[0])
+    rev_complete_locked(s, in[0], (int)in[1], ARG_PTR(args, 1),
+                        args[1].length);
+  while (s->alive && QList_IsEmpty(&s->rev_pending))
+    pthread_cond_wait(&s->cond, &s->mut);
+  if (!s->alive) {
+    pthread_mutex_unlock(&s->mut);
+    return DSP_AEE_EOFFSET + AEE_EBADSTATE;
+  }
+  pn = QList_Pop(&s->rev_pending);
+  rev = STD_RECOVER_REC(struct mock_rev, qn, pn);
+  QList_AppendNode(&s->rev_active, &rev->qn);
+  out[0] = rev->ctx;
+  out[1] = rev->handle;
+  out[2] = rev->sc;
+  out[3] = rev->inlen;
+  if (bufs)
+    memcpy(bufs, rev->in, STD_MIN((uint64_t)rev->inlen, args[3].length));
+  pthread_mutex_unlock(&s->mut);
+  return AEE_SUCCESS;
+}
+
+/* Copies the rest of a request: args are primIn {ctx, offset, bufsLen},
+ * primROut {bufsLenReq} and bufs */
+static int listener_get_in_bufs2(struct mock_session *s,
+                                 struct fastrpc_invoke_args *args) {
+  uint32_t *in = ARG_PTR(args, 0);
+  uint32_t *out = ARG_PTR(args, 1);
+  uint8_t *bufs = ARG_PTR(args, 2);
+  int nErr = AEE_EBADPARM;
+  QNode *pn;
+
+  pthread_mutex_lock(&s->mut);
+  QLIST_FOR_ALL(&s->rev_active, pn) {
+    struct mock_rev *rev = STD_RECOVER_REC(struct mock_rev, qn, pn);
+
+    if (rev->ctx != in[0] || in[1] > (uint32_t)rev->inlen)
+      continue;
+    if (bufs)
+      memcpy(bufs, rev->in + in[1],
+             STD_MIN((uint64_t)(rev->inlen - in[1]), args[2].length));
+    out[0] = rev->inlen;
+    nErr = AEE_SUCCESS;
+    break;
+  }
+  pthread_mutex_unlock(&s->mut);
+  return nErr;
+}
+
+static int module_invoke(struct mock_session *s, remote_handle handle,
+                         uint32_t sc, struct fastrpc_invoke_args *args) {
+  struct mock_module *m = NULL;
+  enum mock_module_type type = MOCK_MODULE_NULL;
+
+  RW_MUTEX_LOCK_READ(s->modlock);
+  HASH_FIND(hh, s->modules, &handle, sizeof(handle), m);
+  if (m)
+    type = m->type;
+  RW_MUTEX_UNLOCK_READ(s->modlock);
+  if (!m) {
+    // Const handles of DSP system modules
+    return handle < MOCK_FIRST_HANDLE ? AEE_SUCCESS : AEE_EINVHANDLE;
+  }
+  switch (type) {
+  case MOCK_MODULE_SKEL:
+    return skel_invoke(handle, sc, args);
+  case MOCK_MODULE_DSPQUEUE:
+    return dspqueue_invoke(s, REMOTE_SCALARS_METHOD(sc), args);
+  default:
+    return AEE_SUCCESS;
+  }
+}
+
+/* Runs a remote call on the mock DSP */
+static int mock_dispatch(struct mock_session *s, remote_handle handle,
+                         uint32_t sc, struct fastrpc_invoke_args *args) {
+  uint32_t mid = REMOTE_SCALARS_METHOD(sc);
+
+  switch (handle) {
+  case MOCK_REMOTECTL_HANDLE:
+    if (mid == MOCK_REMOTECTL_OPEN_MID)
+      return remotectl_open(s, args);
+    if (mid == MOCK_REMOTECTL_CLOSE_MID)
+      return remotectl_close(s, args);
+    break;
+  case MOCK_REMOTECTL1_HANDLE:
+    if (mid == MOCK_REMOTECTL1_OPEN1_MID)
+      return remotectl_open(s, args);
+    if (mid == MOCK_REMOTECTL1_CLOSE1_MID)
+      return remotectl_close(s, args);
+    break;
+  case MOCK_ADSP_LISTENER_HANDLE:
+    if (mid == MOCK_ADSP_LISTENER_NEXT2_MID)
+      return listener_next2(s, args);
+    if (mid == MOCK_ADSP_LISTENER_GET_IN_BUFS2_MID)
+      return listener_get_in_bufs2(s, args);
+    break;
+  case MOCK_ADSP_LISTENER1_HANDLE:
+    if (mid == MOCK_ADSP_LISTENER1_NEXT2_MID)
+      return listener_next2(s, args);
+    if (mid == MOCK_ADSP_LISTENER1_GET_IN_BUFS2_MID)
+      return listener_get_in_bufs2(s, args);
+    break;
+  case MOCK_ADSP_CURRENT_PROCESS1_HANDLE:
+    if (mid == MOCK_ADSP_CURRENT_PROCESS1_EXIT_MID)
+      session_exit(s);
+    break;
+  default:
+    return module_invoke(s, handle, sc, args);
+  }
+  return AEE_SUCCESS;
+}
+
+/* Loopback DSP thread running async invokes */
+static void *mock_dsp_thread(void *arg) {
+  struct mock_session *s = (struct mock_session *)arg;
+  struct mock_job *job;
+  QNode *pn;
+
+  pthread_mutex_lock(&s->mut);
+  while (1) {
+    while (s->alive && QList_IsEmpty(&s->jobs))
+      pthread_cond_wait(&s->cond, &s->mut);
+    if (!s->alive)
+      break;
+    pn = QList_Pop(&s->jobs);
+    job = STD_RECOVER_REC(struct mock_job, qn, pn);
+    pthread_mutex_unlock(&s->mut);
+    job->result = mock_dispatch(s, job->handle, job->sc, job->args);
+    pthread_mutex_lock(&s->mut);
+    QList_AppendNode(&s->done, &job->qn);
+    pthread_cond_broadcast(&s->cond);
+  }
+  pthread_mutex_unlock(&s->mut);
+  return NULL;
+}
+
+int fastrpc_mock_init(int dev, uint32_t flags) {
+  struct mock_session *s = session_get(dev);
+  int nErr = AEE_SUCCESS;
+
+  VERIFYC(s, AEE_EBADPARM);
+  pthread_mutex_lock(&s->mut);
+  s->alive = true;
+  if (!s->thread_started) {
+    if (!(nErr = pthread_create(&s->thread, NULL, mock_dsp_thread, s)))
+      s->thread_started = true;
+  }
+  pthread_mutex_unlock(&s->mut);
+  VERIFY(AEE_SUCCESS == nErr);
+  FARF(ALWAYS, "%s: mock DSP process created on device %d, domain %d, "
+       "flags 0x%x", __func__, dev, s->domain, flags);
+bail:
+  if (s)
+    session_put(s);
+  if (nErr)
+    FARF(ERROR, "Error 0x%x: %s failed for device %d", nErr, __func__, dev);
+  return nErr;
+}
+
+int fastrpc_mock_invoke(int dev, remote_handle handle, uint32_t sc,
+                        struct fastrpc_invoke_args *args,
+                        struct fastrpc_async_job *job) {
+  struct mock_session *s = session_get(dev);
+  struct mock_job *mjob = NULL;
+  int nErr = AEE_SUCCESS, total = REMOTE_SCALARS_LENGTH(sc);
+
+  VERIFYC(s, AEE_EBADPARM);
+  if (!job || !job->isasyncjob) {
+    nErr = mock_dispatch(s, handle, sc, args);
+    goto bail;
+  }
+  VERIFYC(NULL != (mjob = calloc(1, sizeof(*mjob) + total * sizeof(*args))),
+          AEE_ENOMEMORY);
+  mjob->jobid = job->jobid;
+  mjob->handle = handle;
+  mjob->sc = sc;
+  if (total)
+    memcpy(mjob->args, args, total * sizeof(*args));
+  pthread_mutex_lock(&s->mut);
+  if (s->alive) {
+    QList_AppendNode(&s->jobs, &mjob->qn);
+    pthread_cond_broadcast(&s->cond);
+    mjob = NULL;
+  } else {
+    nErr = AEE_EBADSTATE;
+  }
+  pthread_mutex_unlock(&s->mut);
+bail:
+  if (s)
+    session_put(s);
+  free(mjob);
+  return nErr;
+}
+
+/*
+ * The library stops the async thread with a signal that exits the thread
+ * from within the wait, release the session when that happens.
+ */
+static void invoke2_response_cleanup(void *arg) {
+  struct mock_session *s = (struct mock_session *)arg;
+
+  pthread_mutex_unlock(&s->mut);
+  session_put(s);
+}
+
+int fastrpc_mock_invoke2_response(int dev, fastrpc_async_jobid *jobid,
+                                  remote_handle *handle, uint32_t *sc,
+                                  int *result) {
+  struct mock_session *s = session_get(dev);
+  struct mock_job *job = NULL;
+  int nErr = AEE_SUCCESS;
+  QNode *pn;
+
+  VERIFYC(s, AEE_EBADPARM);
+  pthread_mutex_lock(&s->mut);
+  pthread_cleanup_push(invoke2_response_cleanup, s);
+  while (QList_IsEmpty(&s->done) && !s->async_wake && s->alive)
+    pthread_cond_wait(&s->cond, &s->mut);
+  pthread_cleanup_pop(0);
+  if ((pn = QList_Pop(&s->done)))
+    job = STD_RECOVER_REC(struct mock_job, qn, pn);
+  else
+    s->async_wake = false;
+  pthread_mutex_unlock(&s->mut);
+  VERIFYC(job, AEE_EINTERRUPTED);
+  *jobid = job->jobid;
+  *handle = job->handle;
+  *sc = job->sc;
+  *result = job->result;
+bail:
+  if (s)
+    session_put(s);
+  free(job);
+  return nErr;
+}
+
+int fastrpc_mock_mmap(int dev, int fd, size_t len, uintptr_t vaddrin,
+                      uint64_t *vaddrout) {
+  struct mock_session *s = session_get(dev);
+  struct mock_map *map = NULL;
+  int nErr = AEE_SUCCESS;
+
+  VERIFYC(s, AEE_EBADPARM);
+  VERIFYC(NULL != (map = calloc(1, sizeof(*map))), AEE_ENOMEMORY);
+  if (!vaddrin) {
+    // The DSP needs its own view of buffers mapped by fd only
+    VERIFYC(fd >= 0, AEE_EBADPARM);
+    map->local = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    VERIFYC(MAP_FAILED != map->local, AEE_EMMAP);
+    vaddrin = (uintptr_t)map->local;
+  }
+  map->fd = fd;
+  map->vaddr = vaddrin;
+  map->len = len;
+  pthread_mutex_lock(&s->mut);
+  QList_AppendNode(&s->maps, &map->qn);
+  pthread_mutex_unlock(&s->mut);
+  *vaddrout = vaddrin;
+  map = NULL;
+bail:
+  if (s)
+    session_put(s);
+  free(map);
+  return nErr;
+}
+
+int fastrpc_mock_munmap(int dev, int fd, uint64_t vaddr) {
+  struct mock_session *s = session_get(dev);
+  struct mock_map *map = NULL;
+  int nErr = AEE_SUCCESS;
+  QNode *pn, *pnn;
+
+  VERIFYC(s, AEE_EBADPARM);
+  pthread_mutex_lock(&s->mut);
+  QLIST_NEXTSAFE_FOR_ALL(&s->maps, pn, pnn) {
+    struct mock_map *m = STD_RECOVER_REC(struct mock_map, qn, pn);
+
+    if (m->vaddr == vaddr || (!vaddr && m->fd == fd)) {
+      QNode_DequeueZ(&m->qn);
+      map = m;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&s->mut);
+  VERIFYC(map, AEE_ENOSUCHMAP);
+  if (map->local)
+    munmap(map->local, map->len);
+bail:
+  if (s)
+    session_put(s);
+  free(map);
+  return nErr;
+}
+
+int fastrpc_mock_getdspinfo(int dev, uint32_t attr, uint32_t *capability) {
+  *capability =
+      (attr == ASYNC_FASTRPC_SUPPORT || attr == REVERSE_RPC_BUF_REF_SUPPORT)
+          ? 1
+          : 0;
+  return AEE_SUCCESS;
+}
+
+int fastrpc_mock_control(int dev, int req, void *c) {
+  struct mock_session *s = NULL;
+
+  if (req != DSPRPC_ASYNC_WAKE)
+    return AEE_EUNSUPPORTED;
+  if (!(s = session_get(dev)))
+    return AEE_EBADPARM;
+  pthread_mutex_lock(&s->mut);
+  s->async_wake = true;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->mut);
+  session_put(s);
+  return AEE_SUCCESS;
+}
+
+/* Updates the state of a created signal */
+static int signal_update(int dev, uint32_t signal, uint8_t set, uint8_t clear,
+                         bool create) {
+  struct mock_session *s = NULL;
+  int nErr = AEE_SUCCESS;
+
+  VERIFYC(signal < DSPSIGNAL_NUM_SIGNALS, AEE_EBADPARM);
+  VERIFYC(NULL != (s = session_get(dev)), AEE_EBADPARM);
+  pthread_mutex_lock(&s->mut);
+  if (create || (s->signals[signal] & MOCK_SIGNAL_CREATED)) {
+    s->signals[signal] = (s->signals[signal] & ~clear) | set;
+    pthread_cond_broadcast(&s->cond);
+  } else {
+    nErr = AEE_EBADPARM;
+  }
+  pthread_mutex_unlock(&s->mut);
+bail:
+  if (s)
+    session_put(s);
+  return nErr;
+}
+
+int fastrpc_mock_signal_create(int dev, uint32_t signal) {
+  return signal_update(dev, signal, MOCK_SIGNAL_CREATED, 0xff, true);
+}
+
+int fastrpc_mock_signal_destroy(int dev, uint32_t signal) {
+  return signal_update(dev, signal, 0, 0xff, false);
+}
+
+int fastrpc_mock_signal_signal(int dev, uint32_t signal) {
+  return signal_update(dev, signal, MOCK_SIGNAL_PENDING, 0, false);
+}
+
+int fastrpc_mock_signal_cancel_wait(int dev, uint32_t signal) {
+  return signal_update(dev, signal, MOCK_SIGNAL_CANCELED, 0, false);
+}
+
+/*
+ * Multi-domain contexts only need an id unique in the process, the mock
+ * processes of the domains are the sessions already opened on them
+ */
+int fastrpc_mock_mdctx_manage(int dev, int req, void *user_ctx,
+                              unsigned int *domain_ids,
+                              unsigned int num_domain_ids, uint64_t *ctx) {
+  struct mock_session *s = NULL;
+  int nErr = AEE_SUCCESS;
+
+  (void)user_ctx;
+  (void)domain_ids;
+  (void)num_domain_ids;
+  VERIFYC(NULL != (s = session_get(dev)), AEE_EBADPARM);
+  VERIFYC(ctx, AEE_EBADPARM);
+  if (req == FASTRPC_MDCTX_SETUP) {
+    *ctx = atomic_fetch_add(&mock.next_ctx, 1);
+  } else {
+    VERIFYC(req == FASTRPC_MDCTX_REMOVE, AEE_EBADPARM);
+  }
+bail:
+  if (s)
+    session_put(s);
+  return nErr;
+}
+
+/*
+ * Waits for a signal. Like the driver, a timeout or a canceled wait fail
+ * with -1 and errno ETIMEDOUT or EINTR.
+ */
+int fastrpc_mock_signal_wait(int dev, uint32_t signal, uint32_t timeout_usec) {
+  struct mock_session *s = NULL;
+  struct timespec ts;
+  int nErr = AEE_SUCCESS, rc = 0, err = 0;
+
+  VERIFYC(signal < DSPSIGNAL_NUM_SIGNALS, AEE_EBADPARM);
+  VERIFYC(NULL != (s = session_get(dev)), AEE_EBADPARM);
+  if (timeout_usec != DSPSIGNAL_TIMEOUT_NONE) {
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_usec / 1000000;
+    ts.tv_nsec += (timeout_usec % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+  }
+  pthread_mutex_lock(&s->mut);
+  while (1) {
+    uint8_t *state = &s->signals[signal];
+
+    if (!(*state & MOCK_SIGNAL_CREATED)) {
+      nErr = AEE_EBADPARM;
+      break;
+    }
+    if (*state & MOCK_SIGNAL_PENDING) {
+      *state &= ~MOCK_SIGNAL_PENDING;
+      break;
+    }
+    if (*state & MOCK_SIGNAL_CANCELED) {
+      *state &= ~MOCK_SIGNAL_CANCELED;
+      err = EINTR;
+      break;
+    }
+    if (rc == ETIMEDOUT || s->closed) {
+      err = rc == ETIMEDOUT ? ETIMEDOUT : EINTR;
+      break;
+    }
+    if (timeout_usec == DSPSIGNAL_TIMEOUT_NONE)
+      pthread_cond_wait(&s->cond, &s->mut);
+    else
+      rc = pthread_cond_timedwait(&s->cond, &s->mut, &ts);
+  }
+  pthread_mutex_unlock(&s->mut);
+bail:
+  if (s)
+    session_put(s);
+  if (err) {
+    errno = err;
+    return -1;
+  }
+  return nErr;
+}
+
+int fastrpc_mock_reverse_invoke(int domain, remote_handle handle, uint32_t sc,
+                                remote_arg *pra) {
+  struct mock_session *s = NULL;
+  struct mock_rev rev = {0};
+  struct sbuf buf;
+  struct listener_buf_ref refs[2 * 0xf];
+  int nErr = AEE_SUCCESS, ii, nova = 0, attr = 0, fd = -1;
+  int inbufs = REMOTE_SCALARS_INBUFS(sc), outbufs = REMOTE_SCALARS_OUTBUFS(sc);
+  int nrefs = REMOTE_SCALARS_INHANDLES(sc) + REMOTE_SCALARS_OUTHANDLES(sc);
+  void *base = NULL;
+
+  VERIFYC(NULL != (s = session_get_domain(domain)), AEE_EBADSTATE);
+  VERIFYC(!(NULL == pra && inbufs + outbufs + nrefs > 0), AEE_EBADPARM);
+  // The buffers passed by reference are described by fd and offset
+  for (ii = 0; ii < nrefs; ii++) {
+    remote_arg *arg = &pra[inbufs + outbufs + ii];
+
+    VERIFY(AEE_SUCCESS == (nErr = fdlist_fd_from_buf(arg->buf.pv,
+                                                     (int)arg->buf.nLen, &nova,
+                                                     &base, &attr, &fd)));
+    VERIFYC(fd != -1, AEE_EBADPARM);
+    refs[ii].fd = fd;
+    refs[ii].offset = (uint32_t)((uintptr_t)arg->buf.pv - (uintptr_t)base);
+    refs[ii].len = (uint32_t)arg->buf.nLen;
+  }
+  sbuf_init(&buf, 0, 0, 0);
+  pack_in_bufs(&buf, pra, inbufs);
+  pack_out_lens(&buf, pra + inbufs, outbufs);
+  pack_buf_refs(&buf, refs, nrefs);
+  rev.inlen = sbuf_needed(&buf);
+  VERIFYC(NULL != (rev.in = malloc(rev.inlen + 1)), AEE_ENOMEMORY);
+  sbuf_init(&buf, 0, rev.in, rev.inlen);
+  pack_in_bufs(&buf, pra, inbufs);
+  pack_out_lens(&buf, pra + inbufs, outbufs);
+  pack_buf_refs(&buf, refs, nrefs);
+  rev.handle = handle;
+  rev.sc = sc;
+  rev.pra = pra;
+
+  pthread_mutex_lock(&s->mut);
+  if (++s->next_ctx == 0)
+    s->next_ctx = 1;
+  rev.ctx = s->next_ctx;
+  QList_AppendNode(&s->rev_pending, &rev.qn);
+  pthread_cond_broadcast(&s->cond);
+  while (!rev.done && s->alive)
+    pthread_cond_wait(&s->cond, &s->mut);
+  if (!rev.done) {
+    QNode_DequeueZ(&rev.qn);
+    rev.result = AEE_EBADSTATE;
+  }
+  pthread_mutex_unlock(&s->mut);
+  nErr = rev.result;
+bail:
+  if (s)
+    session_put(s);
+  free(rev.in);
+  return nErr;
+}
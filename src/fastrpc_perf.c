@@ -285,18 +285,19 @@ int fastrpc_perf_init(int dev, int domain) {
   struct fastrpc_perf *p = &gperf;
   struct perf_keys *pk = &gperf.kernel;
   struct perf_keys *pd = &gperf.dsp;
+  int perf_on = PERF_OFF;
 
   pk->enable = fastrpc_get_property_int(FASTRPC_PERF_KERNEL, 0) ||
                fastrpc_config_is_perfkernel_enabled();
   pd->enable = fastrpc_get_property_int(FASTRPC_PERF_ADSP, 0) ||
                fastrpc_config_is_perfdsp_enabled();
 
-  p->perf_on = (pk->enable || pd->enable) ? PERF_MODE : PERF_OFF;
+  perf_on = (pk->enable || pd->enable) ? PERF_MODE : PERF_OFF;
   p->freq = fastrpc_get_property_int(FASTRPC_PERF_FREQ, 1000);
   VERIFYC(p->freq > 0, AEE_ERPC);
   p->process_trace_enabled =
       fastrpc_get_property_int(FASTRPC_ENABLE_SYSTRACE, 0);
-  if (p->perf_on) {
+  if (perf_on) {
     check_perf_v2_enabled(domain);
   }
   p->count = 0;
@@ -320,6 +321,8 @@ bail:
          nErr, pk->enable, pd->enable, p->freq);
     p->perf_on = 0;
   } else {
+    // Published last: init may run while invokes are already in flight
+    p->perf_on = perf_on;
     FARF(ALWAYS,
          "%s: enabled systrace 0x%x and RPC traces (kernel %d, dsp %d) with "
          "frequency %d",
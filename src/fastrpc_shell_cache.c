@@ -0,0 +1,331 @@
+// Copyright (c) 2024, Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "AEEStdErr.h"
+#include "HAP_farf.h"
+#include "apps_std_internal.h"
+#include "fastrpc_common.h"
+#include "fastrpc_shell_cache.h"
+#include "verify.h"
+
+#ifndef PROPERTY_VALUE_MAX
+#define PROPERTY_VALUE_MAX 92
+#endif
+
+#define SHELL_CACHE_MAGIC 0x4c454853 // "SHEL"
+#define SHELL_CACHE_VERSION 1
+#define SHELL_CACHE_STATS_FILE "stats"
+
+/* Identity of a file the image was read from, zero if there is none */
+struct shell_cache_file_key {
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime;
+  int64_t mtimensec;
+};
+
+struct shell_cache_key {
+  struct shell_cache_file_key shell;
+  struct shell_cache_file_key sig;
+};
+
+/* Header of a cache entry, the image starts on the next page */
+struct shell_cache_header {
+  uint32_t magic;
+  uint32_t version;
+  struct shell_cache_key key;
+  uint32_t shell_len;
+  uint32_t sig_len;
+};
+
+/* Counters shared by all processes through the stats file */
+struct shell_cache_shared_stats {
+  _Atomic uint64_t hits;
+  _Atomic uint64_t misses;
+  _Atomic uint64_t stores;
+  _Atomic uint64_t errors;
+};
+
+static struct {
+  char dir[PROPERTY_VALUE_MAX];
+  size_t page_size;
+  struct shell_cache_shared_stats *shared; // NULL if the file is unusable
+  struct shell_cache_shared_stats local;
+} cache;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Entries are sent to the DSP as the PD shell, so only files no other user
+ * can have written are used: owned by the user, not writable by group or
+ * others. Entries are only ever replaced by rename, never written in place.
+ */
+static bool shell_cache_trusted(const struct stat *st, mode_t type) {
+  return (st->st_mode & S_IFMT) == type && st->st_uid == geteuid() &&
+         !(st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+static void shell_cache_init_once(void) {
+  char path[PATH_MAX];
+  int fd = -1;
+  void *map = MAP_FAILED;
+  struct stat st;
+
+  if (!fastrpc_get_property_string(FASTRPC_SHELL_CACHE_DIR, cache.dir, NULL) ||
+      !cache.dir[0]) {
+    cache.dir[0] = '\0';
+    return;
+  }
+  cache.page_size = (size_t)sysconf(_SC_PAGESIZE);
+  // Entries are shared with the other processes of the same user only
+  mkdir(cache.dir, 0700);
+  if (lstat(cache.dir, &st) != 0) {
+    FARF(ERROR, "Error: %s: %s unusable (errno %s), shell cache off",
+         __func__, cache.dir, strerror(errno));
+    cache.dir[0] = '\0';
+    return;
+  }
+  if (!shell_cache_trusted(&st, S_IFDIR)) {
+    FARF(ERROR,
+         "Error: %s: %s is not a directory private to the user, shell cache "
+         "off",
+         __func__, cache.dir);
+    cache.dir[0] = '\0';
+    return;
+  }
+  snprintf(path, sizeof(path), "%s/%s", cache.dir, SHELL_CACHE_STATS_FILE);
+  fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+  if (fd >= 0) {
+    // A new file reads as zero counters
+    if (fstat(fd, &st) == 0 && shell_cache_trusted(&st, S_IFREG) &&
+        (st.st_size >= (off_t)sizeof(*cache.shared) ||
+         ftruncate(fd, sizeof(*cache.shared)) == 0)) {
+      map = mmap(NULL, sizeof(*cache.shared), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+    }
+    close(fd);
+  }
+  if (map != MAP_FAILED) {
+    cache.shared = map;
+  } else {
+    FARF(ERROR, "Error: %s: stats file %s unusable (errno %s)", __func__, path,
+         strerror(errno));
+  }
+  FARF(ALWAYS, "%s: shell cache in %s", __func__, cache.dir);
+}
+
+static bool shell_cache_enabled(void) {
+  pthread_once(&cache_once, shell_cache_init_once);
+  return cache.dir[0] != '\0';
+}
+
+static void shell_cache_count(size_t offset) {
+  atomic_fetch_add((_Atomic uint64_t *)((char *)&cache.local + offset), 1);
+  if (cache.shared) {
+    atomic_fetch_add((_Atomic uint64_t *)((char *)cache.shared + offset), 1);
+  }
+}
+
+#define SHELL_CACHE_COUNT(counter)                                             \
+  shell_cache_count(offsetof(struct shell_cache_shared_stats, counter))
+
+static int shell_cache_file_key(apps_std_FILE fh,
+                                struct shell_cache_file_key *fk) {
+  int nErr = AEE_SUCCESS;
+  struct stat st;
+
+  memset(fk, 0, sizeof(*fk));
+  if (fh == -1) {
+    return nErr;
+  }
+  VERIFY(AEE_SUCCESS == (nErr = apps_std_fstat_internal(fh, &st)));
+  fk->dev = st.st_dev;
+  fk->ino = st.st_ino;
+  fk->size = st.st_size;
+  fk->mtime = st.st_mtim.tv_sec;
+  fk->mtimensec = st.st_mtim.tv_nsec;
+bail:
+  return nErr;
+}
+
+// Builds the key of an image and the path of its cache entry
+static int shell_cache_entry(apps_std_FILE shell, apps_std_FILE sig,
+                             struct shell_cache_key *key, char *path,
+                             size_t path_len) {
+  int nErr = AEE_SUCCESS;
+  const unsigned char *p = (const unsigned char *)key;
+  uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+  size_t ii;
+
+  memset(key, 0, sizeof(*key));
+  VERIFY(AEE_SUCCESS == (nErr = shell_cache_file_key(shell, &key->shell)));
+  VERIFY(AEE_SUCCESS == (nErr = shell_cache_file_key(sig, &key->sig)));
+  for (ii = 0; ii < sizeof(*key); ii++) {
+    hash = (hash ^ p[ii]) * 0x100000001b3ULL;
+  }
+  VERIFYC(snprintf(path, path_len, "%s/shell-%016" PRIx64 ".img", cache.dir,
+                   hash) < (int)path_len,
+          AEE_EBADSIZE);
+bail:
+  return nErr;
+}
+
+int fastrpc_shell_cache_lookup(apps_std_FILE shell, apps_std_FILE sig,
+                               struct fastrpc_shell_image *img) {
+  int nErr = AEE_SUCCESS, fd = -1;
+  char path[PATH_MAX];
+  struct shell_cache_key key;
+  const struct shell_cache_header *hdr = NULL;
+  void *map = MAP_FAILED;
+  size_t map_len = 0;
+  struct stat st;
+
+  memset(img, 0, sizeof(*img));
+  if (!shell_cache_enabled()) {
+    return AEE_EUNSUPPORTED;
+  }
+  VERIFY(AEE_SUCCESS ==
+         (nErr = shell_cache_entry(shell, sig, &key, path, sizeof(path))));
+  fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+  VERIFYC(fd >= 0, AEE_ENOSUCHFILE);
+  VERIFYC(fstat(fd, &st) == 0, AEE_EFILE);
+  VERIFYC(shell_cache_trusted(&st, S_IFREG), AEE_EFILE);
+  map_len = cache.page_size + key.shell.size + key.sig.size;
+  VERIFYC((uint64_t)st.st_size == map_len, AEE_EFILE);
+  map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+  VERIFYC(map != MAP_FAILED, AEE_EMMAP);
+  hdr = map;
+  // Entries of another key with the same hash are misses too
+  VERIFYC(hdr->magic == SHELL_CACHE_MAGIC &&
+              hdr->version == SHELL_CACHE_VERSION &&
+              !memcmp(&hdr->key, &key, sizeof(key)) &&
+              hdr->shell_len == key.shell.size &&
+              hdr->sig_len == key.sig.size,
+          AEE_EFILE);
+  img->base = map;
+  img->map_len = map_len;
+  img->data = (char *)map + cache.page_size;
+  img->shell_len = hdr->shell_len;
+  img->sig_len = hdr->sig_len;
+  SHELL_CACHE_COUNT(hits);
+  FARF(RUNTIME_RPC_HIGH, "%s: hit %s, shell %u bytes, testsig %u bytes",
+       __func__, path, img->shell_len, img->sig_len);
+bail:
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (nErr != AEE_SUCCESS) {
+    if (map != MAP_FAILED) {
+      munmap(map, map_len);
+    }
+    SHELL_CACHE_COUNT(misses);
+    if (nErr != AEE_ENOSUCHFILE) {
+      SHELL_CACHE_COUNT(errors);
+      FARF(ERROR, "Error 0x%x: %s: unusable entry %s (errno %s)", nErr,
+           __func__, path, strerror(errno));
+    }
+  }
+  return nErr;
+}
+
+void fastrpc_shell_cache_store(apps_std_FILE shell, apps_std_FILE sig,
+                               const void *data, uint32_t shell_len,
+                               uint32_t sig_len) {
+  int nErr = AEE_SUCCESS, fd = -1;
+  char path[PATH_MAX], tmp[PATH_MAX];
+  struct shell_cache_key key;
+  struct shell_cache_header hdr = {0};
+  size_t len = (size_t)shell_len + sig_len;
+
+  tmp[0] = '\0';
+  if (!shell_cache_enabled()) {
+    return;
+  }
+  VERIFY(AEE_SUCCESS ==
+         (nErr = shell_cache_entry(shell, sig, &key, path, sizeof(path))));
+  // Files changed while they were read
+  VERIFYC(key.shell.size == shell_len && key.sig.size == sig_len,
+          AEE_EFILE);
+  VERIFYC(snprintf(tmp, sizeof(tmp), "%s.%d.%d", path, getpid(), gettid()) <
+              (int)sizeof(tmp),
+          AEE_EBADSIZE);
+  fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  VERIFYC(fd >= 0, AEE_EFILE);
+  hdr.magic = SHELL_CACHE_MAGIC;
+  hdr.version = SHELL_CACHE_VERSION;
+  hdr.key = key;
+  hdr.shell_len = shell_len;
+  hdr.sig_len = sig_len;
+  VERIFYC(ftruncate(fd, cache.page_size + len) == 0, AEE_EFILE);
+  VERIFYC(pwrite(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr), AEE_EFILE);
+  VERIFYC(pwrite(fd, data, len, cache.page_size) == (ssize_t)len, AEE_EFILE);
+  // Readers only ever see complete entries
+  VERIFYC(rename(tmp, path) == 0, AEE_EFILE);
+  tmp[0] = '\0';
+  SHELL_CACHE_COUNT(stores);
+  FARF(ALWAYS, "%s: added %s, shell %u bytes, testsig %u bytes", __func__,
+       path, shell_len, sig_len);
+bail:
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (tmp[0]) {
+    unlink(tmp);
+  }
+  if (nErr != AEE_SUCCESS) {
+    SHELL_CACHE_COUNT(errors);
+    FARF(ERROR, "Error 0x%x: %s failed (errno %s)", nErr, __func__,
+         strerror(errno));
+  }
+}
+
+void fastrpc_shell_cache_release(struct fastrpc_shell_image *img) {
+  if (img->base) {
+    munmap(img->base, img->map_len);
+  }
+  memset(img, 0, sizeof(*img));
+}
+
+static void shell_cache_read_stats(struct shell_cache_shared_stats *from,
+                                   struct fastrpc_shell_cache_stats *to) {
+  to->hits = atomic_load(&from->hits);
+  to->misses = atomic_load(&from->misses);
+  to->stores = atomic_load(&from->stores);
+  to->errors = atomic_load(&from->errors);
+}
+
+int fastrpc_shell_cache_get_stats(struct fastrpc_shell_cache_stats *process,
+                                  struct fastrpc_shell_cache_stats *all) {
+  if (!shell_cache_enabled()) {
+    return AEE_EUNSUPPORTED;
+  }
+  if (process) {
+    shell_cache_read_stats(&cache.local, process);
+  }
+  if (all) {
+    if (cache.shared) {
+      shell_cache_read_stats(cache.shared, all);
+    } else {
+      memset(all, 0, sizeof(*all));
+    }
+  }
+  return AEE_SUCCESS;
+}
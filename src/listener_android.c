@@ -11,11 +11,17 @@
 #include <assert.h>
 #include <dlfcn.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/eventfd.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "AEEStdErr.h"
@@ -24,8 +30,11 @@
 #include "rpcmem_internal.h"
 #include "adsp_listener.h"
 #include "adsp_listener1.h"
+#include "fastrpc_cap.h"
 #include "fastrpc_common.h"
 #include "fastrpc_internal.h"
+#include "fastrpc_mem.h"
+#include "listener_android.h"
 #include "listener_buf.h"
 #include "mod_table.h"
 #include "platform_libs.h"
@@ -34,13 +43,87 @@
 #include "verify.h"
 #include "fastrpc_hash_table.h"
 
+/* Number of listener threads per domain */
+#define LISTENER_THREADS_ENV "ADSP_LISTENER_THREADS"
+#define LISTENER_THREADS_MAX 16
+/*
+ * Modules invoked by one listener thread at a time, separated by ';'.
+ * An entry matches the name a module is opened with, or the library of a
+ * "file:///lib.so?..." URI.
+ */
+#define LISTENER_SERIAL_MODULES_ENV "ADSP_LISTENER_SERIAL_MODULES"
+/* Bytes of request and response buffers each listener thread starts with */
+#define LISTENER_BUF_PREALLOC_ENV "ADSP_LISTENER_BUF_PREALLOC"
+/* Set to 0 to release listener buffers instead of pooling them */
+#define LISTENER_BUF_POOL_ENV "ADSP_LISTENER_BUF_POOL"
+/*
+ * A buffer shrinks once this many calls in a row fit in a quarter of it, so
+ * that alternating request sizes keep reusing the same buffer
+ */
+#define LISTENER_SHRINK_CALLS 64
+
+/* Reverse handle of a module that is invoked one call at a time */
 typedef struct {
-  pthread_t thread;
+  remote_handle handle;
+  UT_hash_handle hh;
+} listener_serial_handle;
+
+/* Latency of the reverse invokes of a handle */
+typedef struct {
+  struct listener_handle_stats stats;
+  UT_hash_handle hh;
+} listener_handle_entry;
+
+/*
+ * Latency of the reverse invokes served by one listener thread, merged by
+ * listener_android_get_stats(). The lock is only contended by the readers
+ * of the stats, never by the other listener threads.
+ */
+struct listener_thread_stats {
+  pthread_mutex_t mut; // guards handles
+  listener_handle_entry *handles;
+};
+
+/* Request or response buffer of a listener thread */
+struct listener_buf {
+  uint8_t *data;
+  int capacity;
+  int small_calls; // calls in a row that fit in a quarter of the buffer
+};
+
+/* Allocation settings of listener buffers */
+struct listener_buf_opts {
+  int heapid;
+  uint32_t flags;
+  int cache_size; // buffers up to this size are never shrunk
+  int prealloc;
+};
+
+typedef struct {
+  pthread_t thread; // first listener thread, starts and joins the others
+  pthread_t pool[LISTENER_THREADS_MAX - 1];
+  int num_pool;
+  atomic_int live_threads;
   int eventfd;
   int update_requested;
   int params_updated;
   sem_t *r_sem;
   remote_handle64 adsp_listener1_handle;
+  bool buf_refs; // DSP passes buffers by reference, see listener_buf_ref
+  bool locks_init;
+  pthread_mutex_t serial_mut;  // held while a serial module runs
+  pthread_mutex_t handles_mut; // guards serial_handles
+  listener_serial_handle *serial_handles;
+  atomic_int num_serial_handles;
+  _Atomic uint64_t invokes;
+  _Atomic uint64_t grows;
+  _Atomic uint64_t shrinks;
+  _Atomic uint64_t bytes_copied;
+  _Atomic uint64_t bytes_in;
+  _Atomic uint64_t bytes_out;
+  _Atomic uint64_t bytes_by_ref;
+  atomic_int num_thread_stats; // thread_stats taken by the listener threads
+  struct listener_thread_stats thread_stats[LISTENER_THREADS_MAX];
   ADD_DOMAIN_HASH();
 } listener_config;
 
@@ -48,6 +131,99 @@ DECLARE_HASH_TABLE(listener, listener_config);
 
 extern void set_thread_context(int domain);
 
+/*
+ * Returns true if a module name is listed in ADSP_LISTENER_SERIAL_MODULES
+ */
+static bool listener_is_serial_module(const char *name) {
+  const char *list = getenv(LISTENER_SERIAL_MODULES_ENV);
+  const char *file = name, *entry, *end;
+  size_t filelen, len;
+
+  if (!list || !name) {
+    return false;
+  }
+  if (!strncmp(file, "file://", strlen("file://"))) {
+    file += strlen("file://");
+    while (*file == '/') {
+      file++;
+    }
+  }
+  filelen = strcspn(file, "?");
+  for (entry = list; *entry; entry = *end ? end + 1 : end) {
+    end = entry + strcspn(entry, ";");
+    len = end - entry;
+    if (len && ((len == strlen(name) && !strncmp(entry, name, len)) ||
+                (len == filelen && !strncmp(entry, file, len)))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Tags or untags the reverse handle of a serial module
+ */
+static void listener_set_serial_handle(int domain, remote_handle handle,
+                                       bool serial) {
+  listener_config *me = NULL;
+  listener_serial_handle *sh = NULL;
+
+  GET_HASH_NODE(listener_config, domain, me);
+  if (!me) {
+    return;
+  }
+  pthread_mutex_lock(&me->handles_mut);
+  HASH_FIND(hh, me->serial_handles, &handle, sizeof(handle), sh);
+  if (serial && !sh && NULL != (sh = calloc(1, sizeof(*sh)))) {
+    sh->handle = handle;
+    HASH_ADD(hh, me->serial_handles, handle, sizeof(sh->handle), sh);
+    atomic_fetch_add(&me->num_serial_handles, 1);
+    FARF(ALWAYS, "%s: handle 0x%x of domain %d is invoked serially", __func__,
+         handle, domain);
+  } else if (!serial && sh) {
+    HASH_DEL(me->serial_handles, sh);
+    atomic_fetch_sub(&me->num_serial_handles, 1);
+    free(sh);
+  }
+  pthread_mutex_unlock(&me->handles_mut);
+}
+
+static bool listener_is_serial_handle(listener_config *me,
+                                      remote_handle handle) {
+  listener_serial_handle *sh = NULL;
+
+  if (!atomic_load(&me->num_serial_handles)) {
+    return false;
+  }
+  pthread_mutex_lock(&me->handles_mut);
+  HASH_FIND(hh, me->serial_handles, &handle, sizeof(handle), sh);
+  pthread_mutex_unlock(&me->handles_mut);
+  return sh != NULL;
+}
+
+/* Drops the stats of a closed handle from every listener thread */
+static void listener_drop_handle_stats(int domain, remote_handle handle) {
+  listener_config *me = NULL;
+  listener_handle_entry *e = NULL;
+
+  GET_HASH_NODE(listener_config, domain, me);
+  if (!me || !me->locks_init) {
+    return;
+  }
+  for (int i = 0; i < LISTENER_THREADS_MAX; i++) {
+    struct listener_thread_stats *ts = &me->thread_stats[i];
+
+    pthread_mutex_lock(&ts->mut);
+    HASH_FIND(hh, ts->handles, &handle, sizeof(handle), e);
+    if (e) {
+      HASH_DEL(ts->handles, e);
+    }
+    pthread_mutex_unlock(&ts->mut);
+    free(e);
+    e = NULL;
+  }
+}
+
 __QAIC_IMPL_EXPORT int
 __QAIC_IMPL(apps_remotectl_open)(const char *name, uint32_t *handle, char *dlStr,
                                  int dlerrorLen,
@@ -60,6 +236,9 @@ __QAIC_IMPL(apps_remotectl_open)(const char *name, uint32_t *handle, char *dlStr
   VERIFY(AEE_SUCCESS ==
          (nErr = fastrpc_update_module_list(
               REVERSE_HANDLE_LIST_PREPEND, domain, (remote_handle)*handle, &local, NULL)));
+  if (listener_is_serial_module(name)) {
+    listener_set_serial_handle(domain, (remote_handle)*handle, true);
+  }
 bail:
   return nErr;
 }
@@ -79,6 +258,8 @@ __QAIC_IMPL(apps_remotectl_close)(uint32_t handle, char *errStr, int errStrLen,
     }
     goto bail;
   }
+  listener_set_serial_handle(domain, (remote_handle)handle, false);
+  listener_drop_handle_stats(domain, (remote_handle)handle);
   VERIFY(AEE_SUCCESS ==
          (nErr = fastrpc_update_module_list(
               REVERSE_HANDLE_LIST_DEQUEUE, domain, (remote_handle)handle, NULL, NULL)));
@@ -94,46 +275,210 @@ bail:
     }                                                                          \
   } while (0)
 
-static __inline void *rpcmem_realloc(int heapid, uint32_t flags, void *buf,
-                                     int oldsize, size_t size) {
-  void *bufnew = rpcmem_alloc_internal(heapid, flags, size);
-  if (buf && bufnew) {
-    memmove(bufnew, buf, STD_MIN(oldsize, size));
-    rpcmem_free_internal(buf);
-    buf = NULL;
+#define MIN_BUF_SIZE 0x1000
+#define ALIGNB(sz) ((sz) == 0 ? MIN_BUF_SIZE : _SBUF_ALIGN((sz), MIN_BUF_SIZE))
+
+/* Size class of a listener buffer: the next power of two pages */
+static int listener_buf_size(int len) {
+  int size = MIN_BUF_SIZE;
+
+  while (size < len && size <= INT_MAX / 2) {
+    size <<= 1;
   }
-  return bufnew;
+  return size < len ? ALIGNB(len) : size;
 }
 
-#define MIN_BUF_SIZE 0x1000
-#define ALIGNB(sz) ((sz) == 0 ? MIN_BUF_SIZE : _SBUF_ALIGN((sz), MIN_BUF_SIZE))
+/*
+ * Fits a listener buffer to len bytes, keeping its first keep bytes.
+ * A buffer grows to the size class of len at once, and shrinks to the size
+ * class of twice len once LISTENER_SHRINK_CALLS calls in a row needed at
+ * most a quarter of it.
+ */
+static int listener_buf_fit(listener_config *me,
+                            const struct listener_buf_opts *o,
+                            struct listener_buf *b, int len, int keep) {
+  int size = 0;
+  uint8_t *data = NULL;
+
+  if (len > b->capacity) {
+    size = listener_buf_size(len);
+    atomic_fetch_add(&me->grows, 1);
+  } else if (b->capacity > o->cache_size && b->capacity > o->prealloc &&
+             listener_buf_size(len) <= b->capacity / 4) {
+    if (++b->small_calls < LISTENER_SHRINK_CALLS) {
+      return AEE_SUCCESS;
+    }
+    size = STD_MAX(listener_buf_size(2 * len), o->prealloc);
+    atomic_fetch_add(&me->shrinks, 1);
+  } else {
+    b->small_calls = 0;
+    return AEE_SUCCESS;
+  }
+  b->small_calls = 0;
+  if (NULL == (data = rpcmem_alloc_internal(o->heapid, o->flags, size))) {
+    FARF(ERROR, "Error: %s: rpcmem_alloc of %d bytes failed", __func__, size);
+    return AEE_ENORPCMEMORY;
+  }
+  keep = STD_MIN(keep, STD_MIN(b->capacity, size));
+  if (b->data && keep > 0) {
+    memmove(data, b->data, keep);
+    atomic_fetch_add(&me->bytes_copied, keep);
+  }
+  if (b->data) {
+    rpcmem_free_internal(b->data);
+  }
+  b->data = data;
+  b->capacity = size;
+  return AEE_SUCCESS;
+}
 
+static uint64_t listener_now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Adds the reverse invokes of src to dst */
+static void listener_merge_handle_stats(struct listener_handle_stats *dst,
+                                        const struct listener_handle_stats *src) {
+  dst->calls += src->calls;
+  dst->total_us += src->total_us;
+  dst->max_us = STD_MAX(dst->max_us, src->max_us);
+  for (int i = 0; i < LISTENER_LATENCY_BUCKETS; i++) {
+    dst->latency[i] += src->latency[i];
+  }
+}
+
+/* Accounts a reverse invoke of a handle in the stats of the calling thread */
+static void listener_account(listener_config *me,
+                             struct listener_thread_stats *ts,
+                             remote_handle handle, uint64_t us) {
+  listener_handle_entry *e = NULL;
+  int bucket = 0;
+
+  while (bucket < LISTENER_LATENCY_BUCKETS - 1 && us >= (1ULL << bucket)) {
+    bucket++;
+  }
+  atomic_fetch_add(&me->invokes, 1);
+  if (!ts) {
+    return;
+  }
+  pthread_mutex_lock(&ts->mut);
+  HASH_FIND(hh, ts->handles, &handle, sizeof(handle), e);
+  if (!e && NULL != (e = calloc(1, sizeof(*e)))) {
+    e->stats.handle = handle;
+    HASH_ADD(hh, ts->handles, stats.handle, sizeof(e->stats.handle), e);
+  }
+  if (e) {
+    e->stats.calls++;
+    e->stats.total_us += us;
+    e->stats.max_us = STD_MAX(e->stats.max_us, us);
+    e->stats.latency[bucket]++;
+  }
+  pthread_mutex_unlock(&ts->mut);
+}
+
+/* Drops the mapping references taken by listener_ref_bufs() */
+static void listener_unref_bufs(listener_config *me,
+                                struct listener_buf_ref *refs, int num_refs) {
+  for (int ii = 0; ii < num_refs; ii++) {
+    fastrpc_buffer_ref(me->domain, refs[ii].fd, -1, NULL, NULL);
+  }
+}
+
+/*
+ * Points the arguments of the buffer references of a reverse invoke at the
+ * process mappings of their buffers. A reference is held on each mapping
+ * until listener_unref_bufs().
+ */
+static int listener_ref_bufs(listener_config *me,
+                             struct listener_buf_ref *refs, int in_refs,
+                             remote_arg *in_args, int out_refs,
+                             remote_arg *out_args) {
+  int nErr = AEE_SUCCESS, ii = 0;
+  remote_arg *arg = NULL;
+  void *va = NULL;
+  size_t size = 0;
+
+  for (ii = 0; ii < in_refs + out_refs; ii++) {
+    arg = ii < in_refs ? &in_args[ii] : &out_args[ii - in_refs];
+    VERIFY(AEE_SUCCESS == (nErr = fastrpc_buffer_ref(me->domain, refs[ii].fd,
+                                                     1, &va, &size)));
+    if (!va || (uint64_t)refs[ii].offset + refs[ii].len > size) {
+      fastrpc_buffer_ref(me->domain, refs[ii].fd, -1, NULL, NULL);
+      nErr = AEE_EBADPARM;
+      goto bail;
+    }
+    arg->buf.pv = (uint8_t *)va + refs[ii].offset;
+    arg->buf.nLen = refs[ii].len;
+    atomic_fetch_add(&me->bytes_by_ref, refs[ii].len);
+  }
+bail:
+  if (nErr != AEE_SUCCESS) {
+    FARF(ERROR,
+         "Error 0x%x: %s: invalid reference fd %d offset 0x%x len 0x%x",
+         nErr, __func__, refs[ii].fd, refs[ii].offset, refs[ii].len);
+    listener_unref_bufs(me, refs, ii);
+  }
+  return nErr;
+}
+
+/*
+ * Serves reverse invokes of a domain. Each listener thread of the domain
+ * runs this loop with its own buffers and context.
+ */
 static void listener(listener_config *me) {
   int nErr = AEE_SUCCESS, i = 0, domain = me->domain, ref = 0;
+  remote_handle64 listener1_handle = me->adsp_listener1_handle;
+  bool serial = false;
   adsp_listener1_invoke_ctx ctx = 0;
-  uint8_t *outBufs = 0;
-  int outBufsLen = 0, outBufsCapacity = 0;
-  uint8_t *inBufs = 0;
-  int inBufsLen = 0, inBufsLenReq = 0;
+  struct listener_buf out = {0}, in = {0};
+  int outBufsLen = 0;
+  int inBufsLenReq = 0;
   int result = -1, bufs_len = 0;
   adsp_listener1_remote_handle handle = -1;
   uint32_t sc = 0;
+  struct listener_buf_ref refs[2 * 0xf];
+  int in_refs = 0, out_refs = 0, nin = 0, nout = 0;
   const char *eheap = getenv("ADSP_LISTENER_HEAP_ID");
-  int heapid = eheap == 0 ? -1 : atoi(eheap);
   const char *eflags = getenv("ADSP_LISTENER_HEAP_FLAGS");
-  uint32_t flags = eflags == 0 ? 0 : (uint32_t)atoi(eflags);
   const char *emin = getenv("ADSP_LISTENER_MEM_CACHE_SIZE");
-  int cache_size = emin == 0 ? 0 : atoi(emin);
+  const char *eprealloc = getenv(LISTENER_BUF_PREALLOC_ENV);
+  const char *epool = getenv(LISTENER_BUF_POOL_ENV);
+  struct listener_buf_opts opts = {
+      .heapid = eheap == 0 ? -1 : atoi(eheap),
+      .flags = eflags == 0 ? 0 : (uint32_t)atoi(eflags),
+      .cache_size = emin == 0 ? 0 : atoi(emin),
+      .prealloc = eprealloc == 0 ? 0 : atoi(eprealloc),
+  };
+  uint64_t start = 0;
   remote_arg args[512];
   struct sbuf buf;
   eventfd_t event = 0xff;
+  int stats_slot = atomic_fetch_add(&me->num_thread_stats, 1);
+  struct listener_thread_stats *ts =
+      stats_slot < LISTENER_THREADS_MAX ? &me->thread_stats[stats_slot] : NULL;
 
   FARF(ALWAYS, "%s thread starting\n", __func__);
   memset(args, 0, sizeof(args));
-  if (eheap || eflags || emin) {
+  if (eheap || eflags || emin || eprealloc) {
     FARF(RUNTIME_RPC_HIGH,
-         "listener using ion heap: %d flags: %x cache: %lld\n", (int)heapid,
-         (int)flags, cache_size);
+         "listener using ion heap: %d flags: %x cache: %d prealloc: %d\n",
+         opts.heapid, (int)opts.flags, opts.cache_size, opts.prealloc);
+  }
+  // Freed buffers are kept registered in the rpcmem pool for the next resize
+  if (!epool || atoi(epool)) {
+    opts.flags |= RPCMEM_POOLED;
+  }
+  if (opts.prealloc > 0) {
+    opts.prealloc = listener_buf_size(opts.prealloc);
+    if (listener_buf_fit(me, &opts, &in, opts.prealloc, 0) ||
+        listener_buf_fit(me, &opts, &out, opts.prealloc, 0)) {
+      opts.prealloc = 0;
+    }
+  } else {
+    opts.prealloc = 0;
   }
 
   do {
@@ -146,14 +491,14 @@ static void listener(listener_config *me) {
          "%s responding 0x%x for ctx 0x%x, handle 0x%x, sc 0x%x", __func__,
          result, ctx, handle, sc);
     FASTRPC_PUT_REF(domain);
-    if (me->adsp_listener1_handle != INVALID_HANDLE) {
+    if (listener1_handle != INVALID_HANDLE) {
       nErr = __QAIC_HEADER(adsp_listener1_next2)(
-          me->adsp_listener1_handle, ctx, result, outBufs, outBufsLen, &ctx,
-          &handle, &sc, inBufs, inBufsLen, &inBufsLenReq);
+          listener1_handle, ctx, result, out.data, outBufsLen, &ctx,
+          &handle, &sc, in.data, in.capacity, &inBufsLenReq);
     } else {
       nErr = __QAIC_HEADER(adsp_listener_next2)(
-          ctx, result, outBufs, outBufsLen, &ctx, &handle, &sc, inBufs,
-          inBufsLen, &inBufsLenReq);
+          ctx, result, out.data, outBufsLen, &ctx, &handle, &sc, in.data,
+          in.capacity, &inBufsLenReq);
     }
     if (nErr) {
       if (nErr == AEE_EINTERRUPTED) {
@@ -169,14 +514,14 @@ static void listener(listener_config *me) {
           goto bail;
       }
       /* For any other error, retry once and exit if error seen again */
-      if (me->adsp_listener1_handle != INVALID_HANDLE) {
+      if (listener1_handle != INVALID_HANDLE) {
         nErr = __QAIC_HEADER(adsp_listener1_next2)(
-            me->adsp_listener1_handle, ctx, nErr, 0, 0, &ctx, &handle, &sc,
-            inBufs, inBufsLen, &inBufsLenReq);
+            listener1_handle, ctx, nErr, 0, 0, &ctx, &handle, &sc,
+            in.data, in.capacity, &inBufsLenReq);
       } else {
         nErr = __QAIC_HEADER(adsp_listener_next2)(ctx, nErr, 0, 0, &ctx,
-                                                  &handle, &sc, inBufs,
-                                                  inBufsLen, &inBufsLenReq);
+                                                  &handle, &sc, in.data,
+                                                  in.capacity, &inBufsLenReq);
       }
       if (nErr) {
         FARF(RUNTIME_HIGH,
@@ -195,66 +540,66 @@ static void listener(listener_config *me) {
       result = AEE_EBADSIZE;
       goto invoke;
     }
-    if (ALIGNB(bufs_len) < inBufsLen && inBufsLen > cache_size) {
-      void *buf;
-      int size = ALIGNB(bufs_len);
-      if (NULL ==
-          (buf = rpcmem_realloc(heapid, flags, inBufs, inBufsLen, size))) {
-        result = AEE_ENORPCMEMORY;
-        FARF(RUNTIME_RPC_HIGH, "rpcmem_realloc shrink failed");
-        goto invoke;
-      }
-      inBufs = buf;
-      inBufsLen = size;
-    }
-    if (inBufsLenReq > inBufsLen) {
-      void *buf;
+    if (inBufsLenReq > in.capacity) {
       int req;
-      int oldLen = inBufsLen;
-      int size = _SBUF_ALIGN(inBufsLenReq, MIN_BUF_SIZE);
-      if (AEE_SUCCESS ==
-          (buf = rpcmem_realloc(heapid, flags, inBufs, inBufsLen, size))) {
-        result = AEE_ENORPCMEMORY;
-        FARF(ERROR, "rpcmem_realloc failed");
+      int oldLen = in.capacity;
+
+      // Keep the part of the request already received
+      if (AEE_SUCCESS !=
+          (result = listener_buf_fit(me, &opts, &in, inBufsLenReq, oldLen))) {
         goto invoke;
       }
-      inBufs = buf;
-      inBufsLen = size;
-      if (me->adsp_listener1_handle != INVALID_HANDLE) {
+      if (listener1_handle != INVALID_HANDLE) {
         result = __QAIC_HEADER(adsp_listener1_get_in_bufs2)(
-            me->adsp_listener1_handle, ctx, oldLen, inBufs + oldLen,
-            inBufsLen - oldLen, &req);
+            listener1_handle, ctx, oldLen, in.data + oldLen,
+            in.capacity - oldLen, &req);
       } else {
         result = __QAIC_HEADER(adsp_listener_get_in_bufs2)(
-            ctx, oldLen, inBufs + oldLen, inBufsLen - oldLen, &req);
+            ctx, oldLen, in.data + oldLen, in.capacity - oldLen, &req);
       }
       if (AEE_SUCCESS != result) {
         FARF(RUNTIME_RPC_HIGH, "adsp_listener_invoke_get_in_bufs2 failed  %x",
              result);
         goto invoke;
       }
-      if (req > inBufsLen) {
+      if (req > in.capacity) {
         result = AEE_EBADPARM;
         FARF(RUNTIME_RPC_HIGH,
              "adsp_listener_invoke_get_in_bufs2 failed, size is invalid req %d "
              "inBufsLen %d result %d",
-             req, inBufsLen, result);
+             req, in.capacity, result);
         goto invoke;
       }
+    } else if (AEE_SUCCESS != (result = listener_buf_fit(me, &opts, &in,
+                                                         inBufsLenReq,
+                                                         inBufsLenReq))) {
+      goto invoke;
     }
-    if (REMOTE_SCALARS_INHANDLES(sc) + REMOTE_SCALARS_OUTHANDLES(sc) > 0) {
+    // Handles are buffers passed by reference, see struct listener_buf_ref
+    in_refs = REMOTE_SCALARS_INHANDLES(sc);
+    out_refs = REMOTE_SCALARS_OUTHANDLES(sc);
+    nin = REMOTE_SCALARS_INBUFS(sc) + in_refs;
+    nout = REMOTE_SCALARS_OUTBUFS(sc) + out_refs;
+    if ((in_refs + out_refs > 0 && !me->buf_refs) || nin > 0xff ||
+        nout > 0xff) {
       result = AEE_EBADPARM;
       goto invoke;
     }
 
-    sbuf_init(&buf, 0, inBufs, inBufsLen);
+    sbuf_init(&buf, 0, in.data, in.capacity);
     unpack_in_bufs(&buf, args, REMOTE_SCALARS_INBUFS(sc));
-    unpack_out_lens(&buf, args + REMOTE_SCALARS_INBUFS(sc),
-                    REMOTE_SCALARS_OUTBUFS(sc));
+    unpack_out_lens(&buf, args + nin, REMOTE_SCALARS_OUTBUFS(sc));
+    if (in_refs + out_refs) {
+      unpack_buf_refs(&buf, refs, in_refs + out_refs);
+      if (sbuf_left(&buf) < 0) {
+        result = AEE_EBADPARM;
+        goto invoke;
+      }
+    }
+    atomic_fetch_add(&me->bytes_in, inBufsLenReq);
 
     sbuf_init(&buf, 0, 0, 0);
-    pack_out_bufs(&buf, args + REMOTE_SCALARS_INBUFS(sc),
-                  REMOTE_SCALARS_OUTBUFS(sc));
+    pack_out_bufs(&buf, args + nin, REMOTE_SCALARS_OUTBUFS(sc));
     outBufsLen = sbuf_needed(&buf);
 
     if (__builtin_smul_overflow(outBufsLen, 2, &bufs_len)) {
@@ -265,42 +610,44 @@ static void listener(listener_config *me) {
       result = AEE_EBADSIZE;
       goto invoke;
     }
-    if (ALIGNB(bufs_len) < outBufsCapacity && outBufsCapacity > cache_size) {
-      void *buf;
-      int size = ALIGNB(bufs_len);
-      if (NULL == (buf = rpcmem_realloc(heapid, flags, outBufs, outBufsCapacity,
-                                        size))) {
-        result = AEE_ENORPCMEMORY;
-        FARF(RUNTIME_RPC_HIGH, "listener rpcmem_realloc shrink failed");
-        goto invoke;
-      }
-      outBufs = buf;
-      outBufsCapacity = size;
+    // The response is packed after the resize, nothing to keep
+    if (AEE_SUCCESS !=
+        (result = listener_buf_fit(me, &opts, &out, outBufsLen, 0))) {
+      goto invoke;
     }
-    if (outBufsLen > outBufsCapacity) {
-      void *buf;
-      int size = ALIGNB(outBufsLen);
-      if (NULL == (buf = rpcmem_realloc(heapid, flags, outBufs, outBufsCapacity,
-                                        size))) {
-        result = AEE_ENORPCMEMORY;
-        FARF(ERROR, "listener rpcmem_realloc failed");
-        goto invoke;
-      }
-      outBufs = buf;
-      outBufsLen = size;
-      outBufsCapacity = size;
+    sbuf_init(&buf, 0, out.data, outBufsLen);
+    pack_out_bufs(&buf, args + nin, REMOTE_SCALARS_OUTBUFS(sc));
+    if (AEE_SUCCESS !=
+        (result = listener_ref_bufs(me, refs, in_refs,
+                                    args + REMOTE_SCALARS_INBUFS(sc), out_refs,
+                                    args + nin + REMOTE_SCALARS_OUTBUFS(sc)))) {
+      goto invoke;
+    }
+    // Modules that are not thread safe run one call at a time
+    serial = listener_is_serial_handle(me, handle);
+    if (serial) {
+      pthread_mutex_lock(&me->serial_mut);
+    }
+    start = listener_now_us();
+    result = mod_table_invoke(
+        handle,
+        REMOTE_SCALARS_MAKEX(REMOTE_SCALARS_METHOD_ATTR(sc),
+                             REMOTE_SCALARS_METHOD(sc), nin, nout, 0, 0),
+        args);
+    if (serial) {
+      pthread_mutex_unlock(&me->serial_mut);
+    }
+    listener_unref_bufs(me, refs, in_refs + out_refs);
+    if (result == AEE_SUCCESS) {
+      atomic_fetch_add(&me->bytes_out, outBufsLen);
     }
-    sbuf_init(&buf, 0, outBufs, outBufsLen);
-    pack_out_bufs(&buf, args + REMOTE_SCALARS_INBUFS(sc),
-                  REMOTE_SCALARS_OUTBUFS(sc));
-    result = mod_table_invoke(handle, sc, args);
+    listener_account(me, ts, handle, listener_now_us() - start);
     if (result && is_process_exiting(domain))
       result = AEE_EBADSTATE; // override result as process is exiting
   } while (1);
 bail:
-  me->adsp_listener1_handle = INVALID_HANDLE;
-  RPC_FREEIF(outBufs);
-  RPC_FREEIF(inBufs);
+  RPC_FREEIF(out.data);
+  RPC_FREEIF(in.data);
   if (nErr != AEE_SUCCESS) {
     if(!is_process_exiting(domain)) {
       FARF(ERROR,
@@ -309,6 +656,12 @@ bail:
           nErr, __func__, result, ctx, handle, sc, strerror(errno));
     }
   }
+  // The last listener thread to exit reports it
+  if (atomic_fetch_sub(&me->live_threads, 1) > 1) {
+    dlerror();
+    return;
+  }
+  me->adsp_listener1_handle = INVALID_HANDLE;
   for (i = 0; i < RETRY_WRITE; i++) {
     if (AEE_SUCCESS == (nErr = eventfd_write(me->eventfd, event))) {
       break;
@@ -333,6 +686,47 @@ extern int fastrpc_set_remote_uthread_params(int domain);
 PL_DEP(mod_table);
 PL_DEP(apps_std);
 
+static void *listener_pool_thread(void *arg) {
+  listener_config *me = (listener_config *)arg;
+
+  set_thread_context(me->domain);
+  listener(me);
+  return NULL;
+}
+
+/*
+ * Starts the other listener threads of a domain, configured with
+ * ADSP_LISTENER_THREADS. All threads pull reverse invokes from the same
+ * listener, so a slow reverse call only holds up its own thread.
+ */
+static void listener_pool_start(listener_config *me) {
+  const char *env = getenv(LISTENER_THREADS_ENV);
+  int num_threads = env ? atoi(env) : 1, i = 0;
+
+  if (num_threads > LISTENER_THREADS_MAX) {
+    FARF(ERROR, "Warning: %s: %d listener threads requested, using %d",
+         __func__, num_threads, LISTENER_THREADS_MAX);
+    num_threads = LISTENER_THREADS_MAX;
+  }
+  atomic_store(&me->live_threads, 1);
+  me->num_pool = 0;
+  for (i = 1; i < num_threads; i++) {
+    atomic_fetch_add(&me->live_threads, 1);
+    if (pthread_create(&me->pool[me->num_pool], NULL, listener_pool_thread,
+                       me)) {
+      atomic_fetch_sub(&me->live_threads, 1);
+      FARF(ERROR, "Error: %s: failed to create listener thread %d (errno %s)",
+           __func__, i, strerror(errno));
+      break;
+    }
+    me->num_pool++;
+  }
+  if (me->num_pool) {
+    FARF(ALWAYS, "%s: %d listener threads for domain %d", __func__,
+         me->num_pool + 1, me->domain);
+  }
+}
+
 static void *listener_start_thread(void *arg) {
   int nErr = AEE_SUCCESS;
   listener_config *me = (listener_config *)arg;
@@ -366,7 +760,13 @@ static void *listener_start_thread(void *arg) {
     sem_post(me->r_sem);
     VERIFY(AEE_SUCCESS == (nErr = me->params_updated));
   }
+  listener_pool_start(me);
   listener(me);
+  // The pool threads read the listener handle until they exit
+  for (int i = 0; i < me->num_pool; i++) {
+    pthread_join(me->pool[i], 0);
+  }
+  me->num_pool = 0;
 bail:
   me->adsp_listener1_handle = INVALID_HANDLE;
   if (nErr != AEE_SUCCESS) {
@@ -414,11 +814,39 @@ void listener_android_domain_deinit(int domain) {
     return;
 
   FARF(RUNTIME_RPC_HIGH, "fastrpc listener joining to exit");
+  // Pool threads are started and joined by the first thread
   if (me->thread) {
     pthread_join(me->thread, 0);
     me->thread = 0;
   }
   FARF(RUNTIME_RPC_HIGH, "fastrpc listener joined");
+  if (me->locks_init) {
+    listener_serial_handle *sh = NULL, *tmp = NULL;
+    listener_handle_entry *e = NULL, *etmp = NULL;
+
+    pthread_mutex_lock(&me->handles_mut);
+    HASH_ITER(hh, me->serial_handles, sh, tmp) {
+      HASH_DEL(me->serial_handles, sh);
+      free(sh);
+    }
+    atomic_store(&me->num_serial_handles, 0);
+    pthread_mutex_unlock(&me->handles_mut);
+    FARF(RUNTIME_RPC_HIGH,
+         "listener of domain %d served %" PRIu64 " reverse invokes, %" PRIu64
+         " buffer grows, %" PRIu64 " shrinks, %" PRIu64 " bytes copied",
+         domain, atomic_load(&me->invokes), atomic_load(&me->grows),
+         atomic_load(&me->shrinks), atomic_load(&me->bytes_copied));
+    for (int i = 0; i < LISTENER_THREADS_MAX; i++) {
+      struct listener_thread_stats *ts = &me->thread_stats[i];
+
+      pthread_mutex_lock(&ts->mut);
+      HASH_ITER(hh, ts->handles, e, etmp) {
+        HASH_DEL(ts->handles, e);
+        free(e);
+      }
+      pthread_mutex_unlock(&ts->mut);
+    }
+  }
   me->adsp_listener1_handle = INVALID_HANDLE;
   if (me->eventfd != -1) {
     close(me->eventfd);
@@ -437,6 +865,22 @@ int listener_android_domain_init(int domain, int update_requested,
   if (!me) {
     ALLOC_AND_ADD_NEW_NODE_TO_TABLE(listener_config, domain, me);
   }
+  if (!me->locks_init) {
+    pthread_mutex_init(&me->serial_mut, 0);
+    pthread_mutex_init(&me->handles_mut, 0);
+    for (int i = 0; i < LISTENER_THREADS_MAX; i++) {
+      pthread_mutex_init(&me->thread_stats[i].mut, 0);
+    }
+    me->locks_init = true;
+  }
+  atomic_store(&me->num_thread_stats, 0);
+  atomic_store(&me->invokes, 0);
+  atomic_store(&me->grows, 0);
+  atomic_store(&me->shrinks, 0);
+  atomic_store(&me->bytes_copied, 0);
+  atomic_store(&me->bytes_in, 0);
+  atomic_store(&me->bytes_out, 0);
+  atomic_store(&me->bytes_by_ref, 0);
   me->eventfd = -1;
   VERIFYC(-1 != (me->eventfd = eventfd(0, 0)), AEE_EBADPARM);
   FARF(RUNTIME_RPC_HIGH, "Opened Listener event_fd %d for domain %d\n",
@@ -445,6 +889,7 @@ int listener_android_domain_init(int domain, int update_requested,
   me->r_sem = r_sem;
   me->adsp_listener1_handle = INVALID_HANDLE;
   me->domain = domain;
+  me->buf_refs = get_dsp_reverse_rpc_buf_ref_capability(domain) == 1;
   VERIFY(AEE_SUCCESS ==
          (nErr = pthread_create(&me->thread, 0, listener_start_thread,
                                 (void *)me)));
@@ -473,6 +918,60 @@ int close_reverse_handle(remote_handle64 h, char *dlerr, int dlerrorLen,
   return apps_remotectl_close((uint32_t)h, dlerr, dlerrorLen, dlErr);
 }
 
+int listener_android_get_stats(int domain, struct listener_stats *stats,
+                               struct listener_handle_stats *handles,
+                               int *num_handles) {
+  listener_config *me = NULL;
+  listener_handle_entry *merged = NULL, *m = NULL, *e = NULL, *tmp = NULL;
+  int nErr = AEE_SUCCESS, count = 0;
+
+  GET_HASH_NODE(listener_config, domain, me);
+  VERIFYC(me && me->locks_init, AEE_ERESOURCENOTFOUND);
+  VERIFYC(stats && (!handles || num_handles), AEE_EBADPARM);
+  stats->invokes = atomic_load(&me->invokes);
+  stats->grows = atomic_load(&me->grows);
+  stats->shrinks = atomic_load(&me->shrinks);
+  stats->bytes_copied = atomic_load(&me->bytes_copied);
+  stats->bytes_in = atomic_load(&me->bytes_in);
+  stats->bytes_out = atomic_load(&me->bytes_out);
+  stats->bytes_by_ref = atomic_load(&me->bytes_by_ref);
+  if (num_handles) {
+    // Merge the stats of the handles across the listener threads
+    for (int i = 0; i < LISTENER_THREADS_MAX; i++) {
+      struct listener_thread_stats *ts = &me->thread_stats[i];
+
+      pthread_mutex_lock(&ts->mut);
+      HASH_ITER(hh, ts->handles, e, tmp) {
+        HASH_FIND(hh, merged, &e->stats.handle, sizeof(e->stats.handle), m);
+        if (!m) {
+          if (NULL == (m = calloc(1, sizeof(*m)))) {
+            pthread_mutex_unlock(&ts->mut);
+            nErr = AEE_ENOMEMORY;
+            goto bail;
+          }
+          m->stats.handle = e->stats.handle;
+          HASH_ADD(hh, merged, stats.handle, sizeof(m->stats.handle), m);
+        }
+        listener_merge_handle_stats(&m->stats, &e->stats);
+      }
+      pthread_mutex_unlock(&ts->mut);
+    }
+    HASH_ITER(hh, merged, m, tmp) {
+      if (handles && count < *num_handles) {
+        handles[count] = m->stats;
+      }
+      count++;
+    }
+    *num_handles = count;
+  }
+bail:
+  HASH_ITER(hh, merged, m, tmp) {
+    HASH_DEL(merged, m);
+    free(m);
+  }
+  return nErr;
+}
+
 int listener_android_geteventfd(int domain, int *fd) {
   listener_config *me = NULL;
   int nErr = 0;
@@ -24,6 +24,8 @@
 #include "verify.h"
 #include <assert.h>
 #include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
 
 /*
  * Handle size needed is about ~250 bytes
@@ -32,7 +34,8 @@
  */
 #define MAX_REV_HANDLES 20
 #define REV_HANDLE_SIZE 256
-static uint8_t rev_handle_table[MAX_REV_HANDLES][REV_HANDLE_SIZE];
+static uint8_t rev_handle_table[MAX_REV_HANDLES][REV_HANDLE_SIZE]
+    __attribute__((aligned(REV_HANDLE_SIZE)));
 RW_MUTEX_T rev_handle_table_lock;
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 #ifdef WINNT
@@ -90,12 +93,20 @@ extern int errno;
  * you can also register a const handle, an invoke function for a known handle
  * value.  since handle keys are allocated, you should pick handle values that
  * are not going to be returned by malloc (0, or odd).
+ *
+ * the first MAX_CONST_SLOTS const handles are also kept in constSlots, where
+ * invokes find them without locking. const handles are only removed when the
+ * table is destroyed.
  */
+#define MAX_CONST_SLOTS 8
 struct static_mod_table {
   RW_MUTEX_T mut;
   struct static_mod *staticModOverrides;
   struct static_mod *staticMods;
   struct const_mod *constMods;
+  struct const_mod *_Atomic constSlots[MAX_CONST_SLOTS];
+  atomic_int numConstSlots;
+  atomic_bool constOverflow; // some const handles are only in constMods
   bool bInit;
 };
 
@@ -132,7 +143,17 @@ struct parsed_uri {
   int verlen;
 };
 
+/*
+ * Open module in a slot of rev_handle_table. Invokes look the slot up from
+ * the handle and take a reference without locking: pub_key is the handle
+ * once the module is fully open, and refs can only be raised while it is
+ * not 0. The last reference closes the module and frees the slot.
+ * Each open of the module holds one reference, opens counts those not
+ * closed yet so that a close drops only the reference of an open.
+ */
 struct open_mod {
+  _Atomic uint32_t pub_key;
+  atomic_int refs;
   void *dlhandle;
   invoke_fn invoke;
   handle_invoke_fn handle_invoke;
@@ -140,7 +161,7 @@ struct open_mod {
   UT_hash_handle hh;
   remote_handle64 h64;
   struct parsed_uri vals;
-  int refs;
+  atomic_int opens; // In the padding before uri, not to shrink it
   char uri[1];
 };
 
@@ -175,6 +196,11 @@ static void static_mod_table_dtor_imp(struct static_mod_table *me) {
         free(sm);
         sm = NULL;
       }
+      for (int ii = 0; ii < MAX_CONST_SLOTS; ii++) {
+        atomic_store(&me->constSlots[ii], NULL);
+      }
+      atomic_store(&me->numConstSlots, 0);
+      atomic_store(&me->constOverflow, false);
       HASH_ITER(hh, me->constMods, dm, ftmp) {
         if (me->constMods) {
           HASH_DEL(me->constMods, dm);
@@ -202,6 +228,32 @@ static int open_mod_table_ctor_imp(void *ctx, void *data) {
 
 static int open_mod_handle_close(struct open_mod *mod, remote_handle64 h);
 
+// Clears a slot, pub_key, refs and opens are already 0 for a free slot
+static void open_mod_reset(struct open_mod *dm) {
+  memset(&dm->dlhandle, 0,
+         REV_HANDLE_SIZE - offsetof(struct open_mod, dlhandle));
+}
+
+/*
+ * Makes a fully opened module visible to invokes, with the reference of the
+ * open. No other reference can be taken before, as refs is 0 in a free slot.
+ */
+static void open_mod_publish(struct open_mod *dm) {
+  atomic_store_explicit(&dm->refs, 1, memory_order_relaxed);
+  atomic_store_explicit(&dm->opens, 1, memory_order_relaxed);
+  atomic_store_explicit(&dm->pub_key, (uint32_t)dm->key, memory_order_release);
+}
+
+/*
+ * Frees the slot of a module for the next open. Opens look for a free slot
+ * with rev_handle_table_lock held.
+ */
+static void open_mod_free_slot(struct open_mod *dm) {
+  RW_MUTEX_LOCK_WRITE(rev_handle_table_lock);
+  dm->key = 0;
+  RW_MUTEX_UNLOCK_WRITE(rev_handle_table_lock);
+}
+
 static void open_mod_table_dtor_imp(void *data) {
   struct open_mod_table *me = (struct open_mod_table *)data;
   struct open_mod *dm, *ftmp;
@@ -211,6 +263,9 @@ static void open_mod_table_dtor_imp(void *data) {
       if (me->openMods) {
         HASH_DEL(me->openMods, dm);
       }
+      atomic_store(&dm->pub_key, 0);
+      atomic_store(&dm->refs, 0);
+      atomic_store(&dm->opens, 0);
       if (dm->h64) {
         (void)open_mod_handle_close(dm, dm->h64);
       }
@@ -313,7 +368,17 @@ static int static_mod_table_register_const_handle(
   RW_MUTEX_LOCK_WRITE(me->mut);
   HASH_FIND_INT(me->constMods, &local, dmOld);
   if (dmOld == 0) {
+    int slot = atomic_load(&me->numConstSlots);
+
     HASH_ADD_INT(me->constMods, key, dm);
+    // Published once complete, readers only see filled slots
+    if (slot < MAX_CONST_SLOTS) {
+      atomic_store_explicit(&me->constSlots[slot], dm, memory_order_release);
+      atomic_store_explicit(&me->numConstSlots, slot + 1,
+                            memory_order_release);
+    } else {
+      atomic_store(&me->constOverflow, true);
+    }
   }
   RW_MUTEX_UNLOCK_WRITE(me->mut);
   nErr = dmOld != 0 ? -1 : nErr;
@@ -459,30 +524,51 @@ static inline int next_available_rev_handle(uint32_t *handle_idx) {
   return nErr;
 }
 
+/*
+ * Takes a reference on an open module, fails if its last reference is gone
+ * and it is being closed.
+ */
+static bool open_mod_tryget(struct open_mod *dm) {
+  int refs = atomic_load_explicit(&dm->refs, memory_order_relaxed);
+
+  do {
+    if (refs <= 0) {
+      return false;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(
+      &dm->refs, &refs, refs + 1, memory_order_acquire, memory_order_relaxed));
+  return true;
+}
+
+/*
+ * Must be called with rev_handle_table_lock held, which serializes opens.
+ * Modules being closed are skipped.
+ */
 uint32_t is_reverse_handle_opened(struct open_mod_table *me,
                                 remote_handle *handle, const char *uri) {
   int ii = 0;
   uint32_t keyfound = 0;
   struct open_mod *dmOld;
-  RW_MUTEX_LOCK_WRITE(me->mut);
+
+  (void)me;
   for (ii = 0; ii < MAX_REV_HANDLES; ++ii) {
     dmOld = (struct open_mod *)&(rev_handle_table[ii][0]);
-    if (dmOld->key != 0) {
-      if (!strncmp(dmOld->uri, uri, MAX(strlen(dmOld->uri), strlen(uri)))) {
-        keyfound = 1;
-        break;
-      }
+    if (atomic_load(&dmOld->pub_key) != 0 &&
+        !strncmp(dmOld->uri, uri, MAX(strlen(dmOld->uri), strlen(uri))) &&
+        open_mod_tryget(dmOld)) {
+      // The reference taken is the one of this open
+      atomic_fetch_add(&dmOld->opens, 1);
+      keyfound = 1;
+      break;
     }
   }
   if (keyfound) {
     *handle = dmOld->key;
-    dmOld->refs++;
     FARF(
         ALWAYS,
         "%s: reverse module %s already found with handle 0x%x (idx %u) refs %d",
-        __func__, uri, *handle, ii, dmOld->refs);
+        __func__, uri, *handle, ii, atomic_load(&dmOld->refs));
   }
-  RW_MUTEX_UNLOCK_WRITE(me->mut);
   return keyfound;
 }
 
@@ -514,7 +600,7 @@ static int open_mod_table_open_dynamic(struct open_mod_table *me,
   VERIFYC(0 == (nErr = next_available_rev_handle(&handle_idx)), AEE_EINVHANDLE);
   VERIFYC(handle_idx < MAX_REV_HANDLES, AEE_EINVHANDLE);
   dm = (struct open_mod *)&(rev_handle_table[handle_idx][0]);
-  memset(dm, 0, REV_HANDLE_SIZE);
+  open_mod_reset(dm);
   memmove(dm->uri, uri, len + 1);
   FARF(RUNTIME_RPC_HIGH, "calling parse_uri");
   (void)parse_uri(dm->uri, len, &dm->vals);
@@ -580,7 +666,6 @@ static int open_mod_table_open_dynamic(struct open_mod_table *me,
           AEE_ENOSUCHSYMBOL);
 
   dm->key = (uint32_t)(uintptr_t)dm;
-  dm->refs = 1;
   if (dm->handle_invoke) {
     VERIFY(AEE_SUCCESS == (nErr = open_mod_handle_open(dm, uri, &dm->h64)));
   }
@@ -602,6 +687,7 @@ static int open_mod_table_open_dynamic(struct open_mod_table *me,
     nErr = dmOld != 0 ? -1 : nErr;
     if (nErr == 0) {
       *handle = dm->key;
+      open_mod_publish(dm);
     }
   }
   RW_MUTEX_UNLOCK_WRITE(me->mut);
@@ -633,7 +719,7 @@ bail:
       DLCLOSE(dm->dlhandle);
     }
     if (dm) {
-      dm->key = 0;
+      open_mod_free_slot(dm);
       dm = NULL;
     }
     VERIFY_EPRINTF("Error 0x%x: %s failed for %s, dlerr 0x%x", nErr, __func__,
@@ -674,7 +760,7 @@ static int open_mod_table_open_from_static(struct open_mod_table *me,
   VERIFYC(0 == (nErr = next_available_rev_handle(&handle_idx)), AEE_EINVHANDLE);
   VERIFYC(handle_idx < MAX_REV_HANDLES, AEE_EINVHANDLE);
   dm = (struct open_mod *)&(rev_handle_table[handle_idx][0]);
-  memset(dm, 0, REV_HANDLE_SIZE);
+  open_mod_reset(dm);
   RW_MUTEX_LOCK_READ(me->mut);
   HASH_FIND_STR(*tbl, uri, sm);
   RW_MUTEX_UNLOCK_READ(me->mut);
@@ -709,7 +795,6 @@ static int open_mod_table_open_from_static(struct open_mod_table *me,
   dm->handle_invoke = sm->handle_invoke;
   dm->invoke = sm->invoke;
   dm->key = (uint32_t)(uintptr_t)dm;
-  dm->refs = 1;
   if (dm->handle_invoke) {
     VERIFY(AEE_SUCCESS == (nErr = open_mod_handle_open(dm, uri, &dm->h64)));
   }
@@ -718,6 +803,7 @@ static int open_mod_table_open_from_static(struct open_mod_table *me,
   if (!keyfound) {
     HASH_ADD_INT(me->openMods, key, dm);
     *handle = dm->key;
+    open_mod_publish(dm);
   }
   RW_MUTEX_UNLOCK_WRITE(me->mut);
 bail:
@@ -735,7 +821,7 @@ bail:
     if (dm->h64) {
       (void)open_mod_handle_close(dm, dm->h64);
     }
-    dm->key = 0;
+    open_mod_free_slot(dm);
     dm = NULL;
   }
   return nErr;
@@ -769,73 +855,99 @@ bail:
   return nErr;
 }
 
-static void open_mod_close(struct open_mod_table *me, struct open_mod *dm) {
-  RW_MUTEX_LOCK_WRITE(me->mut);
-  FARF(RUNTIME_RPC_HIGH, "%s: uri:%s, refs:%d", __func__, dm->uri, dm->refs);
-  dm->refs--;
-  if (dm->refs == 0) {
-    HASH_DEL(me->openMods, dm);
-  } else {
+/*
+ * Drops a reference on an open module, the last one closes it and frees its
+ * slot. Returns the error of dlclose.
+ */
+static int open_mod_close(struct open_mod_table *me, struct open_mod *dm) {
+  int dlErr = 0, refs = atomic_fetch_sub_explicit(&dm->refs, 1,
+                                                  memory_order_acq_rel);
+
+  if (refs != 1) {
     FARF(RUNTIME_RPC_HIGH, "%s : module %s has pending invokes ref count %d",
-         __func__, dm->uri, dm->refs);
-    dm = 0;
+         __func__, dm->uri, refs - 1);
+    return 0;
   }
+  atomic_store(&dm->pub_key, 0);
+  RW_MUTEX_LOCK_WRITE(me->mut);
+  HASH_DEL(me->openMods, dm);
   RW_MUTEX_UNLOCK_WRITE(me->mut);
-  if (dm) {
-    if (dm->h64) {
-      (void)open_mod_handle_close(dm, dm->h64);
-    }
-    if (dm->dlhandle) {
-      DLCLOSE(dm->dlhandle);
-    }
-    FARF(ALWAYS, "%s: closed reverse module %s with handle 0x%x", __func__,
-         dm->uri, (uint32_t)dm->key);
-    dm->key = 0;
-    dm = NULL;
+  if (dm->h64) {
+    (void)open_mod_handle_close(dm, dm->h64);
+  }
+  if (dm->dlhandle) {
+    dlErr = DLCLOSE(dm->dlhandle);
+  }
+  FARF(ALWAYS, "%s: closed reverse module %s with handle 0x%x", __func__,
+       dm->uri, (uint32_t)dm->key);
+  open_mod_free_slot(dm);
+  return dlErr;
+}
+
+/*
+ * Finds an open module by handle and takes a reference on it, without
+ * locking. The handle is the address of the slot of the module, plus the
+ * bumps needed to make it unique.
+ */
+static struct open_mod *open_mod_table_get_open(struct open_mod_table *me,
+                                                remote_handle handle) {
+  uint32_t idx =
+      (handle - (uint32_t)(uintptr_t)rev_handle_table) / REV_HANDLE_SIZE;
+  struct open_mod *om = 0;
+
+  (void)me;
+  if (handle == 0 || idx >= MAX_REV_HANDLES) {
+    return 0;
   }
+  om = (struct open_mod *)&(rev_handle_table[idx][0]);
+  if (atomic_load_explicit(&om->pub_key, memory_order_acquire) != handle ||
+      !open_mod_tryget(om)) {
+    return 0;
+  }
+  // The slot may have been closed and reopened before the reference was taken
+  if (atomic_load_explicit(&om->pub_key, memory_order_acquire) != handle) {
+    (void)open_mod_close(me, om);
+    return 0;
+  }
+  return om;
 }
+
+/*
+ * Ends one open of a module, fails if all its opens are closed already so
+ * that a repeated close cannot drop the reference of another open.
+ */
+static bool open_mod_put_open(struct open_mod *dm) {
+  int opens = atomic_load_explicit(&dm->opens, memory_order_relaxed);
+
+  do {
+    if (opens <= 0) {
+      return false;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(
+      &dm->opens, &opens, opens - 1, memory_order_relaxed,
+      memory_order_relaxed));
+  return true;
+}
+
 static int open_mod_table_close(struct open_mod_table *me,
                                 remote_handle64 handle, char *errStr,
                                 int errStrLen, int *pdlErr) {
   int nErr = AEE_SUCCESS;
-  struct open_mod *dm, *del = 0;
-  int dlErr = 0, locked = 0;
+  struct open_mod *dm;
+  int dlErr = 0;
   // First ensure that the handle is valid
-  RW_MUTEX_LOCK_WRITE(me->mut);
-  HASH_FIND_INT(me->openMods, &handle, dm);
-  locked = 1;
-  VERIFYC(dm, AEE_ENOSUCHMOD);
-  if (dm) {
-    dm->refs--;
-    if (dm->refs == 0) {
-      del = dm;
-      FARF(RUNTIME_RPC_HIGH, "deleting %s %p %d", del->uri, del, dm->refs);
-      HASH_DEL(me->openMods, dm);
-      del->key = 0;
-    } else {
-      FARF(RUNTIME_RPC_HIGH, "%s: pending ref: dm->refs %d, for uri: %s",
-           __func__, dm->refs, dm->uri);
-      dm = 0;
-    }
-  }
-  RW_MUTEX_UNLOCK_WRITE(me->mut);
-  locked = 0;
-  if (del) {
-    if (del->h64) {
-      (void)open_mod_handle_close(dm, dm->h64);
-    }
-    if (del->dlhandle) {
-      dlErr = DLCLOSE(del->dlhandle);
-    }
-    FARF(ALWAYS, "%s: closed reverse module %s with handle 0x%x", __func__,
-         del->uri, (uint32_t)handle);
-    del = NULL;
+  VERIFYC(0 != (dm = open_mod_table_get_open(me, (remote_handle)handle)),
+          AEE_ENOSUCHMOD);
+  if (!open_mod_put_open(dm)) {
+    // Every open was closed already, only drop the reference just taken
+    (void)open_mod_close(me, dm);
+    nErr = AEE_ENOSUCHMOD;
+    goto bail;
   }
+  // Drop the reference of the open, ours closes the module if it was the last
+  atomic_fetch_sub(&dm->refs, 1);
+  dlErr = open_mod_close(me, dm);
 bail:
-  if (locked) {
-    locked = 0;
-    RW_MUTEX_UNLOCK_WRITE(me->mut);
-  }
   if (dlErr) {
     const char *error = DLERROR();
     nErr = dlErr;
@@ -851,25 +963,24 @@ bail:
   return nErr;
 }
 
-static struct open_mod *open_mod_table_get_open(struct open_mod_table *me,
-                                                remote_handle handle) {
-  struct open_mod *om = 0;
-  RW_MUTEX_LOCK_WRITE(me->mut);
-  HASH_FIND_INT(me->openMods, &handle, om);
-  if (0 != om) {
-    om->refs++;
-    FARF(RUNTIME_RPC_HIGH, "%s: module %s, increament refs %d", __func__,
-         om->uri, om->refs);
-  }
-  RW_MUTEX_UNLOCK_WRITE(me->mut);
-  return om;
-}
 static struct const_mod *open_mod_table_get_const(struct open_mod_table *me,
                                                   remote_handle handle) {
+  struct static_mod_table *smt = me->smt;
   struct const_mod *cm = 0;
-  RW_MUTEX_LOCK_READ(me->smt->mut);
-  HASH_FIND_INT(me->smt->constMods, &handle, cm);
-  RW_MUTEX_UNLOCK_READ(me->smt->mut);
+  int ii, num = atomic_load_explicit(&smt->numConstSlots, memory_order_acquire);
+
+  for (ii = 0; ii < num; ii++) {
+    cm = atomic_load_explicit(&smt->constSlots[ii], memory_order_acquire);
+    if (cm && cm->key == handle) {
+      return cm;
+    }
+  }
+  cm = 0;
+  if (atomic_load(&smt->constOverflow)) {
+    RW_MUTEX_LOCK_READ(smt->mut);
+    HASH_FIND_INT(smt->constMods, &handle, cm);
+    RW_MUTEX_UNLOCK_READ(smt->mut);
+  }
   return cm;
 }
 
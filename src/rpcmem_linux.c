@@ -48,7 +48,9 @@
 #include "apps_std.h"
 #include "fastrpc_common.h"
 #include "fastrpc_ioctl.h"
+#include "fastrpc_mock.h"
 #include "rpcmem.h"
+#include "uthash.h"
 #include "verify.h"
 #include "fastrpc_mem.h"
 
@@ -69,47 +71,107 @@ struct dma_heap_allocation_data {
 #define DMA_HEAP_IOCTL_ALLOC                                                   \
   _IOWR(DMA_HEAP_IOC_MAGIC, 0x0, struct dma_heap_allocation_data)
 #define DMA_HEAP_NAME "/dev/dma_heap/system"
+/* Pooled size classes are powers of two pages, up to 2^RPCMEM_POOL_MAX_ORDER */
+#define RPCMEM_POOL_MAX_ORDER 14
+#define RPCMEM_POOL_CLASSES (RPCMEM_POOL_MAX_ORDER + 1)
+/* Default number of bytes the pool may hold */
+#define RPCMEM_POOL_DEFAULT_LIMIT (64 * 1024 * 1024)
+
 static int dmafd = -1;
 static int rpcfd = -1;
-static QList rpclst;
 static pthread_mutex_t rpcmt;
 struct rpc_info {
-  QNode qn;
+  QNode qn;            // Node in the pool free list of pooled buffers
+  UT_hash_handle hh;   // Node in rpctbl while allocated
   void *buf;
   void *aligned_buf;
   int size;
   int fd;
   int dma;
+  int heapid;
+  int pool_class; // Size class of pooled buffers, -1 if not pooled
+};
+
+/* Free buffers of a heap, one list per size class */
+struct rpcmem_pool {
+  QNode qn;
+  int heapid;
+  QList freelst[RPCMEM_POOL_CLASSES];
+  struct rpcmem_pool_stats stats;
 };
 
+/* Allocated buffers keyed by their address, protected by rpcmt */
+static struct rpc_info *rpctbl = NULL;
+
+/* List of per-heap pools, protected by rpcmt */
+static QList poollst;
+static size_t pool_limit = RPCMEM_POOL_DEFAULT_LIMIT;
+static uint64_t pool_bytes = 0;
+static int pool_all = 0; // Pool all allocations, set by FASTRPC_RPCMEM_POOL
+
 struct fastrpc_alloc_dma_buf {
   int fd;         /* fd */
   uint32_t flags; /* flags to map with */
   uint64_t size;  /* size */
 };
 
+/* Opens the fastrpc device node that allocates buffers without a DMA heap */
+static void rpcmem_open_rpcfd_locked(void) {
+  /*
+   * Application should link proper library as DEFAULT_DOMAIN_ID
+   * is used to open rpc device node and not the uri passed by
+   * user.
+   */
+  rpcfd = open_device_node(DEFAULT_DOMAIN_ID);
+  if (rpcfd < 0)
+    FARF(ALWAYS, "Warning %d: Unable to open fastrpc dev node for domain: %d\n", errno, DEFAULT_DOMAIN_ID);
+}
+
 void rpcmem_init() {
-  QList_Ctor(&rpclst);
+  const char *env = NULL;
+
+  rpctbl = NULL;
+  QList_Ctor(&poollst);
   pthread_mutex_init(&rpcmt, 0);
   pthread_mutex_lock(&rpcmt);
 
+  if ((env = getenv("FASTRPC_RPCMEM_POOL")))
+    pool_all = atoi(env);
+  if ((env = getenv("FASTRPC_RPCMEM_POOL_LIMIT")))
+    pool_limit = (size_t)strtoull(env, NULL, 0);
+
   dmafd = open(DMA_HEAP_NAME, O_RDONLY | O_CLOEXEC);
   if (dmafd < 0) {
     FARF(ALWAYS, "Warning %d: Unable to open %s, falling back to fastrpc ioctl\n", errno, DMA_HEAP_NAME);
     /*
-     * Application should link proper library as DEFAULT_DOMAIN_ID
-     * is used to open rpc device node and not the uri passed by
-     * user.
+     * Buffers of the mock driver are allocated with memfd, the device is
+     * opened by the first allocation made after it is deselected
      */
-    rpcfd = open_device_node(DEFAULT_DOMAIN_ID);
-    if (rpcfd < 0)
-      FARF(ALWAYS, "Warning %d: Unable to open fastrpc dev node for domain: %d\n", errno, DEFAULT_DOMAIN_ID);
+    if (!fastrpc_mock_enabled())
+      rpcmem_open_rpcfd_locked();
   }
   pthread_mutex_unlock(&rpcmt);
 }
 
+static void rpcmem_release(struct rpc_info *rinfo, int unregister);
+static void rpcmem_pool_trim_locked(size_t bytes, QList *released);
+
 void rpcmem_deinit() {
+  QList released;
+  QNode *pn;
+
+  QList_Ctor(&released);
   pthread_mutex_lock(&rpcmt);
+  rpcmem_pool_trim_locked(0, &released);
+  while ((pn = QList_Pop(&poollst)))
+    free(STD_RECOVER_REC(struct rpcmem_pool, qn, pn));
+  /*
+   * FastRPC buffer registrations are already gone at this point, only
+   * the mappings and fds are released.
+   */
+  while ((pn = QList_Pop(&released)))
+    rpcmem_release(STD_RECOVER_REC(struct rpc_info, qn, pn), 0);
+  HASH_CLEAR(hh, rpctbl);
   if (dmafd != -1)
     close(dmafd);
   if (rpcfd != -1)
@@ -125,36 +187,135 @@ int rpcmem_set_dmabuf_name(const char *name, int fd, int heapid,
 }
 
 int rpcmem_to_fd_internal(void *po) {
-  struct rpc_info *rinfo, *rfree = 0;
-  QNode *pn, *pnn;
+  struct rpc_info *rinfo = 0;
+  int fd = -1;
 
   pthread_mutex_lock(&rpcmt);
-  QLIST_NEXTSAFE_FOR_ALL(&rpclst, pn, pnn) {
-    rinfo = STD_RECOVER_REC(struct rpc_info, qn, pn);
-    if (rinfo->aligned_buf == po) {
-      rfree = rinfo;
-      break;
+  HASH_FIND_PTR(rpctbl, &po, rinfo);
+  if (rinfo)
+    fd = rinfo->fd;
+  pthread_mutex_unlock(&rpcmt);
+
+  return fd;
+}
+
+int rpcmem_to_fd(void *po) { return rpcmem_to_fd_internal(po); }
+
+/* Returns the pool size class of an allocation, or -1 if it is too large */
+static int rpcmem_pool_class(size_t size) {
+  size_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+  int order = 0;
+
+  while (((size_t)1 << order) < pages)
+    order++;
+  return order < RPCMEM_POOL_CLASSES ? order : -1;
+}
+
+static struct rpcmem_pool *rpcmem_pool_get_locked(int heapid, int create) {
+  struct rpcmem_pool *pool = NULL;
+  QNode *pn;
+  int ii;
+
+  QLIST_FOR_ALL(&poollst, pn) {
+    pool = STD_RECOVER_REC(struct rpcmem_pool, qn, pn);
+    if (pool->heapid == heapid)
+      return pool;
+  }
+  if (!create || !(pool = calloc(1, sizeof(*pool))))
+    return NULL;
+  pool->heapid = heapid;
+  for (ii = 0; ii < RPCMEM_POOL_CLASSES; ii++)
+    QList_Ctor(&pool->freelst[ii]);
+  QList_AppendNode(&poollst, &pool->qn);
+  return pool;
+}
+
+/*
+ * Moves pooled buffers to the released list, largest classes first, until
+ * the pool holds at most the given number of bytes.
+ */
+static void rpcmem_pool_trim_locked(size_t bytes, QList *released) {
+  struct rpcmem_pool *pool;
+  QNode *pn, *pnode;
+  int ii;
+
+  for (ii = RPCMEM_POOL_CLASSES - 1; ii >= 0 && pool_bytes > bytes; ii--) {
+    QLIST_FOR_ALL(&poollst, pnode) {
+      pool = STD_RECOVER_REC(struct rpcmem_pool, qn, pnode);
+      while (pool_bytes > bytes && (pn = QList_Pop(&pool->freelst[ii]))) {
+        struct rpc_info *rinfo = STD_RECOVER_REC(struct rpc_info, qn, pn);
+        pool_bytes -= rinfo->size;
+        pool->stats.cached_bufs--;
+        pool->stats.cached_bytes -= rinfo->size;
+        pool->stats.releases++;
+        QList_AppendNode(released, &rinfo->qn);
+      }
     }
   }
+}
+
+/* Unregisters (if requested), unmaps and frees a buffer */
+static void rpcmem_release(struct rpc_info *rinfo, int unregister) {
+  if (unregister)
+    remote_register_buf(rinfo->buf, rinfo->size, -1);
+  munmap(rinfo->buf, rinfo->size);
+  close(rinfo->fd);
+  free(rinfo);
+}
+
+int rpcmem_pool_set_limit(size_t bytes) {
+  pthread_mutex_lock(&rpcmt);
+  pool_limit = bytes;
   pthread_mutex_unlock(&rpcmt);
+  rpcmem_pool_trim(bytes);
+  return 0;
+}
 
-  if (rfree)
-    return rfree->fd;
+void rpcmem_pool_trim(size_t bytes) {
+  QList released;
+  QNode *pn;
 
-  return -1;
+  QList_Ctor(&released);
+  pthread_mutex_lock(&rpcmt);
+  rpcmem_pool_trim_locked(bytes, &released);
+  pthread_mutex_unlock(&rpcmt);
+  while ((pn = QList_Pop(&released)))
+    rpcmem_release(STD_RECOVER_REC(struct rpc_info, qn, pn), 1);
 }
 
-int rpcmem_to_fd(void *po) { return rpcmem_to_fd_internal(po); }
+int rpcmem_pool_get_stats(int heapid, struct rpcmem_pool_stats *stats) {
+  struct rpcmem_pool *pool;
+  int nErr = AEE_SUCCESS;
+
+  if (!stats)
+    return AEE_EBADPARM;
+  pthread_mutex_lock(&rpcmt);
+  if ((pool = rpcmem_pool_get_locked(heapid, 0)))
+    *stats = pool->stats;
+  else
+    nErr = AEE_ENOSUCH;
+  pthread_mutex_unlock(&rpcmt);
+  return nErr;
+}
 
 void *rpcmem_alloc_internal(int heapid, uint32_t flags, size_t size) {
   struct rpc_info *rinfo;
-  int nErr = 0, fd = -1;
+  struct rpcmem_pool *pool = NULL;
+  int nErr = 0, fd = -1, pool_class = -1;
   struct dma_heap_allocation_data dmabuf = {
       .len = size,
       .fd_flags = O_RDWR | O_CLOEXEC,
   };
 
-  if ((dmafd == -1 && rpcfd == -1) || size <= 0) {
+#ifdef ENABLE_MOCK_DRIVER
+  if (dmafd == -1 && rpcfd == -1 && !fastrpc_mock_enabled()) {
+    pthread_mutex_lock(&rpcmt);
+    if (rpcfd == -1)
+      rpcmem_open_rpcfd_locked();
+    pthread_mutex_unlock(&rpcmt);
+  }
+#endif
+  if ((dmafd == -1 && rpcfd == -1 && !fastrpc_mock_enabled()) || size <= 0) {
     FARF(ERROR,
            "Error: Unable to allocate memory dmaheap fd %d, rpcfd %d, size "
            "%zu, flags %u",
@@ -162,8 +323,50 @@ void *rpcmem_alloc_internal(int heapid, uint32_t flags, size_t size) {
     return NULL;
   }
 
+  if ((flags & RPCMEM_POOLED) || pool_all)
+    pool_class = rpcmem_pool_class(size);
+  if (pool_class >= 0) {
+    QNode *pn = NULL;
+
+    pthread_mutex_lock(&rpcmt);
+    if ((pool = rpcmem_pool_get_locked(heapid, 1)) &&
+        (pn = QList_Pop(&pool->freelst[pool_class]))) {
+      rinfo = STD_RECOVER_REC(struct rpc_info, qn, pn);
+      pool_bytes -= rinfo->size;
+      pool->stats.hits++;
+      pool->stats.cached_bufs--;
+      pool->stats.cached_bytes -= rinfo->size;
+      HASH_ADD_PTR(rpctbl, aligned_buf, rinfo);
+      pthread_mutex_unlock(&rpcmt);
+      FARF(RUNTIME_RPC_HIGH, "Reused pooled buffer fd %d ptr %p size %d\n",
+           rinfo->fd, rinfo->aligned_buf, rinfo->size);
+      return rinfo->aligned_buf;
+    }
+    if (pool)
+      pool->stats.misses++;
+    pthread_mutex_unlock(&rpcmt);
+    /* Allocate the whole size class so the buffer can be reused */
+    size = ((size_t)PAGE_SIZE) << pool_class;
+    dmabuf.len = size;
+  }
+
   VERIFY(0 != (rinfo = calloc(1, sizeof(*rinfo))));
+  rinfo->heapid = heapid;
+  rinfo->pool_class = pool_class;
 
+#ifdef ENABLE_MOCK_DRIVER
+  if (fastrpc_mock_enabled()) {
+    fd = fastrpc_mock_alloc_buf(size);
+    if (fd < 0) {
+      nErr = AEE_ENOMEMORY;
+      FARF(ERROR,
+           "Error %d: Unable to allocate mock driver memory, heapid %d, size "
+           "%zu, flags %u",
+           errno, heapid, size, flags);
+      goto bail;
+    }
+  } else
+#endif
   if (dmafd != -1) {
     nErr = ioctl(dmafd, DMA_HEAP_IOCTL_ALLOC, &dmabuf);
     if (nErr) {
@@ -199,7 +402,7 @@ void *rpcmem_alloc_internal(int heapid, uint32_t flags, size_t size) {
   rinfo->aligned_buf = rinfo->buf;
   rinfo->size = size;
   pthread_mutex_lock(&rpcmt);
-  QList_AppendNode(&rpclst, &rinfo->qn);
+  HASH_ADD_PTR(rpctbl, aligned_buf, rinfo);
   pthread_mutex_unlock(&rpcmt);
   FARF(RUNTIME_RPC_HIGH, "Allocted memory from DMA heap fd %d ptr %p orig ptr %p\n",
        rinfo->fd, rinfo->aligned_buf, rinfo->buf);
@@ -218,25 +421,29 @@ bail:
 }
 
 void rpcmem_free_internal(void *po) {
-  struct rpc_info *rinfo, *rfree = 0;
-  QNode *pn, *pnn;
+  struct rpc_info *rfree = 0;
+  struct rpcmem_pool *pool = NULL;
 
   pthread_mutex_lock(&rpcmt);
-  QLIST_NEXTSAFE_FOR_ALL(&rpclst, pn, pnn) {
-    rinfo = STD_RECOVER_REC(struct rpc_info, qn, pn);
-    if (rinfo->aligned_buf == po) {
-      rfree = rinfo;
-      QNode_Dequeue(&rinfo->qn);
-      break;
+  HASH_FIND_PTR(rpctbl, &po, rfree);
+  if (rfree)
+    HASH_DEL(rpctbl, rfree);
+  /* Keep pooled buffers mapped and registered for reuse, up to the limit */
+  if (rfree && rfree->pool_class >= 0 &&
+      (pool = rpcmem_pool_get_locked(rfree->heapid, 0))) {
+    if (pool_bytes + rfree->size <= pool_limit) {
+      QList_AppendNode(&pool->freelst[rfree->pool_class], &rfree->qn);
+      pool_bytes += rfree->size;
+      pool->stats.cached_bufs++;
+      pool->stats.cached_bytes += rfree->size;
+      rfree = 0;
+    } else {
+      pool->stats.releases++;
     }
   }
   pthread_mutex_unlock(&rpcmt);
-  if (rfree) {
-    remote_register_buf(rfree->buf, rfree->size, -1);
-    munmap(rfree->buf, rfree->size);
-    close(rfree->fd);
-    free(rfree);
-  }
+  if (rfree)
+    rpcmem_release(rfree, 1);
   return;
 }
 
@@ -0,0 +1,1908 @@
+// Copyright (c) 2024, Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "remote.h"
+#include "rpcmem.h"
+#include "dspqueue.h"
+#include "fastrpc_common.h"
+#include "fastrpc_mock.h"
+#include "fastrpc_shell_cache.h"
+#include "listener_android.h"
+
+#define DEFAULT_LIBRARY "libcdsprpc.so"
+#define DEFAULT_BACKEND "mock"
+#define DEFAULT_URI "fastrpc_bench" CDSP_DOMAIN
+#define DEFAULT_ITERATIONS 100000
+#define DEFAULT_MAX_BUFFERS 100000
+#define DEFAULT_MAX_THREADS 4
+#define BUFFER_SIZE 4096
+#define BENCH_METHOD 2
+#define QUEUE_MESSAGE_SIZE 64
+#define QUEUE_TIMEOUT_US 1000000
+#define QUEUE_BATCH_PACKETS 16
+#define QUEUE_INPLACE_SIZE 4096
+#define QUEUE_BROADCAST_MAX_DOMAINS 4
+#define QUEUE_IDLE_MAX 62 /* leaves room for the active queue */
+#define QUEUE_EPOLL_MAX 16
+/* Fits fewer than QUEUE_BATCH_PACKETS messages, so bursts wait for space */
+#define QUEUE_BROADCAST_REQ_SIZE 1024
+#define REVERSE_MODULE "fastrpc_bench_reverse"
+#define REVERSE_BLOCKING_MODULE "fastrpc_bench_blocking"
+#define REVERSE_BLOCKING_US 1000
+#define REVERSE_SMALL_SIZE 1024
+#define REVERSE_LARGE_SIZE (256 * 1024)
+#define REVERSE_PAYLOAD_MODULE "fastrpc_bench_payload"
+#define REVERSE_DISPATCH_MODULE "fastrpc_bench_dispatch"
+/* Odd, so never a handle of an open module */
+#define REVERSE_DISPATCH_CONST_HANDLE 0xbe5c1
+#define REMOTECTL_HANDLE 0
+#define REMOTECTL_ERR_LEN 256
+#define SESSION_ITERATIONS 100
+#define SHELL_CACHE_ITERATIONS 1000
+#define SHELL_CACHE_IMAGE_SIZE (1024 * 1024)
+
+typedef void *(*rpcmem_alloc_t)(int heapid, uint32_t flags, int size);
+typedef void (*rpcmem_free_t)(void *po);
+typedef int (*rpcmem_to_fd_t)(void *po);
+typedef int (*remote_handle64_open_t)(const char *name, remote_handle64 *ph);
+typedef int (*remote_handle64_close_t)(remote_handle64 h);
+typedef int (*remote_handle64_invoke_t)(remote_handle64 h, uint32_t dwScalars,
+                                        remote_arg *pra);
+typedef int (*fastrpc_mmap_t)(int domain, int fd, void *vaddr, int offset,
+                              size_t length, enum fastrpc_map_flags flags);
+typedef int (*fastrpc_munmap_t)(int domain, int fd, void *vaddr,
+                                size_t length);
+typedef AEEResult (*dspqueue_create_t)(int domain, uint32_t flags,
+                                       uint32_t req_queue_size,
+                                       uint32_t resp_queue_size,
+                                       dspqueue_callback_t packet_callback,
+                                       dspqueue_callback_t error_callback,
+                                       void *callback_context,
+                                       dspqueue_t *queue);
+typedef AEEResult (*dspqueue_close_t)(dspqueue_t queue);
+typedef AEEResult (*dspqueue_write_t)(dspqueue_t queue, uint32_t flags,
+                                      uint32_t num_buffers,
+                                      struct dspqueue_buffer *buffers,
+                                      uint32_t message_length,
+                                      const uint8_t *message,
+                                      uint32_t timeout_us);
+typedef AEEResult (*dspqueue_read_t)(dspqueue_t queue, uint32_t *flags,
+                                     uint32_t max_buffers,
+                                     uint32_t *num_buffers,
+                                     struct dspqueue_buffer *buffers,
+                                     uint32_t max_message_length,
+                                     uint32_t *message_length,
+                                     uint8_t *message, uint32_t timeout_us);
+typedef AEEResult (*dspqueue_write_batch_t)(dspqueue_t queue,
+                                            uint32_t num_packets,
+                                            struct dspqueue_packet *packets,
+                                            uint32_t *num_written,
+                                            uint32_t timeout_us);
+typedef AEEResult (*dspqueue_write_reserve_t)(
+    dspqueue_t queue, uint32_t flags, uint32_t num_buffers,
+    struct dspqueue_buffer *buffers, uint32_t message_length,
+    uint8_t **message, uint32_t timeout_us);
+typedef AEEResult (*dspqueue_write_commit_t)(dspqueue_t queue);
+typedef AEEResult (*dspqueue_read_acquire_t)(
+    dspqueue_t queue, uint32_t *flags, uint32_t max_buffers,
+    uint32_t *num_buffers, struct dspqueue_buffer *buffers,
+    uint32_t *message_length, const uint8_t **message, uint32_t timeout_us);
+typedef AEEResult (*dspqueue_read_release_t)(dspqueue_t queue);
+typedef AEEResult (*dspqueue_read_noblock_t)(
+    dspqueue_t queue, uint32_t *flags, uint32_t max_buffers,
+    uint32_t *num_buffers, struct dspqueue_buffer *buffers,
+    uint32_t max_message_length, uint32_t *message_length, uint8_t *message);
+typedef int (*dspqueue_request_t)(dspqueue_request_payload *req);
+typedef AEEResult (*dspqueue_get_eventfd_t)(dspqueue_t queue, int *fd);
+typedef int (*remote_session_control_t)(uint32_t req, void *data,
+                                        uint32_t datalen);
+typedef int (*fastrpc_mock_reverse_invoke_t)(int domain, remote_handle handle,
+                                             uint32_t sc, remote_arg *pra);
+typedef int (*mod_table_register_static_t)(const char *name,
+                                           int (*pfn)(uint32_t sc,
+                                                      remote_arg *pra));
+typedef int (*mod_table_open_t)(const char *uri, remote_handle *handle,
+                                char *dlerr, int dlerrorLen, int *pdlErr);
+typedef int (*mod_table_invoke_t)(remote_handle handle, uint32_t sc,
+                                  remote_arg *pra);
+typedef int (*mod_table_close_t)(remote_handle handle, char *errStr,
+                                 int errStrLen, int *pdlErr);
+typedef int (*mod_table_register_const_handle_t)(
+    remote_handle remote, const char *uri,
+    int (*pfn)(uint32_t sc, remote_arg *pra));
+typedef int (*listener_android_get_stats_t)(
+    int domain, struct listener_stats *stats,
+    struct listener_handle_stats *handles, int *num_handles);
+typedef void (*fastrpc_get_invoke_alloc_stats_t)(uint64_t *invokes,
+                                                 uint64_t *heap_allocs);
+typedef int (*fastrpc_shell_cache_lookup_t)(apps_std_FILE shell,
+                                            apps_std_FILE sig,
+                                            struct fastrpc_shell_image *img);
+typedef void (*fastrpc_shell_cache_store_t)(apps_std_FILE shell,
+                                            apps_std_FILE sig,
+                                            const void *data,
+                                            uint32_t shell_len,
+                                            uint32_t sig_len);
+typedef void (*fastrpc_shell_cache_release_t)(struct fastrpc_shell_image *img);
+typedef int (*fastrpc_shell_cache_get_stats_t)(
+    struct fastrpc_shell_cache_stats *process,
+    struct fastrpc_shell_cache_stats *all);
+typedef int (*apps_std_fopen_t)(const char *name, const char *mode,
+                                apps_std_FILE *psout);
+typedef int (*apps_std_fclose_t)(apps_std_FILE sin);
+typedef int (*apps_std_fread_t)(apps_std_FILE sin, unsigned char *buf,
+                                int bufLen, int *bytesRead, int *bEOF);
+typedef int (*apps_std_fseek_t)(apps_std_FILE sin, int offset,
+                                apps_std_SEEK whence);
+
+/* Library entry points used by the benchmarks */
+static struct {
+    rpcmem_alloc_t rpcmem_alloc;
+    rpcmem_free_t rpcmem_free;
+    rpcmem_to_fd_t rpcmem_to_fd;
+    remote_handle64_open_t remote_handle64_open;
+    remote_handle64_close_t remote_handle64_close;
+    remote_handle64_invoke_t remote_handle64_invoke;
+    fastrpc_mmap_t fastrpc_mmap;
+    fastrpc_munmap_t fastrpc_munmap;
+    dspqueue_create_t dspqueue_create;
+    dspqueue_close_t dspqueue_close;
+    dspqueue_write_t dspqueue_write;
+    dspqueue_read_t dspqueue_read;
+    remote_session_control_t remote_session_control;
+    /* Only present in newer libraries */
+    fastrpc_get_invoke_alloc_stats_t fastrpc_get_invoke_alloc_stats;
+    dspqueue_write_batch_t dspqueue_write_batch;
+    dspqueue_write_reserve_t dspqueue_write_reserve;
+    dspqueue_write_commit_t dspqueue_write_commit;
+    dspqueue_read_acquire_t dspqueue_read_acquire;
+    dspqueue_read_release_t dspqueue_read_release;
+    dspqueue_read_noblock_t dspqueue_read_noblock;
+    dspqueue_request_t dspqueue_request;
+    dspqueue_get_eventfd_t dspqueue_get_eventfd;
+    fastrpc_shell_cache_lookup_t fastrpc_shell_cache_lookup;
+    fastrpc_shell_cache_store_t fastrpc_shell_cache_store;
+    fastrpc_shell_cache_release_t fastrpc_shell_cache_release;
+    fastrpc_shell_cache_get_stats_t fastrpc_shell_cache_get_stats;
+    apps_std_fopen_t apps_std_fopen;
+    apps_std_fclose_t apps_std_fclose;
+    apps_std_fread_t apps_std_fread;
+    apps_std_fseek_t apps_std_fseek;
+    /* Only present in libraries built with the mock driver */
+    fastrpc_mock_reverse_invoke_t fastrpc_mock_reverse_invoke;
+    mod_table_register_static_t mod_table_register_static;
+    listener_android_get_stats_t listener_android_get_stats;
+    mod_table_open_t mod_table_open;
+    mod_table_invoke_t mod_table_invoke;
+    mod_table_close_t mod_table_close;
+    mod_table_register_const_handle_t mod_table_register_const_handle;
+} lib;
+
+#define LOAD_SYMBOL(handle, name) \
+    (lib.name = (name##_t)dlsym(handle, #name))
+
+static int iterations = DEFAULT_ITERATIONS;
+static int max_buffers = DEFAULT_MAX_BUFFERS;
+static int max_threads = DEFAULT_MAX_THREADS;
+static const char *uri = DEFAULT_URI;
+static bool mock_backend;
+/* Shell cache of the run, unless FASTRPC_SHELL_CACHE_DIR is set */
+static char shell_cache_dir[] = "/tmp/fastrpc_bench_cache.XXXXXX";
+static bool own_shell_cache_dir;
+
+/* Per-thread state of a multi-threaded measurement */
+struct worker {
+    pthread_t thread;
+    int (*op)(struct worker *w);
+    uint64_t *samples;
+    int count;
+    int err;
+    remote_handle64 handle;
+    remote_arg *args;
+    int num_args;
+    void *buf;
+    int fd;
+    dspqueue_t queue;
+    remote_handle reverse_handle;
+    uint32_t reverse_sc;
+    unsigned int calls;
+    uint32_t sum; /* of the messages consumed, keeps the reads */
+    unsigned int domains; /* of a multi-domain queue */
+    dspqueue_t *queues; /* serviced together through epoll_fd */
+    int *event_fds;
+    int num_queues;
+    int epoll_fd;
+};
+
+/* 0 while workers wait to start, 1 to run and -1 to quit */
+static atomic_int workers_go;
+
+typedef int (*bench_fn_t)(void);
+
+struct bench {
+    const char *name;
+    const char *desc;
+    bench_fn_t run;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Sorts the samples and prints mean and percentile latencies, and the
+ * throughput when the wall time taken by all samples is known
+ */
+static void report(const char *name, uint64_t *samples, int count,
+                   uint64_t wall_ns) {
+    uint64_t total = 0;
+    int i;
+
+    if (count <= 0) {
+        printf("%-32s no samples\n", name);
+        return;
+    }
+    for (i = 0; i < count; i++)
+        total += samples[i];
+    qsort(samples, count, sizeof(*samples), cmp_u64);
+    printf("%-32s n=%-8d mean=%8.1f ns p50=%8" PRIu64 " ns p99=%8" PRIu64
+           " ns p999=%8" PRIu64 " ns",
+           name, count, (double)total / count, samples[count / 2],
+           samples[(int)(count * 0.99)], samples[(int)(count * 0.999)]);
+    if (wall_ns)
+        printf(" %12.0f ops/s", (double)count * 1e9 / wall_ns);
+    printf("\n");
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    int i;
+
+    while (!atomic_load(&workers_go))
+        sched_yield();
+    if (atomic_load(&workers_go) < 0)
+        return NULL;
+    for (i = 0; i < iterations; i++) {
+        uint64_t start = now_ns();
+
+        w->err = w->op(w);
+        w->samples[i] = now_ns() - start;
+        if (w->err)
+            break;
+    }
+    w->count = i;
+    return NULL;
+}
+
+/* Times iterations calls of each worker's op, all workers in parallel */
+static int run_workers(const char *name, struct worker *workers,
+                       int nthreads) {
+    uint64_t *samples = NULL, start = 0, wall;
+    int i, created, nErr = 0;
+
+    samples = calloc((size_t)nthreads * iterations, sizeof(*samples));
+    if (!samples)
+        return -ENOMEM;
+    atomic_store(&workers_go, 0);
+    for (created = 0; created < nthreads; created++) {
+        workers[created].samples = samples + (size_t)created * iterations;
+        workers[created].count = 0;
+        workers[created].err = 0;
+        if (pthread_create(&workers[created].thread, NULL, worker_main,
+                           &workers[created])) {
+            nErr = -errno;
+            break;
+        }
+    }
+    if (!nErr) {
+        start = now_ns();
+        atomic_store(&workers_go, 1);
+    } else {
+        atomic_store(&workers_go, -1);
+    }
+    for (i = 0; i < created; i++)
+        pthread_join(workers[i].thread, NULL);
+    wall = now_ns() - start;
+    for (i = 0; i < created && !nErr; i++) {
+        if (workers[i].err) {
+            fprintf(stderr, "%s: operation failed with 0x%x\n", name,
+                    workers[i].err);
+            nErr = workers[i].err;
+        }
+    }
+    if (!nErr)
+        report(name, samples, nthreads * iterations, wall);
+    free(samples);
+    return nErr;
+}
+
+/* Thread counts double from 1 up to and including max_threads */
+static int next_thread_count(int n) {
+    return (n < max_threads && 2 * n > max_threads) ? max_threads : 2 * n;
+}
+
+/*
+ * Cost of rpcmem_to_fd and rpcmem_free with a growing number of live
+ * buffers. Lookup cost is expected to stay flat.
+ */
+static int bench_rpcmem_lookup(void) {
+    void **bufs = NULL;
+    uint64_t *samples = NULL;
+    int live, n, i, nErr = 0;
+
+    bufs = calloc(max_buffers, sizeof(*bufs));
+    samples = calloc(iterations > max_buffers ? iterations : max_buffers,
+                     sizeof(*samples));
+    if (!bufs || !samples) {
+        nErr = -ENOMEM;
+        goto bail;
+    }
+    for (live = 10; live <= max_buffers; live *= 10) {
+        char name[64];
+
+        for (n = 0; n < live; n++) {
+            bufs[n] = lib.rpcmem_alloc(RPCMEM_HEAP_ID_SYSTEM,
+                                       RPCMEM_DEFAULT_FLAGS, BUFFER_SIZE);
+            if (!bufs[n])
+                break;
+        }
+        if (n < live) {
+            fprintf(stderr, "rpcmem_alloc failed after %d buffers\n", n);
+            nErr = -ENOMEM;
+        } else {
+            for (i = 0; i < iterations; i++) {
+                void *po = bufs[rand() % live];
+                uint64_t start = now_ns();
+
+                if (lib.rpcmem_to_fd(po) < 0)
+                    nErr = -EINVAL;
+                samples[i] = now_ns() - start;
+            }
+            snprintf(name, sizeof(name), "rpcmem_to_fd live=%d", live);
+            report(name, samples, iterations, 0);
+        }
+        for (i = 0; i < n; i++) {
+            uint64_t start = now_ns();
+
+            lib.rpcmem_free(bufs[i]);
+            samples[i] = now_ns() - start;
+        }
+        if (n == live) {
+            snprintf(name, sizeof(name), "rpcmem_free live=%d", live);
+            report(name, samples, n, 0);
+        }
+        if (nErr)
+            break;
+    }
+bail:
+    free(bufs);
+    free(samples);
+    return nErr;
+}
+
+static int op_invoke(struct worker *w) {
+    return lib.remote_handle64_invoke(
+        w->handle, REMOTE_SCALARS_MAKEX(0, BENCH_METHOD, w->num_args, 0, 0, 0),
+        w->args);
+}
+
+static int op_rpcmem_churn(struct worker *w) {
+    void *po = lib.rpcmem_alloc(RPCMEM_HEAP_ID_SYSTEM, RPCMEM_DEFAULT_FLAGS,
+                                BUFFER_SIZE);
+
+    if (!po)
+        return -ENOMEM;
+    lib.rpcmem_free(po);
+    return 0;
+}
+
+static int op_map_churn(struct worker *w) {
+    int nErr;
+
+    nErr = lib.fastrpc_mmap(CDSP_DOMAIN_ID, w->fd, w->buf, 0, BUFFER_SIZE,
+                            FASTRPC_MAP_FD);
+    if (nErr)
+        return nErr;
+    return lib.fastrpc_munmap(CDSP_DOMAIN_ID, w->fd, w->buf, BUFFER_SIZE);
+}
+
+static int op_queue_roundtrip(struct worker *w) {
+    uint8_t msg[QUEUE_MESSAGE_SIZE] = {0};
+    uint32_t flags, num_buffers, len;
+    int nErr;
+
+    nErr = lib.dspqueue_write(w->queue, 0, 0, NULL, sizeof(msg), msg,
+                              QUEUE_TIMEOUT_US);
+    if (nErr)
+        return nErr;
+    nErr = lib.dspqueue_read(w->queue, &flags, 0, &num_buffers, NULL,
+                             sizeof(msg), &len, msg, QUEUE_TIMEOUT_US);
+    if (!nErr && len != sizeof(msg))
+        nErr = -EBADMSG;
+    return nErr;
+}
+
+/* Runs op over every thread count, named after the op and the count */
+static int sweep_threads(const char *label, struct worker *workers,
+                         int (*op)(struct worker *w)) {
+    int n, i, nErr = 0;
+
+    for (n = 1; n <= max_threads && !nErr; n = next_thread_count(n)) {
+        char name[64];
+
+        for (i = 0; i < n; i++)
+            workers[i].op = op;
+        snprintf(name, sizeof(name), "%s threads=%d", label, n);
+        nErr = run_workers(name, workers, n);
+    }
+    return nErr;
+}
+
+/* Releases the buffers and handles held by the workers */
+static void free_workers(struct worker *workers) {
+    int i, j;
+
+    for (i = 0; i < max_threads; i++) {
+        struct worker *w = &workers[i];
+
+        for (j = 0; w->args && j < w->num_args; j++)
+            lib.rpcmem_free(w->args[j].buf.pv);
+        free(w->args);
+        if (w->buf)
+            lib.rpcmem_free(w->buf);
+        if (w->queue)
+            lib.dspqueue_close(w->queue);
+    }
+    if (workers[0].handle)
+        lib.remote_handle64_close(workers[0].handle);
+    free(workers);
+}
+
+/* Allocates max_threads workers sharing one handle on the bench module */
+static struct worker *alloc_workers(void) {
+    struct worker *workers = calloc(max_threads, sizeof(*workers));
+    remote_handle64 h = 0;
+    int i, nErr;
+
+    if (!workers)
+        return NULL;
+    nErr = lib.remote_handle64_open(uri, &h);
+    if (nErr) {
+        fprintf(stderr, "Error 0x%x: unable to open %s\n", nErr, uri);
+        free(workers);
+        return NULL;
+    }
+    for (i = 0; i < max_threads; i++)
+        workers[i].handle = h;
+    return workers;
+}
+
+/*
+ * sweep_threads of op_invoke. Synchronous invokes take their argument
+ * arrays from a per-thread scratch of the library, so fails if the library
+ * counted any heap allocation made by the invokes of the run.
+ */
+static int sweep_invokes(const char *label, struct worker *workers) {
+    uint64_t invokes[2] = {0}, allocs[2] = {0};
+    int nErr;
+
+    if (lib.fastrpc_get_invoke_alloc_stats)
+        lib.fastrpc_get_invoke_alloc_stats(&invokes[0], &allocs[0]);
+    nErr = sweep_threads(label, workers, op_invoke);
+    if (nErr || !lib.fastrpc_get_invoke_alloc_stats)
+        return nErr;
+    lib.fastrpc_get_invoke_alloc_stats(&invokes[1], &allocs[1]);
+    printf("invokes=%" PRIu64 " heap_allocs=%" PRIu64 "\n",
+           invokes[1] - invokes[0], allocs[1] - allocs[0]);
+    if (allocs[1] != allocs[0]) {
+        fprintf(stderr, "%s: synchronous invokes allocated from the heap\n",
+                label);
+        nErr = -EFAULT;
+    }
+    return nErr;
+}
+
+/* Invokes without arguments: the fixed cost of a remote call */
+static int bench_null_invoke(void) {
+    struct worker *workers = alloc_workers();
+    int nErr;
+
+    if (!workers)
+        return -ENODEV;
+    nErr = sweep_invokes("null_invoke", workers);
+    free_workers(workers);
+    return nErr;
+}
+
+/* Invokes passing registered buffers, which the library looks up by address */
+static int bench_buffer_invoke(void) {
+    static const int counts[] = {1, 8, 64};
+    struct worker *workers = alloc_workers();
+    int c, i, nErr = 0;
+
+    if (!workers)
+        return -ENODEV;
+    for (c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])) && !nErr; c++) {
+        char label[32];
+
+        for (i = 0; i < max_threads && !nErr; i++) {
+            struct worker *w = &workers[i];
+
+            for (; w->num_args > 0; w->num_args--)
+                lib.rpcmem_free(w->args[w->num_args - 1].buf.pv);
+            free(w->args);
+            w->args = calloc(counts[c], sizeof(*w->args));
+            if (!w->args) {
+                nErr = -ENOMEM;
+                break;
+            }
+            for (; w->num_args < counts[c]; w->num_args++) {
+                remote_arg *arg = &w->args[w->num_args];
+
+                arg->buf.pv = lib.rpcmem_alloc(RPCMEM_HEAP_ID_SYSTEM,
+                                               RPCMEM_DEFAULT_FLAGS,
+                                               BUFFER_SIZE);
+                if (!arg->buf.pv) {
+                    nErr = -ENOMEM;
+                    break;
+                }
+                arg->buf.nLen = BUFFER_SIZE;
+            }
+        }
+        if (nErr)
+            break;
+        snprintf(label, sizeof(label), "buffer_invoke bufs=%d", counts[c]);
+        nErr = sweep_invokes(label, workers);
+    }
+    free_workers(workers);
+    return nErr;
+}
+
+/* Buffer allocation and DSP mapping created and torn down per operation */
+static int bench_register_churn(void) {
+    struct worker *workers = alloc_workers();
+    int i, nErr = 0;
+
+    if (!workers)
+        return -ENODEV;
+    nErr = sweep_threads("rpcmem_alloc/free", workers, op_rpcmem_churn);
+    for (i = 0; i < max_threads && !nErr; i++) {
+        workers[i].buf = lib.rpcmem_alloc(RPCMEM_HEAP_ID_SYSTEM,
+                                          RPCMEM_DEFAULT_FLAGS, BUFFER_SIZE);
+        if (!workers[i].buf)
+            nErr = -ENOMEM;
+        else
+            workers[i].fd = lib.rpcmem_to_fd(workers[i].buf);
+    }
+    if (!nErr)
+        nErr = sweep_threads("fastrpc_mmap/munmap", workers, op_map_churn);
+    free_workers(workers);
+    return nErr;
+}
+
+/* Reads the responses to QUEUE_BATCH_PACKETS messages */
+static int queue_read_batch(struct worker *w) {
+    uint8_t msg[QUEUE_MESSAGE_SIZE];
+    uint32_t flags, num_buffers, len;
+    int i, nErr = 0;
+
+    for (i = 0; i < QUEUE_BATCH_PACKETS && !nErr; i++) {
+        nErr = lib.dspqueue_read(w->queue, &flags, 0, &num_buffers, NULL,
+                                 sizeof(msg), &len, msg, QUEUE_TIMEOUT_US);
+        if (!nErr && len != sizeof(msg))
+            nErr = -EBADMSG;
+    }
+    return nErr;
+}
+
+/* QUEUE_BATCH_PACKETS messages written one by one, then their responses */
+static int op_queue_single(struct worker *w) {
+    uint8_t msg[QUEUE_MESSAGE_SIZE] = {0};
+    int i, nErr = 0;
+
+    for (i = 0; i < QUEUE_BATCH_PACKETS && !nErr; i++)
+        nErr = lib.dspqueue_write(w->queue, 0, 0, NULL, sizeof(msg), msg,
+                                  QUEUE_TIMEOUT_US);
+    return nErr ? nErr : queue_read_batch(w);
+}
+
+/* QUEUE_BATCH_PACKETS messages written in one batch, then their responses */
+static int op_queue_batch(struct worker *w) {
+    uint8_t msg[QUEUE_MESSAGE_SIZE] = {0};
+    struct dspqueue_packet packets[QUEUE_BATCH_PACKETS];
+    uint32_t written = 0;
+    int i, nErr;
+
+    for (i = 0; i < QUEUE_BATCH_PACKETS; i++) {
+        packets[i] = (struct dspqueue_packet){
+            .message_length = sizeof(msg),
+            .message = msg,
+        };
+    }
+    nErr = lib.dspqueue_write_batch(w->queue, QUEUE_BATCH_PACKETS, packets,
+                                    &written, QUEUE_TIMEOUT_US);
+    if (!nErr && written != QUEUE_BATCH_PACKETS)
+        nErr = -EIO;
+    return nErr ? nErr : queue_read_batch(w);
+}
+
+/* Fills a message as a producer would, word by word */
+static void queue_fill_message(uint8_t *msg, uint32_t len, uint32_t seed) {
+    uint32_t i;
+
+    for (i = 0; i + sizeof(uint32_t) <= len; i += sizeof(uint32_t)) {
+        memcpy(msg + i, &seed, sizeof(seed));
+        seed++;
+    }
+}
+
+/* Sums a message as a consumer would */
+static uint32_t queue_sum_message(const uint8_t *msg, uint32_t len) {
+    uint32_t i, v, sum = 0;
+
+    for (i = 0; i + sizeof(uint32_t) <= len; i += sizeof(uint32_t)) {
+        memcpy(&v, msg + i, sizeof(v));
+        sum += v;
+    }
+    return sum;
+}
+
+/* A message built in a buffer and copied in, then read out and consumed */
+static int op_queue_copy(struct worker *w) {
+    uint8_t msg[QUEUE_INPLACE_SIZE];
+    uint32_t flags, num_buffers, len;
+    int nErr;
+
+    queue_fill_message(msg, sizeof(msg), w->calls++);
+    nErr = lib.dspqueue_write(w->queue, 0, 0, NULL, sizeof(msg), msg,
+                              QUEUE_TIMEOUT_US);
+    if (!nErr)
+        nErr = lib.dspqueue_read(w->queue, &flags, 0, &num_buffers, NULL,
+                                 sizeof(msg), &len, msg, QUEUE_TIMEOUT_US);
+    if (!nErr && len != sizeof(msg))
+        nErr = -EBADMSG;
+    if (!nErr)
+        w->sum += queue_sum_message(msg, len);
+    return nErr;
+}
+
+/* The same message built and consumed in place in the queues */
+static int op_queue_inplace(struct worker *w) {
+    uint8_t *out = NULL;
+    const uint8_t *in = NULL;
+    uint32_t flags, num_buffers, len;
+    int nErr;
+
+    nErr = lib.dspqueue_write_reserve(w->queue, 0, 0, NULL,
+                                      QUEUE_INPLACE_SIZE, &out,
+                                      QUEUE_TIMEOUT_US);
+    if (nErr)
+        return nErr;
+    queue_fill_message(out, QUEUE_INPLACE_SIZE, w->calls++);
+    nErr = lib.dspqueue_write_commit(w->queue);
+    if (!nErr)
+        nErr = lib.dspqueue_read_acquire(w->queue, &flags, 0, &num_buffers,
+                                         NULL, &len, &in, QUEUE_TIMEOUT_US);
+    if (nErr)
+        return nErr;
+    if (len != QUEUE_INPLACE_SIZE)
+        nErr = -EBADMSG;
+    else
+        w->sum += queue_sum_message(in, len);
+    lib.dspqueue_read_release(w->queue);
+    return nErr;
+}
+
+static int run_queue_roundtrip(const char *name, uint32_t flags,
+                               int (*op)(struct worker *w)) {
+    struct worker *workers = NULL;
+    int i, nErr = 0;
+
+    if (!mock_backend) {
+        printf("skipped, needs a DSP client echoing queue packets\n");
+        return 0;
+    }
+    workers = alloc_workers();
+    if (!workers)
+        return -ENODEV;
+    for (i = 0; i < max_threads && !nErr; i++) {
+        nErr = lib.dspqueue_create(CDSP_DOMAIN_ID, flags, 0, 0, NULL, NULL,
+                                   NULL, &workers[i].queue);
+        if (nErr)
+            fprintf(stderr, "Error 0x%x: dspqueue_create failed\n", nErr);
+    }
+    if (!nErr)
+        nErr = sweep_threads(name, workers, op);
+    free_workers(workers);
+    return nErr;
+}
+
+/* A message written to a dspqueue and its response read back, per thread */
+static int bench_queue_roundtrip(void) {
+    return run_queue_roundtrip("queue_roundtrip", 0, op_queue_roundtrip);
+}
+
+/* Same as queue_roundtrip with reads polling for the response */
+static int bench_queue_poll(void) {
+    return run_queue_roundtrip("queue_poll", DSPQUEUE_CREATE_FLAG_POLL,
+                               op_queue_roundtrip);
+}
+
+static int bench_queue_inplace(void) {
+    int nErr;
+
+    if (!lib.dspqueue_write_reserve || !lib.dspqueue_read_acquire) {
+        printf("skipped, dspqueue_write_reserve not supported\n");
+        return 0;
+    }
+    nErr = run_queue_roundtrip("queue_inplace copy", 0, op_queue_copy);
+    if (!nErr)
+        nErr = run_queue_roundtrip("queue_inplace in place", 0,
+                                   op_queue_inplace);
+    return nErr;
+}
+
+static int bench_queue_batch(void) {
+    int nErr;
+
+    if (!lib.dspqueue_write_batch) {
+        printf("skipped, dspqueue_write_batch not supported\n");
+        return 0;
+    }
+    nErr = run_queue_roundtrip("queue_batch single", 0, op_queue_single);
+    if (!nErr)
+        nErr = run_queue_roundtrip("queue_batch batch", 0, op_queue_batch);
+    return nErr;
+}
+
+/*
+ * queue_roundtrip on one queue with 0, 16 and QUEUE_IDLE_MAX other queues
+ * open but idle in the process
+ */
+static int bench_queue_idle(void) {
+    static const int idle_counts[] = {0, 16, QUEUE_IDLE_MAX};
+    dspqueue_t idle[QUEUE_IDLE_MAX] = {0};
+    struct worker *workers = NULL;
+    int c, i, open = 0, nErr = 0;
+
+    if (!mock_backend) {
+        printf("skipped, needs a DSP client echoing queue packets\n");
+        return 0;
+    }
+    workers = alloc_workers();
+    if (!workers)
+        return -ENODEV;
+    nErr = lib.dspqueue_create(CDSP_DOMAIN_ID, 0, 0, 0, NULL, NULL, NULL,
+                               &workers[0].queue);
+    if (nErr)
+        fprintf(stderr, "Error 0x%x: dspqueue_create failed\n", nErr);
+    workers[0].op = op_queue_roundtrip;
+    for (c = 0; c < (int)(sizeof(idle_counts) / sizeof(idle_counts[0])) &&
+                !nErr; c++) {
+        char name[64];
+
+        for (; open < idle_counts[c] && !nErr; open++) {
+            nErr = lib.dspqueue_create(CDSP_DOMAIN_ID, 0, 0, 0, NULL, NULL,
+                                       NULL, &idle[open]);
+            if (nErr)
+                fprintf(stderr, "Error 0x%x: dspqueue_create failed\n",
+                        nErr);
+        }
+        if (nErr)
+            break;
+        snprintf(name, sizeof(name), "queue_idle idle=%d", open);
+        nErr = run_workers(name, workers, 1);
+    }
+    for (i = 0; i < open; i++) {
+        if (idle[i])
+            lib.dspqueue_close(idle[i]);
+    }
+    free_workers(workers);
+    return nErr;
+}
+
+/*
+ * A message written to each queue, then the responses of all queues read as
+ * their eventfds become ready
+ */
+static int op_queue_epoll(struct worker *w) {
+    uint8_t msg[QUEUE_MESSAGE_SIZE] = {0};
+    struct epoll_event events[QUEUE_EPOLL_MAX];
+    uint32_t flags, num_buffers, len;
+    uint64_t count;
+    int left = w->num_queues, i, n, nErr = 0;
+
+    for (i = 0; i < w->num_queues && !nErr; i++)
+        nErr = lib.dspqueue_write(w->queues[i], 0, 0, NULL, sizeof(msg), msg,
+                                  QUEUE_TIMEOUT_US);
+    while (!nErr && left > 0) {
+        n = epoll_wait(w->epoll_fd, events, QUEUE_EPOLL_MAX,
+                       QUEUE_TIMEOUT_US / 1000);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            nErr = n ? -errno : AEE_EEXPIRED;
+            break;
+        }
+        for (i = 0; i < n && !nErr; i++) {
+            dspqueue_t q = w->queues[events[i].data.u32];
+
+            // Reset the eventfd before draining, later packets set it again
+            if (read(w->event_fds[events[i].data.u32], &count,
+                     sizeof(count)) < 0 && errno != EAGAIN) {
+                nErr = -errno;
+                break;
+            }
+            while (!nErr) {
+                nErr = lib.dspqueue_read_noblock(q, &flags, 0, &num_buffers,
+                                                 NULL, sizeof(msg), &len,
+                                                 msg);
+                if (nErr == AEE_EWOULDBLOCK) {
+                    nErr = 0;
+                    break;
+                }
+                if (!nErr && len != sizeof(msg))
+                    nErr = -EBADMSG;
+                left--;
+            }
+        }
+    }
+    return nErr;
+}
+
+/*
+ * Roundtrips on 1, 4 and QUEUE_EPOLL_MAX queues, each served by its own
+ * thread blocking in dspqueue_read, or all by one thread waiting on their
+ * eventfds with epoll. An epoll operation is one message on every queue.
+ */
+static int bench_queue_epoll(void) {
+    static const int queue_counts[] = {1, 4, QUEUE_EPOLL_MAX};
+    dspqueue_t queues[QUEUE_EPOLL_MAX] = {0};
+    int event_fds[QUEUE_EPOLL_MAX];
+    struct worker *workers = NULL;
+    int c, i, armed = 0, nErr = 0;
+
+    if (!mock_backend) {
+        printf("skipped, needs a DSP client echoing queue packets\n");
+        return 0;
+    }
+    if (!lib.dspqueue_get_eventfd || !lib.dspqueue_read_noblock) {
+        printf("skipped, dspqueue_get_eventfd not supported\n");
+        return 0;
+    }
+    // One worker per queue, and the epoll worker after them
+    workers = calloc(QUEUE_EPOLL_MAX + 1, sizeof(*workers));
+    if (!workers)
+        return -ENOMEM;
+    workers[QUEUE_EPOLL_MAX].epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (workers[QUEUE_EPOLL_MAX].epoll_fd < 0)
+        nErr = -errno;
+    for (i = 0; i < QUEUE_EPOLL_MAX && !nErr; i++) {
+        nErr = lib.dspqueue_create(CDSP_DOMAIN_ID, 0, 0, 0, NULL, NULL, NULL,
+                                   &workers[i].queue);
+        if (!nErr)
+            nErr = lib.dspqueue_create(CDSP_DOMAIN_ID, 0, 0, 0, NULL, NULL,
+                                       NULL, &queues[i]);
+        if (nErr)
+            fprintf(stderr, "Error 0x%x: dspqueue_create failed\n", nErr);
+        workers[i].op = op_queue_roundtrip;
+    }
+    workers[QUEUE_EPOLL_MAX].op = op_queue_epoll;
+    workers[QUEUE_EPOLL_MAX].queues = queues;
+    workers[QUEUE_EPOLL_MAX].event_fds = event_fds;
+    for (c = 0; c < (int)(sizeof(queue_counts) / sizeof(queue_counts[0])) &&
+                !nErr; c++) {
+        char name[64];
+
+        snprintf(name, sizeof(name), "queue_epoll threads queues=%d",
+                 queue_counts[c]);
+        nErr = run_workers(name, workers, queue_counts[c]);
+        // Only the queues in use are in the epoll set
+        for (; armed < queue_counts[c] && !nErr; armed++) {
+            struct epoll_event ev = {.events = EPOLLIN, .data.u32 = armed};
+
+            nErr = lib.dspqueue_get_eventfd(queues[armed], &event_fds[armed]);
+            if (nErr)
+                fprintf(stderr, "Error 0x%x: dspqueue_get_eventfd failed\n",
+                        nErr);
+            else if (epoll_ctl(workers[QUEUE_EPOLL_MAX].epoll_fd,
+                               EPOLL_CTL_ADD, event_fds[armed], &ev))
+                nErr = -errno;
+        }
+        if (nErr)
+            break;
+        workers[QUEUE_EPOLL_MAX].num_queues = queue_counts[c];
+        snprintf(name, sizeof(name), "queue_epoll epoll queues=%d",
+                 queue_counts[c]);
+        nErr = run_workers(name, &workers[QUEUE_EPOLL_MAX], 1);
+    }
+    // The eventfds are closed with their queues
+    for (i = 0; i < QUEUE_EPOLL_MAX; i++) {
+        if (workers[i].queue)
+            lib.dspqueue_close(workers[i].queue);
+        if (queues[i])
+            lib.dspqueue_close(queues[i]);
+    }
+    if (workers[QUEUE_EPOLL_MAX].epoll_fd >= 0)
+        close(workers[QUEUE_EPOLL_MAX].epoll_fd);
+    free(workers);
+    return nErr;
+}
+
+/*
+ * QUEUE_BATCH_PACKETS messages broadcast to all domains of a multi-domain
+ * queue, then the response of every domain to each. Blocking reads are not
+ * supported on multi-domain queues, responses are polled.
+ */
+static int op_queue_broadcast(struct worker *w) {
+    uint8_t msg[QUEUE_MESSAGE_SIZE] = {0};
+    uint32_t flags, num_buffers, len;
+    unsigned int left = QUEUE_BATCH_PACKETS * w->domains;
+    uint64_t deadline;
+    int i, nErr = 0;
+
+    for (i = 0; i < QUEUE_BATCH_PACKETS && !nErr; i++)
+        nErr = lib.dspqueue_write(w->queue, 0, 0, NULL, sizeof(msg), msg,
+                                  QUEUE_TIMEOUT_US);
+    deadline = now_ns() + QUEUE_TIMEOUT_US * 1000ULL;
+    while (!nErr && left > 0) {
+        nErr = lib.dspqueue_read_noblock(w->queue, &flags, 0, &num_buffers,
+                                         NULL, sizeof(msg), &len, msg);
+        if (nErr == AEE_EWOULDBLOCK) {
+            nErr = now_ns() < deadline ? 0 : AEE_EEXPIRED;
+            sched_yield();
+        } else if (!nErr) {
+            if (len != sizeof(msg))
+                nErr = -EBADMSG;
+            left--;
+        }
+    }
+    return nErr;
+}
+
+/*
+ * Broadcast to a multi-domain queue over 2 to QUEUE_BROADCAST_MAX_DOMAINS
+ * domains, emulated by sessions on the CDSP
+ */
+static int bench_queue_broadcast(void) {
+    remote_handle64 handles[QUEUE_BROADCAST_MAX_DOMAINS] = {0};
+    uint64_t contexts[QUEUE_BROADCAST_MAX_DOMAINS + 1] = {0};
+    uint32_t domain_ids[QUEUE_BROADCAST_MAX_DOMAINS];
+    uint64_t queue_ids[QUEUE_BROADCAST_MAX_DOMAINS];
+    struct worker *workers = NULL;
+    unsigned int n, i;
+    int nErr = 0;
+
+    if (!mock_backend) {
+        printf("skipped, needs a DSP client echoing queue packets\n");
+        return 0;
+    }
+    if (!lib.dspqueue_request || !lib.dspqueue_read_noblock) {
+        printf("skipped, multi-domain queues not supported\n");
+        return 0;
+    }
+    workers = calloc(1, sizeof(*workers));
+    if (!workers)
+        return -ENOMEM;
+    // Contexts are created on sessions already open
+    for (i = 0; i < QUEUE_BROADCAST_MAX_DOMAINS && !nErr; i++) {
+        char session_uri[256];
+
+        domain_ids[i] = CDSP_DOMAIN_ID + i * NUM_DOMAINS;
+        snprintf(session_uri, sizeof(session_uri), "%s&_session=%u", uri, i);
+        nErr = lib.remote_handle64_open(session_uri, &handles[i]);
+        if (nErr)
+            fprintf(stderr, "Error 0x%x: unable to open %s\n", nErr,
+                    session_uri);
+    }
+    // Destroying a context closes its sessions, all are destroyed at the end
+    for (n = 2; n <= QUEUE_BROADCAST_MAX_DOMAINS && !nErr; n++) {
+        fastrpc_context_create create = {
+            .effec_domain_ids = domain_ids,
+            .num_domain_ids = n,
+        };
+
+        nErr = lib.remote_session_control(FASTRPC_CONTEXT_CREATE, &create,
+                                          sizeof(create));
+        if (nErr)
+            fprintf(stderr, "Error 0x%x: context creation failed\n", nErr);
+        contexts[n] = create.ctx;
+    }
+    for (n = 2; n <= QUEUE_BROADCAST_MAX_DOMAINS && !nErr; n++) {
+        dspqueue_request_payload req = {.id = DSPQUEUE_CREATE};
+        char name[64];
+
+        req.create.ctx = contexts[n];
+        req.create.req_queue_size = QUEUE_BROADCAST_REQ_SIZE;
+        req.create.ids = queue_ids;
+        req.create.num_ids = n;
+        nErr = lib.dspqueue_request(&req);
+        if (nErr) {
+            fprintf(stderr, "Error 0x%x: multi-domain queue creation failed\n",
+                    nErr);
+        } else {
+            workers[0].queue = req.create.queue;
+            workers[0].domains = n;
+            workers[0].op = op_queue_broadcast;
+            snprintf(name, sizeof(name), "queue_broadcast domains=%u", n);
+            nErr = run_workers(name, workers, 1);
+            lib.dspqueue_close(workers[0].queue);
+            workers[0].queue = NULL;
+        }
+    }
+    for (n = 2; n <= QUEUE_BROADCAST_MAX_DOMAINS; n++) {
+        fastrpc_context_destroy destroy = {.ctx = contexts[n]};
+
+        if (contexts[n])
+            lib.remote_session_control(FASTRPC_CONTEXT_DESTROY, &destroy,
+                                       sizeof(destroy));
+    }
+    for (i = 0; i < QUEUE_BROADCAST_MAX_DOMAINS; i++) {
+        if (handles[i])
+            lib.remote_handle64_close(handles[i]);
+    }
+    free(workers);
+    return nErr;
+}
+
+static int reverse_skel_invoke(uint32_t sc, remote_arg *pra) {
+    return 0;
+}
+
+/* Stands in for a reverse call that waits on I/O */
+static int reverse_blocking_skel_invoke(uint32_t sc, remote_arg *pra) {
+    usleep(REVERSE_BLOCKING_US);
+    return 0;
+}
+
+static int op_reverse_invoke(struct worker *w) {
+    return lib.fastrpc_mock_reverse_invoke(
+        CDSP_DOMAIN_ID, w->reverse_handle,
+        REMOTE_SCALARS_MAKEX(0, BENCH_METHOD, w->num_args, 0, 0, 0), w->args);
+}
+
+/* Opens a CPU module from the mock DSP through apps_remotectl */
+static int reverse_open(const char *name, remote_handle *handle) {
+    uint32_t in[2] = {strlen(name) + 1, REMOTECTL_ERR_LEN};
+    uint32_t out[2] = {0};
+    char dlerr[REMOTECTL_ERR_LEN] = {0};
+    remote_arg args[4] = {
+        {.buf = {in, sizeof(in)}},
+        {.buf = {(void *)name, strlen(name) + 1}},
+        {.buf = {out, sizeof(out)}},
+        {.buf = {dlerr, sizeof(dlerr)}},
+    };
+    int nErr;
+
+    nErr = lib.fastrpc_mock_reverse_invoke(
+        CDSP_DOMAIN_ID, REMOTECTL_HANDLE, REMOTE_SCALARS_MAKEX(0, 0, 2, 2, 0, 0),
+        args);
+    if (!nErr)
+        nErr = out[1];
+    if (nErr)
+        fprintf(stderr, "Error 0x%x: reverse open of %s failed: %s\n", nErr,
+                name, dlerr);
+    *handle = out[0];
+    return nErr;
+}
+
+static void reverse_close(remote_handle handle) {
+    uint32_t in[2] = {handle, REMOTECTL_ERR_LEN};
+    uint32_t out[1] = {0};
+    char err[REMOTECTL_ERR_LEN] = {0};
+    remote_arg args[3] = {
+        {.buf = {in, sizeof(in)}},
+        {.buf = {out, sizeof(out)}},
+        {.buf = {err, sizeof(err)}},
+    };
+
+    lib.fastrpc_mock_reverse_invoke(CDSP_DOMAIN_ID, REMOTECTL_HANDLE,
+                                    REMOTE_SCALARS_MAKEX(0, 1, 1, 2, 0, 0),
+                                    args);
+}
+
+/*
+ * Reverse invokes from the mock DSP to a CPU module, each served by a
+ * listener thread of the session
+ */
+static int run_reverse_invoke(const char *name, const char *module,
+                              int (*skel)(uint32_t, remote_arg *)) {
+    struct worker *workers = NULL;
+    remote_handle h = 0;
+    int i, nErr = 0;
+
+    if (!mock_backend || !lib.fastrpc_mock_reverse_invoke ||
+        !lib.mod_table_register_static) {
+        printf("skipped, needs the mock driver\n");
+        return 0;
+    }
+    // The session and its listener are up once the bench module is open
+    workers = alloc_workers();
+    if (!workers)
+        return -ENODEV;
+    nErr = lib.mod_table_register_static(module, skel);
+    if (!nErr)
+        nErr = reverse_open(module, &h);
+    for (i = 0; i < max_threads && !nErr; i++)
+        workers[i].reverse_handle = h;
+    if (!nErr)
+        nErr = sweep_threads(name, workers, op_reverse_invoke);
+    if (h)
+        reverse_close(h);
+    free_workers(workers);
+    return nErr;
+}
+
+static int bench_reverse_invoke(void) {
+    return run_reverse_invoke("reverse_invoke", REVERSE_MODULE,
+                              reverse_skel_invoke);
+}
+
+/* Alternates the request size of a reverse invoke between two sizes */
+static int op_reverse_sizes(struct worker *w) {
+    w->args[0].buf.nLen =
+        (w->calls++ & 1) ? REVERSE_LARGE_SIZE : REVERSE_SMALL_SIZE;
+    return op_reverse_invoke(w);
+}
+
+/*
+ * Reverse invokes alternating between small and large requests, which used
+ * to resize the listener buffers on every call
+ */
+static int bench_reverse_sizes(void) {
+    struct worker *workers = NULL;
+    struct listener_stats before = {0}, after = {0};
+    struct listener_handle_stats hs[8];
+    remote_handle h = 0;
+    int i, nErr = 0, num = 8;
+
+    if (!mock_backend || !lib.fastrpc_mock_reverse_invoke ||
+        !lib.mod_table_register_static) {
+        printf("skipped, needs the mock driver\n");
+        return 0;
+    }
+    workers = alloc_workers();
+    if (!workers)
+        return -ENODEV;
+    nErr = lib.mod_table_register_static(REVERSE_MODULE, reverse_skel_invoke);
+    if (!nErr)
+        nErr = reverse_open(REVERSE_MODULE, &h);
+    for (i = 0; i < max_threads && !nErr; i++) {
+        struct worker *w = &workers[i];
+
+        w->reverse_handle = h;
+        w->args = calloc(1, sizeof(*w->args));
+        if (w->args)
+            w->args[0].buf.pv = lib.rpcmem_alloc(RPCMEM_HEAP_ID_SYSTEM,
+                                                 RPCMEM_DEFAULT_FLAGS,
+                                                 REVERSE_LARGE_SIZE);
+        if (!w->args || !w->args[0].buf.pv) {
+            nErr = -ENOMEM;
+            break;
+        }
+        w->num_args = 1;
+    }
+    if (!nErr && lib.listener_android_get_stats)
+        lib.listener_android_get_stats(CDSP_DOMAIN_ID, &before, NULL, NULL);
+    if (!nErr)
+        nErr = sweep_threads("reverse_sizes", workers, op_reverse_sizes);
+    if (!nErr && lib.listener_android_get_stats &&
+        !lib.listener_android_get_stats(CDSP_DOMAIN_ID, &after, hs, &num)) {
+        printf("listener invokes=%" PRIu64 " grows=%" PRIu64
+               " shrinks=%" PRIu64 " bytes_copied=%" PRIu64 "\n",
+               after.invokes - before.invokes, after.grows - before.grows,
+               after.shrinks - before.shrinks,
+               after.bytes_copied - before.bytes_copied);
+        for (i = 0; i < num && i < 8; i++) {
+            if (hs[i].handle == h && hs[i].calls)
+                printf("handle 0x%x calls=%" PRIu64 " mean=%.1f us max=%" PRIu64
+                       " us\n", hs[i].handle, hs[i].calls,
+                       (double)hs[i].total_us / hs[i].calls, hs[i].max_us);
+        }
+    }
+    if (h)
+        reverse_close(h);
+    free_workers(workers);
+    return nErr;
+}
+
+/* Copies its input buffer to its output buffer, like a read into DSP memory */
+static int reverse_payload_skel_invoke(uint32_t sc, remote_arg *pra) {
+    if (REMOTE_SCALARS_INBUFS(sc) != 1 || REMOTE_SCALARS_OUTBUFS(sc) != 1)
+        return -1;
+    memcpy(pra[1].buf.pv, pra[0].buf.pv,
+           pra[0].buf.nLen < pra[1].buf.nLen ? pra[0].buf.nLen
+                                             : pra[1].buf.nLen);
+    return 0;
+}
+
+static int op_reverse_payload(struct worker *w) {
+    return lib.fastrpc_mock_reverse_invoke(CDSP_DOMAIN_ID, w->reverse_handle,
+                                           w->reverse_sc, w->args);
+}
+
+/*
+ * Reverse invokes moving an input and an output buffer, copied through the
+ * listener buffers or passed by reference to buffers mapped with
+ * fastrpc_mmap, followed by the bytes moved per call
+ */
+static int bench_reverse_payload(void) {
+    static const int sizes[] = {4096, 65536, 1024 * 1024};
+    struct worker *workers = NULL, *w = NULL;
+    struct listener_stats before = {0}, after = {0};
+    remote_handle h = 0;
+    int i, s, ref, nErr = 0;
+
+    if (!mock_backend || !lib.fastrpc_mock_reverse_invoke ||
+        !lib.mod_table_register_static) {
+        printf("skipped, needs the mock driver\n");
+        return 0;
+    }
+    workers = alloc_workers();
+    if (!workers)
+        return -ENODEV;
+    w = &workers[0];
+    nErr = lib.mod_table_register_static(REVERSE_PAYLOAD_MODULE,
+                                         reverse_payload_skel_invoke);
+    if (!nErr)
+        nErr = reverse_open(REVERSE_PAYLOAD_MODULE, &h);
+    w->reverse_handle = h;
+    if (!nErr && !(w->args = calloc(2, sizeof(*w->args))))
+        nErr = -ENOMEM;
+    for (s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])) && !nErr; s++) {
+        for (i = 0; i < 2 && !nErr; i++) {
+            w->args[i].buf.pv = lib.rpcmem_alloc(RPCMEM_HEAP_ID_SYSTEM,
+                                                 RPCMEM_DEFAULT_FLAGS,
+                                                 sizes[s]);
+            if (!w->args[i].buf.pv) {
+                nErr = -ENOMEM;
+                break;
+            }
+            w->args[i].buf.nLen = sizes[s];
+            w->num_args = i + 1;
+            memset(w->args[i].buf.pv, i, sizes[s]);
+            nErr = lib.fastrpc_mmap(CDSP_DOMAIN_ID,
+                                    lib.rpcmem_to_fd(w->args[i].buf.pv),
+                                    w->args[i].buf.pv, 0, sizes[s],
+                                    FASTRPC_MAP_FD);
+        }
+        for (ref = 0; ref < 2 && !nErr; ref++) {
+            char name[64];
+
+            snprintf(name, sizeof(name), "reverse_payload %s size=%d",
+                     ref ? "ref" : "copy", sizes[s]);
+            w->reverse_sc = ref ? REMOTE_SCALARS_MAKEX(0, BENCH_METHOD, 0, 0,
+                                                       1, 1)
+                                : REMOTE_SCALARS_MAKEX(0, BENCH_METHOD, 1, 1,
+                                                       0, 0);
+            w->op = op_reverse_payload;
+            if (lib.listener_android_get_stats)
+                lib.listener_android_get_stats(CDSP_DOMAIN_ID, &before, NULL,
+                                               NULL);
+            nErr = run_workers(name, w, 1);
+            if (!nErr && lib.listener_android_get_stats &&
+                !lib.listener_android_get_stats(CDSP_DOMAIN_ID, &after, NULL,
+                                                NULL) &&
+                after.invokes > before.invokes) {
+                uint64_t calls = after.invokes - before.invokes;
+
+                printf("%-32s copied=%" PRIu64 " B/call by_ref=%" PRIu64
+                       " B/call\n", "",
+                       (after.bytes_in - before.bytes_in + after.bytes_out -
+                        before.bytes_out) / calls,
+                       (after.bytes_by_ref - before.bytes_by_ref) / calls);
+            }
+        }
+        for (i = 0; i < w->num_args; i++) {
+            lib.fastrpc_munmap(CDSP_DOMAIN_ID,
+                               lib.rpcmem_to_fd(w->args[i].buf.pv),
+                               w->args[i].buf.pv, sizes[s]);
+            lib.rpcmem_free(w->args[i].buf.pv);
+            w->args[i].buf.pv = NULL;
+        }
+        w->num_args = 0;
+    }
+    if (h)
+        reverse_close(h);
+    free_workers(workers);
+    return nErr;
+}
+
+/* Reverse invokes that block, which only overlap with several listeners */
+static int bench_reverse_blocking(void) {
+    return run_reverse_invoke("reverse_blocking", REVERSE_BLOCKING_MODULE,
+                              reverse_blocking_skel_invoke);
+}
+
+static int op_reverse_dispatch(struct worker *w) {
+    return lib.mod_table_invoke(w->reverse_handle, w->reverse_sc, NULL);
+}
+
+/*
+ * Dispatch of reverse invokes by the module table alone, as done by each
+ * listener thread, on an open module and on a const handle
+ */
+static int bench_reverse_dispatch(void) {
+    struct worker *workers = NULL;
+    remote_handle h = 0;
+    char dlerr[REMOTECTL_ERR_LEN] = {0};
+    int i, dlErr = 0, nErr = 0;
+
+    if (!lib.mod_table_open || !lib.mod_table_invoke || !lib.mod_table_close ||
+        !lib.mod_table_register_static ||
+        !lib.mod_table_register_const_handle) {
+        printf("skipped, mod_table not exported\n");
+        return 0;
+    }
+    workers = calloc(max_threads, sizeof(*workers));
+    if (!workers)
+        return -ENOMEM;
+    nErr = lib.mod_table_register_static(REVERSE_DISPATCH_MODULE,
+                                         reverse_skel_invoke);
+    if (!nErr)
+        nErr = lib.mod_table_open(REVERSE_DISPATCH_MODULE, &h, dlerr,
+                                  sizeof(dlerr), &dlErr);
+    if (!nErr && dlErr)
+        nErr = dlErr;
+    if (nErr) {
+        fprintf(stderr, "Error 0x%x: unable to open %s: %s\n", nErr,
+                REVERSE_DISPATCH_MODULE, dlerr);
+        h = 0;
+    }
+    for (i = 0; i < max_threads && !nErr; i++) {
+        workers[i].reverse_handle = h;
+        workers[i].reverse_sc = REMOTE_SCALARS_MAKEX(0, BENCH_METHOD, 0, 0, 0,
+                                                     0);
+    }
+    if (!nErr)
+        nErr = sweep_threads("reverse_dispatch open", workers,
+                             op_reverse_dispatch);
+    if (h)
+        lib.mod_table_close(h, dlerr, sizeof(dlerr), &dlErr);
+    // Registered once per process, a later run reuses it
+    if (!nErr) {
+        lib.mod_table_register_const_handle(REVERSE_DISPATCH_CONST_HANDLE,
+                                            REVERSE_DISPATCH_MODULE,
+                                            reverse_skel_invoke);
+        for (i = 0; i < max_threads; i++)
+            workers[i].reverse_handle = REVERSE_DISPATCH_CONST_HANDLE;
+        nErr = sweep_threads("reverse_dispatch const", workers,
+                             op_reverse_dispatch);
+    }
+    free(workers);
+    return nErr;
+}
+
+/*
+ * Open and close of the bench module while another handle keeps the session
+ * up. A closed handle's slot must be reused: the slot index, in the low bits
+ * of the local handle, must not change from one open to the next.
+ */
+static int op_handle_churn(struct worker *w) {
+    remote_handle64 h = 0;
+    int nErr;
+
+    nErr = lib.remote_handle64_open(uri, &h);
+    if (nErr)
+        return nErr;
+    if (!w->sum)
+        w->sum = (uint32_t)h;
+    else if (w->sum != (uint32_t)h)
+        nErr = -EMFILE;
+    if (nErr)
+        fprintf(stderr, "handle_churn: slot 0x%x not reused, got 0x%x\n",
+                w->sum, (uint32_t)h);
+    lib.remote_handle64_close(h);
+    return nErr;
+}
+
+static int bench_handle_churn(void) {
+    struct worker *workers = alloc_workers();
+    int nErr;
+
+    if (!workers)
+        return -ENODEV;
+    workers[0].op = op_handle_churn;
+    nErr = run_workers("handle_churn open/close", workers, 1);
+    free_workers(workers);
+    return nErr;
+}
+
+static int session_prewarm(uint32_t op, bool with_module, int *status) {
+    struct remote_rpc_session_prewarm pw = {
+        .domain = CDSP_DOMAIN_ID,
+        .op = op,
+        .skel_uris = &uri,
+        .num_skel_uris = with_module ? 1 : 0,
+        .timeout_us = FASTRPC_PREWARM_WAIT_FOREVER,
+    };
+    int nErr = lib.remote_session_control(FASTRPC_SESSION_PREWARM, &pw,
+                                          sizeof(pw));
+
+    if (status)
+        *status = pw.status;
+    return nErr;
+}
+
+/*
+ * First open of the bench module on a new session: cold, once a prewarm is
+ * done, right after starting a prewarm, joining it, and once a prewarm that
+ * also opened the module is done. Closing the module ends the session, even
+ * with the module held by the prewarm: checked with a poll, or once the
+ * prewarm has reported when joining it.
+ */
+static int bench_session_open(void) {
+    static const char *modes[] = {"open cold", "open prewarmed",
+                                  "open joining prewarm",
+                                  "open prewarmed with module"};
+    int n = iterations < SESSION_ITERATIONS ? iterations : SESSION_ITERATIONS;
+    uint64_t *samples = calloc(n, sizeof(*samples));
+    int m, i, status, nErr = 0;
+
+    if (!samples)
+        return -ENOMEM;
+    for (m = 0; m < (int)(sizeof(modes) / sizeof(modes[0])) && !nErr; m++) {
+        for (i = 0; i < n && !nErr; i++) {
+            remote_handle64 h = 0;
+            uint64_t start;
+
+            if (m > 0)
+                nErr = session_prewarm(FASTRPC_PREWARM_START, m == 3, NULL);
+            if (!nErr && (m == 1 || m == 3)) {
+                nErr = session_prewarm(FASTRPC_PREWARM_WAIT, false, &status);
+                if (!nErr && status)
+                    nErr = status;
+            }
+            if (nErr) {
+                fprintf(stderr, "Error 0x%x: session prewarm failed\n", nErr);
+                break;
+            }
+            start = now_ns();
+            nErr = lib.remote_handle64_open(uri, &h);
+            samples[i] = now_ns() - start;
+            if (nErr) {
+                fprintf(stderr, "Error 0x%x: unable to open %s\n", nErr, uri);
+                break;
+            }
+            lib.remote_handle64_close(h);
+            // A bring-up the open joined may not have reported yet
+            nErr = session_prewarm(m == 2 ? FASTRPC_PREWARM_WAIT
+                                          : FASTRPC_PREWARM_POLL,
+                                   false, &status);
+            if (!nErr && status != AEE_ENOTINITIALIZED) {
+                fprintf(stderr, "Error 0x%x: session still open after close\n",
+                        status);
+                nErr = -EBUSY;
+            }
+        }
+        if (!nErr)
+            report(modes[m], samples, n, 0);
+    }
+    free(samples);
+    return nErr;
+}
+
+/* Reads the whole shell file from its start into buf */
+static int shell_cache_read(apps_std_FILE fh, unsigned char *buf) {
+    int nErr, readlen = 0, eof = 0;
+
+    nErr = lib.apps_std_fseek(fh, 0, APPS_STD_SEEK_SET);
+    if (!nErr)
+        nErr = lib.apps_std_fread(fh, buf, SHELL_CACHE_IMAGE_SIZE, &readlen,
+                                  &eof);
+    if (!nErr && readlen != SHELL_CACHE_IMAGE_SIZE)
+        nErr = -EIO;
+    return nErr;
+}
+
+/* Times n lookups of the shell, each of which must hit and match buf */
+static int shell_cache_hits(apps_std_FILE fh, const unsigned char *buf,
+                            uint64_t *samples, int n) {
+    struct fastrpc_shell_image img;
+    int i, nErr = 0;
+
+    for (i = 0; i < n && !nErr; i++) {
+        uint64_t start = now_ns();
+
+        nErr = lib.fastrpc_shell_cache_lookup(fh, -1, &img);
+        samples[i] = now_ns() - start;
+        if (nErr) {
+            fprintf(stderr, "Error 0x%x: shell_cache: cached shell missed\n",
+                    nErr);
+            break;
+        }
+        if (img.shell_len != SHELL_CACHE_IMAGE_SIZE || img.sig_len ||
+            memcmp(img.data, buf, SHELL_CACHE_IMAGE_SIZE)) {
+            fprintf(stderr, "shell_cache: hit does not match the shell\n");
+            nErr = -EFAULT;
+        }
+        lib.fastrpc_shell_cache_release(&img);
+    }
+    return nErr;
+}
+
+/* Removes the shell cache directory of the run and its entries */
+static void shell_cache_remove_dir(const char *dir) {
+    char path[PATH_MAX];
+    struct dirent *de;
+    DIR *d = opendir(dir);
+
+    if (!d)
+        return;
+    while ((de = readdir(d))) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+/*
+ * Lookup of a 1 MB PD shell in the shell cache, against reading the file.
+ * The first lookup misses and the image is stored, after which lookups hit.
+ * The shell is then rewritten with the same size: the next lookup must miss,
+ * and hit again once the new image is stored. Fails if the cache counters of
+ * the process do not add up.
+ */
+static int bench_shell_cache(void) {
+    char shell[] = "/tmp/fastrpc_bench_shell.XXXXXX";
+    int n = iterations < SHELL_CACHE_ITERATIONS ? iterations
+                                                : SHELL_CACHE_ITERATIONS;
+    struct fastrpc_shell_cache_stats before, after;
+    struct fastrpc_shell_image img;
+    unsigned char *buf = NULL;
+    uint64_t *samples = NULL;
+    apps_std_FILE fh = -1;
+    struct stat st;
+    struct timespec times[2];
+    int i, fd = -1, nErr = 0;
+
+    if (!lib.fastrpc_shell_cache_lookup || !lib.fastrpc_shell_cache_store ||
+        !lib.fastrpc_shell_cache_release ||
+        !lib.fastrpc_shell_cache_get_stats || !lib.apps_std_fopen ||
+        !lib.apps_std_fclose || !lib.apps_std_fread || !lib.apps_std_fseek) {
+        printf("skipped, shell cache not supported\n");
+        return 0;
+    }
+    if (lib.fastrpc_shell_cache_get_stats(&before, NULL)) {
+        printf("skipped, shell cache off\n");
+        return 0;
+    }
+    buf = malloc(SHELL_CACHE_IMAGE_SIZE);
+    samples = calloc(n, sizeof(*samples));
+    fd = mkstemp(shell);
+    if (!buf || !samples || fd < 0) {
+        nErr = -ENOMEM;
+        goto bail;
+    }
+    for (i = 0; i < SHELL_CACHE_IMAGE_SIZE; i++)
+        buf[i] = (unsigned char)i;
+    if (write(fd, buf, SHELL_CACHE_IMAGE_SIZE) != SHELL_CACHE_IMAGE_SIZE) {
+        nErr = -EIO;
+        goto bail;
+    }
+    nErr = lib.apps_std_fopen(shell, "r", &fh);
+    if (nErr) {
+        fprintf(stderr, "Error 0x%x: unable to open %s\n", nErr, shell);
+        goto bail;
+    }
+
+    if (!lib.fastrpc_shell_cache_lookup(fh, -1, &img)) {
+        lib.fastrpc_shell_cache_release(&img);
+        fprintf(stderr, "shell_cache: new shell hit\n");
+        nErr = -EFAULT;
+        goto bail;
+    }
+    lib.fastrpc_shell_cache_store(fh, -1, buf, SHELL_CACHE_IMAGE_SIZE, 0);
+    nErr = shell_cache_hits(fh, buf, samples, n);
+    if (nErr)
+        goto bail;
+    report("shell_cache hit", samples, n, 0);
+    for (i = 0; i < n && !nErr; i++) {
+        uint64_t start = now_ns();
+
+        nErr = shell_cache_read(fh, buf);
+        samples[i] = now_ns() - start;
+    }
+    if (nErr) {
+        fprintf(stderr, "Error 0x%x: unable to read %s\n", nErr, shell);
+        goto bail;
+    }
+    report("shell_cache read", samples, n, 0);
+
+    // Same size and a later modification time, like an updated shell
+    buf[0] ^= 0xff;
+    if (pwrite(fd, buf, 1, 0) != 1 || fstat(fd, &st)) {
+        nErr = -EIO;
+        goto bail;
+    }
+    times[0] = st.st_atim;
+    times[1] = st.st_mtim;
+    times[1].tv_sec++;
+    if (futimens(fd, times)) {
+        nErr = -errno;
+        goto bail;
+    }
+    if (!lib.fastrpc_shell_cache_lookup(fh, -1, &img)) {
+        lib.fastrpc_shell_cache_release(&img);
+        fprintf(stderr, "shell_cache: updated shell hit\n");
+        nErr = -EFAULT;
+        goto bail;
+    }
+    lib.fastrpc_shell_cache_store(fh, -1, buf, SHELL_CACHE_IMAGE_SIZE, 0);
+    nErr = shell_cache_hits(fh, buf, samples, 1);
+    if (nErr)
+        goto bail;
+
+    lib.fastrpc_shell_cache_get_stats(&after, NULL);
+    after.hits -= before.hits;
+    after.misses -= before.misses;
+    after.stores -= before.stores;
+    after.errors -= before.errors;
+    printf("%-32s hits=%" PRIu64 " misses=%" PRIu64 " stores=%" PRIu64
+           " errors=%" PRIu64 "\n",
+           "shell_cache", after.hits, after.misses, after.stores,
+           after.errors);
+    if (after.hits != (uint64_t)n + 1 || after.misses != 2 ||
+        after.stores != 2 || after.errors) {
+        fprintf(stderr, "shell_cache: expected hits=%d misses=2 stores=2 "
+                        "errors=0\n",
+                n + 1);
+        nErr = -EFAULT;
+    }
+bail:
+    if (fh != -1)
+        lib.apps_std_fclose(fh);
+    if (fd >= 0) {
+        close(fd);
+        unlink(shell);
+    }
+    free(samples);
+    free(buf);
+    return nErr;
+}
+
+static const struct bench benches[] = {
+    {"rpcmem_lookup", "rpcmem_to_fd/rpcmem_free cost vs live buffers",
+     bench_rpcmem_lookup},
+    {"null_invoke", "invoke without arguments vs threads", bench_null_invoke},
+    {"buffer_invoke", "invoke with N registered buffers vs threads",
+     bench_buffer_invoke},
+    {"register_churn", "buffer allocation and mapping churn vs threads",
+     bench_register_churn},
+    {"queue_roundtrip", "dspqueue write and read of the response vs threads",
+     bench_queue_roundtrip},
+    {"queue_poll", "queue_roundtrip with polling reads vs threads",
+     bench_queue_poll},
+    {"queue_batch", "16 queue packets written one by one vs in a batch",
+     bench_queue_batch},
+    {"queue_inplace", "4 KB queue messages copied vs built and read in place",
+     bench_queue_inplace},
+    {"queue_broadcast", "16 queue packets broadcast to 2 to 4 domains",
+     bench_queue_broadcast},
+    {"queue_idle", "queue_roundtrip with 0 to 62 other queues open",
+     bench_queue_idle},
+    {"queue_epoll", "1 to 16 queues served by a thread each vs one epoll thread",
+     bench_queue_epoll},
+    {"reverse_invoke", "reverse invoke served by the listener vs threads",
+     bench_reverse_invoke},
+    {"reverse_blocking", "reverse invoke blocking for 1 ms vs threads",
+     bench_reverse_blocking},
+    {"reverse_sizes", "reverse invoke alternating 1 KB and 256 KB vs threads",
+     bench_reverse_sizes},
+    {"reverse_payload", "reverse invoke payload copied vs passed by reference",
+     bench_reverse_payload},
+    {"reverse_dispatch", "module table dispatch of reverse invokes vs threads",
+     bench_reverse_dispatch},
+    {"handle_churn", "open and close of a handle, checking its slot is reused",
+     bench_handle_churn},
+    {"session_open", "first open on a new session, cold and prewarmed",
+     bench_session_open},
+    {"shell_cache", "PD shell lookup in the shell cache vs reading the file",
+     bench_shell_cache},
+};
+
+#define NUM_BENCHES (int)(sizeof(benches) / sizeof(benches[0]))
+
+static void print_usage() {
+    int i;
+
+    printf("Usage:\n"
+           "    fastrpc_bench [-l library] [-d backend] [-b benchmark] [-i iterations]\n"
+           "                  [-n max_buffers] [-t max_threads] [-u uri]\n\n"
+           "Options:\n"
+           "-l library: FastRPC library to benchmark.\n"
+           "    Default Value: " DEFAULT_LIBRARY "\n"
+           "-d backend: mock for the userspace mock driver of the library,\n"
+           "    device for the FastRPC driver.\n"
+           "    Default Value: " DEFAULT_BACKEND "\n"
+           "-b benchmark: Run only the named benchmark.\n"
+           "-i iterations: Number of timed operations per measurement and thread.\n"
+           "    Default Value: %d\n"
+           "-n max_buffers: Largest number of live buffers.\n"
+           "    Default Value: %d\n"
+           "-t max_threads: Largest number of threads.\n"
+           "    Default Value: %d\n"
+           "-u uri: CDSP module invoked by the invoke benchmarks.\n"
+           "    Default Value: " DEFAULT_URI "\n\n"
+           "Benchmarks:\n", DEFAULT_ITERATIONS, DEFAULT_MAX_BUFFERS,
+           DEFAULT_MAX_THREADS);
+    for (i = 0; i < NUM_BENCHES; i++)
+        printf("    %-20s %s\n", benches[i].name, benches[i].desc);
+}
+
+int main(int argc, char *argv[]) {
+    const char *library = DEFAULT_LIBRARY;
+    const char *backend = DEFAULT_BACKEND;
+    const char *only = NULL;
+    void *lib_handle = NULL;
+    struct rlimit rl;
+    int opt, i, nErr = 0, ran = 0;
+
+    while ((opt = getopt(argc, argv, "l:d:b:i:n:t:u:")) != -1) {
+        switch (opt) {
+            case 'l':
+                library = optarg;
+                break;
+            case 'd':
+                backend = optarg;
+                break;
+            case 'b':
+                only = optarg;
+                break;
+            case 'i':
+                iterations = atoi(optarg);
+                break;
+            case 'n':
+                max_buffers = atoi(optarg);
+                break;
+            case 't':
+                max_threads = atoi(optarg);
+                break;
+            case 'u':
+                uri = optarg;
+                break;
+            default:
+                print_usage();
+                return -1;
+        }
+    }
+    if (iterations <= 0 || max_buffers <= 0 || max_threads <= 0) {
+        print_usage();
+        return -1;
+    }
+    if (!strcmp(backend, "mock")) {
+        // Read by the library when it is loaded, so it never opens a device
+        setenv(FASTRPC_MOCK_DRIVER_ENV, "1", 1);
+        mock_backend = true;
+    } else if (strcmp(backend, "device")) {
+        print_usage();
+        return -1;
+    }
+
+    // Every live buffer holds a file descriptor
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    lib_handle = dlopen(library, RTLD_LAZY);
+    if (!lib_handle) {
+        fprintf(stderr, "Error loading %s: %s\n", library, dlerror());
+        return -1;
+    }
+    if (!LOAD_SYMBOL(lib_handle, rpcmem_alloc) ||
+        !LOAD_SYMBOL(lib_handle, rpcmem_free) ||
+        !LOAD_SYMBOL(lib_handle, rpcmem_to_fd) ||
+        !LOAD_SYMBOL(lib_handle, remote_handle64_open) ||
+        !LOAD_SYMBOL(lib_handle, remote_handle64_close) ||
+        !LOAD_SYMBOL(lib_handle, remote_handle64_invoke) ||
+        !LOAD_SYMBOL(lib_handle, fastrpc_mmap) ||
+        !LOAD_SYMBOL(lib_handle, fastrpc_munmap) ||
+        !LOAD_SYMBOL(lib_handle, dspqueue_create) ||
+        !LOAD_SYMBOL(lib_handle, dspqueue_close) ||
+        !LOAD_SYMBOL(lib_handle, dspqueue_write) ||
+        !LOAD_SYMBOL(lib_handle, dspqueue_read) ||
+        !LOAD_SYMBOL(lib_handle, remote_session_control)) {
+        fprintf(stderr, "Symbols not found in %s\n", library);
+        dlclose(lib_handle);
+        return -1;
+    }
+    if (mock_backend) {
+        struct remote_rpc_mock_driver mock = {.enable = 1};
+        int err = lib.remote_session_control(FASTRPC_MOCK_DRIVER, &mock,
+                                             sizeof(mock));
+
+        if (err) {
+            fprintf(stderr,
+                    "Error 0x%x: %s has no mock driver, configure it with "
+                    "--enable-mock-driver or run with -d device\n",
+                    err, library);
+            dlclose(lib_handle);
+            return -1;
+        }
+    }
+    LOAD_SYMBOL(lib_handle, fastrpc_mock_reverse_invoke);
+    LOAD_SYMBOL(lib_handle, mod_table_register_static);
+    LOAD_SYMBOL(lib_handle, listener_android_get_stats);
+    LOAD_SYMBOL(lib_handle, fastrpc_get_invoke_alloc_stats);
+    LOAD_SYMBOL(lib_handle, dspqueue_write_batch);
+    LOAD_SYMBOL(lib_handle, dspqueue_write_reserve);
+    LOAD_SYMBOL(lib_handle, dspqueue_write_commit);
+    LOAD_SYMBOL(lib_handle, dspqueue_read_acquire);
+    LOAD_SYMBOL(lib_handle, dspqueue_read_release);
+    LOAD_SYMBOL(lib_handle, dspqueue_read_noblock);
+    LOAD_SYMBOL(lib_handle, dspqueue_request);
+    LOAD_SYMBOL(lib_handle, dspqueue_get_eventfd);
+    LOAD_SYMBOL(lib_handle, mod_table_open);
+    LOAD_SYMBOL(lib_handle, mod_table_invoke);
+    LOAD_SYMBOL(lib_handle, mod_table_close);
+    LOAD_SYMBOL(lib_handle, mod_table_register_const_handle);
+    LOAD_SYMBOL(lib_handle, fastrpc_shell_cache_lookup);
+    LOAD_SYMBOL(lib_handle, fastrpc_shell_cache_store);
+    LOAD_SYMBOL(lib_handle, fastrpc_shell_cache_release);
+    LOAD_SYMBOL(lib_handle, fastrpc_shell_cache_get_stats);
+    LOAD_SYMBOL(lib_handle, apps_std_fopen);
+    LOAD_SYMBOL(lib_handle, apps_std_fclose);
+    LOAD_SYMBOL(lib_handle, apps_std_fread);
+    LOAD_SYMBOL(lib_handle, apps_std_fseek);
+    // Read by the library on the first use of the shell cache
+    if (!getenv("FASTRPC_SHELL_CACHE_DIR") && mkdtemp(shell_cache_dir)) {
+        setenv("FASTRPC_SHELL_CACHE_DIR", shell_cache_dir, 1);
+        own_shell_cache_dir = true;
+    }
+
+    for (i = 0; i < NUM_BENCHES; i++) {
+        int err;
+
+        if (only && strcmp(only, benches[i].name))
+            continue;
+        printf("== %s: %s\n", benches[i].name, benches[i].desc);
+        err = benches[i].run();
+        if (err) {
+            printf("Benchmark %s failed with error %d\n", benches[i].name, err);
+            nErr = err;
+        }
+        ran++;
+    }
+    if (!ran) {
+        fprintf(stderr, "Unknown benchmark %s\n", only);
+        nErr = -1;
+    }
+
+    dlclose(lib_handle);
+    if (own_shell_cache_dir)
+        shell_cache_remove_dir(shell_cache_dir);
+    return nErr;
+}